@@ -0,0 +1,37 @@
+/*
+ * Maps the MPLAB C18 extensions used by robot code onto standard C, so it can
+ * be compiled by the host compiler. vexbuild --host includes this file before
+ * every source file.
+ *
+ * Inline assembly (_asm ... _endasm) and short long have no host equivalent,
+ * code that uses them has to be left out with #ifndef VEX_HOST.
+ */
+#ifndef C18COMPAT_H_
+#define C18COMPAT_H_
+
+#define VEX_HOST 1
+
+/* The host has a single address space */
+#define rom
+#define ram
+#define near
+#define far
+#define overlay
+
+/* Program memory versions of the string functions */
+#define strcpypgm2ram strcpy
+#define strcatpgm2ram strcat
+#define strcmppgm2ram strcmp
+#define strncpypgm2ram strncpy
+#define strlenpgm strlen
+#define memcpypgm2ram memcpy
+#define memcmppgm2ram memcmp
+#define sprintf_rom sprintf
+
+/* C18 stdlib.h conversions, which the host C library does not have */
+char *btoa(signed char value, char *string);
+char *itoa(int value, char *string);
+char *ltoa(long value, char *string);
+char *ultoa(unsigned long value, char *string);
+
+#endif /* C18COMPAT_H_ */
@@ -0,0 +1,944 @@
+/*
+ * Host model of the controller, implementing Api.h for vexbuild --host.
+ *
+ * Inputs are whatever the test last set, outputs are recorded for the test
+ * to read back. Sensors that need hardware to mean anything (camera, graphic
+ * display, accelerometer) return zeros.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vexhost.h"
+
+typedef struct {
+    void (*handler)(void);
+    unsigned long periodUs;
+    unsigned long long dueUs;
+} ScheduledTimer;
+
+typedef struct {
+    unsigned char data[VEXHOST_SERIAL_BUFFER];
+    unsigned head;
+    unsigned count;
+} SerialBuffer;
+
+static unsigned long long nowUs;
+static unsigned long callTimeUs;
+static unsigned long long runTimeUs;
+
+static unsigned char autonomousMode;
+static unsigned char enabled;
+
+static unsigned char digitalInputs[VEXHOST_DIGITAL_PORTS + 1];
+static unsigned char digitalOutputs[VEXHOST_DIGITAL_PORTS + 1];
+static unsigned char directions[VEXHOST_DIGITAL_PORTS + 1];
+static unsigned int analogInputs[VEXHOST_ANALOG_PORTS + 1];
+static unsigned char pwms[VEXHOST_PWM_PORTS + 1];
+
+static unsigned char oiAnalog[VEXHOST_OI_PORTS + 1][VEXHOST_OI_CHANNELS + 1];
+static unsigned char oiDigital[VEXHOST_OI_PORTS + 1][VEXHOST_OI_CHANNELS + 1];
+
+static unsigned char interruptLevels[VEXHOST_INTERRUPT_PORTS + 1];
+static unsigned char interruptEdges[VEXHOST_INTERRUPT_PORTS + 1];
+static void (*interruptHandlers[VEXHOST_INTERRUPT_PORTS + 1])(unsigned char port, unsigned char value);
+static unsigned char interruptWatchers[VEXHOST_INTERRUPT_PORTS + 1];
+
+static long encoders[VEXHOST_DIGITAL_PORTS + 1];
+static long quadEncoders[VEXHOST_DIGITAL_PORTS + 1];
+static long gearTooth[VEXHOST_DIGITAL_PORTS + 1];
+static int gyroAngles[VEXHOST_ANALOG_PORTS + 1];
+static unsigned int ultrasonics[VEXHOST_DIGITAL_PORTS + 1];
+static unsigned compassHeading;
+
+static unsigned char timerRunning[VEXHOST_TIMERS + 1];
+static unsigned long long timerStartUs[VEXHOST_TIMERS + 1];
+static unsigned long timerValues[VEXHOST_TIMERS + 1];
+static ScheduledTimer scheduledTimers[VEXHOST_TIMERS];
+
+static SerialBuffer serialInputs[3];
+static SerialBuffer serialOutputs[3];
+
+static char lcdText[2][17];
+
+static unsigned char validPort(unsigned char port, unsigned char count) {
+    return port >= 1 && port <= count;
+}
+
+static void spendCallTime(void) {
+    if (callTimeUs != 0) {
+        VexHost_Advance(callTimeUs);
+    }
+}
+
+void VexHost_Reset(void) {
+    unsigned char port;
+    unsigned char channel;
+
+    nowUs = 0;
+    callTimeUs = 0;
+    runTimeUs = 0;
+    autonomousMode = 0;
+    enabled = 1;
+
+    memset(digitalInputs, 1, sizeof(digitalInputs));
+    memset(digitalOutputs, 0, sizeof(digitalOutputs));
+    memset(directions, INPUT, sizeof(directions));
+    memset(analogInputs, 0, sizeof(analogInputs));
+    memset(pwms, 127, sizeof(pwms));
+    for (port = 0; port <= VEXHOST_OI_PORTS; port++) {
+        for (channel = 0; channel <= VEXHOST_OI_CHANNELS; channel++) {
+            oiAnalog[port][channel] = 127;
+            oiDigital[port][channel] = 0;
+        }
+    }
+
+    memset(interruptLevels, 0, sizeof(interruptLevels));
+    memset(interruptEdges, 0, sizeof(interruptEdges));
+    memset(interruptHandlers, 0, sizeof(interruptHandlers));
+    memset(interruptWatchers, 0, sizeof(interruptWatchers));
+
+    memset(encoders, 0, sizeof(encoders));
+    memset(quadEncoders, 0, sizeof(quadEncoders));
+    memset(gearTooth, 0, sizeof(gearTooth));
+    memset(gyroAngles, 0, sizeof(gyroAngles));
+    memset(ultrasonics, 0, sizeof(ultrasonics));
+    compassHeading = 0;
+
+    memset(timerRunning, 0, sizeof(timerRunning));
+    memset(timerStartUs, 0, sizeof(timerStartUs));
+    memset(timerValues, 0, sizeof(timerValues));
+    memset(scheduledTimers, 0, sizeof(scheduledTimers));
+
+    memset(serialInputs, 0, sizeof(serialInputs));
+    memset(serialOutputs, 0, sizeof(serialOutputs));
+    memset(lcdText, 0, sizeof(lcdText));
+}
+
+void VexHost_Advance(unsigned long us) {
+    unsigned long long endUs = nowUs + us;
+
+    for (;;) {
+        ScheduledTimer *next = NULL;
+        int i;
+
+        for (i = 0; i < VEXHOST_TIMERS; i++) {
+            ScheduledTimer *timer = &scheduledTimers[i];
+            if (timer->handler != NULL && timer->dueUs <= endUs && (next == NULL || timer->dueUs < next->dueUs)) {
+                next = timer;
+            }
+        }
+        if (next == NULL) {
+            break;
+        }
+
+        nowUs = next->dueUs;
+        {
+            void (*handler)(void) = next->handler;
+            if (next->periodUs != 0) {
+                next->dueUs += next->periodUs;
+            } else {
+                next->handler = NULL;
+            }
+            handler();
+        }
+    }
+    nowUs = endUs;
+
+    if (runTimeUs != 0 && nowUs >= runTimeUs) {
+        exit(0);
+    }
+}
+
+unsigned long long VexHost_GetTime(void) {
+    return nowUs;
+}
+
+void VexHost_SetCallTime(unsigned long us) {
+    callTimeUs = us;
+}
+
+void VexHost_SetRunTime(unsigned long ms) {
+    runTimeUs = (unsigned long long) ms * 1000;
+}
+
+void VexHost_SetMode(unsigned char autonomous, unsigned char enable) {
+    autonomousMode = autonomous;
+    enabled = enable;
+}
+
+void VexHost_SetDigitalInput(unsigned char port, unsigned char value) {
+    if (validPort(port, VEXHOST_DIGITAL_PORTS)) {
+        digitalInputs[port] = value != 0;
+    }
+}
+
+unsigned char VexHost_GetDigitalOutput(unsigned char port) {
+    return validPort(port, VEXHOST_DIGITAL_PORTS) ? digitalOutputs[port] : 0;
+}
+
+void VexHost_SetAnalogInput(unsigned char port, unsigned int value) {
+    if (validPort(port, VEXHOST_ANALOG_PORTS)) {
+        analogInputs[port] = value & 0x3ff;
+    }
+}
+
+unsigned char VexHost_GetPWM(unsigned char port) {
+    return validPort(port, VEXHOST_PWM_PORTS) ? pwms[port] : 127;
+}
+
+void VexHost_SetOIAInput(unsigned char port, unsigned char channel, unsigned char value) {
+    if (validPort(port, VEXHOST_OI_PORTS) && validPort(channel, VEXHOST_OI_CHANNELS)) {
+        oiAnalog[port][channel] = value;
+    }
+}
+
+void VexHost_SetOIDInput(unsigned char port, unsigned char channel, unsigned char value) {
+    if (validPort(port, VEXHOST_OI_PORTS) && validPort(channel, VEXHOST_OI_CHANNELS)) {
+        oiDigital[port][channel] = value != 0;
+    }
+}
+
+void VexHost_SetInterruptInput(unsigned char port, unsigned char value) {
+    unsigned char old;
+
+    if (!validPort(port, VEXHOST_INTERRUPT_PORTS)) {
+        return;
+    }
+    value = value != 0;
+    old = interruptLevels[port];
+    interruptLevels[port] = value;
+    if (old == value || value != interruptEdges[port]) {
+        return;
+    }
+
+    interruptWatchers[port] = 1;
+    if (interruptHandlers[port] != NULL) {
+        interruptHandlers[port](port, value);
+    }
+}
+
+void VexHost_AddEncoderCounts(unsigned char channel, long counts) {
+    if (validPort(channel, VEXHOST_DIGITAL_PORTS)) {
+        encoders[channel] += counts;
+        gearTooth[channel] += counts;
+    }
+}
+
+void VexHost_AddQuadEncoderCounts(unsigned char channelA, long counts) {
+    if (validPort(channelA, VEXHOST_DIGITAL_PORTS)) {
+        quadEncoders[channelA] += counts;
+    }
+}
+
+void VexHost_SetGyroAngle(unsigned char port, int angle) {
+    if (validPort(port, VEXHOST_ANALOG_PORTS)) {
+        gyroAngles[port] = angle;
+    }
+}
+
+void VexHost_SetUltrasonic(unsigned char echo, unsigned int distance) {
+    if (validPort(echo, VEXHOST_DIGITAL_PORTS)) {
+        ultrasonics[echo] = distance;
+    }
+}
+
+void VexHost_SetCompassHeading(unsigned heading) {
+    compassHeading = heading;
+}
+
+static void serialPut(SerialBuffer *buffer, unsigned char value) {
+    if (buffer->count < VEXHOST_SERIAL_BUFFER) {
+        buffer->data[(buffer->head + buffer->count) % VEXHOST_SERIAL_BUFFER] = value;
+        buffer->count++;
+    }
+}
+
+static unsigned char serialGet(SerialBuffer *buffer) {
+    unsigned char value;
+
+    if (buffer->count == 0) {
+        return 0;
+    }
+    value = buffer->data[buffer->head];
+    buffer->head = (buffer->head + 1) % VEXHOST_SERIAL_BUFFER;
+    buffer->count--;
+    return value;
+}
+
+void VexHost_SerialInput(unsigned char port, const unsigned char *data, unsigned length) {
+    unsigned i;
+
+    if (validPort(port, 2)) {
+        for (i = 0; i < length; i++) {
+            serialPut(&serialInputs[port], data[i]);
+        }
+    }
+}
+
+unsigned VexHost_SerialOutput(unsigned char port, unsigned char *data, unsigned length) {
+    unsigned count = 0;
+
+    if (validPort(port, 2)) {
+        while (count < length && serialOutputs[port].count != 0) {
+            data[count++] = serialGet(&serialOutputs[port]);
+        }
+    }
+    return count;
+}
+
+const char *VexHost_GetLCDText(unsigned char line) {
+    return validPort(line, 2) ? lcdText[line - 1] : "";
+}
+
+/* C18 stdlib.h conversions */
+
+char *ltoa(long value, char *string) {
+    sprintf(string, "%ld", value);
+    return string;
+}
+
+char *ultoa(unsigned long value, char *string) {
+    sprintf(string, "%lu", value);
+    return string;
+}
+
+char *itoa(int value, char *string) {
+    return ltoa(value, string);
+}
+
+char *btoa(signed char value, char *string) {
+    return ltoa(value, string);
+}
+
+/* Digital and analog I/O */
+
+void SetDigitalOutput(unsigned char port, unsigned char value) {
+    if (validPort(port, VEXHOST_DIGITAL_PORTS)) {
+        digitalOutputs[port] = value != 0;
+    }
+}
+
+unsigned char GetDigitalInput(unsigned char port) {
+    spendCallTime();
+    if (!validPort(port, VEXHOST_DIGITAL_PORTS)) {
+        return 0;
+    }
+    return directions[port] == OUTPUT ? digitalOutputs[port] : digitalInputs[port];
+}
+
+void SetDirection(unsigned char port, unsigned char direction) {
+    if (validPort(port, VEXHOST_DIGITAL_PORTS)) {
+        directions[port] = direction;
+    }
+}
+
+void DefineControllerIO(unsigned char numberOfAnalogChannels,
+                        unsigned char p1, unsigned char p2, unsigned char p3, unsigned char p4,
+                        unsigned char p5, unsigned char p6, unsigned char p7, unsigned char p8,
+                        unsigned char p9, unsigned char p10, unsigned char p11, unsigned char p12,
+                        unsigned char p13, unsigned char p14, unsigned char p15, unsigned char p16) {
+    unsigned char ports[VEXHOST_DIGITAL_PORTS] = {
+        p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15, p16
+    };
+    unsigned char i;
+
+    (void) numberOfAnalogChannels;
+    for (i = 0; i < VEXHOST_DIGITAL_PORTS; i++) {
+        directions[i + 1] = ports[i];
+    }
+}
+
+void SetupWhoControlsPwms(int pwmSpec1, int pwmSpec2, int pwmSpec3, int pwmSpec4) {
+    (void) pwmSpec1;
+    (void) pwmSpec2;
+    (void) pwmSpec3;
+    (void) pwmSpec4;
+}
+
+void Set_Number_of_Analog_Channels(unsigned char numberOfChannels) {
+    (void) numberOfChannels;
+}
+
+unsigned int GetAnalogInput(unsigned char port) {
+    spendCallTime();
+    return validPort(port, VEXHOST_ANALOG_PORTS) ? analogInputs[port] : 0;
+}
+
+unsigned int Get_Analog_Value(unsigned char ADC_channel) {
+    /* ADC channels count from 0, ports from 1 */
+    return GetAnalogInput(ADC_channel + 1);
+}
+
+/* Motors */
+
+void SetPWM(unsigned char port, int speed) {
+    if (validPort(port, VEXHOST_PWM_PORTS)) {
+        if (speed < 0) {
+            speed = 0;
+        } else if (speed > 255) {
+            speed = 255;
+        }
+        pwms[port] = (unsigned char) speed;
+    }
+}
+
+unsigned char GetPWM(unsigned char port) {
+    return VexHost_GetPWM(port);
+}
+
+/* Output */
+
+void PrintToScreen(rom const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+void InitLCD(void) {
+}
+
+unsigned char SetLCDText(unsigned char nLine, rom const char *szMsg, ...) {
+    va_list args;
+
+    if (!validPort(nLine, 2)) {
+        return 0;
+    }
+    va_start(args, szMsg);
+    vsnprintf(lcdText[nLine - 1], sizeof(lcdText[0]), szMsg, args);
+    va_end(args);
+    return 1;
+}
+
+unsigned char SetLCDLight(unsigned char nLight) {
+    (void) nLight;
+    return 1;
+}
+
+void StartLCDButtonsWatcher(void) {
+}
+
+void StopLCDButtonsWatcher(void) {
+}
+
+void GetLCDButtonsWatcher(unsigned char *b1, unsigned char *b2, unsigned char *b3) {
+    *b1 = 0;
+    *b2 = 0;
+    *b3 = 0;
+}
+
+void SetGDWaitTime(unsigned time) {
+    (void) time;
+}
+
+void ResetGD(void) {
+}
+
+void ClearGD(unsigned char ucRow1, unsigned char ucCol1, unsigned char ucRow2, unsigned char ucCol2, unsigned char ucFrame) {
+    (void) ucRow1;
+    (void) ucCol1;
+    (void) ucRow2;
+    (void) ucCol2;
+    (void) ucFrame;
+}
+
+void PrintTextToGD(unsigned char ucRow, unsigned char ucCol, unsigned long ulColor, rom const char *szText, ...) {
+    va_list args;
+
+    (void) ucRow;
+    (void) ucCol;
+    (void) ulColor;
+    va_start(args, szText);
+    vprintf(szText, args);
+    va_end(args);
+}
+
+void PrintFrameToGD(unsigned char ucRow1, unsigned char ucCol1, unsigned char ucRow2, unsigned char ucCol2, unsigned long ulColor) {
+    (void) ucRow1;
+    (void) ucCol1;
+    (void) ucRow2;
+    (void) ucCol2;
+    (void) ulColor;
+}
+
+/* Competition */
+
+unsigned char IsAutonomous(void) {
+    spendCallTime();
+    return autonomousMode;
+}
+
+unsigned char IsEnabled(void) {
+    spendCallTime();
+    return enabled;
+}
+
+void SetCompetitionMode(unsigned char mode, unsigned char operatorTime) {
+    (void) mode;
+    (void) operatorTime;
+}
+
+/* Encoders and other counting sensors */
+
+void StartEncoder(unsigned char channel) {
+    (void) channel;
+}
+
+void StopEncoder(unsigned char channel) {
+    (void) channel;
+}
+
+long GetEncoder(unsigned char channel) {
+    spendCallTime();
+    return validPort(channel, VEXHOST_DIGITAL_PORTS) ? encoders[channel] : 0;
+}
+
+void PresetEncoder(unsigned char channel, long presetValue) {
+    if (validPort(channel, VEXHOST_DIGITAL_PORTS)) {
+        encoders[channel] = presetValue;
+    }
+}
+
+void StartQuadEncoder(unsigned char channelA, unsigned char channelB, unsigned char invert) {
+    (void) channelA;
+    (void) channelB;
+    (void) invert;
+}
+
+void StopQuadEncoder(unsigned char channelA, unsigned char channelB) {
+    (void) channelA;
+    (void) channelB;
+}
+
+long GetQuadEncoder(unsigned char channelA, unsigned char channelB) {
+    (void) channelB;
+    spendCallTime();
+    return validPort(channelA, VEXHOST_DIGITAL_PORTS) ? quadEncoders[channelA] : 0;
+}
+
+void PresetQuadEncoder(unsigned char channelA, unsigned char channelB, long presetValue) {
+    (void) channelB;
+    if (validPort(channelA, VEXHOST_DIGITAL_PORTS)) {
+        quadEncoders[channelA] = presetValue;
+    }
+}
+
+void StartGTSensor(unsigned char port, unsigned char invert) {
+    (void) port;
+    (void) invert;
+}
+
+void StopGTSensor(unsigned char port) {
+    (void) port;
+}
+
+long GetGTSensor(unsigned char port) {
+    spendCallTime();
+    return validPort(port, VEXHOST_DIGITAL_PORTS) ? gearTooth[port] : 0;
+}
+
+void PresetGTSensor(unsigned char port, long presetValue) {
+    if (validPort(port, VEXHOST_DIGITAL_PORTS)) {
+        gearTooth[port] = presetValue;
+    }
+}
+
+void StartInterruptWatcher(unsigned char port, unsigned char direction) {
+    if (validPort(port, VEXHOST_INTERRUPT_PORTS)) {
+        interruptEdges[port] = direction;
+        interruptWatchers[port] = 0;
+    }
+}
+
+void StopInterruptWatcher(unsigned char port) {
+    (void) port;
+}
+
+unsigned char GetInterruptWatcher(unsigned char port) {
+    unsigned char value;
+
+    spendCallTime();
+    if (!validPort(port, VEXHOST_INTERRUPT_PORTS)) {
+        return 0;
+    }
+    value = interruptWatchers[port];
+    interruptWatchers[port] = 0;
+    return value;
+}
+
+unsigned int GetUltrasonic(unsigned char echo, unsigned char ping) {
+    (void) ping;
+    spendCallTime();
+    return validPort(echo, VEXHOST_DIGITAL_PORTS) ? ultrasonics[echo] : 0;
+}
+
+void StartUltrasonic(unsigned char echo, unsigned char ping) {
+    (void) echo;
+    (void) ping;
+}
+
+void StopUltrasonic(unsigned char echo, unsigned char ping) {
+    (void) echo;
+    (void) ping;
+}
+
+void InitGyro(unsigned char port) {
+    (void) port;
+}
+
+void StartGyro(unsigned char port) {
+    (void) port;
+}
+
+void StopGyro(unsigned char port) {
+    (void) port;
+}
+
+int GetGyroAngle(unsigned char port) {
+    spendCallTime();
+    return validPort(port, VEXHOST_ANALOG_PORTS) ? gyroAngles[port] : 0;
+}
+
+void SetGyroType(unsigned char port, unsigned type) {
+    (void) port;
+    (void) type;
+}
+
+void SetGyroDeadband(unsigned char port, char deadband) {
+    (void) port;
+    (void) deadband;
+}
+
+void InitAccelerometer(unsigned char port) {
+    (void) port;
+}
+
+void StartAccelerometer(unsigned char port) {
+    (void) port;
+}
+
+int GetAcceleration(unsigned char port) {
+    (void) port;
+    return 0;
+}
+
+int GetVelocity(unsigned char port) {
+    (void) port;
+    return 0;
+}
+
+int GetDistance(unsigned char port) {
+    (void) port;
+    return 0;
+}
+
+void StopAccelerometer(unsigned char port) {
+    (void) port;
+}
+
+void InitializeCompass(unsigned char port) {
+    (void) port;
+}
+
+unsigned GetCompassHeading(void) {
+    spendCallTime();
+    return compassHeading;
+}
+
+/* Time */
+
+void Wait(unsigned long ms) {
+    VexHost_Advance(ms * 1000);
+}
+
+void StartTimer(unsigned char timerNumber) {
+    if (validPort(timerNumber, VEXHOST_TIMERS) && !timerRunning[timerNumber]) {
+        timerRunning[timerNumber] = 1;
+        timerStartUs[timerNumber] = nowUs;
+    }
+}
+
+void StopTimer(unsigned char timerNumber) {
+    if (validPort(timerNumber, VEXHOST_TIMERS) && timerRunning[timerNumber]) {
+        timerValues[timerNumber] = GetTimer(timerNumber);
+        timerRunning[timerNumber] = 0;
+    }
+}
+
+void PresetTimer(unsigned char timerNumber, unsigned long value) {
+    if (validPort(timerNumber, VEXHOST_TIMERS)) {
+        timerValues[timerNumber] = value;
+        timerStartUs[timerNumber] = nowUs;
+    }
+}
+
+unsigned long GetTimer(unsigned char timerNumber) {
+    spendCallTime();
+    if (!validPort(timerNumber, VEXHOST_TIMERS)) {
+        return 0;
+    }
+    if (!timerRunning[timerNumber]) {
+        return timerValues[timerNumber];
+    }
+    return timerValues[timerNumber] + (unsigned long) ((nowUs - timerStartUs[timerNumber]) / 1000);
+}
+
+unsigned GetSecondClock(void) {
+    spendCallTime();
+    return (unsigned) (nowUs / 1000000);
+}
+
+unsigned long GetMsClock(void) {
+    spendCallTime();
+    return (unsigned long) (nowUs / 1000);
+}
+
+unsigned long GetUsClock(void) {
+    spendCallTime();
+    return (unsigned long) nowUs;
+}
+
+unsigned GetGameTime(void) {
+    return GetSecondClock();
+}
+
+unsigned char GetPacketNumber(void) {
+    spendCallTime();
+    return (unsigned char) (nowUs / VEXHOST_PACKET_US);
+}
+
+static void scheduleTimer(unsigned long time, void (*handler)(void), unsigned long periodUs) {
+    int i;
+
+    CancelTimer(handler);
+    for (i = 0; i < VEXHOST_TIMERS; i++) {
+        if (scheduledTimers[i].handler == NULL) {
+            scheduledTimers[i].handler = handler;
+            scheduledTimers[i].periodUs = periodUs;
+            scheduledTimers[i].dueUs = nowUs + (unsigned long long) time * 1000;
+            return;
+        }
+    }
+}
+
+void RegisterSingleTimer(unsigned long time, void (*handler)(void)) {
+    scheduleTimer(time, handler, 0);
+}
+
+void RegisterRepeatingTimer(unsigned long time, void (*handler)(void)) {
+    scheduleTimer(time, handler, time * 1000);
+}
+
+void CancelTimer(void (*handler)(void)) {
+    int i;
+
+    for (i = 0; i < VEXHOST_TIMERS; i++) {
+        if (scheduledTimers[i].handler == handler) {
+            scheduledTimers[i].handler = NULL;
+        }
+    }
+}
+
+/* Interrupts */
+
+void RegisterInterruptHandler(unsigned char port, unsigned char edge, void (*handler)(unsigned char port, unsigned char value)) {
+    if (validPort(port, VEXHOST_INTERRUPT_PORTS)) {
+        interruptEdges[port] = edge;
+        interruptHandlers[port] = handler;
+    }
+}
+
+void UnRegisterInterruptHandler(unsigned char port) {
+    if (validPort(port, VEXHOST_INTERRUPT_PORTS)) {
+        interruptHandlers[port] = NULL;
+    }
+}
+
+void SetInterruptEdge(unsigned char port, unsigned char edge) {
+    if (validPort(port, VEXHOST_INTERRUPT_PORTS)) {
+        interruptEdges[port] = edge;
+    }
+}
+
+/* Operator interface */
+
+unsigned char GetOIDInput(unsigned char port, unsigned char channel) {
+    spendCallTime();
+    if (!validPort(port, VEXHOST_OI_PORTS) || !validPort(channel, VEXHOST_OI_CHANNELS)) {
+        return 0;
+    }
+    return oiDigital[port][channel];
+}
+
+unsigned char GetOIAInput(unsigned char port, unsigned char channel) {
+    spendCallTime();
+    if (!validPort(port, VEXHOST_OI_PORTS) || !validPort(channel, VEXHOST_OI_CHANNELS)) {
+        return 127;
+    }
+    return oiAnalog[port][channel];
+}
+
+unsigned char GetRxInput(unsigned char port, unsigned char channel) {
+    return GetOIAInput(port, channel);
+}
+
+unsigned char ReceivingData(unsigned char port) {
+    (void) port;
+    return 1;
+}
+
+void OIToDOutput(unsigned char port, unsigned char function, unsigned char dport) {
+    SetDigitalOutput(dport, GetOIDInput(port, function));
+}
+
+static unsigned char invertPWM(int value, unsigned char invert) {
+    if (value < 0) {
+        value = 0;
+    } else if (value > 255) {
+        value = 255;
+    }
+    return invert ? (unsigned char) (255 - value) : (unsigned char) value;
+}
+
+void OIToPWM(unsigned char port, unsigned char function, unsigned char pwm, unsigned char invert) {
+    SetPWM(pwm, invertPWM(GetOIAInput(port, function), invert));
+}
+
+/* Drive helpers, mixed the way the IFI default code mixes them */
+
+void Arcade2(unsigned char port,
+             unsigned char moveChannel, unsigned char rotateChannel,
+             unsigned char leftPWM, unsigned char rightPWM,
+             unsigned char leftInvert, unsigned char rightInvert) {
+    int move = GetOIAInput(port, moveChannel);
+    int rotate = GetOIAInput(port, rotateChannel);
+
+    SetPWM(leftPWM, invertPWM(move + rotate - 127, leftInvert));
+    SetPWM(rightPWM, invertPWM(move - rotate + 127, rightInvert));
+}
+
+void Arcade4(unsigned char port,
+             unsigned char ucRotateChannel, unsigned char ucMoveChannel,
+             unsigned char ucLeftfrontPWM, unsigned char ucRightfrontPWM,
+             unsigned char ucLeftrearPWM, unsigned char ucRightrearPWM,
+             unsigned char ucLeftfrontInvert, unsigned char ucRightfrontInvert,
+             unsigned char ucLeftrearInvert, unsigned char ucRightrearInvert) {
+    int move = GetOIAInput(port, ucMoveChannel);
+    int rotate = GetOIAInput(port, ucRotateChannel);
+
+    SetPWM(ucLeftfrontPWM, invertPWM(move + rotate - 127, ucLeftfrontInvert));
+    SetPWM(ucLeftrearPWM, invertPWM(move + rotate - 127, ucLeftrearInvert));
+    SetPWM(ucRightfrontPWM, invertPWM(move - rotate + 127, ucRightfrontInvert));
+    SetPWM(ucRightrearPWM, invertPWM(move - rotate + 127, ucRightrearInvert));
+}
+
+void Tank2(unsigned char port,
+           unsigned char leftChannel, unsigned char rightChannel,
+           unsigned char leftPWM, unsigned char rightPWM,
+           unsigned char leftInvert, unsigned char rightInvert) {
+    SetPWM(leftPWM, invertPWM(GetOIAInput(port, leftChannel), leftInvert));
+    SetPWM(rightPWM, invertPWM(GetOIAInput(port, rightChannel), rightInvert));
+}
+
+void Tank4(unsigned char port,
+           unsigned char ucLeftChannel, unsigned char ucRightChannel,
+           unsigned char ucLeftfrontPWM, unsigned char ucRightfrontPWM,
+           unsigned char ucLeftrearPWM, unsigned char ucRightrearPWM,
+           unsigned char ucLeftfrontInvert, unsigned char ucRightfrontInvert,
+           unsigned char ucLeftrearInvert, unsigned char ucRightrearInvert) {
+    int left = GetOIAInput(port, ucLeftChannel);
+    int right = GetOIAInput(port, ucRightChannel);
+
+    SetPWM(ucLeftfrontPWM, invertPWM(left, ucLeftfrontInvert));
+    SetPWM(ucLeftrearPWM, invertPWM(left, ucLeftrearInvert));
+    SetPWM(ucRightfrontPWM, invertPWM(right, ucRightfrontInvert));
+    SetPWM(ucRightrearPWM, invertPWM(right, ucRightrearInvert));
+}
+
+/* Camera, which the model does not see anything with */
+
+void InitCamera(unsigned char cameraInitIndex) {
+    (void) cameraInitIndex;
+}
+
+void CaptureTrackingData(unsigned char *centerX, unsigned char *centerY,
+                         unsigned char *x1, unsigned char *y1,
+                         unsigned char *x2, unsigned char *y2,
+                         unsigned char *regionSize, unsigned char *confidence,
+                         unsigned char *pan, unsigned char *tilt) {
+    *centerX = *centerY = *x1 = *y1 = *x2 = *y2 = 0;
+    *regionSize = *confidence = 0;
+    *pan = *tilt = 127;
+}
+
+void StopCamera(void) {
+}
+
+void StartCamera(void) {
+}
+
+TPacket *CopyTrackingData(void) {
+    static TPacket packet;
+    return &packet;
+}
+
+void SetServoTracking(unsigned char panTracking, unsigned char tiltTracking) {
+    (void) panTracking;
+    (void) tiltTracking;
+}
+
+void SetServoPosition(unsigned char servo, unsigned char position) {
+    (void) servo;
+    (void) position;
+}
+
+void InitializeCamera(CameraInitializationData *c) {
+    (void) c;
+}
+
+unsigned char GetCameraStatus(void) {
+    return 0;
+}
+
+void SetCameraDebugMode(unsigned char mode) {
+    (void) mode;
+}
+
+/* Serial ports */
+
+unsigned char ReadSerialPortOne(void) {
+    return serialGet(&serialInputs[1]);
+}
+
+void WriteSerialPortOne(unsigned char value) {
+    serialPut(&serialOutputs[1], value);
+}
+
+unsigned char ReadSerialPortTwo(void) {
+    return serialGet(&serialInputs[2]);
+}
+
+void WriteSerialPortTwo(unsigned char value) {
+    serialPut(&serialOutputs[2], value);
+}
+
+unsigned char GetSerialPort1ByteCount(void) {
+    spendCallTime();
+    return serialInputs[1].count > 255 ? 255 : (unsigned char) serialInputs[1].count;
+}
+
+unsigned char GetSerialPort2ByteCount(void) {
+    spendCallTime();
+    return serialInputs[2].count > 255 ? 255 : (unsigned char) serialInputs[2].count;
+}
+
+void OpenSerialPortOne(unsigned baudRate) {
+    (void) baudRate;
+}
+
+void OpenSerialPortTwo(unsigned baudRate) {
+    (void) baudRate;
+}
@@ -0,0 +1,70 @@
+/*
+ * Model of the controller that backs the functions of Api.h in host builds
+ * (vexbuild --host). Tests use these functions to set the inputs the robot
+ * code sees, advance time and read back its outputs.
+ *
+ * Time only passes when the robot code calls Wait(), or when a test calls
+ * VexHost_Advance(). Timers registered with RegisterSingleTimer() and
+ * RegisterRepeatingTimer() run from VexHost_Advance(), in time order.
+ */
+#ifndef VEXHOST_H_
+#define VEXHOST_H_
+
+#include "Api.h"
+
+#define VEXHOST_DIGITAL_PORTS 16
+#define VEXHOST_ANALOG_PORTS 16
+#define VEXHOST_PWM_PORTS 8
+#define VEXHOST_INTERRUPT_PORTS 6
+#define VEXHOST_OI_PORTS 2
+#define VEXHOST_OI_CHANNELS 6
+#define VEXHOST_TIMERS 6
+#define VEXHOST_SERIAL_BUFFER 256
+
+/* The master processor sends the user processor a packet every 18.5 ms */
+#define VEXHOST_PACKET_US 18500UL
+
+/* Put the model back in its power on state */
+void VexHost_Reset(void);
+
+/* Let time pass, running any timers that become due */
+void VexHost_Advance(unsigned long us);
+unsigned long long VexHost_GetTime(void);
+
+/*
+ * Time that passes on every call to an input function, so code that polls
+ * in a loop without calling Wait() still sees time pass. 0 by default.
+ */
+void VexHost_SetCallTime(unsigned long us);
+
+/* Exit the program once this much time has passed, 0 to run forever */
+void VexHost_SetRunTime(unsigned long ms);
+
+void VexHost_SetMode(unsigned char autonomous, unsigned char enabled);
+
+void VexHost_SetDigitalInput(unsigned char port, unsigned char value);
+unsigned char VexHost_GetDigitalOutput(unsigned char port);
+void VexHost_SetAnalogInput(unsigned char port, unsigned int value);
+unsigned char VexHost_GetPWM(unsigned char port);
+
+/* Joystick axes are 0-255, 127 centered, buttons are 0 or 1 */
+void VexHost_SetOIAInput(unsigned char port, unsigned char channel, unsigned char value);
+void VexHost_SetOIDInput(unsigned char port, unsigned char channel, unsigned char value);
+
+/* Change the level of an interrupt port, calling its handler on the registered edge */
+void VexHost_SetInterruptInput(unsigned char port, unsigned char value);
+
+void VexHost_AddEncoderCounts(unsigned char channel, long counts);
+void VexHost_AddQuadEncoderCounts(unsigned char channelA, long counts);
+void VexHost_SetGyroAngle(unsigned char port, int angle);
+void VexHost_SetUltrasonic(unsigned char echo, unsigned int distance);
+void VexHost_SetCompassHeading(unsigned heading);
+
+/* Bytes for the robot code to read from a serial port */
+void VexHost_SerialInput(unsigned char port, const unsigned char *data, unsigned length);
+/* Take the bytes the robot code wrote to a serial port, returns how many there were */
+unsigned VexHost_SerialOutput(unsigned char port, unsigned char *data, unsigned length);
+
+const char *VexHost_GetLCDText(unsigned char line);
+
+#endif /* VEXHOST_H_ */
@@ -0,0 +1,56 @@
+/*
+ * Entry point of a host build of a robot program, standing in for the one in
+ * easyCRuntime.lib. Like the runtime, it has defaults for the functions a
+ * program does not define.
+ *
+ * VEXHOST_RUN_MS sets how long the program runs for in model time (20000 ms
+ * by default), VEXHOST_AUTONOMOUS_MS how much of that is autonomous (0 by
+ * default) and VEXHOST_CALL_US how much time each input function call takes
+ * (10 us by default).
+ */
+#include <stdlib.h>
+
+#include "vexhost.h"
+
+__attribute__((weak)) void IO_Initialization(void) {
+}
+
+__attribute__((weak)) void Initialize(void) {
+}
+
+__attribute__((weak)) void Autonomous(void) {
+}
+
+__attribute__((weak)) void OperatorControl(void) {
+    for (;;) {
+        Wait(1);
+    }
+}
+
+static unsigned long environment(const char *name, unsigned long value) {
+    const char *setting = getenv(name);
+    return setting != NULL ? strtoul(setting, NULL, 10) : value;
+}
+
+static void endAutonomous(void) {
+    VexHost_SetMode(0, 1);
+}
+
+int main(void) {
+    unsigned long autonomousMs = environment("VEXHOST_AUTONOMOUS_MS", 0);
+
+    VexHost_Reset();
+    VexHost_SetRunTime(environment("VEXHOST_RUN_MS", 20000));
+    VexHost_SetCallTime(environment("VEXHOST_CALL_US", 10));
+
+    IO_Initialization();
+    Initialize();
+
+    if (autonomousMs != 0) {
+        VexHost_SetMode(1, 1);
+        RegisterSingleTimer(autonomousMs, endAutonomous);
+        Autonomous();
+    }
+    OperatorControl();
+    return 0;
+}
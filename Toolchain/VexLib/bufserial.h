@@ -0,0 +1,53 @@
+/*
+ * Buffered serial ports, which never wait for the USART. WriteSerialPortOne()
+ * waits for the transmitter before each byte, so a debug print stalls the
+ * control loop for about 87 us a byte at 115200 baud. The functions here copy
+ * into ring buffers and return, and an interrupt moves the bytes between the
+ * rings and the USARTs.
+ *
+ * The interrupt is a 1 ms repeating timer, registered by BufSerial_Open(),
+ * since the Vex and easyC libraries own the interrupt vectors. Each tick
+ * fills the USART's two byte transmit buffer and takes the received bytes
+ * from the library's receive queue, so a port sends at most 2000 bytes a
+ * second. Writes also start sending straight away when the transmitter is
+ * free. Bytes that do not fit in a ring are dropped and counted.
+ * BufSerial_Write() and BufSerial_WriteText() copy with the interrupt held
+ * off, so timers can write whole frames to a port the program writes to as
+ * well.
+ *
+ * The rings of both ports are in one section (bufserial), so they share a
+ * data bank. The sizes have to be powers of two, up to 128.
+ */
+#ifndef BUFSERIAL_H_
+#define BUFSERIAL_H_
+
+#define BUFSERIAL_TX_SIZE 64
+#define BUFSERIAL_RX_SIZE 32
+
+/* Open port 1 or 2 with a baud rate constant of Api.h, the rings are emptied */
+void BufSerial_Open(unsigned char port, unsigned baudRate);
+
+/* Queue bytes to send, returning how many fit */
+unsigned char BufSerial_Write(unsigned char port, const unsigned char *data, unsigned char length);
+/* Queue all of a frame or none of it, returning 1 if it fit */
+unsigned char BufSerial_WriteFrame(unsigned char port, const unsigned char *data, unsigned char length);
+unsigned char BufSerial_WriteByte(unsigned char port, unsigned char value);
+unsigned char BufSerial_WriteText(unsigned char port, const rom char *text);
+
+/* Take received bytes, returning how many there were */
+unsigned char BufSerial_Read(unsigned char port, unsigned char *data, unsigned char length);
+/* The next received byte, or -1 when there is none */
+short BufSerial_ReadByte(unsigned char port);
+
+/* Received bytes waiting to be read, and room left for bytes to send */
+unsigned char BufSerial_Available(unsigned char port);
+unsigned char BufSerial_Free(unsigned char port);
+
+/* Bytes dropped because a ring was full, since the port was opened */
+unsigned BufSerial_GetTxOverflows(unsigned char port);
+unsigned BufSerial_GetRxOverflows(unsigned char port);
+
+/* The interrupt's work, for a program that wants to run it from elsewhere */
+void BufSerial_Service(void);
+
+#endif /* BUFSERIAL_H_ */
@@ -0,0 +1,60 @@
+/*
+ * Fixed point math, a faster alternative to the float functions of math.h.
+ * The PIC has no floating point hardware, so every float sin() or sqrt() is
+ * a software routine thousands of cycles long.
+ *
+ * Fractions are Q15 (1.0 is 32768, so the largest is 32767) or Q8.8 (1.0 is
+ * 256). Angles are binary angles: a full turn is 65536, so they wrap around
+ * the way unsigned shorts do, and 0x4000 is 90 degrees.
+ *
+ * Accuracy, checked against the host math library:
+ *   Fix_Sin, Fix_Cos   within 5 of the rounded Q15 value
+ *   Fix_Atan2          within 6 binary angle units (0.033 degrees)
+ *   Fix_Sqrt           exact, the square root rounded down
+ *   Fix_SqrtQ8_8       within 1 of the rounded Q8.8 value
+ *   Fix_MulQ15/Q8_8    rounded to nearest
+ *
+ * Defining FIXMATH_REPLACES_FLOAT before including this header makes the
+ * sin(), cos(), atan2() and sqrt() calls of the file use the float wrappers
+ * below, so code can be sped up without converting it. The wrappers are
+ * slower than the fixed point functions, since they still convert floats.
+ */
+#ifndef FIXMATH_H_
+#define FIXMATH_H_
+
+typedef short q15;
+typedef short q8_8;
+typedef unsigned short binary_angle;
+
+#define FIX_Q15_ONE 32767
+#define FIX_Q8_8_ONE 256
+#define FIX_DEGREES(degrees) ((binary_angle)((degrees) * 65536L / 360))
+
+q15 Fix_Sin(binary_angle angle);
+q15 Fix_Cos(binary_angle angle);
+
+/* The angle of the vector (x, y), 0 when both are 0 */
+binary_angle Fix_Atan2(short y, short x);
+
+unsigned short Fix_Sqrt(unsigned long value);
+q8_8 Fix_SqrtQ8_8(q8_8 value);
+
+q15 Fix_MulQ15(q15 a, q15 b);
+q8_8 Fix_MulQ8_8(q8_8 a, q8_8 b);
+/* base to a whole power, by squaring. Overflow is not checked. */
+q8_8 Fix_PowQ8_8(q8_8 base, unsigned char exponent);
+
+/* Radians in and out, like the math.h functions they replace */
+float Fix_SinF(float radians);
+float Fix_CosF(float radians);
+float Fix_Atan2F(float y, float x);
+float Fix_SqrtF(float value);
+
+#ifdef FIXMATH_REPLACES_FLOAT
+#define sin(x) Fix_SinF(x)
+#define cos(x) Fix_CosF(x)
+#define atan2(y, x) Fix_Atan2F(y, x)
+#define sqrt(x) Fix_SqrtF(x)
+#endif
+
+#endif /* FIXMATH_H_ */
@@ -0,0 +1,208 @@
+/*
+ * Buffered serial ports, see bufserial.h.
+ *
+ * Each ring has a head the writer moves and a tail the reader moves, both
+ * counting up without limit, so the interrupt and the program never write
+ * the same byte. The rings are full when they are the size apart.
+ */
+#include <p18cxxx.h>
+#include "Api.h"
+#include "bufserial.h"
+
+#define TX_MASK (BUFSERIAL_TX_SIZE - 1)
+#define RX_MASK (BUFSERIAL_RX_SIZE - 1)
+
+#define SERVICE_MS 1
+
+#ifdef VEX_HOST
+/* The host model takes bytes as fast as they come */
+#define TX_READY(port) 1
+#define TX_PUT(port, value) ((port) == 0 ? WriteSerialPortOne(value) : WriteSerialPortTwo(value))
+#else
+#define TX_READY(port) ((port) == 0 ? PIR1bits.TX1IF : PIR3bits.TX2IF)
+#define TX_PUT(port, value) ((port) == 0 ? (TXREG1 = (value)) : (TXREG2 = (value)))
+#endif
+
+#pragma udata bufserial
+static unsigned char txRings[2][BUFSERIAL_TX_SIZE];
+static unsigned char rxRings[2][BUFSERIAL_RX_SIZE];
+#pragma udata
+
+static volatile unsigned char txHeads[2];
+static volatile unsigned char txTails[2];
+static volatile unsigned char rxHeads[2];
+static volatile unsigned char rxTails[2];
+static volatile unsigned txOverflows[2];
+static volatile unsigned rxOverflows[2];
+static unsigned char opened[2];
+static unsigned char serviceRegistered;
+
+/* Ports are 1 and 2, anything else is no port */
+static unsigned char validPort(unsigned char port) {
+    return port == 1 || port == 2;
+}
+
+static void transmit(unsigned char index) {
+    while (txTails[index] != txHeads[index] && TX_READY(index)) {
+        TX_PUT(index, txRings[index][txTails[index] & TX_MASK]);
+        txTails[index]++;
+    }
+}
+
+static void receive(unsigned char index) {
+    unsigned char value;
+
+    while (index == 0 ? GetSerialPort1ByteCount() : GetSerialPort2ByteCount()) {
+        value = index == 0 ? ReadSerialPortOne() : ReadSerialPortTwo();
+        if ((unsigned char)(rxHeads[index] - rxTails[index]) == BUFSERIAL_RX_SIZE) {
+            rxOverflows[index]++;
+        } else {
+            rxRings[index][rxHeads[index] & RX_MASK] = value;
+            rxHeads[index]++;
+        }
+    }
+}
+
+void BufSerial_Service(void) {
+    unsigned char index;
+
+    for (index = 0; index < 2; index++) {
+        if (opened[index]) {
+            transmit(index);
+            receive(index);
+        }
+    }
+}
+
+void BufSerial_Open(unsigned char port, unsigned baudRate) {
+    unsigned char index = port - 1;
+
+    if (!validPort(port)) {
+        return;
+    }
+    opened[index] = 0;
+    txHeads[index] = txTails[index] = 0;
+    rxHeads[index] = rxTails[index] = 0;
+    txOverflows[index] = rxOverflows[index] = 0;
+    if (port == 1) {
+        OpenSerialPortOne(baudRate);
+    } else {
+        OpenSerialPortTwo(baudRate);
+    }
+    opened[index] = 1;
+    if (!serviceRegistered) {
+        RegisterRepeatingTimer(SERVICE_MS, BufSerial_Service);
+        serviceRegistered = 1;
+    }
+}
+
+unsigned char BufSerial_Write(unsigned char port, const unsigned char *data, unsigned char length) {
+    unsigned char index = port - 1;
+    unsigned char count;
+    unsigned char enabled = INTCONbits.GIEL;
+
+    if (!validPort(port)) {
+        return 0;
+    }
+    /* Whole, so writes from a timer never land in the middle of this one */
+    INTCONbits.GIEL = 0;
+    for (count = 0; count < length; count++) {
+        if ((unsigned char)(txHeads[index] - txTails[index]) == BUFSERIAL_TX_SIZE) {
+            txOverflows[index] += length - count;
+            break;
+        }
+        txRings[index][txHeads[index] & TX_MASK] = data[count];
+        txHeads[index]++;
+    }
+    transmit(index);
+    INTCONbits.GIEL = enabled;
+    return count;
+}
+
+unsigned char BufSerial_WriteFrame(unsigned char port, const unsigned char *data, unsigned char length) {
+    unsigned char index = port - 1;
+    unsigned char count;
+    unsigned char fits;
+    unsigned char enabled = INTCONbits.GIEL;
+
+    if (!validPort(port)) {
+        return 0;
+    }
+    /* Checked and copied in one go, so a timer can't take the room between */
+    INTCONbits.GIEL = 0;
+    fits = BUFSERIAL_TX_SIZE - (unsigned char)(txHeads[index] - txTails[index]) >= length;
+    if (fits) {
+        for (count = 0; count < length; count++) {
+            txRings[index][txHeads[index] & TX_MASK] = data[count];
+            txHeads[index]++;
+        }
+        transmit(index);
+    } else {
+        txOverflows[index] += length;
+    }
+    INTCONbits.GIEL = enabled;
+    return fits;
+}
+
+unsigned char BufSerial_WriteByte(unsigned char port, unsigned char value) {
+    return BufSerial_Write(port, &value, 1);
+}
+
+unsigned char BufSerial_WriteText(unsigned char port, const rom char *text) {
+    unsigned char index = port - 1;
+    unsigned char count = 0;
+    unsigned char enabled = INTCONbits.GIEL;
+
+    if (!validPort(port)) {
+        return 0;
+    }
+    INTCONbits.GIEL = 0;
+    for (; *text != '\0'; text++) {
+        if ((unsigned char)(txHeads[index] - txTails[index]) == BUFSERIAL_TX_SIZE) {
+            txOverflows[index]++;
+        } else {
+            txRings[index][txHeads[index] & TX_MASK] = *text;
+            txHeads[index]++;
+            count++;
+        }
+    }
+    transmit(index);
+    INTCONbits.GIEL = enabled;
+    return count;
+}
+
+unsigned char BufSerial_Read(unsigned char port, unsigned char *data, unsigned char length) {
+    unsigned char index = port - 1;
+    unsigned char count;
+
+    if (!validPort(port)) {
+        return 0;
+    }
+    for (count = 0; count < length && rxTails[index] != rxHeads[index]; count++) {
+        data[count] = rxRings[index][rxTails[index] & RX_MASK];
+        rxTails[index]++;
+    }
+    return count;
+}
+
+short BufSerial_ReadByte(unsigned char port) {
+    unsigned char value;
+
+    return BufSerial_Read(port, &value, 1) ? value : -1;
+}
+
+unsigned char BufSerial_Available(unsigned char port) {
+    return validPort(port) ? rxHeads[port - 1] - rxTails[port - 1] : 0;
+}
+
+unsigned char BufSerial_Free(unsigned char port) {
+    return validPort(port) ? BUFSERIAL_TX_SIZE - (unsigned char)(txHeads[port - 1] - txTails[port - 1]) : 0;
+}
+
+unsigned BufSerial_GetTxOverflows(unsigned char port) {
+    return validPort(port) ? txOverflows[port - 1] : 0;
+}
+
+unsigned BufSerial_GetRxOverflows(unsigned char port) {
+    return validPort(port) ? rxOverflows[port - 1] : 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Fixed point math, see fixmath.h.
+ */
+#include "fixmath.h"
+
+#define RADIANS_TO_ANGLE 10430.378f
+#define ANGLE_TO_RADIANS (1.0f / RADIANS_TO_ANGLE)
+
+/* sin() of the first quarter turn in 64 steps, in Q15 */
+static rom const short sineTable[65] = {
+    0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+    6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767
+};
+
+/* atan(2^-i) in binary angle units */
+#define CORDIC_STEPS 14
+static rom const unsigned short cordicTable[CORDIC_STEPS] = {
+    8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20, 10, 5, 3, 1
+};
+
+/*
+ * Vectors are scaled to within this before the CORDIC steps. The steps grow
+ * them by up to 1.65 times, which x only has room for as an unsigned short.
+ */
+#define CORDIC_LIMIT 16383
+
+/* sin() of 0 to a quarter turn (0x4000), interpolated between table entries */
+static q15 quarterSine(unsigned short angle) {
+    unsigned char index = angle >> 8;
+    unsigned char fraction = angle;
+    unsigned short step;
+
+    if (index == 64) {
+        return sineTable[64];
+    }
+    /* The table only rises, and the step is split into bytes so the products fit in 16 bits */
+    step = sineTable[index + 1] - sineTable[index];
+    return sineTable[index] + (step >> 8) * fraction + (((step & 0xFF) * fraction) >> 8);
+}
+
+q15 Fix_Sin(binary_angle angle) {
+    unsigned short part = angle & 0x3FFF;
+
+    switch (angle >> 14) {
+    case 0:
+        return quarterSine(part);
+    case 1:
+        return quarterSine(0x4000 - part);
+    case 2:
+        return -quarterSine(part);
+    default:
+        return -quarterSine(0x4000 - part);
+    }
+}
+
+q15 Fix_Cos(binary_angle angle) {
+    return Fix_Sin(angle + 0x4000);
+}
+
+binary_angle Fix_Atan2(short y, short x) {
+    binary_angle angle = 0;
+    unsigned short cordicX;
+    unsigned short next;
+    unsigned char i;
+
+    if (x == 0 && y == 0) {
+        return 0;
+    }
+    while (x > CORDIC_LIMIT || x < -CORDIC_LIMIT || y > CORDIC_LIMIT || y < -CORDIC_LIMIT) {
+        x >>= 1;
+        y >>= 1;
+    }
+    /* Small vectors are scaled up, for precision */
+    while (x <= CORDIC_LIMIT / 2 && x >= -CORDIC_LIMIT / 2 && y <= CORDIC_LIMIT / 2 && y >= -CORDIC_LIMIT / 2) {
+        x <<= 1;
+        y <<= 1;
+    }
+    /* The steps only converge within a quarter turn of the x axis */
+    if (x < 0) {
+        x = -x;
+        y = -y;
+        angle = 0x8000;
+    }
+    cordicX = x;
+
+    /* Rotate the vector onto the x axis, adding up the rotations */
+    for (i = 0; i < CORDIC_STEPS; i++) {
+        if (y > 0) {
+            next = cordicX + (y >> i);
+            y -= cordicX >> i;
+            angle += cordicTable[i];
+        } else {
+            next = cordicX - (y >> i);
+            y += cordicX >> i;
+            angle -= cordicTable[i];
+        }
+        cordicX = next;
+    }
+    return angle;
+}
+
+unsigned short Fix_Sqrt(unsigned long value) {
+    unsigned long root = 0;
+    unsigned long bit = 1UL << 30;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+q8_8 Fix_SqrtQ8_8(q8_8 value) {
+    if (value <= 0) {
+        return 0;
+    }
+    return Fix_Sqrt((unsigned long)value << 8);
+}
+
+q15 Fix_MulQ15(q15 a, q15 b) {
+    return ((long)a * b + 0x4000) >> 15;
+}
+
+q8_8 Fix_MulQ8_8(q8_8 a, q8_8 b) {
+    return ((long)a * b + 0x80) >> 8;
+}
+
+q8_8 Fix_PowQ8_8(q8_8 base, unsigned char exponent) {
+    q8_8 result = FIX_Q8_8_ONE;
+
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result = Fix_MulQ8_8(result, base);
+        }
+        exponent >>= 1;
+        if (exponent != 0) {
+            base = Fix_MulQ8_8(base, base);
+        }
+    }
+    return result;
+}
+
+float Fix_SinF(float radians) {
+    return Fix_Sin((long)(radians * RADIANS_TO_ANGLE)) * (1.0f / 32768);
+}
+
+float Fix_CosF(float radians) {
+    return Fix_Cos((long)(radians * RADIANS_TO_ANGLE)) * (1.0f / 32768);
+}
+
+float Fix_Atan2F(float y, float x) {
+    float absX = x < 0 ? -x : x;
+    float absY = y < 0 ? -y : y;
+    float scale = absX > absY ? absX : absY;
+
+    if (scale == 0) {
+        return 0;
+    }
+    scale = 16384 / scale;
+    return (short)Fix_Atan2(y * scale, x * scale) * ANGLE_TO_RADIANS;
+}
+
+float Fix_SqrtF(float value) {
+    float scale = 1;
+
+    if (value <= 0) {
+        return 0;
+    }
+    /* Bring the value to between 4096 and 16384, where the root has 16 bits */
+    while (value >= 16384) {
+        value *= 0.25f;
+        scale *= 2;
+    }
+    while (value < 4096) {
+        value *= 4;
+        scale *= 0.5f;
+    }
+    return Fix_Sqrt(value * 262144.0f) * (1.0f / 512) * scale;
+}
@@ -0,0 +1,199 @@
+/*
+ * A hashed timer wheel, see timerwheel.h.
+ *
+ * The slots and the pending list are circular lists, with a head that has
+ * the links of a timer and nothing else, so a timer can be taken off
+ * whichever list it is on without knowing which, and a whole slot can be
+ * moved onto the pending list in a few writes. The program changes the
+ * lists with the interrupt held off.
+ */
+#include <p18cxxx.h>
+#include "Api.h"
+#include "timerwheel.h"
+
+#define SLOT_MASK (TIMERWHEEL_SLOTS - 1)
+#define TICK_MS 1
+
+typedef struct {
+    TimerWheel_Timer *next;
+    TimerWheel_Timer *previous;
+} List;
+
+#define HEAD(list) ((TimerWheel_Timer *)(list))
+
+static List slots[TIMERWHEEL_SLOTS];
+/* The timers of the slots the tick has reached, in cooperative mode */
+static List pending;
+/* The timers a tick is running, in interrupt mode */
+static List expired;
+static volatile unsigned short ticks;
+static unsigned char wheelMode;
+static unsigned char started;
+static unsigned char tickRegistered;
+
+static void clear(List *list) {
+    list->next = list->previous = HEAD(list);
+}
+
+static void detach(TimerWheel_Timer *timer) {
+    timer->previous->next = timer->next;
+    timer->next->previous = timer->previous;
+    timer->next = 0;
+}
+
+static void append(List *list, TimerWheel_Timer *timer) {
+    timer->next = HEAD(list);
+    timer->previous = list->previous;
+    list->previous->next = timer;
+    list->previous = timer;
+}
+
+/* Move all of the timers of from onto the end of to */
+static void splice(List *from, List *to) {
+    if (from->next == HEAD(from)) {
+        return;
+    }
+    from->next->previous = to->previous;
+    to->previous->next = from->next;
+    from->previous->next = HEAD(to);
+    to->previous = from->previous;
+    clear(from);
+}
+
+static void schedule(TimerWheel_Timer *timer, unsigned short delay, unsigned short period, void (*handler)(void)) {
+    unsigned char enabled = INTCONbits.GIEL;
+
+    if (delay == 0) {
+        delay = 1;
+    } else if (delay > TIMERWHEEL_MAX_DELAY) {
+        delay = TIMERWHEEL_MAX_DELAY;
+    }
+    INTCONbits.GIEL = 0;
+    if (timer->next) {
+        detach(timer);
+    }
+    timer->due = ticks + delay;
+    timer->period = period > TIMERWHEEL_MAX_DELAY ? TIMERWHEEL_MAX_DELAY : period;
+    timer->handler = handler;
+    append(&slots[timer->due & SLOT_MASK], timer);
+    INTCONbits.GIEL = enabled;
+}
+
+/* Put a timer that just ran back on the wheel, a period on, or a period from now if it fell behind */
+static void repeat(TimerWheel_Timer *timer) {
+    timer->due += timer->period;
+    if ((short)(timer->due - ticks) <= 0) {
+        timer->due = ticks + timer->period;
+    }
+    append(&slots[timer->due & SLOT_MASK], timer);
+}
+
+void TimerWheel_Start(unsigned char mode) {
+    unsigned char i;
+
+    if (!started) {
+        for (i = 0; i < TIMERWHEEL_SLOTS; i++) {
+            clear(&slots[i]);
+        }
+        clear(&pending);
+        clear(&expired);
+        started = 1;
+    }
+    wheelMode = mode;
+    if (!(mode & TIMERWHEEL_OWN_TICK) && !tickRegistered) {
+        RegisterRepeatingTimer(TICK_MS, TimerWheel_Tick);
+        tickRegistered = 1;
+    }
+}
+
+void TimerWheel_Tick(void) {
+    List *slot;
+    TimerWheel_Timer *timer;
+    TimerWheel_Timer *next;
+    void (*handler)(void);
+
+    ticks++;
+    slot = &slots[ticks & SLOT_MASK];
+    if (wheelMode & TIMERWHEEL_COOPERATIVE) {
+        splice(slot, &pending);
+        return;
+    }
+
+    for (timer = slot->next; timer != HEAD(slot); timer = next) {
+        next = timer->next;
+        if (timer->due == ticks) {
+            detach(timer);
+            append(&expired, timer);
+        }
+    }
+    /* A handler can add or cancel any timer, the ones still to run too */
+    while (expired.next != HEAD(&expired)) {
+        timer = expired.next;
+        detach(timer);
+        handler = timer->handler;
+        if (timer->period) {
+            repeat(timer);
+        }
+        handler();
+    }
+}
+
+void TimerWheel_Dispatch(void) {
+    unsigned char enabled = INTCONbits.GIEL;
+    TimerWheel_Timer *timer;
+    void (*handler)(void);
+
+    for (;;) {
+        INTCONbits.GIEL = 0;
+        timer = pending.next;
+        if (timer == HEAD(&pending)) {
+            break;
+        }
+        detach(timer);
+        if ((short)(timer->due - ticks) > 0) {
+            /* Due on a later turn of the wheel */
+            append(&slots[timer->due & SLOT_MASK], timer);
+            INTCONbits.GIEL = enabled;
+            continue;
+        }
+        handler = timer->handler;
+        if (timer->period) {
+            repeat(timer);
+        }
+        INTCONbits.GIEL = enabled;
+        handler();
+    }
+    INTCONbits.GIEL = enabled;
+}
+
+void TimerWheel_Single(TimerWheel_Timer *timer, unsigned short delay, void (*handler)(void)) {
+    schedule(timer, delay, 0, handler);
+}
+
+void TimerWheel_Repeating(TimerWheel_Timer *timer, unsigned short period, void (*handler)(void)) {
+    schedule(timer, period, period, handler);
+}
+
+void TimerWheel_Cancel(TimerWheel_Timer *timer) {
+    unsigned char enabled = INTCONbits.GIEL;
+
+    INTCONbits.GIEL = 0;
+    if (timer->next) {
+        detach(timer);
+    }
+    INTCONbits.GIEL = enabled;
+}
+
+unsigned char TimerWheel_IsActive(const TimerWheel_Timer *timer) {
+    return timer->next != 0;
+}
+
+unsigned short TimerWheel_GetTicks(void) {
+    unsigned char enabled = INTCONbits.GIEL;
+    unsigned short value;
+
+    INTCONbits.GIEL = 0;
+    value = ticks;
+    INTCONbits.GIEL = enabled;
+    return value;
+}
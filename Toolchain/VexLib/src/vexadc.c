@@ -0,0 +1,121 @@
+/*
+ * Background sampling of the analog inputs, see vexadc.h.
+ *
+ * Each tick either starts a conversion of the selected channel, or takes
+ * the result of the one the last tick started. After the last conversion
+ * of a channel it selects the next channel, and the next tick starts it.
+ */
+#include <p18cxxx.h>
+#include "Api.h"
+#include "vexadc.h"
+
+#define TICK_MS 1
+
+#ifdef VEX_HOST
+/* The host model has no converter, so a conversion reads the input */
+static unsigned char hostChannel;
+#define SELECT(channel) (hostChannel = (channel))
+#define START() ((void)0)
+#define RESULT() GetAnalogInput(hostChannel + 1)
+#else
+#define SELECT(channel) (ADCON0 = (ADCON0 & 0xC3) | (channel) << 2)
+#define START() (ADCON0bits.GO = 1)
+#define RESULT() ((unsigned short)ADRESH << 8 | ADRESL)
+#endif
+
+#pragma udata vexadc
+volatile unsigned short vexAdcResults[2][VEXADC_CHANNELS];
+static unsigned short sums[VEXADC_CHANNELS];
+static unsigned char shifts[VEXADC_CHANNELS];
+#pragma udata
+
+volatile unsigned char vexAdcFront;
+static unsigned char channelCount;
+static unsigned char channel;
+static unsigned char samples;
+static unsigned char converting;
+static volatile unsigned short passes;
+
+void VexAdc_Service(void) {
+    unsigned char back;
+
+    if (!converting) {
+        START();
+        converting = 1;
+        return;
+    }
+
+    sums[channel] += RESULT();
+    if (++samples < (unsigned char)(1 << shifts[channel])) {
+        /* The same channel again, which has had since the last conversion to acquire */
+        START();
+        return;
+    }
+    back = vexAdcFront ^ 1;
+    vexAdcResults[back][channel] = sums[channel] >> shifts[channel];
+    sums[channel] = 0;
+    samples = 0;
+    if (++channel == channelCount) {
+        channel = 0;
+        vexAdcFront = back;
+        passes++;
+    }
+    SELECT(channel);
+    converting = 0;
+}
+
+void VexAdc_Start(unsigned char channels) {
+    unsigned char i;
+
+    VexAdc_Stop();
+    if (channels > VEXADC_CHANNELS) {
+        channels = VEXADC_CHANNELS;
+    }
+    if (channels == 0) {
+        return;
+    }
+    for (i = 0; i < VEXADC_CHANNELS; i++) {
+        vexAdcResults[0][i] = vexAdcResults[1][i] = 0;
+        sums[i] = 0;
+    }
+    vexAdcFront = 0;
+    channelCount = channels;
+    channel = 0;
+    samples = 0;
+    converting = 0;
+    passes = 0;
+#ifndef VEX_HOST
+    ADCON2bits.ADFM = 1;
+    ADCON0bits.ADON = 1;
+#endif
+    SELECT(0);
+    RegisterRepeatingTimer(TICK_MS, VexAdc_Service);
+}
+
+void VexAdc_Stop(void) {
+    CancelTimer(VexAdc_Service);
+}
+
+void VexAdc_SetOversampling(unsigned char port, unsigned char shift) {
+    if (port >= 1 && port <= VEXADC_CHANNELS) {
+        shifts[port - 1] = shift > VEXADC_MAX_SHIFT ? VEXADC_MAX_SHIFT : shift;
+    }
+}
+
+unsigned short VexAdc_Get(unsigned char port) {
+    return port >= 1 && port <= channelCount ? vexAdcResults[vexAdcFront][port - 1] : 0;
+}
+
+const volatile unsigned short *VexAdc_Results(void) {
+    return vexAdcResults[vexAdcFront];
+}
+
+unsigned short VexAdc_GetPasses(void) {
+    unsigned char enabled = INTCONbits.GIEL;
+    unsigned short value;
+
+    INTCONbits.GIEL = 0;
+    value = passes;
+    INTCONbits.GIEL = enabled;
+    return value;
+}
@@ -0,0 +1,205 @@
+/*
+ * printf() conversions, see vexfmt.h.
+ *
+ * Decimal digits come from subtracting powers of ten, which is much faster
+ * than dividing on the PIC.
+ */
+#include <stdio.h>
+#include "vexfmt.h"
+
+static rom const unsigned short powers16[] = {10000, 1000, 100, 10};
+static rom const unsigned long powers32[] = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL
+};
+static rom const char lowerDigits[] = "0123456789abcdef";
+static rom const char upperDigits[] = "0123456789ABCDEF";
+
+static char *output;
+static int written;
+
+static void put(char value) {
+    if (output) {
+        *output++ = value;
+    } else {
+        putc(value, stdout);
+    }
+    written++;
+}
+
+static void fill(char value, unsigned char count) {
+    while (count-- != 0) {
+        put(value);
+    }
+}
+
+/* Digits with their sign, padded out to width */
+static void emit(const char *digits, unsigned char length, char sign, unsigned char width, unsigned char flags) {
+    unsigned char size = length + (sign != 0);
+    unsigned char padding = width > size ? width - size : 0;
+
+    if (!(flags & (VEXFMT_LEFT | VEXFMT_ZERO))) {
+        fill(' ', padding);
+    }
+    if (sign) {
+        put(sign);
+    }
+    if ((flags & (VEXFMT_LEFT | VEXFMT_ZERO)) == VEXFMT_ZERO) {
+        fill('0', padding);
+    }
+    while (length-- != 0) {
+        put(*digits++);
+    }
+    if (flags & VEXFMT_LEFT) {
+        fill(' ', padding);
+    }
+}
+
+static char positiveSign(unsigned char flags) {
+    return flags & VEXFMT_PLUS ? '+' : flags & VEXFMT_SPACE ? ' ' : 0;
+}
+
+static unsigned char decimal16(unsigned short value, char *digits) {
+    unsigned char length = 0;
+    unsigned char i;
+    char digit;
+
+    for (i = 0; i < sizeof(powers16) / sizeof(powers16[0]); i++) {
+        digit = '0';
+        while (value >= powers16[i]) {
+            value -= powers16[i];
+            digit++;
+        }
+        if (digit != '0' || length != 0) {
+            digits[length++] = digit;
+        }
+    }
+    digits[length++] = '0' + value;
+    return length;
+}
+
+static unsigned char decimal32(unsigned long value, char *digits) {
+    unsigned char length = 0;
+    unsigned char i;
+    char digit;
+
+    for (i = 0; i < sizeof(powers32) / sizeof(powers32[0]); i++) {
+        digit = '0';
+        while (value >= powers32[i]) {
+            value -= powers32[i];
+            digit++;
+        }
+        if (digit != '0' || length != 0) {
+            digits[length++] = digit;
+        }
+    }
+    digits[length++] = '0' + value;
+    return length;
+}
+
+void VexFmt_Begin(char *buffer) {
+    output = buffer;
+    written = 0;
+}
+
+int VexFmt_End(void) {
+    if (output) {
+        *output = '\0';
+    }
+    return written;
+}
+
+void VexFmt_Text(const rom char *text) {
+    while (*text != '\0') {
+        put(*text++);
+    }
+}
+
+void VexFmt_Char(char value, unsigned char width, unsigned char flags) {
+    emit(&value, 1, 0, width, flags & VEXFMT_LEFT);
+}
+
+void VexFmt_String(const char *value, unsigned char width, unsigned char flags) {
+    const char *end = value;
+
+    while (*end != '\0') {
+        end++;
+    }
+    emit(value, end - value, 0, width, flags & VEXFMT_LEFT);
+}
+
+void VexFmt_RomString(const rom char *value, unsigned char width, unsigned char flags) {
+    const rom char *end = value;
+    unsigned char padding;
+
+    while (*end != '\0') {
+        end++;
+    }
+    padding = width > end - value ? width - (end - value) : 0;
+    if (!(flags & VEXFMT_LEFT)) {
+        fill(' ', padding);
+    }
+    VexFmt_Text(value);
+    if (flags & VEXFMT_LEFT) {
+        fill(' ', padding);
+    }
+}
+
+void VexFmt_Signed16(short value, unsigned char width, unsigned char flags) {
+    char digits[5];
+
+    if (value < 0) {
+        emit(digits, decimal16(-(unsigned short)value, digits), '-', width, flags);
+    } else {
+        emit(digits, decimal16(value, digits), positiveSign(flags), width, flags);
+    }
+}
+
+void VexFmt_Unsigned16(unsigned short value, unsigned char width, unsigned char flags) {
+    char digits[5];
+
+    emit(digits, decimal16(value, digits), 0, width, flags);
+}
+
+void VexFmt_Hex16(unsigned short value, unsigned char width, unsigned char flags) {
+    rom const char *table = flags & VEXFMT_UPPER ? upperDigits : lowerDigits;
+    char digits[4];
+    unsigned char length = 0;
+    signed char shift;
+
+    for (shift = 12; shift >= 0; shift -= 4) {
+        if ((value >> shift) != 0 || length != 0 || shift == 0) {
+            digits[length++] = table[(value >> shift) & 0xF];
+        }
+    }
+    emit(digits, length, 0, width, flags);
+}
+
+void VexFmt_Signed32(long value, unsigned char width, unsigned char flags) {
+    char digits[10];
+
+    if (value < 0) {
+        emit(digits, decimal32(-(unsigned long)value, digits), '-', width, flags);
+    } else {
+        emit(digits, decimal32(value, digits), positiveSign(flags), width, flags);
+    }
+}
+
+void VexFmt_Unsigned32(unsigned long value, unsigned char width, unsigned char flags) {
+    char digits[10];
+
+    emit(digits, decimal32(value, digits), 0, width, flags);
+}
+
+void VexFmt_Hex32(unsigned long value, unsigned char width, unsigned char flags) {
+    rom const char *table = flags & VEXFMT_UPPER ? upperDigits : lowerDigits;
+    char digits[8];
+    unsigned char length = 0;
+    signed char shift;
+
+    for (shift = 28; shift >= 0; shift -= 4) {
+        if ((value >> shift) != 0 || length != 0 || shift == 0) {
+            digits[length++] = table[(value >> shift) & 0xF];
+        }
+    }
+    emit(digits, length, 0, width, flags);
+}
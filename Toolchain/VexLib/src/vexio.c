@@ -0,0 +1,58 @@
+/*
+ * Whole port I/O, see vexio.h.
+ *
+ * Digital ports 1-4 are RA0-RA3, port 5 is RA5, ports 6-12 are RF0-RF6 and
+ * ports 13-16 are RH4-RH7, the pins of analog inputs 1-16.
+ */
+#include <p18cxxx.h>
+#include "Api.h"
+#include "vexio.h"
+
+static unsigned char sent[VEXIO_PWM_PORTS];
+static unsigned char known;
+
+unsigned short VexIO_GetDigitalInputs(void) {
+#ifdef VEX_HOST
+    /* The host model keeps the inputs itself rather than in the ports */
+    unsigned short inputs = 0;
+    unsigned char port;
+
+    for (port = VEXIO_DIGITAL_PORTS; port >= 1; port--) {
+        inputs = inputs << 1 | (GetDigitalInput(port) != 0);
+    }
+    return inputs;
+#else
+    unsigned char enabled = INTCONbits.GIEH;
+    unsigned char a;
+    unsigned char f;
+    unsigned char h;
+
+    INTCONbits.GIEH = 0;
+    a = PORTA;
+    f = PORTF;
+    h = PORTH;
+    INTCONbits.GIEH = enabled;
+    return (a & 0x0F) | (a & 0x20) >> 1 | (unsigned short)(f & 0x7F) << 5 | (unsigned short)(h & 0xF0) << 8;
+#endif
+}
+
+void VexIO_SetPWMs(const unsigned char *values, unsigned char mask) {
+    unsigned char enabled = INTCONbits.GIEL;
+    unsigned char bit = 1;
+    unsigned char i;
+
+    INTCONbits.GIEL = 0;
+    for (i = 0; i < VEXIO_PWM_PORTS; i++) {
+        if ((mask & bit) && (!(known & bit) || sent[i] != values[i])) {
+            SetPWM(i + 1, values[i]);
+            sent[i] = values[i];
+        }
+        bit <<= 1;
+    }
+    known |= mask;
+    INTCONbits.GIEL = enabled;
+}
+
+void VexIO_ForgetPWMs(void) {
+    known = 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Tokenized logging, see vexlog.h.
+ */
+#include "bufserial.h"
+#include "vexlog.h"
+
+#define CHAR_STX 0x0F
+#define CHAR_ETX 0x04
+#define CHAR_ESC 0x05
+
+/* Every byte between the STXs and the ETX can be escaped */
+#define FRAME_SIZE (2 + 2 * (2 + VEXLOG_MAX_ARGUMENTS + 1) + 1)
+
+static unsigned char frame[FRAME_SIZE];
+static unsigned char length;
+static unsigned char checksum;
+static unsigned char logPort;
+static unsigned dropped;
+
+static void put(unsigned char value) {
+    if (value == CHAR_STX || value == CHAR_ETX || value == CHAR_ESC) {
+        frame[length++] = CHAR_ESC;
+    }
+    frame[length++] = value;
+}
+
+void VexLog_Open(unsigned char port, unsigned baudRate) {
+    BufSerial_Open(port, baudRate);
+    logPort = port;
+    dropped = 0;
+}
+
+unsigned VexLog_GetDropped(void) {
+    return dropped;
+}
+
+void VexLog_Begin(unsigned short format) {
+    frame[0] = CHAR_STX;
+    frame[1] = CHAR_STX;
+    length = 2;
+    checksum = 0;
+    VexLog_Put16(format);
+}
+
+void VexLog_Put8(unsigned char value) {
+    checksum -= value;
+    put(value);
+}
+
+void VexLog_Put16(unsigned short value) {
+    VexLog_Put8(value);
+    VexLog_Put8(value >> 8);
+}
+
+void VexLog_Put32(unsigned long value) {
+    VexLog_Put16(value);
+    VexLog_Put16(value >> 16);
+}
+
+void VexLog_End(void) {
+    put(checksum);
+    frame[length++] = CHAR_ETX;
+    if (!BufSerial_WriteFrame(logPort, frame, length)) {
+        dropped++;
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ * Quadrature encoders, see vexquad.h.
+ *
+ * The state of an encoder is its A level in bit 1 and its B level in bit 0.
+ * Going forward, A leads: 00, 10, 11, 01. The table is indexed by the old
+ * state and the new one, and MISSED marks the changes of both levels.
+ *
+ * The controller reads both levels from PORTB, where interrupt ports 1 and 2
+ * are RB2 and RB3 and ports 3-6 are RB4-RB7, so a missed edge on the other
+ * channel shows up as an error. The host model has no PORTB, so there the
+ * levels come from the handler's calls.
+ */
+#include <p18cxxx.h>
+#include "Api.h"
+#include "vexquad.h"
+
+#define PORTS 6
+#define MISSED 2
+#define NO_ENCODER 0xFF
+
+typedef struct {
+    unsigned char portA;
+    unsigned char portB;
+    unsigned char state;
+    volatile short hot;
+    volatile unsigned errors;
+    /* Widened by VexQuad_Get() */
+    short read;
+    long count;
+} Encoder;
+
+static rom const signed char transitions[16] = {
+    0, -1, 1, MISSED,
+    1, 0, MISSED, -1,
+    -1, MISSED, 0, 1,
+    MISSED, 1, -1, 0
+};
+
+static Encoder encoders[VEXQUAD_ENCODERS];
+static unsigned char encoderOf[PORTS + 1];
+
+#ifndef VEX_HOST
+static rom const unsigned char pins[PORTS + 1] = {0, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+#endif
+
+static void edge(unsigned char port, unsigned char value) {
+    Encoder *encoder = &encoders[encoderOf[port]];
+    unsigned char state;
+    signed char change;
+
+#ifdef VEX_HOST
+    state = port == encoder->portA ? (value << 1) | (encoder->state & 1) : (encoder->state & 2) | value;
+    value = port == encoder->portA ? state >> 1 : state & 1;
+#else
+    unsigned char levels = PORTB;
+
+    state = ((levels & pins[encoder->portA]) ? 2 : 0) | ((levels & pins[encoder->portB]) ? 1 : 0);
+    value = (levels & pins[port]) != 0;
+#endif
+    /* Catch the next edge, whichever way it goes */
+    SetInterruptEdge(port, value ? FALLING_EDGE : RISING_EDGE);
+
+    change = transitions[encoder->state << 2 | state];
+    if (change == MISSED) {
+        encoder->errors++;
+    } else {
+        encoder->hot += change;
+    }
+    encoder->state = state;
+}
+
+static unsigned char validEncoder(unsigned char encoder) {
+    return encoder < VEXQUAD_ENCODERS && encoders[encoder].portA != 0;
+}
+
+/* Whether another encoder decodes a port */
+static unsigned char portTaken(unsigned char port, unsigned char encoder) {
+    unsigned char i;
+
+    for (i = 0; i < VEXQUAD_ENCODERS; i++) {
+        if (i != encoder && (encoders[i].portA == port || encoders[i].portB == port)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void VexQuad_Start(unsigned char encoder, unsigned char portA, unsigned char portB, unsigned char invert) {
+    Encoder *e;
+    unsigned char swap;
+
+    if (encoder >= VEXQUAD_ENCODERS || portA < 1 || portA > PORTS || portB < 1 || portB > PORTS || portA == portB ||
+        portTaken(portA, encoder) || portTaken(portB, encoder)) {
+        return;
+    }
+    VexQuad_Stop(encoder);
+    e = &encoders[encoder];
+    /* Swapping the channels counts the other way */
+    if (invert) {
+        swap = portA;
+        portA = portB;
+        portB = swap;
+    }
+    e->portA = portA;
+    e->portB = portB;
+    e->hot = e->read = 0;
+    e->count = 0;
+    e->errors = 0;
+#ifdef VEX_HOST
+    e->state = 0;
+#else
+    e->state = ((PORTB & pins[portA]) ? 2 : 0) | ((PORTB & pins[portB]) ? 1 : 0);
+#endif
+    encoderOf[portA] = encoderOf[portB] = encoder;
+    RegisterInterruptHandler(portA, (e->state & 2) ? FALLING_EDGE : RISING_EDGE, edge);
+    RegisterInterruptHandler(portB, (e->state & 1) ? FALLING_EDGE : RISING_EDGE, edge);
+}
+
+void VexQuad_Stop(unsigned char encoder) {
+    Encoder *e;
+
+    if (!validEncoder(encoder)) {
+        return;
+    }
+    e = &encoders[encoder];
+    UnRegisterInterruptHandler(e->portA);
+    UnRegisterInterruptHandler(e->portB);
+    encoderOf[e->portA] = encoderOf[e->portB] = NO_ENCODER;
+    e->portA = e->portB = 0;
+}
+
+long VexQuad_Get(unsigned char encoder) {
+    Encoder *e;
+    unsigned char enabled = INTCONbits.GIEH;
+    short hot;
+
+    if (!validEncoder(encoder)) {
+        return 0;
+    }
+    e = &encoders[encoder];
+    INTCONbits.GIEH = 0;
+    hot = e->hot;
+    INTCONbits.GIEH = enabled;
+    e->count += (short)(hot - e->read);
+    e->read = hot;
+    return e->count;
+}
+
+void VexQuad_Set(unsigned char encoder, long count) {
+    Encoder *e;
+    unsigned char enabled = INTCONbits.GIEH;
+
+    if (!validEncoder(encoder)) {
+        return;
+    }
+    e = &encoders[encoder];
+    INTCONbits.GIEH = 0;
+    e->read = e->hot;
+    INTCONbits.GIEH = enabled;
+    e->count = count;
+}
+
+unsigned VexQuad_GetErrors(unsigned char encoder) {
+    Encoder *e;
+    unsigned char enabled = INTCONbits.GIEH;
+    unsigned errors;
+
+    if (!validEncoder(encoder)) {
+        return 0;
+    }
+    e = &encoders[encoder];
+    INTCONbits.GIEH = 0;
+    errors = e->errors;
+    INTCONbits.GIEH = enabled;
+    return errors;
+}
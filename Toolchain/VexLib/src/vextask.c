@@ -0,0 +1,152 @@
+/*
+ * Cooperative tasks, see vextask.h.
+ *
+ * Ready tasks wait on a list for each priority, in the order they became
+ * ready, and sleeping tasks on one more list, which each pass checks for
+ * tasks that are due. A task is only ever on one list, so it carries its own
+ * link.
+ */
+#include "Api.h"
+#include "vextask.h"
+
+typedef struct {
+    VexTask *head;
+    VexTask *tail;
+} List;
+
+static const rom VexTask_Entry *entries;
+static VexTask *states;
+static unsigned char taskCount;
+static List ready[VEXTASK_PRIORITIES];
+static List sleeping;
+
+static void append(List *list, VexTask *task) {
+    task->next = 0;
+    if (list->tail) {
+        list->tail->next = task;
+    } else {
+        list->head = task;
+    }
+    list->tail = task;
+}
+
+static void makeReady(VexTask *task) {
+    unsigned char priority = entries[task->id].priority;
+
+    append(&ready[priority < VEXTASK_PRIORITIES ? priority : VEXTASK_PRIORITIES - 1], task);
+}
+
+/* Move the sleeping tasks that are due to their ready lists */
+static void wake(void) {
+    unsigned long nowMs = GetMsClock();
+    VexTask *task = sleeping.head;
+    VexTask *previous = 0;
+    VexTask *next;
+
+    while (task) {
+        next = task->next;
+        if ((long)(nowMs - task->wakeMs) >= 0) {
+            if (previous) {
+                previous->next = next;
+            } else {
+                sleeping.head = next;
+            }
+            if (sleeping.tail == task) {
+                sleeping.tail = previous;
+            }
+            makeReady(task);
+        } else {
+            previous = task;
+        }
+        task = next;
+    }
+}
+
+static void runTask(VexTask *task) {
+    const rom VexTask_Entry *entry = &entries[task->id];
+    unsigned long start = GetUsClock();
+    unsigned long elapsed;
+    unsigned long nowMs;
+    char result;
+
+    result = entry->function(task);
+    elapsed = GetUsClock() - start;
+    task->runUs += elapsed;
+    task->calls++;
+    if (elapsed > task->worstUs) {
+        task->worstUs = elapsed > 0xFFFF ? 0xFFFF : (unsigned short)elapsed;
+    }
+    if (entry->budgetUs != 0 && elapsed > entry->budgetUs) {
+        task->overruns++;
+    }
+
+    if (result == VEXTASK_SLEEPING) {
+        append(&sleeping, task);
+    } else if (result == VEXTASK_ENDED && entry->periodMs != 0) {
+        /* Released a period after the last release, or now if that has passed */
+        task->releaseMs += entry->periodMs;
+        nowMs = GetMsClock();
+        if ((long)(nowMs - task->releaseMs) > 0) {
+            task->misses++;
+            task->releaseMs = nowMs;
+        }
+        task->wakeMs = task->releaseMs;
+        append(&sleeping, task);
+    } else {
+        makeReady(task);
+    }
+}
+
+void VexTask_Init(const rom VexTask_Entry *table, VexTask *tasks, unsigned char count) {
+    unsigned long nowMs = GetMsClock();
+    unsigned char i;
+    VexTask *task;
+
+    entries = table;
+    states = tasks;
+    taskCount = count < VEXTASK_MAX_TASKS ? count : VEXTASK_MAX_TASKS;
+    for (i = 0; i < VEXTASK_PRIORITIES; i++) {
+        ready[i].head = ready[i].tail = 0;
+    }
+    sleeping.head = sleeping.tail = 0;
+    for (i = 0; i < taskCount; i++) {
+        task = &tasks[i];
+        task->resume = 0;
+        task->wakeMs = task->releaseMs = nowMs;
+        task->id = i;
+        task->runUs = 0;
+        task->worstUs = task->calls = task->overruns = task->misses = 0;
+        makeReady(task);
+    }
+}
+
+unsigned char VexTask_Step(void) {
+    unsigned char ran = 0;
+    unsigned char priority;
+    VexTask *task;
+    VexTask *next;
+
+    wake();
+    for (priority = 0; priority < VEXTASK_PRIORITIES; priority++) {
+        /* Tasks that are ready again go on the list for the next pass */
+        task = ready[priority].head;
+        ready[priority].head = ready[priority].tail = 0;
+        while (task) {
+            next = task->next;
+            runTask(task);
+            ran++;
+            task = next;
+        }
+    }
+    return ran;
+}
+
+void VexTask_Run(void) {
+    for (;;) {
+        VexTask_Step();
+    }
+}
+
+VexTask *VexTask_Get(unsigned char id) {
+    return id < taskCount ? &states[id] : 0;
+}
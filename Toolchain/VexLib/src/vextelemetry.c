@@ -0,0 +1,78 @@
+/*
+ * Telemetry channels, see vextelemetry.h.
+ *
+ * Frames are only built in the timer, so they have a buffer of their own
+ * and never share one with VexLog().
+ */
+#include "bufserial.h"
+#include "vextelemetry.h"
+
+#define CHAR_STX 0x0F
+#define CHAR_ETX 0x04
+#define CHAR_ESC 0x05
+
+/* Every byte between the STXs and the ETX can be escaped, but the format */
+#define FRAME_SIZE (2 + 2 + 2 * (2 + VEXTELEMETRY_MAX_SAMPLES + 1) + 1)
+
+/* BufSerial_WriteFrame() never queues a frame bigger than the ring */
+#if FRAME_SIZE > BUFSERIAL_TX_SIZE
+#error "VEXTELEMETRY_MAX_SAMPLES is too large for the transmit ring"
+#endif
+
+static unsigned char frame[FRAME_SIZE];
+static unsigned char length;
+static unsigned char checksum;
+static unsigned char telemetryPort;
+static unsigned short sample;
+static unsigned dropped;
+
+static void put(unsigned char value) {
+    if (value == CHAR_STX || value == CHAR_ETX || value == CHAR_ESC) {
+        frame[length++] = CHAR_ESC;
+    }
+    frame[length++] = value;
+}
+
+void VexTelemetry_Open(unsigned char port, unsigned baudRate) {
+    BufSerial_Open(port, baudRate);
+    telemetryPort = port;
+    sample = 0;
+    dropped = 0;
+}
+
+unsigned VexTelemetry_GetDropped(void) {
+    return dropped;
+}
+
+unsigned short VexTelemetry_Begin(void) {
+    frame[0] = CHAR_STX;
+    frame[1] = CHAR_STX;
+    length = 2;
+    checksum = 0;
+    VexTelemetry_Put16(VEXTELEMETRY_FORMAT);
+    VexTelemetry_Put16(sample);
+    return sample++;
+}
+
+void VexTelemetry_Put8(unsigned char value) {
+    checksum -= value;
+    put(value);
+}
+
+void VexTelemetry_Put16(unsigned short value) {
+    VexTelemetry_Put8(value);
+    VexTelemetry_Put8(value >> 8);
+}
+
+void VexTelemetry_Put32(unsigned long value) {
+    VexTelemetry_Put16(value);
+    VexTelemetry_Put16(value >> 16);
+}
+
+void VexTelemetry_End(void) {
+    put(checksum);
+    frame[length++] = CHAR_ETX;
+    if (!BufSerial_WriteFrame(telemetryPort, frame, length)) {
+        dropped++;
+    }
+}
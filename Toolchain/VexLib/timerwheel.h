@@ -0,0 +1,63 @@
+/*
+ * A hashed timer wheel, for programs with many periodic tasks. Each timer
+ * registered with RegisterRepeatingTimer() or RegisterSingleTimer() is
+ * checked on every tick of the Vex library, so ticks get slower as timers
+ * are added. Here timers hang off one of TIMERWHEEL_SLOTS lists, by the
+ * tick they are due on, so adding and cancelling a timer take the same time
+ * however many there are, and a tick only looks at the timers of its slot.
+ *
+ * The wheel turns once a millisecond, on one repeating timer registered by
+ * TimerWheel_Start(), since the Vex and easyC libraries own the interrupt
+ * vectors. A program with an interrupt of its own, such as Timer0 set up
+ * with OpenTimer0() from timers.h, can call TimerWheel_Tick() from it
+ * instead.
+ *
+ * In TIMERWHEEL_IN_INTERRUPT mode the tick walks its slot and runs the
+ * handlers that are due, like timers of the Vex library do, so it still
+ * takes longer the more timers share the slot and the more are due. Only in
+ * TIMERWHEEL_COOPERATIVE mode does a tick take the same time however many
+ * timers there are: it only moves its slot onto a pending list, and
+ * TimerWheel_Dispatch() walks it and runs the handlers that are due from
+ * the program's loop, with interrupts on.
+ *
+ * The program owns the timers, which start out zeroed, so nothing is
+ * allocated. Delays are in milliseconds, 1 to TIMERWHEEL_MAX_DELAY.
+ */
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#define TIMERWHEEL_SLOTS 16
+#define TIMERWHEEL_MAX_DELAY 32767
+
+/* Where the handlers run */
+#define TIMERWHEEL_IN_INTERRUPT 0x00
+#define TIMERWHEEL_COOPERATIVE 0x01
+/* Added to the mode when the program calls TimerWheel_Tick() itself */
+#define TIMERWHEEL_OWN_TICK 0x02
+
+typedef struct TimerWheel_Timer {
+    /* A timer is active while it is on a list */
+    struct TimerWheel_Timer *next;
+    struct TimerWheel_Timer *previous;
+    unsigned short due;
+    unsigned short period;
+    void (*handler)(void);
+} TimerWheel_Timer;
+
+/* Start turning the wheel once a millisecond, before adding timers */
+void TimerWheel_Start(unsigned char mode);
+/* Turn the wheel by one tick, from an interrupt */
+void TimerWheel_Tick(void);
+/* Run the handlers that are due, in TIMERWHEEL_COOPERATIVE mode */
+void TimerWheel_Dispatch(void);
+
+/* Run handler once after delay, or every period, replacing what timer was doing */
+void TimerWheel_Single(TimerWheel_Timer *timer, unsigned short delay, void (*handler)(void));
+void TimerWheel_Repeating(TimerWheel_Timer *timer, unsigned short period, void (*handler)(void));
+void TimerWheel_Cancel(TimerWheel_Timer *timer);
+unsigned char TimerWheel_IsActive(const TimerWheel_Timer *timer);
+
+/* Ticks since the wheel started, wrapping at 16 bits */
+unsigned short TimerWheel_GetTicks(void);
+
+#endif /* TIMERWHEEL_H_ */
@@ -0,0 +1,62 @@
+/*
+ * Background sampling of the analog inputs. GetAnalogInput() starts a
+ * conversion and waits for it every time it is called, so reading eight
+ * potentiometers and a gyro each loop spends most of the loop waiting on the
+ * A/D converter. Here an interrupt converts the inputs one after the other
+ * and the program reads the last results from memory.
+ *
+ * The interrupt is a 1 ms repeating timer, registered by VexAdc_Start(),
+ * since the Vex and easyC libraries own the interrupt vectors, including the
+ * A/D converter's. Each tick takes the result of the conversion the last
+ * tick started, which is long done, and starts the next, so nothing waits on
+ * the converter. A channel gets 2^shift conversions in a row, set with
+ * VexAdc_SetOversampling(), which are averaged into its result, and a tick
+ * goes to selecting the channel after it, so the 8520's converter has the
+ * time it needs to acquire a new input. A pass over n channels with no
+ * oversampling takes 2n ms.
+ *
+ * The results are double buffered: the interrupt fills one set while the
+ * program reads the other, and they swap at the end of each pass, so each
+ * set holds the results of one pass. VexAdc_Get() and VEXADC_GET() look up
+ * the front set on every read, so two reads can fall either side of a swap
+ * and mix passes. VexAdc_Results() takes the front set once, and the ports
+ * read from it come from the same pass. The interrupt only writes a set a
+ * tick after the swap, so reads from it that take less than a millisecond
+ * never see half of an update, with the interrupts left on.
+ *
+ * The converter is the sampler's while it runs: GetAnalogInput(), the gyro
+ * and anything else of the Vex library that converts can't be used until
+ * VexAdc_Stop().
+ */
+#ifndef VEXADC_H_
+#define VEXADC_H_
+
+#define VEXADC_CHANNELS 16
+/* 64 conversions of 10 bits sum to 16 bits */
+#define VEXADC_MAX_SHIFT 6
+
+/* Sample analog ports 1 to channels, the number given to DefineControllerIO() */
+void VexAdc_Start(unsigned char channels);
+void VexAdc_Stop(void);
+
+/* Average 2^shift conversions into each result of a port, before VexAdc_Start() */
+void VexAdc_SetOversampling(unsigned char port, unsigned char shift);
+
+/* The last result of a port, 0-1023, 0 until the first pass is done */
+unsigned short VexAdc_Get(unsigned char port);
+/* The same without the call or the check of the port */
+#define VEXADC_GET(port) (vexAdcResults[vexAdcFront][(port) - 1])
+
+/* The results of the last pass, port 1 first, to read within a millisecond */
+const volatile unsigned short *VexAdc_Results(void);
+
+/* Passes finished since VexAdc_Start() */
+unsigned short VexAdc_GetPasses(void);
+
+/* The interrupt's work, for a program that wants to run it from elsewhere */
+void VexAdc_Service(void);
+
+extern volatile unsigned short vexAdcResults[2][VEXADC_CHANNELS];
+extern volatile unsigned char vexAdcFront;
+
+#endif /* VEXADC_H_ */
@@ -0,0 +1,39 @@
+/*
+ * The conversions of printf(), one function each, for the formatters
+ * vexbuild --specialize-printf generates in place of printf(), sprintf() and
+ * PrintToScreen() calls with a literal format. Nothing is parsed at run
+ * time, and the 16 bit conversions never use 32 bit arithmetic.
+ *
+ * A formatter calls VexFmt_Begin(), the conversions of its format in order,
+ * then VexFmt_End(). The output goes to stdout, or a buffer for sprintf(),
+ * so formatters must not be used from interrupts while the program uses
+ * them too.
+ */
+#ifndef VEXFMT_H_
+#define VEXFMT_H_
+
+/* Flags of the conversions */
+#define VEXFMT_LEFT 0x01
+#define VEXFMT_ZERO 0x02
+#define VEXFMT_UPPER 0x04
+#define VEXFMT_PLUS 0x08
+#define VEXFMT_SPACE 0x10
+
+/* Write to buffer, or stdout when it is 0 */
+void VexFmt_Begin(char *buffer);
+/* Terminate the buffer, returning how many characters were written */
+int VexFmt_End(void);
+
+void VexFmt_Text(const rom char *text);
+void VexFmt_Char(char value, unsigned char width, unsigned char flags);
+void VexFmt_String(const char *value, unsigned char width, unsigned char flags);
+void VexFmt_RomString(const rom char *value, unsigned char width, unsigned char flags);
+
+void VexFmt_Signed16(short value, unsigned char width, unsigned char flags);
+void VexFmt_Unsigned16(unsigned short value, unsigned char width, unsigned char flags);
+void VexFmt_Hex16(unsigned short value, unsigned char width, unsigned char flags);
+void VexFmt_Signed32(long value, unsigned char width, unsigned char flags);
+void VexFmt_Unsigned32(unsigned long value, unsigned char width, unsigned char flags);
+void VexFmt_Hex32(unsigned long value, unsigned char width, unsigned char flags);
+
+#endif /* VEXFMT_H_ */
@@ -0,0 +1,33 @@
+/*
+ * Digital inputs and motors a whole set at a time. GetDigitalInput() and
+ * SetPWM() take a call, a range check and a bank switch for every port, so a
+ * loop that reads 16 switches and drives 8 motors spends most of that on
+ * overhead.
+ *
+ * VexIO_GetDigitalInputs() reads PORTA, PORTF and PORTH back to back, with
+ * interrupts held off for the three reads, and returns the 16 digital ports
+ * as one snapshot, port 1 in bit 0. Ports set up as outputs read back what
+ * they drive, and ports set up as analog inputs read as 0. The digital ports
+ * are the user processor's own pins, so the snapshot is as new as the call.
+ *
+ * VexIO_SetPWMs() sets the ports in mask, port 1 in bit 0, from values[0] to
+ * values[7]. The motor values only go to the master processor with each
+ * 18.5 ms packet, so the ports are all set with the library's timers held
+ * off, and no packet built in them carries half of an update. Ports whose
+ * value hasn't changed since the last call are skipped, which is what makes
+ * most calls cheap. That means ports set by VexIO_SetPWMs() shouldn't be set
+ * any other way, or VexIO_ForgetPWMs() has to be called after.
+ */
+#ifndef VEXIO_H_
+#define VEXIO_H_
+
+#define VEXIO_DIGITAL_PORTS 16
+#define VEXIO_PWM_PORTS 8
+
+unsigned short VexIO_GetDigitalInputs(void);
+
+void VexIO_SetPWMs(const unsigned char *values, unsigned char mask);
+/* Set every port on the next VexIO_SetPWMs() */
+void VexIO_ForgetPWMs(void);
+
+#endif /* VEXIO_H_ */
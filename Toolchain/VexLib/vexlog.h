@@ -0,0 +1,42 @@
+/*
+ * Tokenized logging. VexLog() takes a literal format and arguments like
+ * printf(), but vexbuild rewrites each call into a call of a function
+ * generated for its format, which sends a record of the format's number and
+ * the raw bytes of the arguments. The text never leaves the build: vexupload
+ * --monitor expands the records with the table vexbuild writes to
+ * build/vexlog/formats.json, and timestamps them.
+ *
+ * A record is framed like the bootloader's packets: two STX (0x0F) bytes,
+ * the format number and the arguments, little endian, then a checksum that
+ * makes the bytes add up to 0, with STX, ETX and ESC (0x05) escaped by an
+ * ESC, and an ETX (0x04). Formats can have %d, %i, %u, %x, %X, their l
+ * versions and %c, with flags and widths, and VEXLOG_MAX_ARGUMENTS bytes of
+ * arguments.
+ *
+ * Records go out through the buffered serial port VexLog_Open() opens, whole
+ * or not at all: a record that does not fit is dropped and counted. The
+ * record is built in one buffer, so VexLog() must not be used from
+ * interrupts while the program uses it too.
+ */
+#ifndef VEXLOG_H_
+#define VEXLOG_H_
+
+#define VEXLOG_MAX_ARGUMENTS 16
+
+/* Never defined, every call is rewritten by vexbuild */
+void VexLog(const rom char *format, ...);
+
+/* Send the records on port 1 or 2, opening it with a baud rate constant of Api.h */
+void VexLog_Open(unsigned char port, unsigned baudRate);
+
+/* Records dropped because the port's ring was full */
+unsigned VexLog_GetDropped(void);
+
+/* Used by the generated functions */
+void VexLog_Begin(unsigned short format);
+void VexLog_Put8(unsigned char value);
+void VexLog_Put16(unsigned short value);
+void VexLog_Put32(unsigned long value);
+void VexLog_End(void);
+
+#endif /* VEXLOG_H_ */
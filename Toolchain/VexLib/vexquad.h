@@ -0,0 +1,33 @@
+/*
+ * Quadrature encoders on the interrupt ports, decoded on every edge of both
+ * channels. GetQuadEncoder() keeps a long for each encoder, updated in the
+ * library's interrupt, so two fast drive encoders keep the interrupt busy
+ * with 32 bit arithmetic and start to lose counts.
+ *
+ * Here both channels are interrupt ports (1-6), and each edge looks the
+ * change in their levels up in a 16 entry table, counting +1, -1, or an
+ * error when an edge was missed and both levels changed. The interrupt only
+ * adds to a 16 bit count. VexQuad_Get() widens it into the 32 bit count,
+ * taking the 16 bit count with interrupts held off, so it has to be called
+ * at least every 32767 counts, and only from the program, not a timer.
+ *
+ * The library calls handlers on one edge of a port, so the handler turns
+ * the edge around each time. An encoder counts 4 times for each of its
+ * lines, where GetQuadEncoder() counts once.
+ */
+#ifndef VEXQUAD_H_
+#define VEXQUAD_H_
+
+#define VEXQUAD_ENCODERS 3
+
+/* Decode an encoder (0-2) on two interrupt ports no other encoder has, counting the other way if invert is set */
+void VexQuad_Start(unsigned char encoder, unsigned char portA, unsigned char portB, unsigned char invert);
+void VexQuad_Stop(unsigned char encoder);
+
+long VexQuad_Get(unsigned char encoder);
+void VexQuad_Set(unsigned char encoder, long count);
+
+/* Edges where both channels had changed, so a count was lost */
+unsigned VexQuad_GetErrors(unsigned char encoder);
+
+#endif /* VEXQUAD_H_ */
@@ -0,0 +1,109 @@
+/*
+ * Cooperative tasks, for breaking the main loop into subsystems that can't
+ * hold each other up. A task is a protothread: a function that runs until it
+ * has to wait, returns, and carries on from where it returned the next time
+ * it is called, with no stack of its own:
+ *
+ *     char Arm_Task(VexTask *task) {
+ *         VexTask_Begin(task);
+ *         for (;;) {
+ *             SetPWM(ARM_MOTOR, 200);
+ *             VexTask_WaitUntil(task, GetDigitalInput(ARM_LIMIT) == 0);
+ *             SetPWM(ARM_MOTOR, 127);
+ *             VexTask_Sleep(task, 500);
+ *         }
+ *         VexTask_End(task);
+ *     }
+ *
+ * Local variables don't keep their values across a wait, so tasks keep their
+ * state in statics, and the wait macros can't be used inside a switch.
+ *
+ * The tasks are declared in the project's tasks.cfg, in priority order, and
+ * vexbuild generates a table of them in program memory, so nothing is
+ * allocated:
+ *
+ *     task Drive_Task 0 10 2000    # function, priority, period ms, budget us
+ *     task Arm_Task 1              # runs on every pass
+ *
+ * VexTask_Step() makes one pass over the tasks that are ready, highest
+ * priority (0) first, and VexTask_Run() makes passes forever. A task with a
+ * period is released again a period after its last release when it ends,
+ * and it has missed its deadline if it ends after the next release. A call
+ * that takes longer than the task's budget is an overrun. Both are counted,
+ * with the time each task runs, timed with GetUsClock().
+ */
+#ifndef VEXTASK_H_
+#define VEXTASK_H_
+
+/* For GetMsClock() in VexTask_Sleep() */
+#include "Api.h"
+
+#define VEXTASK_PRIORITIES 4
+/* As many as fit in a data bank, since the generated array is one section */
+#define VEXTASK_MAX_TASKS 10
+
+/* What a task returns */
+#define VEXTASK_WAITING 0
+#define VEXTASK_YIELDED 1
+#define VEXTASK_SLEEPING 2
+#define VEXTASK_ENDED 3
+
+typedef struct VexTask {
+    /* The line the task carries on from, 0 at its start */
+    unsigned short resume;
+    unsigned long wakeMs;
+    unsigned long releaseMs;
+    struct VexTask *next;
+    unsigned char id;
+
+    /* Run time accounting */
+    unsigned long runUs;
+    unsigned short worstUs;
+    unsigned short calls;
+    unsigned short overruns;
+    unsigned short misses;
+} VexTask;
+
+typedef char (*VexTask_Function)(VexTask *task);
+
+/* An entry of the table generated from tasks.cfg */
+typedef struct {
+    VexTask_Function function;
+    unsigned char priority;
+    unsigned short periodMs;
+    unsigned short budgetUs;
+} VexTask_Entry;
+
+#define VexTask_Begin(task) switch ((task)->resume) { case 0:
+
+#define VexTask_Yield(task) \
+    do { (task)->resume = __LINE__; return VEXTASK_YIELDED; case __LINE__:; } while (0)
+
+#define VexTask_WaitUntil(task, condition) \
+    do { (task)->resume = __LINE__; case __LINE__: if (!(condition)) return VEXTASK_WAITING; } while (0)
+
+/* The scheduler doesn't call a sleeping task until it is due */
+#define VexTask_Sleep(task, ms) \
+    do { \
+        (task)->wakeMs = GetMsClock() + (ms); \
+        (task)->resume = __LINE__; \
+        return VEXTASK_SLEEPING; \
+        case __LINE__:; \
+    } while (0)
+
+#define VexTask_End(task) } (task)->resume = 0; return VEXTASK_ENDED
+
+/* Generated from tasks.cfg: set up the tasks, all ready */
+void VexTask_Start(void);
+
+/* Run each ready task once, returns how many ran */
+unsigned char VexTask_Step(void);
+void VexTask_Run(void);
+
+/* A task's state and accounting, by its place in tasks.cfg */
+VexTask *VexTask_Get(unsigned char id);
+
+/* Used by the generated code */
+void VexTask_Init(const rom VexTask_Entry *table, VexTask *tasks, unsigned char count);
+
+#endif /* VEXTASK_H_ */
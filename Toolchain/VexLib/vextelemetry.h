@@ -0,0 +1,45 @@
+/*
+ * Telemetry channels. The variables a program wants to watch are declared in
+ * the project's telemetry.cfg, each with a type and a divider:
+ *
+ *     period 10                            # ms between samples
+ *     channel left_ticks leftTicks long    # every sample
+ *     channel gyro gyroAngle int 2         # every 2nd sample
+ *     channel left_pwm leftPwm uchar 4     # every 4th sample
+ *
+ * vexbuild generates VexTelemetry_Start() and VexTelemetry_Stop() from it,
+ * with a repeating timer that reads the channels that are due and sends
+ * them as one frame. Which channels a frame has follows from its sample
+ * number, since the dividers are powers of two, so frames only carry the
+ * number and the values. The host gets the layout from the table vexbuild
+ * writes to build/telemetry/layout.json, and vexupload --telemetry decodes,
+ * records and plots the frames.
+ *
+ * Frames are framed like VexLog() records (see vexlog.h), with the format
+ * number VEXTELEMETRY_FORMAT, and go out through the buffered serial port
+ * VexTelemetry_Start() opens. A frame that does not fit in the port's ring
+ * is dropped and counted, and its sample number is skipped.
+ */
+#ifndef VEXTELEMETRY_H_
+#define VEXTELEMETRY_H_
+
+#define VEXTELEMETRY_FORMAT 0xFFFF
+/* The most sample bytes whose frame fits in BufSerial's ring however many of its bytes escape */
+#define VEXTELEMETRY_MAX_SAMPLES 26
+
+/* Generated from telemetry.cfg: send on port 1 or 2, opening it with a baud rate constant of Api.h */
+void VexTelemetry_Start(unsigned char port, unsigned baudRate);
+void VexTelemetry_Stop(void);
+
+/* Frames dropped because the port's ring was full */
+unsigned VexTelemetry_GetDropped(void);
+
+/* Used by the generated code. VexTelemetry_Begin() returns the sample number. */
+void VexTelemetry_Open(unsigned char port, unsigned baudRate);
+unsigned short VexTelemetry_Begin(void);
+void VexTelemetry_Put8(unsigned char value);
+void VexTelemetry_Put16(unsigned short value);
+void VexTelemetry_Put32(unsigned long value);
+void VexTelemetry_End(void);
+
+#endif /* VEXTELEMETRY_H_ */
@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import collections
 import json
 import os
 from pathlib import Path
@@ -13,13 +14,20 @@ from warnings import warn
 
 from serial.serialutil import SerialException
 
+import vexlog
+import vexprintf
+import vexsim
+import vexstack
+import vextask
+import vextelemetry
 import vexupload
+import vexwcet
 
 
 script_path = Path(os.path.realpath(__file__))
 include_regex = re.compile('\s*\#include\s+["<]([^">]+)*[">]')
 
-def build():
+def build(pipeline=None):
     global project_dir
     global toolchain_dir
     
@@ -55,9 +63,16 @@ def build():
         debug("Creating build directory.")
         build_dir.mkdir()
     
-    # Modification time cache file
+    # Modification time cache file. Host builds keep their objects, and the
+    # sources they were built from, apart from controller builds.
     global modification_times_file
-    modification_times_file = build_dir / "modification_times.cache"
+    if host_build:
+        global host_dir
+        host_dir = build_dir / ("host-coverage" if host_coverage else "host")
+        host_dir.mkdir(exist_ok=True)
+        modification_times_file = host_dir / "modification_times.cache"
+    else:
+        modification_times_file = build_dir / "modification_times.cache"
     
     # Read the cached modification times from the file
     read_modification_times()
@@ -80,17 +95,68 @@ def build():
     modified_dependencies()
         
     modified_files = [f for f in modified_files if f.suffix == ".c"]
+    
+    # Turning --specialize-printf on or off rebuilds everything
+    if specialize_printf_enabled != printf_dir().exists():
+        if specialize_printf_enabled:
+            printf_dir().mkdir()
+        else:
+            shutil.rmtree(str(printf_dir()))
+        modified_files = sorted(source_files)
+    
+    # VexLog() formats keep their numbers from build to build
+    global log_table
+    log_dir().mkdir(exist_ok=True)
+    log_table = vexlog.FormatTable(log_dir() / "formats.json")
+    log_table.keep_files({f.name for f in source_files})
+    log_table.write()
+    
+    generated_removed = any([generate_telemetry(), generate_tasks()])
+    
+    if host_build:
+        build_host()
+        write_modification_times()
+        return None
+    
+    # Objects built with one stack model are all rebuilt when it changes
+    global small_stack
+    global unproven_usage
+    small_stack, unproven_usage = read_stack_model()
+    if small_stack and not small_stack_enabled:
+        info("Rebuilding with the large stack model...")
+        small_stack = False
+        modified_files = sorted(source_files)
+    
+    global vexlib
+    vexlib, vexlib_rebuilt = build_library()
+    generated_rebuilt = build_generated() or generated_removed
+    
+    # Erase the controller while the compiler runs
+    if pipeline != None and len(modified_files) != 0:
+        pipeline.erase(predict_dirty_rows())
 
     for f in modified_files:
         compile(f)
-            
     if len(modified_files) != 0:
-        link([build_dir / (f.stem + ".o") for f in source_files])
+        report_log_formats()
+    
+    image = None
+    if len(modified_files) != 0 or vexlib_rebuilt or generated_rebuilt:
+        # Link in a fixed order, so the layout only changes when the code does
+        image = link(object_files(build_dir))
+        if small_stack_enabled:
+            image = choose_stack_model(image)
+        check_cycle_budgets(image)
+        if specialize_printf_enabled:
+            report_printf_specialization(image)
         
         
     # Write the updated modification times to the cache (only if build was
     # successful).
     write_modification_times()
+    write_stack_model()
+    
+    return image
 
 def parse_args():
     import argparse
@@ -104,8 +170,20 @@ def parse_args():
                         default=Path(os.getenv("VEX_TOOLCHAIN_HOME", default_toolchain_dir)))
     
     parser.add_argument("--copy-launcher", help="copy the python launcher for Eclipse", action="store_true")
+    parser.add_argument("--stable-layout", help="keep unchanged code and data at the addresses of the last build",
+                        action="store_true")
+    parser.add_argument("--small-stack", help="build with the small stack model when the stack is proven to fit in its bank",
+                        action="store_true")
+    parser.add_argument("--specialize-printf", help="compile printf calls with literal formats into generated formatters",
+                        action="store_true")
+    parser.add_argument("--host", help="build for the computer running vexbuild and run the project's tests",
+                        action="store_true")
+    parser.add_argument("--coverage", help="measure the test coverage of a host build", action="store_true")
+    parser.add_argument("--cc", help="compiler for host builds", default=os.getenv("CC", "gcc"))
     parser.add_argument("--upload", help="try to upload to the Vex controller", action="store_true")
-    parser.add_argument("--dev", help="serial device to use for uploading", default=None)
+    parser.add_argument("--dev", help="serial device to use for uploading, repeat it to upload to several at once",
+                        action="append", default=None)
+    parser.add_argument("--all", help="upload to every Vex programming module that is plugged in", action="store_true")
     
     args = parser.parse_args()
     
@@ -114,13 +192,30 @@ def parse_args():
     global enable_copy_launcher
     global upload_enabled
     global upload_device
+    global stable_layout
+    global small_stack_enabled
+    global specialize_printf_enabled
+    global host_build
+    global host_coverage
+    global host_cc
     global toolchain_dir
     debug_enabled = args.debug
     project_dir = Path(args.project_dir)
     enable_copy_launcher = args.copy_launcher
     upload_enabled = args.upload
+    stable_layout = args.stable_layout
+    small_stack_enabled = args.small_stack
+    specialize_printf_enabled = args.specialize_printf
+    host_build = args.host
+    host_coverage = args.coverage
+    host_cc = args.cc
     upload_device = args.dev
-    toolchain_dir = args.toolchain
+    if args.all:
+        upload_device = vexupload.find_serial_ports()
+        if args.upload and not upload_device:
+            print("Error: No Vex programming modules found", flush=True, file=sys.stderr)
+            exit(1)
+    toolchain_dir = Path(args.toolchain)
 
 def setup_toolchain():
     global mcc18
@@ -130,14 +225,20 @@ def setup_toolchain():
     c18_dir = toolchain_dir / "mcc18"
     c18_bin_dir = c18_dir / "bin"
     
+    # Host builds only use the headers
     mcc18 = c18_bin_dir / "mcc18.exe"
-    if not mcc18.exists():
+    if not mcc18.exists() and not host_build:
         raise FileNotFoundError("Could not find mcc18.exe")
     
     mplink = c18_bin_dir / "mplink.exe"
-    if not mplink.exists():
+    if not mplink.exists() and not host_build:
         raise FileNotFoundError("Could not find mplink.exe")
     
+    global mplib
+    mplib = c18_bin_dir / "mplib.exe"
+    if not mplib.exists() and not host_build:
+        raise FileNotFoundError("Could not find mplib.exe")
+    
     c18_dir = to_windows_path(c18_dir)
     c18_header_dir = c18_dir / "h"
     c18_lib = c18_dir / "lib"
@@ -150,10 +251,17 @@ def setup_toolchain():
     if not wpilib_dir.exists():
         raise FileNotFoundError("Could not find WPILib.")
     
+    # vexbuild reads the linker script and passes mplink a derived copy
+    wpilib_linker_script = wpilib_dir / "18f8520.lkr"
+    
     wpilib_dir = to_windows_path(wpilib_dir)
     wpilib_vex_lib = wpilib_dir / "Vex_library.lib"
     wpilib_easyc_lib = wpilib_dir / "easyCRuntime.lib"
-    wpilib_linker_script = wpilib_dir / "18f8520.lkr"
+    
+    global vexlib_dir
+    vexlib_dir = toolchain_dir / "VexLib"
+    if not vexlib_dir.exists():
+        raise FileNotFoundError("Could not find VexLib.")
     
     if enable_copy_launcher:
         copy_launcher()
@@ -233,38 +341,770 @@ def find_all_dependencies(file):
 def compile(file):
     info("Compiling: " + str(file))
     
+    source, generated = rewrite_source(file)
+    include_dirs = [(src_dir / file).parent] if generated else []
+    if run_mcc18(source, build_dir / (file.stem + ".o"), include_dirs) != 0:
+        raise ChildProcessError("Failed to compile source file: " + str(file))
+    for path in generated:
+        if run_mcc18(path, build_dir / path.with_suffix(".o").name) != 0:
+            raise ChildProcessError("Failed to compile the generated code of: " + str(file))
+
+def run_mcc18(source, output_file, include_dirs=()):
     args = []
     if get_os()[0] != "Windows":
         args.append("wine")
 
-    output_file = to_windows_path(build_dir / (file.stem + ".o"))
-    args.extend([str(mcc18), "-p=18F8520", "-w=2", "-D_VEX_BOARD", "-ls",
-                    "-I=" + str(c18_header_dir), "-I=" + str(wpilib_dir),
-                    "-fo=" + str(output_file), str(to_windows_path(src_dir / file))])
+    args.extend([str(mcc18), "-p=18F8520", "-w=2", "-D_VEX_BOARD"])
+    if not small_stack:
+        args.append("-ls")
+    args.extend(["-I=" + str(to_windows_path(d)) for d in include_dirs])
+    args.extend(["-I=" + str(c18_header_dir), "-I=" + str(wpilib_dir), "-I=" + str(to_windows_path(vexlib_dir)),
+                    "-fo=" + str(to_windows_path(output_file)), str(to_windows_path(source))])
     
-    if subprocess.call(args) != 0:
-        raise ChildProcessError("Failed to compile source file: " + str(file))
+    return subprocess.call(args)
+
+def printf_dir():
+    return (host_dir if host_build else build_dir) / "printf"
+
+def log_dir():
+    return (host_dir if host_build else build_dir) / "vexlog"
+
+# VexLog() calls are always rewritten into calls of generated functions that
+# send records (see vexlog.py), and with --specialize-printf the printf calls
+# with literal formats are rewritten into calls of generated formatters (see
+# vexprintf.py). Returns the file to compile in place of the source, and the
+# generated files to compile with it.
+def rewrite_source(file):
+    source, log_sites = vexlog.rewrite((src_dir / file).read_text(), file.stem, file.name, log_table)
+    log_table.replace(file.name, log_sites)
+    log_table.write()
+    printf_sites = []
+    if specialize_printf_enabled:
+        source, printf_sites = vexprintf.rewrite(source, file.stem)
+    
+    generated = []
+    for path, sites, generate in ((log_dir() / (file.stem + "_vexlog.c"), log_sites, vexlog.records),
+                                  (printf_dir() / (file.stem + "_printf.c"), printf_sites, vexprintf.formatters)):
+        if sites:
+            write_if_changed(path, generate(sites, file.name))
+            generated.append(path)
+        elif path.exists():
+            path.unlink()
+    
+    rewritten = (printf_dir() if specialize_printf_enabled else log_dir()) / file.name
+    for path in (log_dir() / file.name, printf_dir() / file.name):
+        if (path != rewritten or not generated) and path.exists():
+            path.unlink()
+    if not generated:
+        return src_dir / file, []
+    prototypes = [vexlog.prototype(site) for site in log_sites] + [vexprintf.prototype(site) for site in printf_sites]
+    write_if_changed(rewritten, vexprintf.with_prototypes(source, prototypes, file.name))
+    return rewritten, generated
+
+# The project's objects, in a fixed order so the layout only changes when the
+# code does
+def object_files(directory):
+    objects = []
+    for f in sorted(source_files):
+        objects.append(directory / (f.stem + ".o"))
+        if (log_dir() / (f.stem + "_vexlog.c")).exists():
+            objects.append(directory / (f.stem + "_vexlog.o"))
+        if specialize_printf_enabled and (printf_dir() / (f.stem + "_printf.c")).exists():
+            objects.append(directory / (f.stem + "_printf.o"))
+    objects.extend(generated_object(source) for source in generated_sources())
+    return objects
+
+# Report how many bytes the VexLog() records save over printing their text
+def report_log_formats():
+    if not log_table.formats:
+        return
+    records = sum(vexlog.record_size(entry) for entry in log_table.formats)
+    text = sum(vexlog.text_size(entry) for entry in log_table.formats)
+    info("%i VexLog formats in %s, records take %.1f bytes on average where printf would send %.1f." %
+         (len(log_table.formats), log_table.path, records / len(log_table.formats), text / len(log_table.formats)))
+
+# Report what the formatters cost in flash, and the cycles they save over the
+# functions they replace, measured in vexsim. The functions are only in the
+# program if calls that could not be specialized still use them.
+def report_printf_specialization(image):
+    sites = []
+    for f in sorted(source_files):
+        sites.extend((f, site) for site in
+                     vexprintf.specialize((src_dir / f).read_text(), f.stem, f.name).sites)
+    if not sites:
+        return
+    
+    map_file = build_dir / "Mapfile.map"
+    objects = [f.stem + "_printf" for f in source_files] + ["vexfmt"]
+    size = sum(section.size for section in read_map_sections(map_file)
+               if section.location == "program" and section_object(section.name) in objects)
+    info("Specialized %i printf calls, the formatters take %i bytes of flash." % (len(sites), size))
+    try:
+        results = vexprintf.measure(image, vexsim.read_symbols(map_file), [site for f, site in sites])
+    except vexsim.SimulatorError as e:
+        info("Could not measure the formatters: " + str(e))
+        return
+    for (f, site), (site, cycles, original) in zip(sites, results):
+        line = "  %s:%i %s(\"%s\"): " % (f, site.line, site.function, site.format)
+        if cycles == None:
+            line += "not measured"
+        elif original == None:
+            line += "%i cycles" % cycles
+        else:
+            line += "%i cycles, %i saved" % (cycles, original - cycles)
+        info(line)
+
+def telemetry_dir():
+    return (host_dir if host_build else build_dir) / "telemetry"
+
+def telemetry_source():
+    return telemetry_dir() / "vextelemetry_channels.c"
+
+def task_dir():
+    return (host_dir if host_build else build_dir) / "tasks"
+
+def task_source():
+    return task_dir() / "vextask_table.c"
+
+# The code generated from the project's config files
+def generated_sources():
+    return [source for source in (telemetry_source(), task_source()) if source.exists()]
+
+def generated_object(source):
+    if host_build or not small_stack:
+        return source.with_suffix(".o")
+    return source.with_name(source.stem + "-small-stack.o")
+
+# Projects with a telemetry.cfg have the code that samples their channels
+# generated (see vextelemetry.py), with the layout vexupload decodes the
+# frames with in layout.json next to it. Returns whether the channels were
+# taken out since the last build.
+def generate_telemetry():
+    config_file = project_dir / vextelemetry.CONFIG_NAME
+    if not config_file.exists():
+        if telemetry_dir().exists():
+            shutil.rmtree(str(telemetry_dir()))
+            return True
+        return False
+    
+    try:
+        layout = vextelemetry.read_config(config_file)
+    except ValueError as e:
+        raise ChildProcessError("Could not read the telemetry channels: " + str(e.args[0]))
+    telemetry_dir().mkdir(exist_ok=True)
+    write_if_changed(telemetry_source(), vextelemetry.source(layout))
+    write_if_changed(telemetry_dir() / "layout.json", vextelemetry.layout_json(layout))
+    
+    rate = vextelemetry.bytes_per_second(layout)
+    if rate > vextelemetry.PORT_BYTES_PER_SECOND:
+        warn("Telemetry needs %.0f bytes a second, more than the %i a buffered serial port sends, so frames "
+             "will be dropped." % (rate, vextelemetry.PORT_BYTES_PER_SECOND))
+    return False
+
+# Projects with a tasks.cfg have the table of their tasks generated (see
+# vextask.py). Returns whether the tasks were taken out since the last build.
+def generate_tasks():
+    config_file = project_dir / vextask.CONFIG_NAME
+    if not config_file.exists():
+        if task_dir().exists():
+            shutil.rmtree(str(task_dir()))
+            return True
+        return False
+    
+    try:
+        tasks = vextask.read_config(config_file)
+    except ValueError as e:
+        raise ChildProcessError("Could not read the tasks: " + str(e.args[0]))
+    task_dir().mkdir(exist_ok=True)
+    write_if_changed(task_source(), vextask.source(tasks))
+    return False
+
+# The generated code is compiled like VexLib, with an object for each stack
+# model. Returns whether any of it was compiled.
+def build_generated():
+    compiled = False
+    for source in generated_sources():
+        output_file = generated_object(source)
+        if output_file.exists() and output_file.stat().st_mtime >= source.stat().st_mtime:
+            continue
+        info("Compiling %s..." % source.name)
+        if run_mcc18(source, output_file) != 0:
+            raise ChildProcessError("Failed to compile " + source.name)
+        compiled = True
+    return compiled
+
+# VexLib is compiled with the project's stack model, into a library the linker
+# only takes the functions the program uses from. Its objects are rebuilt when
+# they are older than their source or the library headers.
+def build_library():
+    library_build_dir = build_dir / ("vexlib-small-stack" if small_stack else "vexlib")
+    library_build_dir.mkdir(exist_ok=True)
+    library = library_build_dir / "VexLib.lib"
+    headers_time = max([header.stat().st_mtime for header in vexlib_dir.glob("*.h")], default=0)
+    
+    objects = []
+    rebuilt = False
+    for source in sorted((vexlib_dir / "src").glob("*.c")):
+        output_file = library_build_dir / (source.stem + ".o")
+        objects.append(output_file)
+        if output_file.exists() and output_file.stat().st_mtime >= max(source.stat().st_mtime, headers_time):
+            continue
+        info("Compiling library: " + source.name)
+        if run_mcc18(source, output_file) != 0:
+            raise ChildProcessError("Failed to compile library source file: " + source.name)
+        rebuilt = True
+    
+    if rebuilt or not library.exists():
+        if library.exists():
+            library.unlink()
+        args = []
+        if get_os()[0] != "Windows":
+            args.append("wine")
+        args.extend([str(mplib), "/c", str(to_windows_path(library))])
+        args.extend([str(to_windows_path(f)) for f in objects])
+        if subprocess.call(args) != 0:
+            raise ChildProcessError("Failed to create library: " + library.name)
+        rebuilt = True
+    
+    return library, rebuilt
     
 def link(output_files):
     info("Linking...")
     
-    args = []
-    if get_os()[0] != "Windows":
-        args.append("wine")
+    hex_file = get_hex_file()
+    map_file = build_dir / "Mapfile.map"
+    
+    # mplink replaces both, so read them first
+    previous_image = None
+    if hex_file.exists():
+        # Not mapped, since the link replaces the .vximg file
+        previous_image = vexupload.load_hex(hex_file)
+    
+    # Each attempt keeps less of the previous layout, the last one is a plain link
+    scripts = [None]
+    if stable_layout and map_file.exists():
+        sections = read_map_sections(map_file)
+        changed = [f.stem + suffix for f in modified_files for suffix in ("", "_vexlog", "_printf")]
+        # If the changed code no longer fits, let it and the sections no object is named for move
+        changed_sections = [section.name for section in sections
+                            if section_object(section.name) in changed or section_object(section.name) == None]
+        pad = "NAME=pin" not in linker_script_file().read_text() if linker_script_file().exists() else True
+        script = reserve_build_id(wpilib_linker_script.read_text())
+        scripts[0:0] = [stable_linker_script(script, sections, (), pad),
+                        stable_linker_script(script, sections, changed_sections, pad)]
+    
+    for i, script in enumerate(scripts):
+        if script == None:
+            script = reserve_build_id(wpilib_linker_script.read_text())
+        linker_script = linker_script_file()
+        linker_script.write_text(script)
+        
+        args = []
+        if get_os()[0] != "Windows":
+            args.append("wine")
+            
+        args.extend([str(mplink), str(to_windows_path(linker_script)), "/a", "INHX32", "/w", "/m",
+                     str(to_windows_path(map_file)),
+                     "/o", str(to_windows_path(hex_file))])
+        args.extend([str(to_windows_path(f)) for f in output_files])
+        args.extend(["/l", str(c18_lib), str(wpilib_vex_lib), str(wpilib_easyc_lib), str(to_windows_path(vexlib))])
+        
+        # Only show the errors of the last attempt
+        if i < len(scripts) - 1:
+            result = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+            if result.returncode == 0:
+                break
+            debug(result.stdout.decode(errors="replace"))
+            info("Could not keep the previous layout, relinking...")
+        elif subprocess.call(args) != 0:
+            raise ChildProcessError("Failed to link executable.")
+    
+    image = vexupload.stamp_build_id(hex_file)
+    info("Build ID: " + vexupload.hex_dump(image.build_id))
+    vexupload.write_vximg(image, vexupload.vximg_path(hex_file))
+    
+    if previous_image:
+        id_row = vexupload.row_address(vexupload.BUILD_ID_ADDRESS)
+        dirty_rows = [row for row in image.changed_rows(previous_image) if row != id_row]
+        info("%i of %i flash rows changed since the last build." % (len(dirty_rows), len(image.rows)))
+    
+    return image
+
+def stack_model_file():
+    return build_dir / "stack_model.cache"
+
+# The stack model, and the usage of the large model whose small model build
+# could not be proven to fit, so it isn't tried again until the usage changes
+def read_stack_model():
+    if stack_model_file().exists():
+        cache = json.load(stack_model_file().open())
+        return cache.get("small_stack", False), cache.get("unproven_usage")
+    return False, None
+
+def write_stack_model():
+    json.dump({"small_stack": small_stack, "unproven_usage": unproven_usage},
+              stack_model_file().open(mode='w'), indent=4)
+
+def linker_stack_size():
+    match = stack_size_regex.search(wpilib_linker_script.read_text())
+    return int(match.group(1), 0) if match else vexstack.DEFAULT_STACK_SIZE
+
+def program_size(map_file):
+    return sum(section.size for section in read_map_sections(map_file) if section.location == "program")
+
+# The worst case cycles of the entry points, as far as they can be found
+def entry_cycles(image, symbols, config):
+    analyzer = vexwcet.Analyzer(image, symbols, config)
+    return collections.OrderedDict((analyzer.name(entry), analyzer.function(entry).worst()[0])
+                                   for entry in analyzer.entries())
+
+def analyze_stack(image, symbols, config, stack_size):
+    try:
+        handlers = vexstack.registered_handlers(src_dir, project_dir)
+        analyzer = vexstack.StackAnalyzer(image, symbols, config, handlers)
+        text, usage = analyzer.report(stack_size)
+    except (ValueError, KeyError) as e:
+        raise ChildProcessError("Could not analyze the stack: " + str(e.args[0]))
+    debug(text)
+    info("Software stack: %s%i of %i bytes, return stack: %i of %i levels." %
+         ("" if usage.complete else ">=", usage.depth, stack_size, usage.levels, vexsim.STACK_DEPTH))
+    if not usage.complete:
+        info("The stack analysis is incomplete, run vexstack.py for the details.")
+    return usage
+
+def rebuild_stack_model(small):
+    global small_stack
+    global modified_files
+    global vexlib
+    info("Rebuilding with the %s stack model..." % ("small" if small else "large"))
+    small_stack = small
+    modified_files = sorted(source_files)
+    for f in modified_files:
+        compile(f)
+    vexlib = build_library()[0]
+    build_generated()
+    return link(object_files(build_dir))
+
+# With --small-stack, the program is built without -ls when the stack analysis
+# proves that the software stack stays in its bank, and with it otherwise.
+# Code built without -ls can use more stack than with it, so the small model
+# build is analyzed again and only kept if it fits. Changing the model
+# rebuilds everything.
+def choose_stack_model(image):
+    global unproven_usage
+    map_file = build_dir / "Mapfile.map"
+    stack_size = linker_stack_size()
+    try:
+        config = vexwcet.read_config(project_dir / vexwcet.CONFIG_NAME, src_dir)
+        symbols = vexsim.read_symbols(map_file)
+    except (ValueError, KeyError) as e:
+        raise ChildProcessError("Could not analyze the stack: " + str(e.args[0]))
+    usage = analyze_stack(image, symbols, config, stack_size)
+    
+    fits = vexstack.fits(usage, stack_size)
+    if fits == small_stack:
+        return image
+    if fits and unproven_usage == [usage.depth, usage.levels]:
+        info("The small stack model did not fit the last time, keeping the large one.")
+        return image
+    
+    size_before = program_size(map_file)
+    cycles_before = entry_cycles(image, symbols, config)
+    large_usage = usage
+    image = rebuild_stack_model(fits)
+    if fits:
+        usage = analyze_stack(image, vexsim.read_symbols(map_file), config, stack_size)
+        if not vexstack.fits(usage, stack_size):
+            info("The small stack model build could not be proven to fit.")
+            unproven_usage = [large_usage.depth, large_usage.levels]
+            return rebuild_stack_model(False)
+    
+    cycles_after = entry_cycles(image, vexsim.read_symbols(map_file), config)
+    info("The %s stack model changed the code by %+i bytes." %
+         ("small" if fits else "large", program_size(map_file) - size_before))
+    for name, cycles in cycles_after.items():
+        if cycles != None and cycles_before.get(name) != None:
+            info("  %s: %+i cycles at worst" % (name, cycles - cycles_before[name]))
+    return image
+
+# Projects with a wcet.cfg have the worst case execution times of their entry
+# points checked against their budgets on every link
+def check_cycle_budgets(image):
+    config_file = project_dir / vexwcet.CONFIG_NAME
+    if not config_file.exists():
+        return
+    
+    info("Analyzing worst case execution times...")
+    try:
+        config = vexwcet.read_config(config_file, src_dir)
+        analyzer = vexwcet.Analyzer(image, vexsim.read_symbols(build_dir / "Mapfile.map"), config)
+        text, failures = analyzer.report()
+    except (ValueError, KeyError) as e:
+        raise ChildProcessError("Could not analyze the execution time: " + str(e.args[0]))
+    info(text)
+    if failures:
+        raise ChildProcessError("%i of the entry points are over their cycle budget." % len(failures))
+
+# Guess which rows of the last build the next link will change, from where
+# the sections of the objects being recompiled were
+def predict_dirty_rows():
+    hex_file = get_hex_file()
+    map_file = build_dir / "Mapfile.map"
+    if not hex_file.exists():
+        return []
+    previous_rows = vexupload.load_hex(hex_file).rows
+    if not map_file.exists():
+        return previous_rows
+    
+    changed = [f.stem + suffix for f in modified_files for suffix in ("", "_vexlog", "_printf")]
+    sections = [section for section in read_map_sections(map_file)
+                if section.location == "program" and section.size != 0 and section_object(section.name) in changed]
+    if not sections:
+        return previous_rows
+    
+    # A stable layout keeps everything else in place, otherwise everything
+    # after the first changed section moves
+    if stable_layout:
+        rows = set()
+        for section in sections:
+            rows.update(vexupload.row_addresses(section.address, section.address + section.size))
+        return sorted(rows)
+    first_row = vexupload.row_address(min(section.address for section in sections))
+    return [row for row in previous_rows if row >= first_row]
+
+def linker_script_file():
+    return build_dir / "vexbuild.lkr"
+
+# Change the WPILib linker script to keep the code out of the row that holds
+# the build ID, and out of the last row, which the bootloader cannot erase.
+def reserve_build_id(script):
+    build_id_row = vexupload.row_address(vexupload.BUILD_ID_ADDRESS)
+    pages = ("CODEPAGE   NAME=page       START=%#x          END=%#x\n"
+             "CODEPAGE   NAME=buildid    START=%#x         END=%#x         PROTECTED") % \
+            (vexupload.MIN_PROGRAM_ADDRESS, build_id_row - 1,
+             build_id_row, build_id_row + vexupload.ERASE_ROW_SIZE - 1)
+    script, count = re.subn(r"^CODEPAGE\s+NAME=page\s.*$", pages, script, count=1, flags=re.MULTILINE)
+    if count != 1:
+        raise ValueError("Could not find the program memory page in " + str(wpilib_linker_script))
+    return script
+
+MapSection = collections.namedtuple("MapSection", ("name", "type", "address", "location", "size"))
+map_section_regex = re.compile(r"^\s*(\S+)\s+(\S+)\s+0x([0-9a-fA-F]+)\s+(program|data)\s+0x([0-9a-fA-F]+)\s*$")
+memory_regex = re.compile(r"^\s*(CODEPAGE|DATABANK|ACCESSBANK)\s+NAME=(\S+)\s+START=(\S+)\s+END=(\S+)(\s+PROTECTED)?\s*$",
+                          re.IGNORECASE)
+section_regex = re.compile(r"^\s*SECTION\s+NAME=(\S+)", re.IGNORECASE)
+stack_regex = re.compile(r"^\s*STACK\s.*RAM=(\S+)", re.IGNORECASE)
+stack_size_regex = re.compile(r"^\s*STACK\s+SIZE=(\S+)", re.IGNORECASE | re.MULTILINE)
+
+# Read the "Section Info" table of a mplink map file
+def read_map_sections(map_file):
+    sections = []
+    for line in Path(map_file).read_text(errors="replace").splitlines():
+        match = map_section_regex.match(line)
+        if match:
+            sections.append(MapSection(match.group(1), match.group(2), int(match.group(3), 16),
+                                       match.group(4), int(match.group(5), 16)))
+    return sections
+
+# The object file that the compiler named a section after, for example main
+# for .code_main.o
+def section_object(name):
+    match = re.match(r"^\.\w+?_(.+)\.o$", name)
+    return match.group(1) if match else None
+
+def stable_linker_script(script, sections, unpinned=(), pad=False):
+    """Derive a linker script that pins sections to their addresses in a
+    previous link.
+
+    Every section of the map that lies in a memory region the linker is free
+    to use gets its own protected region, except the unpinned ones. Code
+    regions extend to the end of their last row (or the next pinned section),
+    so code that grows a little keeps its address. If pad is set and there is
+    room, code sections are first spread out to start on row boundaries.
+    Whatever is left of each region stays free for new and unpinned sections.
+    """
+    lines = script.splitlines()
+    assigned = set(match.group(1) for match in map(section_regex.match, lines) if match)
+    # The software stack fills the bank the script puts it in
+    stack_banks = set(match.group(1) for match in map(stack_regex.match, lines) if match)
+    
+    regions = []
+    for i, line in enumerate(lines):
+        match = memory_regex.match(line)
+        if match and not match.group(5) and match.group(2) not in stack_banks:
+            regions.append((i, match.group(1).upper(), match.group(2), int(match.group(3), 0), int(match.group(4), 0)))
+    
+    pins = {region: [] for region in regions}
+    for section in sections:
+        if section.size == 0 or section.name in assigned or section.name in unpinned:
+            continue
+        for region in regions:
+            i, kind, name, start, end = region
+            if (kind == "CODEPAGE") == (section.location == "program") and \
+                    start <= section.address and section.address + section.size - 1 <= end:
+                pins[region].append(section)
+                break
+    
+    section_lines = []
+    for region in reversed(regions):
+        i, kind, name, start, end = region
+        region_pins = sorted(pins[region], key=lambda section: section.address)
+        if not region_pins:
+            continue
+        
+        starts = [section.address for section in region_pins]
+        if kind == "CODEPAGE" and pad:
+            padded = []
+            address = start
+            for section in region_pins:
+                padded.append(address)
+                address = vexupload.round_up(address + section.size, vexupload.ERASE_ROW_SIZE)
+            if address - 1 <= end:
+                starts = padded
         
-    args.extend([str(mplink), str(wpilib_linker_script), "/a", "INHX32", "/w", "/m",
-                 str(to_windows_path(build_dir / "Mapfile.map")),
-                 "/o", str(to_windows_path(get_hex_file()))])
-    args.extend([str(to_windows_path(f)) for f in output_files])
-    args.extend(["/l", str(c18_lib), str(wpilib_vex_lib), str(wpilib_easyc_lib)])
+        first_pin = len(section_lines)
+        carved = []
+        free_start = start
+        for j, section in enumerate(region_pins):
+            section_end = starts[j] + section.size
+            if kind == "CODEPAGE":
+                section_end = vexupload.round_up(section_end, vexupload.ERASE_ROW_SIZE)
+            if j + 1 < len(region_pins):
+                section_end = max(min(section_end, starts[j + 1]), starts[j] + section.size)
+            section_end = min(section_end, end + 1)
+            
+            if free_start < starts[j]:
+                carved.append((free_start, starts[j] - 1, False))
+            carved.append((starts[j], section_end - 1, "pin%i" % (first_pin + j)))
+            free_start = section_end
+        if free_start <= end:
+            carved.append((free_start, end, False))
+        for j, section in enumerate(region_pins):
+            section_lines.append("SECTION    NAME=%s %s=pin%i" % (section.name, "ROM" if kind == "CODEPAGE" else "RAM", first_pin + j))
         
-    if subprocess.call(args) != 0:
-        raise ChildProcessError("Failed to link executable.")
+        # The first free piece keeps the name of the region, in case the
+        # script refers to it
+        region_lines = []
+        free_pieces = 0
+        for piece_start, piece_end, pin_name in carved:
+            if pin_name:
+                region_lines.append("%-10s NAME=%-10s START=%#-12x END=%#-12x PROTECTED" % (kind, pin_name, piece_start, piece_end))
+            else:
+                piece_name = name if free_pieces == 0 else "%s_%i" % (name, free_pieces)
+                free_pieces += 1
+                region_lines.append("%-10s NAME=%-10s START=%#-12x END=%#x" % (kind, piece_name, piece_start, piece_end))
+        lines[i:i + 1] = region_lines
     
+    return "\n".join(lines + [""] + section_lines) + "\n"
+
+# The names declared by a C header, for example the special function
+# registers of p18f8520.h
+def header_declarations(header):
+    text = re.sub(r"/\*.*?\*/", "", header, flags=re.DOTALL)
+    names = []
+    depth = 0
+    in_declaration = False
+    last = None
+    for token in re.findall(r"\w+|[{};]", text):
+        if token == "{":
+            depth += 1
+        elif token == "}":
+            depth -= 1
+        elif token == ";":
+            if depth == 0 and in_declaration:
+                names.append(last)
+                in_declaration = False
+        elif depth == 0:
+            if token == "extern":
+                in_declaration = True
+            last = token
+    return names
+
+# Write a copy of the processor header that the host compiler understands, and
+# definitions for the registers it declares
+def write_host_headers():
+    include_dir = host_dir / "include"
+    include_dir.mkdir(exist_ok=True)
+    
+    header = (toolchain_dir / "mcc18" / "h" / "p18f8520.h").read_text()
+    header = header.replace("unsigned short long", "unsigned long")
+    # The inline assembly macros do nothing on the host
+    header = re.sub(r"^(#define\s+\w+\([^)]*\))\s*\{\s*_asm.*$", r"\1 ((void)0)", header, flags=re.MULTILINE)
+    write_if_changed(include_dir / "p18f8520.h", header)
+    write_if_changed(include_dir / "p18cxxx.h", "#include <p18f8520.h>\n")
+    
+    # Each register and its bits share storage, like they do on the controller
+    names = header_declarations(header)
+    lines = ["#include <p18f8520.h>"]
+    for name in names:
+        if name.endswith("bits") and name[:-4] in names:
+            continue
+        if name + "bits" in names:
+            lines.append("__typeof__(%sbits) %sbits;" % (name, name))
+            lines.append("extern __typeof__(%s) %s __attribute__((alias(\"%sbits\")));" % (name, name, name))
+        else:
+            lines.append("__typeof__(%s) %s;" % (name, name))
+    write_if_changed(host_dir / "sfrs.c", "\n".join(lines) + "\n")
+
+def write_if_changed(path, text):
+    if not path.exists() or path.read_text() != text:
+        path.write_text(text)
+
+def host_compile_args(source, output_file, include_dirs=()):
+    vexhost_dir = toolchain_dir / "VexHost"
+    args = [host_cc, "-std=gnu99", "-g", "-Wall", "-Wno-unknown-pragmas", "-D_VEX_BOARD",
+            "-include", str(vexhost_dir / "c18compat.h")]
+    for include_dir in include_dirs:
+        args.extend(["-I", str(include_dir)])
+    args.extend([
+            "-I", str(host_dir / "include"), "-I", str(vexhost_dir), "-I", str(toolchain_dir / "WPILib" / "Vex"),
+            "-I", str(toolchain_dir / "VexLib"), "-I", str(src_dir), "-idirafter", str(toolchain_dir / "mcc18" / "h")])
+    args.extend(["-O0", "--coverage"] if host_coverage else ["-O2"])
+    args.extend(["-c", "-o", str(output_file), str(source)])
+    return args
+
+def host_executable(path):
+    return path.with_suffix(".exe") if get_os()[0] == "Windows" else path
+
+# Run commands on every processor, and print their output in order
+def run_parallel(commands):
+    import concurrent.futures
+    def run(args):
+        debug(" ".join(args))
+        return subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    with concurrent.futures.ThreadPoolExecutor(os.cpu_count()) as executor:
+        results = list(executor.map(run, commands))
+    for result in results:
+        if result.stdout:
+            info(result.stdout.decode(errors="replace").rstrip())
+    return results
+
+def build_host():
+    write_host_headers()
+    vexhost_dir = toolchain_dir / "VexHost"
+    
+    # The model and VexLib are rebuilt whenever they are missing or older than
+    # their source
+    vexlib_dir = toolchain_dir / "VexLib"
+    (host_dir / "vexlib").mkdir(exist_ok=True)
+    runtime = [(vexhost_dir / "vexhost_main.c", host_dir / "vexhost_main.o"),
+               (vexhost_dir / "vexhost.c", host_dir / "vexhost.o"),
+               (host_dir / "sfrs.c", host_dir / "sfrs.o")]
+    runtime.extend((source, host_dir / "vexlib" / (source.stem + ".o"))
+                   for source in sorted((vexlib_dir / "src").glob("*.c")))
+    headers_time = max([header.stat().st_mtime for header in vexlib_dir.glob("*.h")], default=0)
+    jobs = [(source, output) for source, output in runtime
+            if not output.exists() or output.stat().st_mtime < source.stat().st_mtime or
+            (source.parent.parent == vexlib_dir and output.stat().st_mtime < headers_time)]
+    jobs = [(source, output, ()) for source, output in jobs]
+    jobs.extend((source, generated_object(source), ()) for source in generated_sources()
+                if not generated_object(source).exists() or
+                generated_object(source).stat().st_mtime < source.stat().st_mtime)
+    for f in modified_files:
+        info("Compiling for host: " + str(f))
+        source, generated = rewrite_source(f)
+        jobs.append((source, host_dir / (f.stem + ".o"), [(src_dir / f).parent] if generated else ()))
+        jobs.extend((path, host_dir / path.with_suffix(".o").name, ()) for path in generated)
+    
+    results = run_parallel([host_compile_args(*job) for job in jobs])
+    for (source, output, include_dirs), result in zip(jobs, results):
+        if result.returncode != 0:
+            raise ChildProcessError("Failed to compile source file: " + str(source))
+    if len(modified_files) != 0:
+        report_log_formats()
+    
+    objects = [str(f) for f in object_files(host_dir)]
+    # The tests have their own main()
+    runtime_objects = [str(output) for source, output in runtime[1:]]
+    program = host_executable(host_dir / project_dir.name)
+    info("Linking for host...")
+    if subprocess.call([host_cc] + (["--coverage"] if host_coverage else []) + 
+                       ["-o", str(program)] + objects + runtime_objects + [str(runtime[0][1]), "-lm"]) != 0:
+        raise ChildProcessError("Failed to link host executable.")
+    info("Built " + str(program))
+    
+    run_host_tests(objects + runtime_objects)
+
+# Every C file in the project's test directory is a test program, which passes
+# if it exits with 0
+def run_host_tests(objects):
+    test_dir = project_dir / "test"
+    tests = sorted(test_dir.glob("*.c")) if test_dir.is_dir() else []
+    if not tests:
+        return
+    
+    test_build_dir = host_dir / "test"
+    test_build_dir.mkdir(exist_ok=True)
+    for data_file in host_dir.glob("**/*.gcda"):
+        data_file.unlink()
+    
+    results = run_parallel([host_compile_args(test, test_build_dir / (test.stem + ".o")) for test in tests])
+    for test, result in zip(tests, results):
+        if result.returncode != 0:
+            raise ChildProcessError("Failed to compile test: " + str(test))
+    
+    executables = [host_executable(test_build_dir / test.stem) for test in tests]
+    results = run_parallel([[host_cc] + (["--coverage"] if host_coverage else []) + 
+                            ["-o", str(executable), str(test_build_dir / (test.stem + ".o"))] + objects + ["-lm"]
+                            for test, executable in zip(tests, executables)])
+    for test, result in zip(tests, results):
+        if result.returncode != 0:
+            raise ChildProcessError("Failed to link test: " + str(test))
+    
+    info("Running %i tests..." % len(tests))
+    import concurrent.futures
+    import time
+    def run(executable):
+        start = time.perf_counter()
+        result = subprocess.run([str(executable)], cwd=str(project_dir), stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+        return result, time.perf_counter() - start
+    with concurrent.futures.ThreadPoolExecutor(os.cpu_count()) as executor:
+        results = list(executor.map(run, executables))
+    
+    failed = 0
+    for test, (result, elapsed) in zip(tests, results):
+        if result.returncode == 0:
+            info("PASS %s (%.1f ms)" % (test.name, elapsed * 1000))
+        else:
+            failed += 1
+            info("FAIL %s (exit status %i)" % (test.name, result.returncode))
+            if result.stdout:
+                info(result.stdout.decode(errors="replace").rstrip())
+    
+    if host_coverage:
+        report_coverage()
+    if failed:
+        raise ChildProcessError("%i of %i tests failed." % (failed, len(tests)))
+
+def report_coverage():
+    info("Coverage:")
+    for f in sorted(source_files):
+        result = subprocess.run(["gcov", "-n", "-o", str(host_dir), str(src_dir / f)], cwd=str(host_dir),
+                                stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+        match = re.search(r"Lines executed:\s*([\d.]+)% of (\d+)", result.stdout.decode(errors="replace"))
+        if match:
+            info("  %-30s %6s%% of %s lines" % (f, match.group(1), match.group(2)))
+        else:
+            info("  %-30s not run" % f)
+
 def upload(hex_file):
     if debug_enabled: vexupload.debug_level = vexupload.DebugLevel.verbose
     vexupload.upload(hex_file, upload_device)
 
+# A single controller can be erased while the program builds
+def start_pipelined_upload():
+    if debug_enabled: vexupload.debug_level = vexupload.DebugLevel.verbose
+    # The build has not set up the build directory yet
+    project = project_dir.expanduser().resolve()
+    hex_file = project / "build" / (project.name + ".hex")
+    if upload_device == None:
+        return vexupload.PipelinedUpload(hex_file)
+    if not upload_device:
+        raise IOError("No Vex programming modules found")
+    if len(upload_device) == 1:
+        return vexupload.PipelinedUpload(hex_file, upload_device[0])
+    return None
+
 def to_windows_path(path):
     # A Windows path can only be created from an absolute POSIX path
     if isinstance(path, pathlib.PosixPath) and path.is_absolute():
@@ -295,17 +1135,29 @@ if __name__ == "__main__":
     
     # If debug mode is not enabled, only print warning messages, not their whole stack trace
     if not debug_enabled:
-        warnings.showwarning = lambda message, category, filename, lineno: print("Warning:", message, flush=True, file=sys.stderr)
+        warnings.showwarning = lambda message, category, filename, lineno, file=None, line=None: print("Warning:", message, flush=True, file=sys.stderr)
     
     try:
         
+        # If the upload flag was given, put the controller in program mode
+        # first, so it can be erased during the build
+        pipeline = None
+        if upload_enabled and host_build:
+            warn(UserWarning("Host builds cannot be uploaded."))
+            upload_enabled = False
+        if upload_enabled:
+            pipeline = start_pipelined_upload()
+        
         # Build the program
-        build()
+        image = build(pipeline)
     
         # If the upload flag was given, upload the program
-        if upload_enabled:
+        if pipeline != None:
+            with image if image != None else vexupload.load_image(get_hex_file()) as uploaded_image:
+                pipeline.finish(uploaded_image)
+        elif upload_enabled:
             upload(get_hex_file())
-    except (FileNotFoundError, ChildProcessError, SerialException) as e:
+    except (FileNotFoundError, ChildProcessError, SerialException, IOError) as e:
         # Throw the exception if debug is enabled, otherwise just print it and exit
         if debug_enabled:
             raise e
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Build time extraction of tokenized log formats.
+
+A VexLog() call in a source file is rewritten by vexbuild into a call of a
+function generated for its format, which sends a record of the format's
+number and the raw bytes of the arguments, and nothing of the text:
+
+    VexLog("Arm %d at %lu\\r\\n", arm, ticks);
+
+becomes
+
+    VexLog_main_0(arm, ticks);
+
+with
+
+    void VexLog_main_0(int a1, unsigned long a2) {
+        VexLog_Begin(7);
+        VexLog_Put16(a1);
+        VexLog_Put32(a2);
+        VexLog_End();
+    }
+
+The formats go into a table (build/vexlog/formats.json), which vexupload
+--monitor reads to turn the records back into text. Numbers are kept in the
+table from build to build, so the records of a program already on the
+controller still decode after its source changes. VexLog() has no fallback
+at run time, so a format VexLog can't send is a build error.
+"""
+import collections
+import json
+import re
+
+import vexprintf
+from vexprintf import Conversion
+
+
+log_call_regex = re.compile(r"\bVexLog\s*\(\s*" + vexprintf.string_pattern + r"\s*(,\s*|\))")
+
+# Must match VEXLOG_MAX_ARGUMENTS in vexlog.h
+MAX_ARGUMENT_BYTES = 16
+# The last number is VEXTELEMETRY_FORMAT, for telemetry frames
+MAX_FORMATS = 0xFFFF
+
+Site = collections.namedtuple("Site", "name id format line conversions")
+
+# The struct code of each conversion and size, in the order the record
+# has the argument bytes
+CODES = {
+    ("d", 2): "h", ("i", 2): "h", ("u", 2): "H", ("x", 2): "H", ("X", 2): "H", ("c", 2): "B",
+    ("d", 4): "l", ("i", 4): "l", ("u", 4): "L", ("x", 4): "L", ("X", 4): "L",
+}
+
+# Parameter type and VexLog_Put function of each struct code
+PUTS = {
+    "h": ("int", "VexLog_Put16"),
+    "H": ("unsigned", "VexLog_Put16"),
+    "B": ("char", "VexLog_Put8"),
+    "l": ("long", "VexLog_Put32"),
+    "L": ("unsigned long", "VexLog_Put32"),
+}
+
+class LogFormatError(Exception):
+    pass
+
+class FormatTable:
+    """The formats of every VexLog() call in a project, numbered. A call is
+    known by its file, format, and how many calls with the same format come
+    before it in the file, so moving it around keeps its number.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self.next_id = 0
+        self.formats = []
+        if path.exists():
+            table = json.loads(path.read_text())
+            self.next_id = table["next_id"]
+            self.formats = table["formats"]
+        self.ids = {(entry["file"], entry["format"], entry["occurrence"]): entry["id"] for entry in self.formats}
+
+    def id(self, file_name, text, occurrence):
+        key = (file_name, text, occurrence)
+        if key not in self.ids:
+            if self.next_id >= MAX_FORMATS:
+                raise LogFormatError("No more log format numbers, delete %s to start over" % self.path)
+            self.ids[key] = self.next_id
+            self.next_id += 1
+        return self.ids[key]
+
+    def replace(self, file_name, sites):
+        """Make sites the formats of a file"""
+        self.formats = [entry for entry in self.formats if entry["file"] != file_name]
+        occurrences = collections.Counter()
+        for site in sites:
+            self.formats.append({"id": site.id, "file": file_name, "line": site.line, "format": site.format,
+                                 "occurrence": occurrences[site.format], "text": c_text(site.format),
+                                 "arguments": argument_codes(site)})
+            occurrences[site.format] += 1
+        self.formats.sort(key=lambda entry: entry["id"])
+
+    def keep_files(self, file_names):
+        self.formats = [entry for entry in self.formats if entry["file"] in file_names]
+
+    def write(self):
+        text = json.dumps({"next_id": self.next_id, "formats": self.formats}, indent=4) + "\n"
+        if not self.path.exists() or self.path.read_text() != text:
+            self.path.write_text(text)
+
+def c_text(text):
+    """The text of a C string literal"""
+    return vexprintf.c_bytes(text)[:-1].decode("latin-1")
+
+def argument_codes(site):
+    return "".join(CODES[piece.kind, piece.size] for piece in site.conversions if isinstance(piece, Conversion))
+
+def parse_log_format(text, location):
+    conversions = vexprintf.parse_format(text)
+    if conversions != None:
+        for piece in conversions:
+            if isinstance(piece, Conversion) and (piece.kind, piece.size) not in CODES:
+                conversions = None
+                break
+    if conversions == None:
+        raise LogFormatError("%s: VexLog() can only send %%d, %%i, %%u, %%x, %%X, their l versions and %%c, "
+                             "with flags and widths" % location)
+    codes = "".join(CODES[piece.kind, piece.size] for piece in conversions if isinstance(piece, Conversion))
+    if sum(map(struct_size, codes)) > MAX_ARGUMENT_BYTES:
+        raise LogFormatError("%s: VexLog() can send at most %i bytes of arguments" % (location, MAX_ARGUMENT_BYTES))
+    return conversions
+
+def struct_size(code):
+    return {"B": 1, "h": 2, "H": 2, "l": 4, "L": 4}[code]
+
+def rewrite(source, stem, file_name, table):
+    """The source with its VexLog() calls replaced, and their Sites, without
+    the prototypes of the record functions."""
+    masked = vexprintf.blank_comments(source)
+    sites = []
+    pieces = []
+    position = 0
+    occurrences = collections.Counter()
+    for match in log_call_regex.finditer(masked):
+        text = match.group(1)
+        line = masked.count("\n", 0, match.start()) + 1
+        conversions = parse_log_format(text, "%s:%i" % (file_name, line))
+        name = "VexLog_%s_%i" % (vexprintf.identifier(stem), len(sites))
+        sites.append(Site(name, table.id(file_name, text, occurrences[text]), text, line, conversions))
+        occurrences[text] += 1
+        pieces.append(source[position:match.start()])
+        pieces.append(name + ("(" if match.group(2) != ")" else "()"))
+        pieces.append(vexprintf.kept_newlines(match))
+        position = match.end()
+    pieces.append(source[position:])
+    return "".join(pieces), sites
+
+def prototype(site):
+    parameters = ["%s a%i" % (PUTS[code][0], i + 1) for i, code in enumerate(argument_codes(site))]
+    return "void %s(%s)" % (site.name, ", ".join(parameters) or "void")
+
+def records(sites, file_name):
+    lines = ["/* Generated by vexbuild from %s, do not edit */" % file_name,
+             "#include \"vexlog.h\""]
+    for site in sites:
+        lines.append("")
+        lines.append("/* VexLog(\"%s\") on line %i */" % (site.format.replace("*/", "*\\/"), site.line))
+        lines.append(prototype(site) + " {")
+        lines.append("    VexLog_Begin(%i);" % site.id)
+        for i, code in enumerate(argument_codes(site)):
+            lines.append("    %s(a%i);" % (PUTS[code][1], i + 1))
+        lines.append("    VexLog_End();")
+        lines.append("}")
+    return "\n".join(lines) + "\n"
+
+# Sizes of the entries of a FormatTable, for the report
+
+def record_size(entry):
+    """Bytes a record takes with all of its arguments 0: two STX, the format
+    number, the arguments, the checksum and ETX."""
+    return 2 + 2 + sum(map(struct_size, entry["arguments"])) + 1 + 1
+
+def text_size(entry):
+    """Bytes printf would send for the format with all of its arguments 0"""
+    return len(entry["text"] % tuple(0 for code in entry["arguments"]))
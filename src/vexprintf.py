@@ -0,0 +1,289 @@
+#!/usr/bin/env python3
+"""Build time specialization of printf() calls.
+
+printf(), sprintf() and PrintToScreen() read their format string every time
+they are called, one character at a time, and the C18 versions convert every
+number with 32 bit division. Most calls in robot code have a literal format,
+so vexbuild --specialize-printf rewrites each of those calls into a call of a
+formatter generated for its format, which calls the conversions of
+Toolchain/VexLib/vexfmt.h in order:
+
+    printf("Arm %d\\r\\n", arm);
+
+becomes
+
+    VexPrintf_main_0(arm);
+
+with
+
+    int VexPrintf_main_0(int a1) {
+        VexFmt_Begin(0);
+        VexFmt_Text("Arm ");
+        VexFmt_Signed16(a1, 0, 0);
+        VexFmt_Text("\\r\\n");
+        return VexFmt_End();
+    }
+
+The source files are left alone: the rewritten copy is compiled instead, with
+the formatters in a translation unit of their own. Formats with conversions
+the formatters don't have (floats, precision, *, %n) are left to printf().
+"""
+import collections
+import re
+
+import vexsim
+
+
+FUNCTIONS = ("printf", "PrintToScreen", "sprintf")
+
+# A C string literal, and the escapes that are a % themselves
+string_pattern = r'"((?:[^"\\\n]|\\.)*)"'
+percent_escape_regex = re.compile(r"\\(x0*25(?![0-9a-fA-F])|0?45(?![0-7]))")
+print_call_regex = re.compile(r"\b(printf|PrintToScreen)\s*\(\s*" + string_pattern + r"\s*(,\s*|\))")
+sprintf_call_regex = re.compile(r"\b(sprintf)\s*\(\s*([^,()\";]+?)\s*,\s*" + string_pattern + r"\s*(,\s*|\))")
+conversion_regex = re.compile(r"%([-+ 0]*)([0-9]*)(h|l)?([diuxXcsS%])")
+
+Conversion = collections.namedtuple("Conversion", "kind size width flags")
+Site = collections.namedtuple("Site", "name function format line conversions")
+Specialization = collections.namedtuple("Specialization", "source formatters sites")
+
+# Parameter type and VexFmt function of each conversion and size
+CONVERSIONS = {
+    ("d", 2): ("int", "VexFmt_Signed16"),
+    ("i", 2): ("int", "VexFmt_Signed16"),
+    ("u", 2): ("unsigned", "VexFmt_Unsigned16"),
+    ("x", 2): ("unsigned", "VexFmt_Hex16"),
+    ("X", 2): ("unsigned", "VexFmt_Hex16"),
+    ("d", 4): ("long", "VexFmt_Signed32"),
+    ("i", 4): ("long", "VexFmt_Signed32"),
+    ("u", 4): ("unsigned long", "VexFmt_Unsigned32"),
+    ("x", 4): ("unsigned long", "VexFmt_Hex32"),
+    ("X", 4): ("unsigned long", "VexFmt_Hex32"),
+    ("c", 2): ("char", "VexFmt_Char"),
+    ("s", 2): ("const char *", "VexFmt_String"),
+    ("S", 2): ("const rom char *", "VexFmt_RomString"),
+}
+
+FLAGS = {"-": "VEXFMT_LEFT", "0": "VEXFMT_ZERO", "+": "VEXFMT_PLUS", " ": "VEXFMT_SPACE"}
+
+def parse_format(text):
+    """Split a format, as written in C, into text and Conversions. Returns
+    None when the formatters can't do all of it.
+    """
+    if percent_escape_regex.search(text):
+        return None
+    pieces = []
+    position = 0
+    while True:
+        start = text.find("%", position)
+        if start < 0:
+            break
+        match = conversion_regex.match(text, start)
+        if not match or int(match.group(2) or "0") > 255:
+            return None
+        flags, width, size, kind = match.groups()
+        if start > position:
+            pieces.append(text[position:start])
+        if kind == "%":
+            if flags or width or size:
+                return None
+            pieces.append("%")
+        elif size == "l" and kind in "csS":
+            return None
+        else:
+            pieces.append(Conversion(kind, 4 if size == "l" else 2, int(width or "0"), "".join(sorted(set(flags)))))
+        position = match.end()
+    if position < len(text):
+        pieces.append(text[position:])
+    return merge_text(pieces)
+
+def merge_text(pieces):
+    merged = []
+    for piece in pieces:
+        if isinstance(piece, str) and merged and isinstance(merged[-1], str):
+            merged[-1] += piece
+        else:
+            merged.append(piece)
+    return merged
+
+def blank_comments(source):
+    """The source with its comments replaced by spaces, so calls in them are
+    not found. Strings and characters are kept.
+    """
+    masked = list(source)
+    i = 0
+    while i < len(source):
+        if source.startswith("/*", i):
+            end = source.find("*/", i + 2)
+            end = len(source) if end < 0 else end + 2
+        elif source.startswith("//", i):
+            end = source.find("\n", i)
+            end = len(source) if end < 0 else end
+        elif source[i] in "\"'":
+            quote = source[i]
+            i += 1
+            while i < len(source) and source[i] not in (quote, "\n"):
+                i += 2 if source[i] == "\\" else 1
+            i += 1
+            continue
+        else:
+            i += 1
+            continue
+        for j in range(i, end):
+            if masked[j] != "\n":
+                masked[j] = " "
+        i = end
+    return "".join(masked)
+
+def identifier(text):
+    return re.sub(r"\W", "_", text)
+
+def specialize(source, stem, file_name=None):
+    """Rewrite the calls with literal formats in a source file. Returns a
+    Specialization, with no sites when nothing could be rewritten.
+    """
+    rewritten, sites = rewrite(source, stem)
+    if not sites:
+        return Specialization(source, None, [])
+    file_name = file_name or stem + ".c"
+    return Specialization(with_prototypes(rewritten, [prototype(site) for site in sites], file_name),
+                          formatters(sites, file_name), sites)
+
+def rewrite(source, stem):
+    """The source with its calls replaced, and their Sites, without the
+    prototypes of the formatters."""
+    masked = blank_comments(source)
+    matches = sorted(list(print_call_regex.finditer(masked)) + list(sprintf_call_regex.finditer(masked)),
+                     key=lambda match: match.start())
+    sites = []
+    pieces = []
+    position = 0
+    for match in matches:
+        if match.start() < position:
+            continue
+        function = match.group(1)
+        text = match.group(match.lastindex - 1)
+        conversions = parse_format(text)
+        if conversions == None:
+            continue
+        name = "Vex%s_%s_%i" % ("Sprintf" if function == "sprintf" else "Printf", identifier(stem), len(sites))
+        line = masked.count("\n", 0, match.start()) + 1
+        sites.append(Site(name, function, text, line, conversions))
+        pieces.append(source[position:match.start()])
+        arguments = [match.group(2)] if function == "sprintf" else []
+        if match.group(match.lastindex) != ")":
+            pieces.append("%s(%s" % (name, "".join(argument + ", " for argument in arguments)))
+        else:
+            pieces.append("%s(%s)" % (name, ", ".join(arguments)))
+        pieces.append(kept_newlines(match))
+        position = match.end()
+    pieces.append(source[position:])
+    return "".join(pieces), sites
+
+def kept_newlines(match):
+    """The line breaks of a replaced call, so the lines after it keep their
+    numbers."""
+    return "\n" * match.group(0).count("\n")
+
+def with_prototypes(source, prototypes, file_name):
+    """The prototypes take one line, and #line puts the rest back where it was"""
+    return "%s\n#line 1 \"%s\"\n%s" % (" ".join(p + ";" for p in prototypes), file_name, source)
+
+def parameters(site):
+    names = []
+    if site.function == "sprintf":
+        names.append("char *buffer")
+    argument = 0
+    for piece in site.conversions:
+        if isinstance(piece, Conversion):
+            argument += 1
+            type = CONVERSIONS[piece.kind, piece.size][0]
+            names.append("%s%sa%i" % (type, "" if type.endswith("*") else " ", argument))
+    return ", ".join(names) or "void"
+
+def prototype(site):
+    return "int %s(%s)" % (site.name, parameters(site))
+
+def formatters(sites, file_name):
+    lines = ["/* Generated by vexbuild --specialize-printf from %s, do not edit */" % file_name,
+             "#include \"vexfmt.h\""]
+    for site in sites:
+        lines.append("")
+        lines.append("/* %s(\"%s\") on line %i */" % (site.function, site.format.replace("*/", "*\\/"), site.line))
+        lines.append(prototype(site) + " {")
+        lines.append("    VexFmt_Begin(%s);" % ("buffer" if site.function == "sprintf" else "0"))
+        argument = 0
+        for piece in site.conversions:
+            if isinstance(piece, str):
+                lines.append("    VexFmt_Text(\"%s\");" % piece)
+                continue
+            argument += 1
+            flags = " | ".join(FLAGS[flag] for flag in piece.flags)
+            if piece.kind == "X":
+                flags = " | ".join(filter(None, ("VEXFMT_UPPER", flags)))
+            lines.append("    %s(a%i, %i, %s);" % (CONVERSIONS[piece.kind, piece.size][1], argument, piece.width,
+                                                  flags or "0"))
+        lines.append("    return VexFmt_End();")
+        lines.append("}")
+    return "\n".join(lines) + "\n"
+
+# Measuring
+
+# Formatters and the functions they replace are measured with all of their
+# arguments 0, and with a fast USART 1 to print to
+MAX_CALL_CYCLES = vexsim.INSTRUCTION_RATE
+STARTUP_CYCLES = 10 * vexsim.INSTRUCTION_RATE
+BUFFER_OFFSET = 0x80
+
+def argument_sizes(site):
+    sizes = [2] if site.function == "sprintf" else []
+    for piece in site.conversions:
+        if isinstance(piece, Conversion):
+            sizes.append(1 if piece.kind == "c" else piece.size)
+    return sizes
+
+def c_bytes(text):
+    """The bytes of a C string literal's text."""
+    return text.encode("latin-1").decode("unicode_escape").encode("latin-1") + b"\0"
+
+def measure(image, symbols, sites):
+    """Cycles each formatter takes, and the function it replaced if the
+    program still has it, as (site, formatter cycles, original cycles or None).
+    """
+    simulator = vexsim.Simulator(image, symbols)
+    if simulator.run(STARTUP_CYCLES, "main") != "until":
+        raise vexsim.SimulatorError(simulator.pc, "The program did not get to main")
+    simulator.store(vexsim.SPBRG1, 0)
+    simulator.store(vexsim.TXSTA1, 0x24)
+    simulator.store(vexsim.RCSTA1, 0x80)
+    stack = simulator.read_variable(vexsim.FSR1L, 2)
+    buffer = stack + BUFFER_OFFSET
+    # Formats for the original functions go after the end of the program
+    free = len(simulator.program.rstrip(b"\xff")) + 1 & ~1
+
+    def call(function, arguments):
+        data = b"".join(value.to_bytes(size, "little") for size, value in reversed(arguments))
+        simulator.data[stack:stack + len(data)] = data
+        simulator.write_variable(vexsim.FSR1L, stack + len(data), 2)
+        try:
+            return simulator.call(function, MAX_CALL_CYCLES)
+        except vexsim.SimulatorError:
+            return None
+        finally:
+            simulator.write_variable(vexsim.FSR1L, stack, 2)
+
+    results = []
+    for site in sites:
+        sizes = argument_sizes(site)
+        values = [(size, buffer if site.function == "sprintf" and i == 0 else 0) for i, size in enumerate(sizes)]
+        cycles = call(site.name, values) if site.name in symbols else None
+        original = None
+        text = c_bytes(site.format)
+        if site.function in symbols and free + len(text) <= vexsim.PROGRAM_MEMORY_SIZE:
+            simulator.program[free:free + len(text)] = text
+            simulator.invalidate()
+            # The format is a far rom pointer, after the buffer of sprintf()
+            values.insert(1 if site.function == "sprintf" else 0, (3, free))
+            original = call(site.function, values)
+        results.append((site, cycles, original))
+    return results
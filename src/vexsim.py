@@ -0,0 +1,1861 @@
+#!/usr/bin/env python3
+"""Instruction set simulator for the PIC18F8520 user processor of the Vex
+controller.
+
+It runs the hex files built by vexbuild without a robot, counting instructions
+and instruction cycles, so the compiled code (including easyCRuntime.lib and
+Vex_library.lib) can be benchmarked and regression tested. The core has the
+banked data memory with the access bank, the three FSRs with their indirect
+registers, the 31 level hardware stack and table reads from program memory.
+
+Instructions are decoded the first time they run, into a function per
+address that executes the instruction and returns the address of the next
+one with the cycles it took.
+"""
+import collections
+import functools
+import heapq
+import itertools
+import re
+import sys
+import time
+from pathlib import Path
+
+import vexupload
+from vexupload import MIN_PROGRAM_ADDRESS
+
+
+# The controller runs the PIC at 40 MHz, an instruction cycle is 4 clocks
+INSTRUCTION_RATE = 10000000
+
+PROGRAM_MEMORY_SIZE = 0x8000
+DATA_MEMORY_SIZE = 0x1000
+STACK_DEPTH = 31
+
+# The bootloader lives below the program and passes the reset and interrupt
+# vectors on to the same offsets above it
+RESET_VECTOR = MIN_PROGRAM_ADDRESS
+HIGH_PRIORITY_VECTOR = MIN_PROGRAM_ADDRESS + 0x08
+LOW_PRIORITY_VECTOR = MIN_PROGRAM_ADDRESS + 0x18
+
+# Calls started with Simulator.call() return here, which is in the bootloader
+RETURN_TRAP = 0x0000
+
+# Instruction cycles from an interrupt to the first instruction of its handler
+INTERRUPT_LATENCY = 3
+
+# Core special function registers
+TOSU = 0xFFF
+TOSH = 0xFFE
+TOSL = 0xFFD
+STKPTR = 0xFFC
+PCLATU = 0xFFB
+PCLATH = 0xFFA
+PCL = 0xFF9
+TBLPTRU = 0xFF8
+TBLPTRH = 0xFF7
+TBLPTRL = 0xFF6
+TABLAT = 0xFF5
+PRODH = 0xFF4
+PRODL = 0xFF3
+INTCON = 0xFF2
+INTCON2 = 0xFF1
+INTCON3 = 0xFF0
+FSR0L = 0xFE9
+WREG = 0xFE8
+FSR1L = 0xFE1
+BSR = 0xFE0
+FSR2L = 0xFD9
+STATUS = 0xFD8
+RCON = 0xFD0
+
+# Peripheral registers
+T0CON = 0xFD5
+TMR0L = 0xFD6
+TMR0H = 0xFD7
+T1CON = 0xFCD
+TMR1L = 0xFCE
+TMR1H = 0xFCF
+T2CON = 0xFCA
+PR2 = 0xFCB
+TMR2 = 0xFCC
+T3CON = 0xFB1
+TMR3L = 0xFB2
+TMR3H = 0xFB3
+T4CON = 0xF76
+PR4 = 0xF77
+TMR4 = 0xF78
+SSPCON2 = 0xFC5
+SSPCON1 = 0xFC6
+SSPSTAT = 0xFC7
+SSPBUF = 0xFC9
+ADCON2 = 0xFC0
+ADCON1 = 0xFC1
+ADCON0 = 0xFC2
+ADRESL = 0xFC3
+ADRESH = 0xFC4
+RCSTA1 = 0xFAB
+TXSTA1 = 0xFAC
+TXREG1 = 0xFAD
+RCREG1 = 0xFAE
+SPBRG1 = 0xFAF
+RCSTA2 = 0xF6B
+TXSTA2 = 0xF6C
+TXREG2 = 0xF6D
+RCREG2 = 0xF6E
+SPBRG2 = 0xF6F
+PIE1 = 0xF9D
+PIR1 = 0xF9E
+IPR1 = 0xF9F
+PIE2 = 0xFA0
+PIR2 = 0xFA1
+IPR2 = 0xFA2
+PIE3 = 0xFA3
+PIR3 = 0xFA4
+IPR3 = 0xFA5
+
+# PORTx, LATx and TRISx are in this order, a register apart
+PORTA = 0xF80
+LATA = 0xF89
+TRISA = 0xF92
+PORT_NAMES = "ABCDEFGHJ"
+
+# INTCON bits
+INTCON_GIEH = 0x80
+INTCON_GIEL = 0x40
+INTCON_TMR0IF = 0x04
+INTCON_INT0IF = 0x02
+INTCON_RBIF = 0x01
+# INTCON3 bits
+INTCON3_INT3IF = 0x04
+INTCON3_INT2IF = 0x02
+INTCON3_INT1IF = 0x01
+RCON_IPEN = 0x80
+
+# PIRx bits
+PIR1_ADIF = 0x40
+PIR1_RC1IF = 0x20
+PIR1_TX1IF = 0x10
+PIR1_SSPIF = 0x08
+PIR1_TMR2IF = 0x02
+PIR1_TMR1IF = 0x01
+PIR2_TMR3IF = 0x02
+PIR3_RC2IF = 0x20
+PIR3_TX2IF = 0x10
+PIR3_TMR4IF = 0x08
+
+# The master processor sends the user processor a packet every 18.5 ms
+MASTER_PACKET_CYCLES = 185000
+# Time between the bytes of a packet
+MASTER_BYTE_CYCLES = 100
+# Replies from the user processor kept by MasterLink
+MASTER_REPLIES = 16
+
+# A/D conversions take 12 TAD. TAD for each ADCS setting, in instruction
+# cycles; the RC oscillator (ADCS=x11) has a TAD of about 4 us.
+ADC_CONVERSION_TADS = 12
+ADC_TAD_CYCLES = (0.5, 2, 8, 40, 1, 4, 16, 40)
+
+# STATUS bits
+STATUS_C = 0x01
+STATUS_DC = 0x02
+STATUS_Z = 0x04
+STATUS_OV = 0x08
+STATUS_N = 0x10
+
+# STKPTR bits
+STKPTR_SP = 0x1F
+STKPTR_STKUNF = 0x40
+STKPTR_STKFUL = 0x80
+
+# Offsets of the indirect registers from FSRnL, and how each of them changes
+# the FSR
+INDF = 6
+POSTINC = 5
+POSTDEC = 4
+PREINC = 3
+PLUSW = 2
+
+# Handlers return the next program counter, with the instruction's cycles
+# in the bits above it
+PC_MASK = 0x1FFFFF
+COST_SHIFT = 24
+
+Symbol = collections.namedtuple("Symbol", "name address location")
+
+# A row of the "Symbols" tables of an MPLINK map file:
+# name, address, location (program or data), storage class and file
+map_symbol_regex = re.compile(r"^\s*(\S+)\s+0x([0-9a-fA-F]+)\s+(program|data)\s+(static|extern)\b")
+
+class SimulatorError(Exception):
+    """The simulated program did something the simulator cannot continue from."""
+
+    def __init__(self, address, message):
+        self.address = address
+        super(SimulatorError, self).__init__("%s at %#06x" % (message, address))
+
+class _Stop(Exception):
+    """Raised by a handler to end a run. With after, the instruction finished
+    and the run carries on from the one after it, otherwise from next_pc
+    after the given cycles, or from the instruction itself.
+    """
+
+    def __init__(self, reason, next_pc=None, cycles=0, after=False):
+        self.reason = reason
+        self.next_pc = next_pc
+        self.cycles = cycles
+        self.after = after
+
+class _Sync(Exception):
+    """Raised by Simulator.now() when the run loop has to store the time."""
+
+def read_symbols(map_file):
+    """Read the symbols of an MPLINK map file into a dict of Symbols by name."""
+    symbols = {}
+    in_symbols = False
+    for line in Path(map_file).read_text(errors="replace").splitlines():
+        if "Symbols - Sorted by" in line:
+            in_symbols = True
+            continue
+        if not in_symbols:
+            continue
+        match = map_symbol_regex.match(line)
+        if match:
+            symbols[match.group(1)] = Symbol(match.group(1), int(match.group(2), 16), match.group(3))
+    return symbols
+
+def signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+def is_two_word(word):
+    return ((word & 0xF000) == 0xC000 or (word & 0xFE00) == 0xEC00 or
+            (word & 0xFF00) == 0xEF00 or (word & 0xFFC0) == 0xEE00)
+
+# The Z and N flags of each result
+ZERO_NEGATIVE = bytes(STATUS_Z if byte == 0 else (byte & 0x80) >> 3 for byte in range(256))
+
+_add_table = None
+
+def add_table():
+    """The result of every 8 bit addition, with the C, DC, Z, OV and N flags
+    it sets above it, indexed by a << 9 | b << 1 | carry. Subtraction adds
+    the complement with the carry set.
+    """
+    global _add_table
+    if _add_table == None:
+        table = [0] * (1 << 17)
+        for a in range(256):
+            for b in range(256):
+                overflow_bits = ~(a ^ b) & 0x80
+                for carry in (0, 1):
+                    result = a + b + carry
+                    byte = result & 0xFF
+                    status = result >> 8 | ((a & 0x0F) + (b & 0x0F) + carry) >> 3 & STATUS_DC
+                    status |= (overflow_bits & (a ^ byte)) >> 4 | ZERO_NEGATIVE[byte]
+                    table[a << 9 | b << 1 | carry] = status << 8 | byte
+        _add_table = table
+    return _add_table
+
+class Simulator(object):
+    """A PIC18F8520 running a program image.
+
+    Peripherals are models driven by events scheduled for the cycle they
+    happen in, instead of being stepped every cycle. Between events, the core
+    runs without looking at them.
+
+    Attributes:
+        program -- the contents of program memory
+        data -- the contents of data memory, including the special function registers
+        stack -- the hardware return stack, entry 0 is unused
+        pc -- address of the next instruction to run
+        cycles -- instruction cycles run since the last power on reset
+        instructions -- instructions run since the last power on reset
+        symbols -- Symbols from the map file, by name
+        ports -- the I/O ports and external interrupts, see Ports
+        timers -- Timer0 to Timer4
+        usarts -- USART1 and USART2, see Usart
+        adc -- the A/D converter, see Adc
+        master -- the SPI link to the master processor, see MasterLink
+    """
+
+    def __init__(self, image, symbols=None):
+        if not isinstance(image, vexupload.ProgramImage):
+            with vexupload.load_image(image) as loaded:
+                image = vexupload.ProgramImage(loaded.start_address, loaded.code, loaded.rows, loaded.hex_file)
+
+        self.program = bytearray((0xff,) * PROGRAM_MEMORY_SIZE)
+        self.program[image.start_address:image.end_address] = image.read(image.start_address,
+                                                                          image.end_address - image.start_address)
+        self.data = bytearray(DATA_MEMORY_SIZE)
+        self.stack = [0] * (STACK_DEPTH + 1)
+        self.shadow = [0, 0, 0]
+        self.symbols = symbols if symbols != None else {}
+
+        self.handlers = [self._decode_and_run] * (PROGRAM_MEMORY_SIZE // 2)
+        self.handlers[RETURN_TRAP >> 1] = self._return_trap
+
+        # Registers that do more than hold a value
+        self.indirect = [None] * DATA_MEMORY_SIZE
+        self.read_hooks = [None] * DATA_MEMORY_SIZE
+        self.write_hooks = [None] * DATA_MEMORY_SIZE
+        for fsr in (FSR0L, FSR1L, FSR2L):
+            for mode in (INDF, POSTINC, POSTDEC, PREINC, PLUSW):
+                self.indirect[fsr + mode] = self._indirect(fsr, mode)
+        self.add_register(TOSL, lambda: self._tos() & 0xFF, lambda value: self._set_tos(value, 0))
+        self.add_register(TOSH, lambda: self._tos() >> 8 & 0xFF, lambda value: self._set_tos(value, 8))
+        self.add_register(TOSU, lambda: self._tos() >> 16 & 0x1F, lambda value: self._set_tos(value & 0x1F, 16))
+
+        self.events = []
+        self._event_order = itertools.count()
+        self._running = False
+        self._synced = False
+        self._break_requested = False
+        self._batch_limit = 0
+
+        for register in (INTCON, INTCON2, INTCON3, RCON, PIE1, PIR1, IPR1, PIE2, PIR2, IPR2, PIE3, PIR3, IPR3):
+            self.add_register(register, None, functools.partial(self._write_interrupt_control, register))
+        self.ports = Ports(self)
+        self.timers = (Timer0(self),
+                       Timer16(self, T1CON, TMR1L, TMR1H, PIR1, PIR1_TMR1IF),
+                       Timer8(self, T2CON, TMR2, PR2, PIR1, PIR1_TMR2IF),
+                       Timer16(self, T3CON, TMR3L, TMR3H, PIR2, PIR2_TMR3IF),
+                       Timer8(self, T4CON, TMR4, PR4, PIR3, PIR3_TMR4IF))
+        self.usarts = (Usart(self, TXSTA1, RCSTA1, TXREG1, RCREG1, SPBRG1, PIR1, PIR1_TX1IF, PIR1_RC1IF),
+                       Usart(self, TXSTA2, RCSTA2, TXREG2, RCREG2, SPBRG2, PIR3, PIR3_TX2IF, PIR3_RC2IF))
+        self.adc = Adc(self)
+        self.master = MasterLink(self)
+        self.peripherals = (self.ports,) + self.timers + self.usarts + (self.adc, self.master)
+
+        self.power_on_reset()
+
+    def power_on_reset(self):
+        self.data[:] = bytes(DATA_MEMORY_SIZE)
+        self.cycles = 0
+        self.instructions = 0
+        self.reset()
+
+    def reset(self):
+        """Reset the core, like the RESET instruction. Data memory keeps its contents."""
+        data = self.data
+        for address in range(0xF60, DATA_MEMORY_SIZE):
+            data[address] = 0
+        data[INTCON2] = 0xFF
+        data[INTCON3] = 0xC0
+        data[RCON] = 0x1C
+        data[IPR1] = data[IPR2] = data[IPR3] = 0xFF
+        self.stack[:] = [0] * (STACK_DEPTH + 1)
+        self.shadow[:] = [0, 0, 0]
+        self.pc = RESET_VECTOR
+        self.events[:] = []
+        for peripheral in self.peripherals:
+            peripheral.reset()
+
+    def add_register(self, address, read=None, write=None):
+        """Give a special function register behaviour: read() returns its
+        value and write(value) is called when the program writes it. Without
+        one of them the value is kept in data memory as usual.
+        """
+        if write:
+            # Let the run loop see new events and interrupts straight away
+            def checked_write(value, write=write):
+                write(value)
+                if self._break_requested and self._running:
+                    raise _Stop("break", after=True)
+            self.write_hooks[address] = checked_write
+        else:
+            self.write_hooks[address] = None
+        self.read_hooks[address] = read
+        # Plain registers are accessed directly by the decoded instructions
+        self.invalidate()
+
+    def invalidate(self, address=None):
+        """Forget the decoded instruction at address, or all of them."""
+        if address == None:
+            self.handlers[:] = [self._decode_and_run] * len(self.handlers)
+            self.handlers[RETURN_TRAP >> 1] = self._return_trap
+        else:
+            self.handlers[address >> 1] = self._decode_and_run
+
+    def address_of(self, name):
+        """The address of a symbol, or of a number given as a string."""
+        if isinstance(name, int):
+            return name
+        if name in self.symbols:
+            return self.symbols[name].address
+        try:
+            return int(name, 0)
+        except ValueError:
+            raise KeyError("Unknown symbol: " + name)
+
+    def load(self, address):
+        """Read a data memory address like an instruction would."""
+        read = self.read_hooks[address]
+        return read() if read else self.data[address]
+
+    def store(self, address, value):
+        """Write a data memory address like an instruction would."""
+        write = self.write_hooks[address]
+        if write:
+            write(value)
+        else:
+            self.data[address] = value
+
+    def read_variable(self, name, size=1):
+        """Read a little endian variable from data memory."""
+        address = self.address_of(name)
+        return int.from_bytes(self.data[address:address + size], "little")
+
+    def write_variable(self, name, value, size=1):
+        address = self.address_of(name)
+        self.data[address:address + size] = (value & ((1 << size * 8) - 1)).to_bytes(size, "little")
+
+    @property
+    def w(self):
+        return self.data[WREG]
+
+    def run(self, cycles=None, until=None):
+        """Run for a number of instruction cycles, or until the program gets to
+        the address or symbol until. Returns why it stopped: "cycles", "until",
+        "sleep" or "return" (see call()).
+        """
+        limit = self.cycles + cycles if cycles != None else sys.maxsize
+        if until != None:
+            stop_address = self.address_of(until)
+            self.handlers[stop_address >> 1] = self._breakpoint
+        try:
+            while True:
+                self._fire_events()
+                vector = self.pending_interrupt()
+                if vector != None:
+                    self._take_interrupt(vector)
+                if self.cycles >= limit:
+                    return "cycles"
+                self._break_requested = False
+                self._batch_limit = min(limit, self._next_event())
+                reason = self._execute(self._batch_limit)
+                if reason not in ("cycles", "break"):
+                    return reason
+        finally:
+            if until != None:
+                self.invalidate(stop_address)
+                if stop_address == RETURN_TRAP:
+                    self.handlers[RETURN_TRAP >> 1] = self._return_trap
+
+    def call(self, function, max_cycles=None):
+        """Call a function from where the program is, and run until it
+        returns. Arguments have to be pushed on the software stack (FSR1) by
+        the caller. Returns the cycles the call took, including the return.
+        """
+        self._push(RETURN_TRAP)
+        return_pc = self.pc
+        self.pc = self.address_of(function)
+        start = self.cycles
+        reason = self.run(max_cycles)
+        if reason != "return":
+            raise SimulatorError(self.pc, "%s did not return" % function)
+        self.pc = return_pc
+        return self.cycles - start
+
+    def _execute(self, limit):
+        handlers = self.handlers
+        pc = self.pc
+        cycles = self.cycles
+        count = 0
+        pc_mask = PC_MASK
+        cost_shift = COST_SHIFT
+        self._running = True
+        try:
+            while cycles < limit:
+                try:
+                    next_pc = handlers[pc >> 1](pc)
+                except _Sync:
+                    # A peripheral needs to know the time, so run the
+                    # instruction again with it stored
+                    self.cycles = cycles
+                    self._synced = True
+                    try:
+                        next_pc = handlers[pc >> 1](pc)
+                    finally:
+                        self._synced = False
+                pc = next_pc & pc_mask
+                cycles += next_pc >> cost_shift
+                count += 1
+            return "cycles"
+        except _Stop as stop:
+            if stop.after:
+                size = 4 if is_two_word(self.program_word(pc)) else 2
+                pc += size
+                cycles += size >> 1
+                count += 1
+            elif stop.next_pc != None:
+                pc = stop.next_pc
+                cycles += stop.cycles
+                count += 1
+            return stop.reason
+        except IndexError:
+            if pc >> 1 < len(handlers):
+                raise
+            raise SimulatorError(pc, "Program counter outside of program memory")
+        finally:
+            self._running = False
+            self.pc = pc
+            self.cycles = cycles
+            self.instructions += count
+
+    # Events
+
+    def now(self):
+        """The current cycle, for peripherals. Register hooks have to call it
+        before they change anything, reads included, since the instruction may
+        be run again: MOVFF from a register that changes when it is read to
+        one that needs the time runs the read twice otherwise.
+        """
+        if self._running and not self._synced:
+            raise _Sync()
+        return self.cycles
+
+    def schedule(self, cycle, callback):
+        """Call callback(cycle) once the program has run to cycle. Returns an
+        Event that can be cancelled.
+        """
+        event = Event(cycle, callback)
+        heapq.heappush(self.events, (cycle, next(self._event_order), event))
+        if self._running and cycle < self._batch_limit:
+            self.request_break()
+        return event
+
+    def request_break(self):
+        """Have the run loop look at events and interrupts again after the
+        current instruction.
+        """
+        self._break_requested = True
+
+    def _next_event(self):
+        events = self.events
+        while events and events[0][2].cancelled:
+            heapq.heappop(events)
+        return events[0][0] if events else sys.maxsize
+
+    def _fire_events(self):
+        events = self.events
+        while events and events[0][0] <= self.cycles:
+            cycle, order, event = heapq.heappop(events)
+            if not event.cancelled:
+                event.cancelled = True
+                event.callback(cycle)
+
+    # Interrupts
+
+    def pending_interrupt(self):
+        """The vector of the interrupt the core would take now, or None."""
+        data = self.data
+        intcon = data[INTCON]
+        if not intcon & INTCON_GIEH:
+            return None
+        intcon2 = data[INTCON2]
+        intcon3 = data[INTCON3]
+        # RBIF, INT0IF, TMR0IF, INT1IF, INT2IF and INT3IF that are enabled
+        core = intcon & intcon >> 3 & 0x07 | (intcon3 & intcon3 >> 3 & 0x07) << 3
+        requests = [data[PIR1] & data[PIE1], data[PIR2] & data[PIE2], data[PIR3] & data[PIE3]]
+
+        if not data[RCON] & RCON_IPEN:
+            if core or intcon & INTCON_GIEL and any(requests):
+                return HIGH_PRIORITY_VECTOR
+            return None
+
+        core_high = intcon2 & 0x01 | 0x02 | (intcon2 & 0x04) | (intcon3 & 0x40) >> 3 | (intcon3 & 0x80) >> 3 | (intcon2 & 0x02) << 4
+        priorities = [data[IPR1], data[IPR2], data[IPR3]]
+        if core & core_high or any(request & priority for request, priority in zip(requests, priorities)):
+            return HIGH_PRIORITY_VECTOR
+        if intcon & INTCON_GIEL and (core & ~core_high or
+                                     any(request & ~priority for request, priority in zip(requests, priorities))):
+            return LOW_PRIORITY_VECTOR
+        return None
+
+    def _take_interrupt(self, vector):
+        data = self.data
+        self._push(self.pc)
+        self.shadow[:] = data[WREG], data[STATUS], data[BSR]
+        if vector == HIGH_PRIORITY_VECTOR:
+            data[INTCON] &= ~INTCON_GIEH
+        else:
+            data[INTCON] &= ~INTCON_GIEL
+        self.pc = vector
+        self.cycles += INTERRUPT_LATENCY
+
+    def _write_interrupt_control(self, register, value):
+        self.data[register] = value
+        if self._running and self.pending_interrupt() != None:
+            self.request_break()
+
+    def _breakpoint(self, pc):
+        raise _Stop("until")
+
+    def _return_trap(self, pc):
+        raise _Stop("return")
+
+    def _decode_and_run(self, pc):
+        handler = self.decode(pc)
+        self.handlers[pc >> 1] = handler
+        return handler(pc)
+
+    def program_word(self, address):
+        if address + 1 < PROGRAM_MEMORY_SIZE:
+            return self.program[address] | self.program[address + 1] << 8
+        return 0xFFFF
+
+    def read_program(self, address):
+        """A byte of program memory as seen by TBLRD. The configuration and ID
+        locations are not simulated and read as 0.
+        """
+        return self.program[address] if address < PROGRAM_MEMORY_SIZE else 0
+
+    # Hardware stack
+
+    def _tos(self):
+        return self.stack[self.data[STKPTR] & STKPTR_SP]
+
+    def _set_tos(self, value, shift):
+        sp = self.data[STKPTR] & STKPTR_SP
+        if sp:
+            self.stack[sp] = (self.stack[sp] & ~(0xFF << shift) | value << shift) & PC_MASK
+
+    def _push(self, address, at=None):
+        data = self.data
+        sp = data[STKPTR] & STKPTR_SP
+        if sp == STACK_DEPTH:
+            data[STKPTR] |= STKPTR_STKFUL
+            raise SimulatorError(at if at != None else self.pc, "Hardware stack overflow")
+        sp += 1
+        self.stack[sp] = address
+        data[STKPTR] = data[STKPTR] & ~STKPTR_SP | sp
+
+    def _pop(self, address):
+        data = self.data
+        sp = data[STKPTR] & STKPTR_SP
+        if sp == 0:
+            data[STKPTR] |= STKPTR_STKUNF
+            raise SimulatorError(address, "Hardware stack underflow")
+        data[STKPTR] = data[STKPTR] & ~STKPTR_SP | sp - 1
+        return self.stack[sp]
+
+    # Operands
+
+    def _indirect(self, fsr, mode):
+        """A function that returns the address an indirect register points
+        at, updating the FSR like the register does.
+        """
+        data = self.data
+        fsr_high = fsr + 1
+        if mode == INDF:
+            def address():
+                return data[fsr] | (data[fsr_high] & 0x0F) << 8
+        elif mode == PLUSW:
+            def address():
+                w = data[WREG]
+                return ((data[fsr] | (data[fsr_high] & 0x0F) << 8) + (w - 256 if w & 0x80 else w)) & 0xFFF
+        else:
+            step = 1 if mode in (POSTINC, PREINC) else -1
+            post = mode != PREINC
+            def address():
+                before = data[fsr] | (data[fsr_high] & 0x0F) << 8
+                after = (before + step) & 0xFFF
+                data[fsr] = after & 0xFF
+                data[fsr_high] = after >> 8
+                return before if post else after
+        return address
+
+    def _is_plain(self, address):
+        return not (self.indirect[address] or self.read_hooks[address] or self.write_hooks[address])
+
+    def _operand(self, f, a):
+        """The data address of a file register operand: an int if it is a
+        plain register known when decoding, otherwise a function that returns
+        the address when the instruction runs.
+        """
+        if a == 0:
+            address = f if f < 0x60 else 0xF00 | f
+            if self._is_plain(address):
+                return address
+            indirect = self.indirect[address]
+            return indirect if indirect else (lambda: address)
+
+        data = self.data
+        indirect_registers = self.indirect
+        def banked():
+            address = (data[BSR] & 0x0F) << 8 | f
+            indirect = indirect_registers[address]
+            return indirect() if indirect else address
+        return banked
+
+    def _absolute_operand(self, address):
+        if self._is_plain(address):
+            return address
+        indirect = self.indirect[address]
+        return indirect if indirect else (lambda: address)
+
+    # Flags
+
+    def _alu(self):
+        """Functions that set STATUS like the PIC ALU."""
+        data = self.data
+        sums = add_table()
+        zero_negative = ZERO_NEGATIVE
+
+        def add(a, b, carry):
+            result = sums[a << 9 | b << 1 | carry]
+            data[STATUS] = data[STATUS] & 0xE0 | result >> 8
+            return result & 0xFF
+
+        def logic(byte):
+            data[STATUS] = data[STATUS] & ~(STATUS_Z | STATUS_N) | zero_negative[byte]
+            return byte
+
+        def rotate(byte, carry):
+            data[STATUS] = data[STATUS] & ~(STATUS_C | STATUS_Z | STATUS_N) | zero_negative[byte] | carry
+            return byte
+
+        return add, logic, rotate
+
+    # Decoding
+
+    def decode(self, address):
+        """A handler function for the instruction at address."""
+        word = self.program_word(address)
+        data = self.data
+        add, logic, rotate = self._alu()
+
+        next_pc = address + 2 | 1 << COST_SHIFT
+        # Where a skip goes, and how long it takes, depends on the instruction after it
+        skipped = address + 2
+        if is_two_word(self.program_word(skipped)):
+            skipped = skipped + 4 | 3 << COST_SHIFT
+        else:
+            skipped = skipped + 2 | 2 << COST_SHIFT
+
+        f = word & 0xFF
+        a = word >> 8 & 1
+        d = word >> 9 & 1
+        top = word >> 12
+
+        if top == 0x0:
+            high = word >> 8
+            if high == 0x00:
+                return self._decode_control(address, word)
+            if high == 0x01:
+                k = word & 0x0F
+                def movlb(pc):
+                    data[BSR] = k
+                    return next_pc
+                return movlb
+            if high in (0x02, 0x03):
+                def mulwf(v):
+                    product = v * data[WREG]
+                    data[PRODL] = product & 0xFF
+                    data[PRODH] = product >> 8
+                return self._file_read(address, f, a, mulwf, next_pc)
+            if high < 0x08:
+                return self._file_op(address, f, a, d, lambda v: add(v, 0xFF, 0), next_pc)
+            return self._decode_literal(address, word, next_pc, add, logic)
+
+        if top == 0x1:
+            op = word >> 10 & 3
+            if op == 0:
+                alu = lambda v: logic(v | data[WREG])
+            elif op == 1:
+                alu = lambda v: logic(v & data[WREG])
+            elif op == 2:
+                alu = lambda v: logic(v ^ data[WREG])
+            else:
+                alu = lambda v: logic(v ^ 0xFF)
+            return self._file_op(address, f, a, d, alu, next_pc)
+
+        if top == 0x2:
+            op = word >> 10 & 3
+            if op == 0:
+                return self._file_op(address, f, a, d, lambda v: add(v, data[WREG], data[STATUS] & STATUS_C), next_pc)
+            if op == 1:
+                return self._file_op(address, f, a, d, lambda v: add(v, data[WREG], 0), next_pc)
+            if op == 2:
+                return self._file_op(address, f, a, d, lambda v: add(v, 1, 0), next_pc)
+            return self._file_skip(address, f, a, d, lambda v: v - 1 & 0xFF, lambda v: v == 0, skipped, next_pc)
+
+        if top == 0x3:
+            op = word >> 10 & 3
+            if op == 0:
+                alu = lambda v: rotate(v >> 1 | (data[STATUS] & STATUS_C) << 7, v & 1)
+            elif op == 1:
+                alu = lambda v: rotate((v << 1 | data[STATUS] & STATUS_C) & 0xFF, v >> 7)
+            elif op == 2:
+                alu = lambda v: (v << 4 | v >> 4) & 0xFF
+            else:
+                return self._file_skip(address, f, a, d, lambda v: v + 1 & 0xFF, lambda v: v == 0, skipped, next_pc)
+            return self._file_op(address, f, a, d, alu, next_pc)
+
+        if top == 0x4:
+            op = word >> 10 & 3
+            if op == 0:
+                return self._file_op(address, f, a, d, lambda v: logic((v >> 1 | v << 7) & 0xFF), next_pc)
+            if op == 1:
+                return self._file_op(address, f, a, d, lambda v: logic((v << 1 | v >> 7) & 0xFF), next_pc)
+            if op == 2:
+                return self._file_skip(address, f, a, d, lambda v: v + 1 & 0xFF, lambda v: v != 0, skipped, next_pc)
+            return self._file_skip(address, f, a, d, lambda v: v - 1 & 0xFF, lambda v: v != 0, skipped, next_pc)
+
+        if top == 0x5:
+            op = word >> 10 & 3
+            if op == 0:
+                return self._movf(address, f, a, d, logic, next_pc)
+            if op == 1:
+                alu = lambda v: add(data[WREG], v ^ 0xFF, data[STATUS] & STATUS_C)
+            elif op == 2:
+                alu = lambda v: add(v, data[WREG] ^ 0xFF, data[STATUS] & STATUS_C)
+            else:
+                alu = lambda v: add(v, data[WREG] ^ 0xFF, 1)
+            return self._file_op(address, f, a, d, alu, next_pc)
+
+        if top == 0x6:
+            op = word >> 9 & 7
+            if op == 0:
+                return self._file_test(address, f, a, lambda v: v < data[WREG], skipped, next_pc)
+            if op == 1:
+                return self._file_test(address, f, a, lambda v: v == data[WREG], skipped, next_pc)
+            if op == 2:
+                return self._file_test(address, f, a, lambda v: v > data[WREG], skipped, next_pc)
+            if op == 3:
+                return self._file_test(address, f, a, lambda v: v == 0, skipped, next_pc)
+            if op == 4:
+                return self._file_write(address, f, a, lambda: 0xFF, next_pc)
+            if op == 5:
+                def clrf():
+                    data[STATUS] |= STATUS_Z
+                    return 0
+                return self._file_write(address, f, a, clrf, next_pc)
+            if op == 6:
+                return self._file_op(address, f, a, 1, lambda v: add(0, v ^ 0xFF, 1), next_pc)
+            return self._file_write(address, f, a, lambda: data[WREG], next_pc)
+
+        if top <= 0xB:
+            mask = 1 << (word >> 9 & 7)
+            if top == 0x7:
+                return self._file_op(address, f, a, 1, lambda v: v ^ mask, next_pc)
+            if top == 0x8:
+                return self._file_op(address, f, a, 1, lambda v: v | mask, next_pc)
+            if top == 0x9:
+                clear = ~mask & 0xFF
+                return self._file_op(address, f, a, 1, lambda v: v & clear, next_pc)
+            if top == 0xA:
+                return self._file_test(address, f, a, lambda v: v & mask, skipped, next_pc)
+            return self._file_test(address, f, a, lambda v: not v & mask, skipped, next_pc)
+
+        if top == 0xC:
+            return self._movff(address, word & 0xFFF, self.program_word(address + 2) & 0xFFF)
+
+        if top == 0xD:
+            target = address + 2 + 2 * signed(word & 0x7FF, 11) & PC_MASK | 2 << COST_SHIFT
+            if word & 0x0800:
+                return_address = address + 2
+                push = self._push
+                def rcall(pc):
+                    push(return_address, address)
+                    return target
+                return rcall
+            def bra(pc):
+                return target
+            return bra
+
+        if top == 0xE:
+            return self._decode_branch(address, word, next_pc)
+
+        # The second word of a two word instruction is a NOP
+        def nop(pc):
+            return next_pc
+        return nop
+
+    def _decode_control(self, address, word):
+        data = self.data
+        next_pc = address + 2 | 1 << COST_SHIFT
+
+        if word in (0x0000, 0x0004):
+            # NOP, CLRWDT (the watchdog is not simulated)
+            def nop(pc):
+                return next_pc
+            return nop
+        if word == 0x0003:
+            def sleep(pc):
+                raise _Stop("sleep", after=True)
+            return sleep
+        if word == 0x0005:
+            push = self._push
+            return_address = address + 2
+            def push_pc(pc):
+                push(return_address, address)
+                return next_pc
+            return push_pc
+        if word == 0x0006:
+            pop = self._pop
+            def pop_pc(pc):
+                pop(address)
+                return next_pc
+            return pop_pc
+        if word == 0x0007:
+            def daw(pc):
+                w = data[WREG]
+                carry = data[STATUS] & STATUS_C
+                if w & 0x0F > 9 or data[STATUS] & STATUS_DC:
+                    w += 0x06
+                if w >> 4 > 9 or carry:
+                    w += 0x60
+                data[WREG] = w & 0xFF
+                data[STATUS] = data[STATUS] & ~STATUS_C | (1 if w > 0xFF or carry else 0)
+                return next_pc
+            return daw
+        if 0x0008 <= word <= 0x000F:
+            return self._table(address, word)
+        if word in (0x0010, 0x0011, 0x0012, 0x0013):
+            fast = word & 1
+            interrupt = word < 0x0012
+            pop = self._pop
+            shadow = self.shadow
+            def return_from(pc):
+                target = pop(address)
+                if fast:
+                    data[WREG], data[STATUS], data[BSR] = shadow
+                if interrupt:
+                    self._enable_interrupts()
+                    if self.pending_interrupt() != None:
+                        raise _Stop("break", target, 2)
+                return target | 2 << COST_SHIFT
+            return return_from
+        if word == 0x00FF:
+            def reset(pc):
+                self.reset()
+                return RESET_VECTOR | 1 << COST_SHIFT
+            return reset
+        return self._invalid(address, word)
+
+    def _enable_interrupts(self):
+        """RETFIE sets GIEH after a high priority interrupt, otherwise GIEL
+        (or GIE with priorities turned off).
+        """
+        data = self.data
+        if data[RCON] & 0x80 and data[INTCON] & 0x80:
+            data[INTCON] |= 0x40
+        else:
+            data[INTCON] |= 0x80
+
+    def _decode_literal(self, address, word, next_pc, add, logic):
+        data = self.data
+        k = word & 0xFF
+        high = word >> 8
+        if high == 0x08:
+            def sublw(pc):
+                data[WREG] = add(k, data[WREG] ^ 0xFF, 1)
+                return next_pc
+            return sublw
+        if high == 0x09:
+            def iorlw(pc):
+                data[WREG] = logic(data[WREG] | k)
+                return next_pc
+            return iorlw
+        if high == 0x0A:
+            def xorlw(pc):
+                data[WREG] = logic(data[WREG] ^ k)
+                return next_pc
+            return xorlw
+        if high == 0x0B:
+            def andlw(pc):
+                data[WREG] = logic(data[WREG] & k)
+                return next_pc
+            return andlw
+        if high == 0x0C:
+            pop = self._pop
+            def retlw(pc):
+                data[WREG] = k
+                return pop(address) | 2 << COST_SHIFT
+            return retlw
+        if high == 0x0D:
+            def mullw(pc):
+                product = data[WREG] * k
+                data[PRODL] = product & 0xFF
+                data[PRODH] = product >> 8
+                return next_pc
+            return mullw
+        if high == 0x0E:
+            def movlw(pc):
+                data[WREG] = k
+                return next_pc
+            return movlw
+        def addlw(pc):
+            data[WREG] = add(data[WREG], k, 0)
+            return next_pc
+        return addlw
+
+    def _decode_branch(self, address, word, next_pc):
+        data = self.data
+        high = word >> 8
+
+        if high < 0xE8:
+            # BZ, BNZ, BC, BNC, BOV, BNOV, BN, BNN
+            mask = (STATUS_Z, STATUS_C, STATUS_OV, STATUS_N)[high >> 1 & 3]
+            target = address + 2 + 2 * signed(word & 0xFF, 8) & PC_MASK | 2 << COST_SHIFT
+            if high & 1:
+                def branch_clear(pc):
+                    return next_pc if data[STATUS] & mask else target
+                return branch_clear
+            def branch_set(pc):
+                return target if data[STATUS] & mask else next_pc
+            return branch_set
+
+        second = self.program_word(address + 2)
+        if high in (0xEC, 0xED, 0xEF) and second >> 12 == 0xF:
+            target = ((second & 0xFFF) << 8 | word & 0xFF) << 1 | 2 << COST_SHIFT
+            if high == 0xEF:
+                def goto(pc):
+                    return target
+                return goto
+
+            return_address = address + 4
+            push = self._push
+            if high & 1:
+                shadow = self.shadow
+                def call_fast(pc):
+                    push(return_address, address)
+                    shadow[:] = data[WREG], data[STATUS], data[BSR]
+                    return target
+                return call_fast
+            def call(pc):
+                push(return_address, address)
+                return target
+            return call
+
+        if high == 0xEE and word & 0xC0 == 0 and second >> 8 == 0xF0:
+            if word >> 4 & 3 == 3:
+                return self._invalid(address, word)
+            fsr = (FSR0L, FSR1L, FSR2L)[word >> 4 & 3]
+            high_byte = word & 0x0F
+            low_byte = second & 0xFF
+            after = address + 4 | 2 << COST_SHIFT
+            def lfsr(pc):
+                data[fsr] = low_byte
+                data[fsr + 1] = high_byte
+                return after
+            return lfsr
+
+        return self._invalid(address, word)
+
+    def _invalid(self, address, word):
+        def invalid(pc):
+            raise SimulatorError(address, "Invalid instruction %#06x" % word)
+        return invalid
+
+    def _table(self, address, word):
+        data = self.data
+        read_program = self.read_program
+        mode = word & 3
+        step = (0, 1, -1, 1)[mode]
+        pre = mode == 3
+        is_read = word < 0x000C
+        next_pc = address + 2 | 2 << COST_SHIFT
+        def table(pc):
+            pointer = data[TBLPTRL] | data[TBLPTRH] << 8 | (data[TBLPTRU] & 0x3F) << 16
+            if pre:
+                pointer = pointer + 1 & 0x3FFFFF
+            if is_read:
+                data[TABLAT] = read_program(pointer)
+            # Table writes only fill the holding registers, which are only
+            # written to flash through EECON1, so they have no effect here
+            if step and not pre:
+                pointer = pointer + step & 0x3FFFFF
+            if step:
+                data[TBLPTRL] = pointer & 0xFF
+                data[TBLPTRH] = pointer >> 8 & 0xFF
+                data[TBLPTRU] = pointer >> 16
+            return next_pc
+        return table
+
+    def _with_pcl(self, address, handler, operand, reads, writes):
+        """Reading PCL latches the upper bytes of the program counter into
+        PCLATH and PCLATU, writing it jumps.
+        """
+        if operand != PCL:
+            return handler
+        data = self.data
+        pc_next = address + 2
+        if reads:
+            inner = handler
+            def handler(pc):
+                data[PCL] = pc_next & 0xFF
+                data[PCLATH] = pc_next >> 8 & 0xFF
+                data[PCLATU] = pc_next >> 16
+                return inner(pc)
+        if writes:
+            jump = handler
+            def handler(pc):
+                jump(pc)
+                return (data[PCLATU] << 16 | data[PCLATH] << 8 | data[PCL]) & PC_MASK & ~1 | 2 << COST_SHIFT
+        return handler
+
+    def _file_op(self, address, f, a, d, alu, next_pc):
+        """Read, modify and write a file register (or write the result to W)."""
+        data = self.data
+        operand = self._operand(f, a)
+        if isinstance(operand, int):
+            if d:
+                def handler(pc):
+                    data[operand] = alu(data[operand])
+                    return next_pc
+            else:
+                def handler(pc):
+                    data[WREG] = alu(data[operand])
+                    return next_pc
+            return self._with_pcl(address, handler, operand, True, d)
+
+        read_hooks = self.read_hooks
+        write_hooks = self.write_hooks
+        if d:
+            def handler(pc):
+                target = operand()
+                read = read_hooks[target]
+                result = alu(read() if read else data[target])
+                write = write_hooks[target]
+                if write:
+                    write(result)
+                else:
+                    data[target] = result
+                return next_pc
+        else:
+            def handler(pc):
+                target = operand()
+                read = read_hooks[target]
+                data[WREG] = alu(read() if read else data[target])
+                return next_pc
+        return handler
+
+    def _file_read(self, address, f, a, use, next_pc):
+        data = self.data
+        operand = self._operand(f, a)
+        if isinstance(operand, int):
+            def handler(pc):
+                use(data[operand])
+                return next_pc
+            return self._with_pcl(address, handler, operand, True, False)
+        load = self.load
+        def handler(pc):
+            use(load(operand()))
+            return next_pc
+        return handler
+
+    def _file_write(self, address, f, a, value, next_pc):
+        data = self.data
+        operand = self._operand(f, a)
+        if isinstance(operand, int):
+            def handler(pc):
+                data[operand] = value()
+                return next_pc
+            return self._with_pcl(address, handler, operand, False, True)
+        write_hooks = self.write_hooks
+        def handler(pc):
+            target = operand()
+            write = write_hooks[target]
+            if write:
+                write(value())
+            else:
+                data[target] = value()
+            return next_pc
+        return handler
+
+    def _movf(self, address, f, a, d, logic, next_pc):
+        data = self.data
+        operand = self._operand(f, a)
+        if isinstance(operand, int):
+            if d:
+                def movf(pc):
+                    logic(data[operand])
+                    return next_pc
+            else:
+                zero_negative = ZERO_NEGATIVE
+                def movf(pc):
+                    value = data[operand]
+                    data[WREG] = value
+                    data[STATUS] = data[STATUS] & ~(STATUS_Z | STATUS_N) | zero_negative[value]
+                    return next_pc
+            return self._with_pcl(address, movf, operand, True, False)
+        read_hooks = self.read_hooks
+        if d:
+            def movf(pc):
+                source = operand()
+                read = read_hooks[source]
+                logic(read() if read else data[source])
+                return next_pc
+        else:
+            def movf(pc):
+                source = operand()
+                read = read_hooks[source]
+                data[WREG] = logic(read() if read else data[source])
+                return next_pc
+        return movf
+
+    def _file_test(self, address, f, a, condition, skipped, next_pc):
+        """Skip the next instruction if condition(file register) is true."""
+        data = self.data
+        operand = self._operand(f, a)
+        if isinstance(operand, int):
+            def handler(pc):
+                return skipped if condition(data[operand]) else next_pc
+            return self._with_pcl(address, handler, operand, True, False)
+        load = self.load
+        def handler(pc):
+            return skipped if condition(load(operand())) else next_pc
+        return handler
+
+    def _file_skip(self, address, f, a, d, alu, condition, skipped, next_pc):
+        """Modify a file register without changing STATUS, and skip the next
+        instruction if condition(result) is true.
+        """
+        data = self.data
+        operand = self._operand(f, a)
+        target = operand if d else WREG
+        if isinstance(operand, int):
+            def handler(pc):
+                result = alu(data[operand])
+                data[target] = result
+                return skipped if condition(result) else next_pc
+            return self._with_pcl(address, handler, operand, True, False)
+        load = self.load
+        store = self.store
+        def handler(pc):
+            source = operand()
+            result = alu(load(source))
+            if d:
+                store(source, result)
+            else:
+                data[WREG] = result
+            return skipped if condition(result) else next_pc
+        return handler
+
+    def _movff(self, address, source, destination):
+        data = self.data
+        next_pc = address + 4 | 2 << COST_SHIFT
+        source = self._absolute_operand(source)
+        destination = self._absolute_operand(destination)
+        if isinstance(source, int) and isinstance(destination, int):
+            def movff(pc):
+                data[destination] = data[source]
+                return next_pc
+            return movff
+
+        read_hooks = self.read_hooks
+        write_hooks = self.write_hooks
+        if isinstance(source, int):
+            source_address = source
+            source = lambda: source_address
+        if isinstance(destination, int):
+            destination_address = destination
+            destination = lambda: destination_address
+        def movff(pc):
+            address = source()
+            read = read_hooks[address]
+            value = read() if read else data[address]
+            address = destination()
+            write = write_hooks[address]
+            if write:
+                write(value)
+            else:
+                data[address] = value
+            return next_pc
+        return movff
+
+class Event(object):
+    """An event scheduled with Simulator.schedule()."""
+
+    __slots__ = ("cycle", "callback", "cancelled")
+
+    def __init__(self, cycle, callback):
+        self.cycle = cycle
+        self.callback = callback
+        self.cancelled = False
+
+    def cancel(self):
+        self.cancelled = True
+
+class Ports(object):
+    """The I/O ports, and the external interrupts on PORTB.
+
+    Reading PORTx gives LATx for outputs and the level set with set_input()
+    for inputs (TRISx bits set). INT0-INT3 (RB0-RB3) set their flags on the
+    edge selected in INTCON2, and a change on RB4-RB7 from the last read of
+    PORTB sets RBIF. The Vex digital I/O ports are wired to these pins, so
+    this covers the interrupt ports.
+    """
+
+    def __init__(self, simulator):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.inputs = bytearray(len(PORT_NAMES))
+        self.portb_read = 0
+        for index in range(len(PORT_NAMES)):
+            simulator.add_register(PORTA + index, functools.partial(self.read_port, index),
+                                   functools.partial(self.write_port, index))
+
+    def reset(self):
+        for index in range(len(PORT_NAMES)):
+            self.data[TRISA + index] = 0xFF
+        self.portb_read = 0
+
+    def read_port(self, index):
+        data = self.data
+        tris = data[TRISA + index]
+        value = data[LATA + index] & ~tris & 0xFF | self.inputs[index] & tris
+        if index == 1:
+            self.portb_read = value
+        return value
+
+    def write_port(self, index, value):
+        self.data[LATA + index] = value
+
+    def output(self, port):
+        """The levels the program drives on a port's output pins."""
+        index = PORT_NAMES.index(port)
+        return self.data[LATA + index] & ~self.data[TRISA + index] & 0xFF
+
+    def set_input(self, port, bit, level):
+        """Set the level of an input pin, for example set_input("B", 2, 1)."""
+        index = PORT_NAMES.index(port)
+        old = self.inputs[index]
+        new = old | 1 << bit if level else old & ~(1 << bit)
+        self.inputs[index] = new
+        if index != 1:
+            return
+
+        data = self.data
+        tris = data[TRISA + 1]
+        changed = (old ^ new) & tris
+        for pin, (register, flag) in enumerate(((INTCON, INTCON_INT0IF), (INTCON3, INTCON3_INT1IF),
+                                                (INTCON3, INTCON3_INT2IF), (INTCON3, INTCON3_INT3IF))):
+            rising_edge = data[INTCON2] & 0x40 >> pin
+            if changed & 1 << pin and bool(new & 1 << pin) == bool(rising_edge):
+                data[register] |= flag
+        if (new ^ self.portb_read) & tris & 0xF0:
+            data[INTCON] |= INTCON_RBIF
+
+class Timer0(object):
+    """Timer0: an 8 or 16 bit counter of instruction cycles, with a
+    prescaler, that sets TMR0IF when it overflows. In 16 bit mode TMR0H is
+    a buffer, read and written with TMR0L. Counting T0CKI is not simulated,
+    the timer stops instead.
+    """
+
+    def __init__(self, simulator):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.event = None
+        simulator.add_register(T0CON, None, self.write_control)
+        simulator.add_register(TMR0L, self.read_low, self.write_low)
+
+    def reset(self):
+        self.data[T0CON] = 0xFF
+        self.count = 0
+        self.start = 0
+        self.event = None
+
+    def running(self):
+        return self.data[T0CON] & 0xA0 == 0x80
+
+    def prescale(self):
+        control = self.data[T0CON]
+        return 1 if control & 0x08 else 2 << (control & 0x07)
+
+    def size(self):
+        return 0x100 if self.data[T0CON] & 0x40 else 0x10000
+
+    def sync(self, now):
+        if self.running():
+            prescale = self.prescale()
+            ticks = (now - self.start) // prescale
+            self.count = (self.count + ticks) % self.size()
+            self.start += ticks * prescale
+        else:
+            self.start = now
+
+    def reschedule(self):
+        if self.event:
+            self.event.cancel()
+            self.event = None
+        if self.running():
+            self.event = self.simulator.schedule(self.start + (self.size() - self.count) * self.prescale(),
+                                                 self.overflow)
+
+    def overflow(self, cycle):
+        self.sync(cycle)
+        self.data[INTCON] |= INTCON_TMR0IF
+        self.reschedule()
+
+    def write_control(self, value):
+        now = self.simulator.now()
+        self.sync(now)
+        self.data[T0CON] = value
+        self.count %= self.size()
+        self.start = now
+        self.reschedule()
+
+    def read_low(self):
+        self.sync(self.simulator.now())
+        self.data[TMR0H] = self.count >> 8
+        return self.count & 0xFF
+
+    def write_low(self, value):
+        now = self.simulator.now()
+        self.count = (self.data[TMR0H] << 8 | value) % self.size()
+        self.start = now
+        self.reschedule()
+
+class Timer16(object):
+    """Timer1 or Timer3: a 16 bit counter of instruction cycles with a
+    prescaler, that sets its interrupt flag when it overflows. With RD16 set,
+    the high byte is a buffer read and written with the low byte. Counting an
+    external clock is not simulated, the timer stops instead.
+    """
+
+    def __init__(self, simulator, control, low, high, flag_register, flag):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.control = control
+        self.low = low
+        self.high = high
+        self.flag_register = flag_register
+        self.flag = flag
+        self.event = None
+        simulator.add_register(control, None, self.write_control)
+        simulator.add_register(low, self.read_low, self.write_low)
+        simulator.add_register(high, self.read_high, self.write_high)
+
+    def reset(self):
+        self.count = 0
+        self.start = 0
+        self.event = None
+
+    def running(self):
+        return self.data[self.control] & 0x03 == 0x01
+
+    def prescale(self):
+        return 1 << (self.data[self.control] >> 4 & 0x03)
+
+    def buffered(self):
+        return self.data[self.control] & 0x80
+
+    def sync(self, now):
+        if self.running():
+            prescale = self.prescale()
+            ticks = (now - self.start) // prescale
+            self.count = (self.count + ticks) & 0xFFFF
+            self.start += ticks * prescale
+        else:
+            self.start = now
+
+    def reschedule(self):
+        if self.event:
+            self.event.cancel()
+            self.event = None
+        if self.running():
+            self.event = self.simulator.schedule(self.start + (0x10000 - self.count) * self.prescale(), self.overflow)
+
+    def overflow(self, cycle):
+        self.sync(cycle)
+        self.data[self.flag_register] |= self.flag
+        self.reschedule()
+
+    def write_control(self, value):
+        now = self.simulator.now()
+        self.sync(now)
+        self.data[self.control] = value
+        self.reschedule()
+
+    def read_low(self):
+        self.sync(self.simulator.now())
+        if self.buffered():
+            self.data[self.high] = self.count >> 8
+        return self.count & 0xFF
+
+    def read_high(self):
+        if self.buffered():
+            return self.data[self.high]
+        self.sync(self.simulator.now())
+        return self.count >> 8
+
+    def write_low(self, value):
+        now = self.simulator.now()
+        self.sync(now)
+        high = self.data[self.high] if self.buffered() else self.count >> 8
+        self.count = high << 8 | value
+        self.start = now
+        self.reschedule()
+
+    def write_high(self, value):
+        if self.buffered():
+            self.data[self.high] = value
+            return
+        now = self.simulator.now()
+        self.sync(now)
+        self.count = value << 8 | self.count & 0xFF
+        self.start = now
+        self.reschedule()
+
+class Timer8(object):
+    """Timer2 or Timer4: an 8 bit counter of instruction cycles with a
+    prescaler, that goes back to 0 after matching its period register. Every
+    postscale matches, it sets its interrupt flag.
+    """
+
+    def __init__(self, simulator, control, timer, period, flag_register, flag):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.control = control
+        self.timer = timer
+        self.period = period
+        self.flag_register = flag_register
+        self.flag = flag
+        self.event = None
+        simulator.add_register(control, None, self.write_control)
+        simulator.add_register(timer, self.read_timer, self.write_timer)
+        simulator.add_register(period, None, self.write_period)
+
+    def reset(self):
+        self.data[self.period] = 0xFF
+        self.count = 0
+        self.matches = 0
+        self.start = 0
+        self.event = None
+
+    def running(self):
+        return self.data[self.control] & 0x04
+
+    def prescale(self):
+        return (1, 4, 16, 16)[self.data[self.control] & 0x03]
+
+    def postscale(self):
+        return (self.data[self.control] >> 3 & 0x0F) + 1
+
+    def sync(self, now):
+        if not self.running():
+            self.start = now
+            return
+        prescale = self.prescale()
+        ticks = (now - self.start) // prescale
+        self.start += ticks * prescale
+
+        period = self.data[self.period] + 1
+        count = self.count
+        if count >= period:
+            # Above the period register, the timer has to wrap around first
+            if ticks < 0x100 - count:
+                self.count = count + ticks
+                return
+            ticks -= 0x100 - count
+            count = 0
+        count += ticks
+        self.matches = (self.matches + count // period) % self.postscale()
+        self.count = count % period
+
+    def reschedule(self):
+        if self.event:
+            self.event.cancel()
+            self.event = None
+        if not self.running():
+            return
+        period = self.data[self.period] + 1
+        if self.count < period:
+            ticks = period - self.count
+        else:
+            ticks = 0x100 - self.count + period
+        ticks += (self.postscale() - self.matches - 1) * period
+        self.event = self.simulator.schedule(self.start + ticks * self.prescale(), self.postscaled)
+
+    def postscaled(self, cycle):
+        self.sync(cycle)
+        self.data[self.flag_register] |= self.flag
+        self.reschedule()
+
+    def write_control(self, value):
+        now = self.simulator.now()
+        self.sync(now)
+        self.data[self.control] = value
+        # Writing the control register clears the prescaler and postscaler
+        self.matches = 0
+        self.start = now
+        self.reschedule()
+
+    def read_timer(self):
+        self.sync(self.simulator.now())
+        return self.count
+
+    def write_timer(self, value):
+        now = self.simulator.now()
+        self.count = value
+        self.matches = 0
+        self.start = now
+        self.reschedule()
+
+    def write_period(self, value):
+        now = self.simulator.now()
+        self.sync(now)
+        self.data[self.period] = value
+        self.reschedule()
+
+class Usart(object):
+    """An asynchronous USART, timed from its baud rate register.
+
+    Bytes written to TXREG are sent one at a time and collected in output.
+    Bytes given to receive() arrive one at a time into the two byte receive
+    FIFO, setting RCIF, or OERR if it is full. Synchronous mode is not
+    simulated.
+    """
+
+    def __init__(self, simulator, txsta, rcsta, txreg, rcreg, spbrg, flag_register, tx_flag, rc_flag):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.txsta = txsta
+        self.rcsta = rcsta
+        self.txreg = txreg
+        self.rcreg = rcreg
+        self.spbrg = spbrg
+        self.flag_register = flag_register
+        self.tx_flag = tx_flag
+        self.rc_flag = rc_flag
+        self.output = bytearray()
+        simulator.add_register(txsta, None, self.write_txsta)
+        simulator.add_register(rcsta, None, self.write_rcsta)
+        simulator.add_register(txreg, None, self.write_txreg)
+        simulator.add_register(rcreg, self.read_rcreg, None)
+
+    def reset(self):
+        self.data[self.txsta] = 0x02
+        self.transmit_buffer = None
+        self.transmitting = False
+        self.fifo = collections.deque()
+        self.pending = collections.deque()
+        self.receive_event = None
+
+    def byte_cycles(self):
+        """Instruction cycles to send a byte with a start and stop bit."""
+        cycles_per_bit = (4 if self.data[self.txsta] & 0x04 else 16) * (self.data[self.spbrg] + 1)
+        return 10 * cycles_per_bit
+
+    def receive(self, data):
+        """Start sending bytes to the program, at the current baud rate."""
+        self.pending.extend(data)
+        if not self.receive_event:
+            self.receive_event = self.simulator.schedule(self.simulator.now() + self.byte_cycles(), self.received)
+
+    def received(self, cycle):
+        data = self.data
+        byte = self.pending.popleft()
+        if data[self.rcsta] & 0x90 == 0x90:
+            if len(self.fifo) < 2:
+                self.fifo.append(byte)
+                data[self.flag_register] |= self.rc_flag
+            else:
+                data[self.rcsta] |= 0x02
+        self.receive_event = None
+        if self.pending:
+            self.receive_event = self.simulator.schedule(cycle + self.byte_cycles(), self.received)
+
+    def read_rcreg(self):
+        # Popping the FIFO twice would lose a byte
+        self.simulator.now()
+        if not self.fifo:
+            return self.data[self.rcreg]
+        self.data[self.rcreg] = self.fifo.popleft()
+        if not self.fifo:
+            self.data[self.flag_register] &= ~self.rc_flag
+        return self.data[self.rcreg]
+
+    def write_rcsta(self, value):
+        # Clearing CREN clears an overrun
+        if not value & 0x10:
+            value &= ~0x02
+        self.data[self.rcsta] = value
+
+    def write_txsta(self, value):
+        data = self.data
+        data[self.txsta] = value & ~0x02 | data[self.txsta] & 0x02
+        if value & 0x20 and self.transmit_buffer == None:
+            data[self.flag_register] |= self.tx_flag
+
+    def write_txreg(self, value):
+        now = self.simulator.now()
+        data = self.data
+        data[self.txreg] = value
+        if not data[self.txsta] & 0x20:
+            return
+        if self.transmitting:
+            self.transmit_buffer = value
+            data[self.flag_register] &= ~self.tx_flag
+        else:
+            self.start_transmit(now, value)
+
+    def start_transmit(self, cycle, value):
+        self.transmitting = True
+        self.data[self.txsta] &= ~0x02
+        self.data[self.flag_register] |= self.tx_flag
+        self.simulator.schedule(cycle + self.byte_cycles(), functools.partial(self.transmitted, value))
+
+    def transmitted(self, value, cycle):
+        self.output.append(value)
+        self.transmitting = False
+        if self.transmit_buffer != None:
+            value = self.transmit_buffer
+            self.transmit_buffer = None
+            self.start_transmit(cycle, value)
+        else:
+            self.data[self.txsta] |= 0x02
+
+class Adc(object):
+    """The A/D converter. Setting GO starts a conversion of the selected
+    channel's input (see set_input()), which sets ADRESH:ADRESL and ADIF
+    12 TAD later.
+    """
+
+    def __init__(self, simulator):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.inputs = [0] * 16
+        simulator.add_register(ADCON0, None, self.write_control)
+
+    def reset(self):
+        self.event = None
+
+    def set_input(self, channel, value):
+        """Set the 10 bit value a channel converts to."""
+        self.inputs[channel] = value & 0x3FF
+
+    def write_control(self, value):
+        now = self.simulator.now()
+        data = self.data
+        data[ADCON0] = value
+        if value & 0x03 == 0x03 and not self.event:
+            tad = ADC_TAD_CYCLES[data[ADCON2] & 0x07]
+            self.event = self.simulator.schedule(now + max(1, int(ADC_CONVERSION_TADS * tad)), self.converted)
+
+    def converted(self, cycle):
+        data = self.data
+        self.event = None
+        if not data[ADCON0] & 0x02:
+            return
+        value = self.inputs[data[ADCON0] >> 2 & 0x0F]
+        if data[ADCON2] & 0x80:
+            data[ADRESH] = value >> 8
+            data[ADRESL] = value & 0xFF
+        else:
+            data[ADRESH] = value >> 2
+            data[ADRESL] = (value & 0x03) << 6
+        data[ADCON0] &= ~0x02
+        data[PIR1] |= PIR1_ADIF
+
+class MasterLink(object):
+    """The master processor's side of the SPI link, with the user processor
+    as the slave.
+
+    Once set_packet() has been called, the packet is sent every 18.5 ms, a
+    byte at a time. Each byte the program receives sets BF and SSPIF, and
+    the byte it last wrote to SSPBUF goes back to the master. The bytes sent
+    back for each packet are kept in replies (newest last), and passed to
+    on_reply if it is set. The contents of the packets are up to the caller,
+    they are whatever the Vex library expects from the master.
+    """
+
+    def __init__(self, simulator, period=MASTER_PACKET_CYCLES, byte_cycles=MASTER_BYTE_CYCLES):
+        self.simulator = simulator
+        self.data = simulator.data
+        self.period = period
+        self.byte_cycles = byte_cycles
+        self.packet = None
+        self.replies = collections.deque(maxlen=MASTER_REPLIES)
+        self.on_reply = None
+        simulator.add_register(SSPBUF, self.read_buffer, self.write_buffer)
+
+    def reset(self):
+        self.received = 0
+        self.transmit = 0
+        self.event = None
+        if self.packet != None:
+            self.event = self.simulator.schedule(self.simulator.now() + self.period, self.start_packet)
+
+    def set_packet(self, packet):
+        """Set the packet sent from now on."""
+        self.packet = bytes(packet)
+        if not self.event:
+            self.event = self.simulator.schedule(self.simulator.now() + self.period, self.start_packet)
+
+    def enabled(self):
+        control = self.data[SSPCON1]
+        return control & 0x20 and control & 0x0F in (0x04, 0x05)
+
+    def start_packet(self, cycle):
+        self.packet_start = cycle
+        self.reply = bytearray()
+        self.send_byte(0, cycle)
+
+    def send_byte(self, index, cycle):
+        data = self.data
+        if self.enabled():
+            self.reply.append(self.transmit)
+            if data[SSPSTAT] & 0x01:
+                data[SSPCON1] |= 0x40
+            else:
+                self.received = self.packet[index]
+                data[SSPSTAT] |= 0x01
+            data[PIR1] |= PIR1_SSPIF
+
+        if index + 1 < len(self.packet):
+            self.event = self.simulator.schedule(cycle + self.byte_cycles, functools.partial(self.send_byte, index + 1))
+            return
+        if self.enabled():
+            self.replies.append(bytes(self.reply))
+            if self.on_reply:
+                self.on_reply(self.replies[-1])
+        self.event = self.simulator.schedule(self.packet_start + self.period, self.start_packet)
+
+    def read_buffer(self):
+        self.simulator.now()
+        self.data[SSPSTAT] &= ~0x01
+        return self.received
+
+    def write_buffer(self, value):
+        self.transmit = value
+
+def parse_args():
+    import argparse
+    parser = argparse.ArgumentParser(description="Run a Vex program on a simulated PIC18F8520")
+
+    parser.add_argument("hex_file", help="program to run")
+    parser.add_argument("--map", help="MPLINK map file with the program's symbols, by default Mapfile.map next to the hex file")
+    parser.add_argument("--seconds", help="controller time to run for", type=float, default=1.0)
+    parser.add_argument("--cycles", help="instruction cycles to run for, instead of --seconds", type=int)
+    parser.add_argument("--until", help="stop when the program gets to this symbol or address")
+
+    return parser.parse_args()
+
+def main(args):
+    map_file = Path(args.map) if args.map else Path(args.hex_file).parent / "Mapfile.map"
+    symbols = read_symbols(map_file) if map_file.exists() else {}
+    simulator = Simulator(args.hex_file, symbols)
+
+    cycles = args.cycles if args.cycles != None else int(args.seconds * INSTRUCTION_RATE)
+    start = time.perf_counter()
+    try:
+        reason = simulator.run(cycles, args.until)
+    except SimulatorError as e:
+        print("Error: " + str(e), flush=True, file=sys.stderr)
+        reason = "error"
+    elapsed = time.perf_counter() - start
+
+    print("Stopped (%s) at %#06x" % (reason, simulator.pc))
+    print("%i instructions in %i cycles, %.6f s of controller time." %
+          (simulator.instructions, simulator.cycles, simulator.cycles / INSTRUCTION_RATE))
+    if elapsed > 0:
+        print("Simulated %.0f instructions/s." % (simulator.instructions / elapsed))
+    return 0 if reason != "error" else 1
+
+if __name__ == "__main__":
+    exit(main(parse_args()))
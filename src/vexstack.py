@@ -0,0 +1,398 @@
+#!/usr/bin/env python3
+"""Static analysis of the stacks of Vex programs.
+
+MPLAB C18 keeps arguments, locals and saved registers on a software stack,
+with FSR1 as the stack pointer and FSR2 as the frame pointer. Following the
+instructions of each function in the linked hex file, the analysis finds how
+far FSR1 can get above where it was at the call, including the functions it
+calls. The interrupt handlers use the same stack, so their use is added on
+top of main's. The analysis also finds how deep calls go on the 31 level
+hardware return stack.
+
+C18 calls through function pointers with computed jumps. Unless wcet.cfg
+gives their targets, those in the library functions that dispatch handlers
+are taken to call one of the functions the project passes to
+RegisterInterruptHandler(), RegisterRepeatingTimer(), RegisterSingleTimer(),
+TimerWheel_Repeating() and TimerWheel_Single(), or that tasks.cfg declares
+as tasks. Any other call through a
+pointer without targets leaves the analysis incomplete.
+
+vexbuild --small-stack uses the analysis to build without -ls (the large
+stack model) when the stack is proven to stay in its bank.
+"""
+import collections
+import re
+import sys
+from pathlib import Path
+
+import vexsim
+import vextask
+import vexwcet
+from vexsim import FSR1L, FSR2L, POSTINC, POSTDEC, PREINC, STACK_DEPTH
+from vexsim import HIGH_PRIORITY_VECTOR, LOW_PRIORITY_VECTOR
+
+
+POSTINC1 = FSR1L + POSTINC
+POSTDEC1 = FSR1L + POSTDEC
+PREINC1 = FSR1L + PREINC
+
+# Size of the stack in the WPILib linker script (STACK SIZE=0x100 RAM=gpr6)
+DEFAULT_STACK_SIZE = 0x100
+
+# Library functions that call the registered handlers through pointers
+DISPATCHERS = frozenset(["InterruptHandlerLow", "InterruptHandlerHigh", "InterruptWatcherHandler",
+                         "Timer_0_Int_Handler", "Timer_1_Int_Handler", "Timer_2_Int_Handler",
+                         "Timer_3_Int_Handler", "Timer_4_Int_Handler",
+                         "TimerWheel_Tick", "TimerWheel_Dispatch", "runTask"])
+
+# Heights past which a path is taken to push in a loop forever
+HEIGHT_LIMIT = 0x1000
+
+register_regex = re.compile(r"\b(?:Register(?:InterruptHandler|RepeatingTimer|SingleTimer)|"
+                            r"TimerWheel_(?:Repeating|Single))\s*\([^;]*?,\s*&?\s*(\w+)\s*\)\s*;")
+
+# How much of the stacks the whole program uses, with the interrupts on top
+# of main
+Usage = collections.namedtuple("Usage", ("depth", "levels", "complete"))
+
+def operands(word, next_word):
+    """The data memory addresses in the access bank an instruction uses, as
+    (address, written).
+    """
+    top = word >> 12
+    if top == 0xC:
+        return [(word & 0x0FFF, False), (next_word & 0x0FFF, True)]
+    if top >= 0xD or word & 0x0100:
+        return []
+    f = word & 0xFF
+    address = f if f < 0x60 else 0xF00 | f
+    opcode = word >> 10
+    if 1 <= opcode <= 0x17 and opcode not in (2, 3):
+        return [(address, bool(word & 0x0200))]
+    # MULWF, CPFSLT, CPFSEQ, CPFSGT, TSTFSZ, BTFSS and BTFSC read it
+    if word >> 9 == 0x01 or 0x60 <= word >> 8 <= 0x67 or top in (0xA, 0xB):
+        return [(address, False)]
+    # SETF, CLRF, NEGF, MOVWF, BTG, BSF and BCF write it
+    if 0x68 <= word >> 8 <= 0x9F:
+        return [(address, True)]
+    return []
+
+def registered_handlers(src_dir, project_dir=None):
+    """The names of the functions the source files in src_dir register as
+    interrupt or timer handlers, and of the tasks in project_dir's tasks.cfg,
+    which are called through their table the same way.
+    """
+    handlers = []
+    if src_dir != None and Path(src_dir).is_dir():
+        for source in sorted(Path(src_dir).glob("**/*.c")):
+            for match in register_regex.finditer(source.read_text(errors="replace")):
+                if match.group(1) not in handlers:
+                    handlers.append(match.group(1))
+    config_file = Path(project_dir) / vextask.CONFIG_NAME if project_dir != None else None
+    if config_file != None and config_file.exists():
+        handlers.extend(task.function for task in vextask.read_config(config_file)
+                        if task.function not in handlers)
+    return handlers
+
+class FunctionStack(object):
+    """The stacks a function uses.
+
+    Attributes:
+        name -- the function's name, or its address if it has no symbol
+        address -- where it starts
+        depth -- most bytes of software stack it uses above FSR1 at the call
+        levels -- most levels of the hardware return stack its calls use
+        deepest -- the call that uses the most software stack, as (site,
+                   function), or None
+        call_depth -- bytes of software stack used at the deepest call
+        complete -- False if the analysis had problems, the depth is then
+                    only a lower bound
+    """
+
+    def __init__(self, name, address):
+        self.name = name
+        self.address = address
+        self.depth = 0
+        self.levels = 0
+        self.deepest = None
+        self.call_depth = 0
+        self.complete = True
+
+class StackAnalyzer(vexwcet.Analyzer):
+    """Stack analysis of a program image. handlers are the names of the
+    functions indirect calls in DISPATCHERS can go to when wcet.cfg doesn't
+    say.
+    """
+
+    def __init__(self, image, symbols=None, config=None, handlers=()):
+        super(StackAnalyzer, self).__init__(image, symbols, config)
+        self.handlers = [name for name in handlers if name in self.symbols]
+
+    def function(self, address):
+        """The FunctionStack of the function starting at address."""
+        if address in self.functions:
+            return self.functions[address]
+        result = FunctionStack(self.name(address), address)
+        if address in self._analyzing:
+            self.problem(result.name, "is recursive")
+            result.complete = False
+            return result
+
+        given = self._setting(self.config.stack, address, None)
+        if given != None:
+            result.depth = given
+            self.functions[address] = result
+            return result
+
+        self._analyzing.add(address)
+        try:
+            self._walk(address, result)
+        finally:
+            self._analyzing.discard(address)
+        self.functions[address] = result
+        return result
+
+    def _call(self, site, callee, height, result, returns=True):
+        time = self.function(callee)
+        if not time.complete:
+            result.complete = False
+        if result.deepest == None or height + time.depth > result.call_depth:
+            result.deepest = (site, callee)
+            result.call_depth = height + time.depth
+        result.depth = max(result.depth, height + time.depth)
+        # A jump to another function leaves its return address to the caller's
+        result.levels = max(result.levels, time.levels + (1 if returns else 0))
+
+    def _indirect_targets(self, address, entry, result, kind):
+        targets = self._setting(self.config.targets, address, None)
+        if targets == None:
+            targets = self.handlers if self.names.get(entry) in DISPATCHERS else []
+        if not targets:
+            self.problem(self.site(address, entry), "needs targets for its %s" %
+                         ("computed jump" if kind == "computed" else "call through the stack"))
+            result.complete = False
+        return [self.address_of(target) for target in targets]
+
+    def _walk(self, entry, result):
+        """Follow every path through a function, with the height of the
+        stack, the height FSR2 was set to and the constant in W, if known.
+        """
+        seen = {}
+        work = [(entry, (0, None, None))]
+        while work:
+            address, state = work.pop()
+            height = state[0]
+            if address in seen:
+                if seen[address] == state[:2]:
+                    continue
+                if seen[address][0] != height:
+                    self.problem(self.site(address, entry), "is reached with different stack heights")
+                    result.complete = False
+                    if height <= seen[address][0] or height > HEIGHT_LIMIT:
+                        continue
+            seen[address] = state[:2]
+
+            instruction = self.instruction(address)
+            if instruction == None:
+                self.problem(self.site(address, entry), "runs outside of the program")
+                result.complete = False
+                continue
+            result.depth = max(result.depth, height)
+            after = self._step(instruction, state)
+            if after == None:
+                self.problem(self.site(address, entry), "changes the stack pointer in a way that cannot be followed")
+                result.complete = False
+                continue
+            result.depth = max(result.depth, after[0])
+
+            next_address = address + instruction.size
+            kind = instruction.kind
+            if kind == "next":
+                work.append((next_address, after))
+            elif kind == "branch":
+                work.extend(((next_address, after), (instruction.target, after)))
+            elif kind == "skip":
+                skipped = self.instruction(next_address)
+                work.extend(((next_address, after), (next_address + (skipped.size if skipped else 2), after)))
+            elif kind == "call":
+                self._call(address, instruction.target, after[0], result)
+                work.append((next_address, after[:2] + (None,)))
+            elif kind == "jump":
+                target = instruction.target
+                if target != entry and target in self.names:
+                    self._call(address, target, after[0], result, returns=False)
+                else:
+                    work.append((target, after))
+            elif kind in ("computed", "push"):
+                for target in self._indirect_targets(address, entry, result, kind):
+                    if kind == "computed" and target not in self.names:
+                        work.append((target, after))
+                    else:
+                        self._call(address, target, after[0], result, returns=kind == "push")
+                if kind == "push":
+                    work.append((next_address, after[:2] + (None,)))
+            elif kind == "return":
+                if after[0] != 0:
+                    self.problem(self.site(address, entry), "returns with %i bytes left on the stack" % after[0])
+                    result.complete = False
+            elif kind == "invalid":
+                self.problem(self.site(address, entry), "is not an instruction")
+                result.complete = False
+
+    def _step(self, instruction, state):
+        """The state after an instruction, or None if it sets the stack
+        pointer to something unknown.
+        """
+        height, frame, w = state
+        word = self.word(instruction.address)
+        next_word = self.word(instruction.address + 2) if instruction.size == 4 else 0
+        used = operands(word, next_word)
+        for address, written in used:
+            if address in (POSTINC1, PREINC1):
+                height += 1
+            elif address == POSTDEC1:
+                height -= 1
+
+        written = [address for address, written in used if written]
+        if word & 0xFFC0 == 0xEE00:
+            # LFSR
+            fsr = word >> 4 & 0x03
+            if fsr == 1:
+                return None
+            if fsr == 2:
+                frame = None
+        if FSR1L in written:
+            opcode = word >> 10
+            if word >> 12 == 0xC:
+                if word & 0x0FFF != FSR2L or frame == None:
+                    return None
+                height = frame
+            elif opcode == 0x09 and w != None:
+                # ADDWF FSR1L, F after MOVLW
+                height += w
+            elif opcode == 0x17 and w != None:
+                # SUBWF FSR1L, F after MOVLW
+                height -= w
+            elif opcode == 0x0A:
+                height += 1
+            elif opcode == 0x01:
+                height -= 1
+            else:
+                return None
+        if FSR2L in written:
+            frame = height if word >> 12 == 0xC and word & 0x0FFF == FSR1L else None
+        w = word & 0xFF if word >> 8 == 0x0E else None
+        return (height, frame, w)
+
+    def usage(self):
+        """The Usage of the whole program: the deepest of main and the other
+        entry points, with the low and high priority interrupts on top.
+        """
+        depth = 0
+        levels = 0
+        complete = True
+        tasks = [entry for entry in self.entries() if entry not in (HIGH_PRIORITY_VECTOR, LOW_PRIORITY_VECTOR)]
+        interrupts = [entry for entry in self.entries() if entry in (HIGH_PRIORITY_VECTOR, LOW_PRIORITY_VECTOR)]
+        if tasks:
+            deepest = max((self.function(entry) for entry in tasks), key=lambda stack: stack.depth)
+            depth = deepest.depth
+            levels = max(self.function(entry).levels for entry in tasks)
+            complete = all(self.function(entry).complete for entry in tasks)
+        for vector in interrupts:
+            stack = self.function(vector)
+            depth += stack.depth
+            levels += 1 + stack.levels
+            complete = complete and stack.complete
+        return Usage(depth, levels, complete)
+
+    def deepest_path(self, address):
+        """The chain of calls to the most software stack from a function, as
+        (FunctionStack, site) with None for the site of the first.
+        """
+        chain = []
+        site = None
+        seen = set()
+        while address not in seen:
+            seen.add(address)
+            stack = self.function(address)
+            chain.append((stack, site))
+            if stack.deepest == None:
+                break
+            site, address = stack.deepest
+        return chain
+
+    def report(self, stack_size=DEFAULT_STACK_SIZE):
+        """Describe the stacks each entry point uses. Returns the text and the Usage."""
+        lines = ["%-40s %12s %12s" % ("Entry", "Stack bytes", "Call levels")]
+        for entry in self.entries():
+            stack = self.function(entry)
+            lines.append("%-40s %12s %12i" % (stack.name, ("" if stack.complete else ">=") + str(stack.depth),
+                                               stack.levels))
+        usage = self.usage()
+        lines.append("%-40s %12s %12i" % ("With interrupts", ("" if usage.complete else ">=") + str(usage.depth),
+                                           usage.levels))
+        lines.append("The software stack is %i bytes, the return stack %i levels." % (stack_size, STACK_DEPTH))
+
+        for entry in self.entries():
+            chain = self.deepest_path(entry)
+            if len(chain) < 2:
+                continue
+            lines.append("")
+            lines.append("Deepest path of %s:" % chain[0][0].name)
+            for depth, (stack, site) in enumerate(chain):
+                label = stack.name if site == None else "%s at %s" % (stack.name, self.site(site, chain[depth - 1][0].address))
+                lines.append("  %-48s %12i" % ("  " * depth + label, stack.depth))
+
+        if self.problems:
+            lines.append("")
+            lines.append("Problems:")
+            for site, message in self.problems:
+                lines.append("  %s %s" % (site, message))
+        return "\n".join(lines), usage
+
+def fits(usage, stack_size=DEFAULT_STACK_SIZE):
+    """Whether the analysis proves the stack stays below the end of its bank."""
+    return usage.complete and usage.depth < stack_size and usage.levels <= STACK_DEPTH
+
+def parse_args():
+    import argparse
+    parser = argparse.ArgumentParser(description="Find how much stack a Vex program uses")
+
+    parser.add_argument("hex_file", help="program to analyze")
+    parser.add_argument("--map", help="MPLINK map file with the program's symbols, by default Mapfile.map next to the hex file")
+    parser.add_argument("--config", help="targets of indirect calls, by default %s in the project directory" %
+                        vexwcet.CONFIG_NAME)
+    parser.add_argument("--src", help="source directory to read wcet: comments and handlers from, by default the project's src")
+    parser.add_argument("--entry", help="functions to analyze as well as the interrupt handlers and main", nargs="+",
+                        default=[])
+    parser.add_argument("--stack-size", help="size of the software stack", type=lambda size: int(size, 0),
+                        default=DEFAULT_STACK_SIZE)
+
+    return parser.parse_args()
+
+def main(args):
+    project_dir = vexwcet.project_dir_of(args.hex_file)
+    map_file = Path(args.map) if args.map else Path(args.hex_file).parent / "Mapfile.map"
+    symbols = vexsim.read_symbols(map_file) if map_file.exists() else {}
+    src_dir = args.src if args.src else project_dir / "src"
+    try:
+        config = vexwcet.read_config(args.config if args.config else project_dir / vexwcet.CONFIG_NAME, src_dir)
+        handlers = registered_handlers(src_dir, project_dir)
+    except ValueError as e:
+        print("Error: " + str(e), flush=True, file=sys.stderr)
+        return 1
+    config.entries.extend(args.entry)
+    analyzer = StackAnalyzer(args.hex_file, symbols, config, handlers)
+    try:
+        text, usage = analyzer.report(args.stack_size)
+    except KeyError as e:
+        print("Error: " + str(e.args[0]), flush=True, file=sys.stderr)
+        return 1
+    print(text)
+    if fits(usage, args.stack_size):
+        print("The stack fits in its bank, so the program can be built with the small stack model.")
+        return 0
+    return 1
+
+if __name__ == "__main__":
+    exit(main(parse_args()))
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+"""Build time table of cooperative tasks.
+
+A project's tasks.cfg declares its tasks (see Toolchain/VexLib/vextask.h),
+each with the function that runs it, a priority from 0 (highest) to 3, and
+optionally a period in milliseconds and a budget in microseconds for each
+call:
+
+    task Drive_Task 0 10 2000    # every 10 ms, overrun past 2 ms
+    task Arm_Task 1              # runs on every pass
+
+vexbuild generates the table of tasks in program memory and the array of
+their state from it, with VexTask_Start() to set them up, so the scheduler
+allocates nothing. Tasks are numbered for VexTask_Get() in the order they
+are declared.
+"""
+import collections
+import re
+
+
+CONFIG_NAME = "tasks.cfg"
+
+# Must match VEXTASK_PRIORITIES and VEXTASK_MAX_TASKS in vextask.h
+PRIORITIES = 4
+# sizeof(VexTask), whose array has to fit in one 256 byte data bank
+TASK_SIZE = 25
+BANK_SIZE = 256
+MAX_TASKS = BANK_SIZE // TASK_SIZE
+
+Task = collections.namedtuple("Task", "function priority period budget")
+
+identifier_regex = re.compile(r"[A-Za-z_]\w*$")
+
+def read_config(config_file):
+    """Read the tasks of a tasks.cfg"""
+    tasks = []
+    for number, line in enumerate(config_file.read_text().splitlines(), 1):
+        where = "%s:%i" % (config_file, number)
+        fields = line.split("#", 1)[0].split()
+        if not fields:
+            continue
+        try:
+            if fields[0].lower() != "task" or not 3 <= len(fields) <= 5:
+                raise ValueError()
+            function = fields[1]
+            priority, period, budget = [int(field, 0) for field in fields[2:]] + [0] * (5 - len(fields))
+            if (not identifier_regex.match(function) or not 0 <= priority < PRIORITIES
+                    or not 0 <= period <= 0xFFFF or not 0 <= budget <= 0xFFFF):
+                raise ValueError()
+            if function in [task.function for task in tasks]:
+                raise ValueError()
+            tasks.append(Task(function, priority, period, budget))
+        except ValueError:
+            raise ValueError("%s: cannot understand \"%s\"" % (where, line.strip()))
+    if not tasks:
+        raise ValueError("%s: no tasks" % config_file)
+    if len(tasks) > MAX_TASKS:
+        raise ValueError("%s: more than %i tasks, whose state would not fit in a %i byte data bank" %
+                         (config_file, MAX_TASKS, BANK_SIZE))
+    return tasks
+
+def source(tasks, config_name=CONFIG_NAME):
+    """The C code of the task table"""
+    lines = ["/* Generated by vexbuild from %s, do not edit */" % config_name,
+             "#include \"vextask.h\"",
+             ""]
+    lines.extend("char %s(VexTask *task);" % task.function for task in tasks)
+    lines.extend(["",
+                  "static rom const VexTask_Entry table[] = {"])
+    lines.extend("    {%s, %i, %i, %i}," % task for task in tasks)
+    lines.extend(["};",
+                  "",
+                  "#pragma udata vextask",
+                  "static VexTask tasks[%i];" % len(tasks),
+                  "#pragma udata",
+                  "",
+                  "void VexTask_Start(void) {",
+                  "    VexTask_Init(table, tasks, %i);" % len(tasks),
+                  "}"])
+    return "\n".join(lines) + "\n"
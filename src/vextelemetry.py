@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Build time layout of telemetry frames.
+
+A project's telemetry.cfg declares the variables to sample, each with the
+type it has on the controller and a divider, the number of sample periods
+between its samples:
+
+    period 10                            # ms between samples
+    channel left_ticks leftTicks long    # every sample
+    channel gyro gyroAngle int 2         # every 2nd sample
+    channel left_pwm leftPwm uchar 4     # every 4th sample
+
+vexbuild generates the code that samples them (see
+Toolchain/VexLib/vextelemetry.h) and the layout vexupload decodes frames
+with. Dividers are powers of two, so a frame's sample number tells which
+channels it has, even after the 16 bit number wraps around.
+"""
+import collections
+import json
+import re
+import struct
+
+
+CONFIG_NAME = "telemetry.cfg"
+DEFAULT_PERIOD_MS = 10
+MAX_DIVIDER = 128
+
+# Must match BUFSERIAL_TX_SIZE in bufserial.h
+TX_RING_BYTES = 64
+# Must match VEXTELEMETRY_MAX_SAMPLES in vextelemetry.h: the most sample bytes
+# whose frame fits in the transmit ring with every byte escaped but the format
+MAX_SAMPLE_BYTES = 26
+# BufSerial sends 2 bytes each millisecond
+PORT_BYTES_PER_SECOND = 2000
+
+# The C type and struct code of each channel type
+TYPES = {
+    "char": ("signed char", "b"),
+    "uchar": ("unsigned char", "B"),
+    "int": ("int", "h"),
+    "uint": ("unsigned int", "H"),
+    "short": ("short", "h"),
+    "ushort": ("unsigned short", "H"),
+    "long": ("long", "l"),
+    "ulong": ("unsigned long", "L"),
+}
+
+PUTS = {1: "VexTelemetry_Put8", 2: "VexTelemetry_Put16", 4: "VexTelemetry_Put32"}
+
+Channel = collections.namedtuple("Channel", "name variable type divider")
+Layout = collections.namedtuple("Layout", "period channels")
+
+identifier_regex = re.compile(r"[A-Za-z_]\w*$")
+
+def read_config(config_file):
+    """Read the channels of a telemetry.cfg"""
+    period = DEFAULT_PERIOD_MS
+    channels = []
+    for number, line in enumerate(config_file.read_text().splitlines(), 1):
+        where = "%s:%i" % (config_file, number)
+        fields = line.split("#", 1)[0].split()
+        if not fields:
+            continue
+        try:
+            setting = fields[0].lower()
+            if setting == "period" and len(fields) == 2:
+                period = int(fields[1], 0)
+                if period <= 0:
+                    raise ValueError()
+            elif setting == "channel" and len(fields) in (4, 5):
+                name, variable, type = fields[1:4]
+                divider = int(fields[4], 0) if len(fields) == 5 else 1
+                if (type not in TYPES or not identifier_regex.match(name) or not identifier_regex.match(variable)
+                        or divider & (divider - 1) != 0 or not 0 < divider <= MAX_DIVIDER):
+                    raise ValueError()
+                if name in [channel.name for channel in channels]:
+                    raise ValueError()
+                channels.append(Channel(name, variable, type, divider))
+            else:
+                raise ValueError()
+        except ValueError:
+            raise ValueError("%s: cannot understand \"%s\"" % (where, line.strip()))
+    if not channels:
+        raise ValueError("%s: no channels" % config_file)
+    if sum(size(channel) for channel in channels) > MAX_SAMPLE_BYTES:
+        raise ValueError("%s: the channels take more than %i bytes, so a frame might not fit in the %i byte "
+                         "transmit ring" % (config_file, MAX_SAMPLE_BYTES, TX_RING_BYTES))
+    return Layout(period, channels)
+
+def worst_frame_size(sample_bytes):
+    """Bytes of a frame with every byte escaped but the STXs, the format and
+    the ETX."""
+    return 2 + 2 + 2 * (2 + sample_bytes + 1) + 1
+
+def code(channel):
+    return TYPES[channel.type][1]
+
+def size(channel):
+    return struct.calcsize("<" + code(channel))
+
+def source(layout, config_name=CONFIG_NAME):
+    """The C code that samples the channels"""
+    lines = ["/* Generated by vexbuild from %s, do not edit */" % config_name,
+             "#include \"Api.h\"",
+             "#include \"vextelemetry.h\"",
+             ""]
+    declarations = []
+    for channel in layout.channels:
+        declaration = "extern %s %s;" % (TYPES[channel.type][0], channel.variable)
+        if declaration not in declarations:
+            declarations.append(declaration)
+    lines.extend(declarations)
+    lines.extend(["",
+                  "static void sample(void) {",
+                  "    unsigned short number = VexTelemetry_Begin();",
+                  ""])
+    for channel in layout.channels:
+        put = "%s(%s);" % (PUTS[size(channel)], channel.variable)
+        if channel.divider == 1:
+            lines.append("    " + put)
+        else:
+            lines.append("    if ((number & %i) == 0) {" % (channel.divider - 1))
+            lines.append("        " + put)
+            lines.append("    }")
+    lines.extend(["    VexTelemetry_End();",
+                  "}",
+                  "",
+                  "void VexTelemetry_Start(unsigned char port, unsigned baudRate) {",
+                  "    VexTelemetry_Open(port, baudRate);",
+                  "    RegisterRepeatingTimer(%i, sample);" % layout.period,
+                  "}",
+                  "",
+                  "void VexTelemetry_Stop(void) {",
+                  "    CancelTimer(sample);",
+                  "}"])
+    return "\n".join(lines) + "\n"
+
+def layout_json(layout):
+    """The layout, for vexupload"""
+    return json.dumps({"period": layout.period,
+                       "channels": [{"name": channel.name, "type": code(channel), "divider": channel.divider}
+                                    for channel in layout.channels]}, indent=4) + "\n"
+
+def bytes_per_second(layout):
+    """Bytes the frames take each second, before escaping: two STX, the
+    format and sample numbers, the samples, the checksum and ETX."""
+    frames = max(channel.divider for channel in layout.channels)
+    samples = sum(size(channel) * frames // channel.divider for channel in layout.channels)
+    return (frames * (2 + 2 + 2 + 1 + 1) + samples) * 1000 / (frames * layout.period)
@@ -1,28 +1,113 @@
 #!/usr/bin/env python3
 import binascii
+import bisect
+import collections
 from enum import IntEnum, Enum
 import enum
+import hashlib
+import json
+import mmap
+import os
 from pathlib import Path
+import re
+import shutil
+import struct
 import sys
 import textwrap
+import threading
+import time
+import weakref
 
 import serial.tools.list_ports
 
 
 MAX_PACKET_LENGTH = 255
 
+# Program memory runs from MIN_PROGRAM_ADDRESS through MAX_PROGRAM_ADDRESS,
+# inclusive
 MIN_PROGRAM_ADDRESS = 0x0800
 MAX_PROGRAM_ADDRESS = 0x7ffd
+PROGRAM_SIZE = MAX_PROGRAM_ADDRESS + 1 - MIN_PROGRAM_ADDRESS
 
 WRITE_CLUSTER_SIZE = 64
 WRITE_BLOCK_SIZE = 8
 
-# A very conservative value, that assumes every single byte has to be escaped (and then some)
-MAX_READ_LENGTH = 100
+# Bytes in a write frame that are not block data: two STX, command, four
+# arguments, checksum and ETX
+WRITE_FRAME_OVERHEAD = 9
+# The most blocks that can fit in a single frame, if none of them need escaping
+MAX_WRITE_BLOCKS = (MAX_PACKET_LENGTH - WRITE_FRAME_OVERHEAD) // WRITE_BLOCK_SIZE
+# Number of blocks per write that every controller is known to accept
+DEFAULT_WRITE_BLOCKS = WRITE_CLUSTER_SIZE // WRITE_BLOCK_SIZE
+# Read timeout used while probing, so rejected probes fail quickly
+PROBE_TIMEOUT = 0.5
+
+# Read timeout used until enough round trips have been timed to derive one
+DEFAULT_TIMEOUT = 3
+
+# Read timeout of the monitor, which checks whether it is done between reads
+MONITOR_TIMEOUT = 0.1
+
+# VEXTELEMETRY_FORMAT, the format number of telemetry frames
+TELEMETRY_FORMAT = b"\xff\xff"
+
+# Seconds of telemetry a live plot shows, and how often it is redrawn
+LIVE_PLOT_SECONDS = 10
+LIVE_PLOT_INTERVAL = 0.2
+
+# Round trips of a command that have to be timed before its timeout is adapted
+ADAPTIVE_TIMEOUT_SAMPLES = 8
+# The adaptive timeout is this multiple of the 99th percentile round trip time,
+# or of the 99th percentile time per row erased, block written or byte read
+# times the rows, blocks or bytes of the command, whichever is longer, plus a
+# margin for scheduling delays on the host
+ADAPTIVE_TIMEOUT_FACTOR = 4
+ADAPTIVE_TIMEOUT_MARGIN = 0.05
+
+# Times a command is sent again after a timeout or a corrupted response
+PACKET_RETRIES = 3
+
+# Bits on the wire per byte: 8 data bits, 1 start bit and 1 stop bit
+BITS_PER_BYTE = 10
+
+# The response to a read has to fit in a frame. The largest read only fits
+# if nothing in it needs escaping, the safe one even if everything does.
+MAX_READ_LENGTH = MAX_PACKET_LENGTH - 10
+MAX_SAFE_READ_LENGTH = (MAX_PACKET_LENGTH - 14) // 2
 
 ERASE_ROW_SIZE = 64
 MAX_ERASE_ROWS = 128
 
+# vexbuild reserves a row of program memory for a digest of the program, so
+# the uploader can tell which program a controller already has.
+BUILD_ID_ADDRESS = 0x7f80
+BUILD_ID_LENGTH = 8
+
+# Number of previously uploaded programs kept to upload changes against
+UPLOAD_CACHE_SIZE = 8
+
+# Bytes of the digest of each row used to find the rows that changed
+ROW_DIGEST_LENGTH = 8
+
+# .vximg files, see MappedImage
+VXIMG_MAGIC = b"VXIMG\0"
+VXIMG_VERSION = 2
+VXIMG_ALIGNMENT = 64
+VXIMG_HEADER_SIZE = 128
+VXIMG_HAS_BUILD_ID = 0x01
+# magic, version, flags, build ID, image digest, start address, end address,
+# number of segments, number of rows, and the size, modification time in ns
+# and digest of the hex file it was written from
+VXIMG_HEADER = struct.Struct("<6sHI%is20sIIIIQq20s" % BUILD_ID_LENGTH)
+# address, length, offset of the contents
+VXIMG_SEGMENT = struct.Struct("<III")
+
+# Intel hex record types
+HEX_DATA = 0x00
+HEX_END_OF_FILE = 0x01
+HEX_EXTENDED_SEGMENT_ADDRESS = 0x02
+HEX_EXTENDED_LINEAR_ADDRESS = 0x04
+
 CHAR_STX = 0x0F
 CHAR_ETX = 0x04
 CHAR_ESC = 0x05
@@ -44,6 +129,9 @@ class DebugLevel(Enum):
     
 debug_level = DebugLevel.none
 
+# Per-user settings, which currently just caches the probed write size
+settings_file = Path.home() / ".vexupload.json"
+
 class HexException(Exception):
     """Exception raised for problems with the hex file.
 
@@ -120,6 +208,8 @@ class Packet(object):
     
         checksum = response[-2]
         command = Command(response[2])
+        arguments = ()
+        data = None
     
         if command == Command.read_program_mem:
             arguments = response[3:7]
@@ -135,98 +225,1291 @@ class Packet(object):
 
         return packet
 
-def upload(hex_file, serial_port=None):
-    debug("upload(): hex_file=%s, serial_port=%s" % (hex_file, serial_port))
-    # Vex uses 115200 bits/sec, no parity, 8 data bits, 1 stop bit
+class UploadStats(object):
+    """Timing of every command sent to one controller.
+
+    Each sample records when the command was sent, the latency until the first
+    byte of the response and until the whole response had arrived, and the
+    sizes of the frames in each direction.
+    """
+
+    def __init__(self, baudrate=115200, base_timeout=DEFAULT_TIMEOUT):
+        self.baudrate = baudrate
+        self.base_timeout = base_timeout
+        self.start = time.monotonic()
+        self.end = self.start
+        self.samples = []
+        self.timeouts = 0
+        self.retries = 0
+        self.program_bytes = 0
+        self.read_bytes = 0
+        self.__pending = None
+    
+    def begin(self, packet, frame_length):
+        now = time.monotonic()
+        data_length = len(packet.data) if packet.data else 0
+        self.__pending = {"command": packet.command.name, "sent": now - self.start, "units": work_units(packet),
+                          "first_byte": None, "response": None,
+                          "raw_bytes": 5 + len(packet.arguments) + data_length,
+                          "frame_bytes": frame_length, "response_bytes": 0}
+        self.__sent = now
+        if packet.command == Command.write_program_mem:
+            self.program_bytes += data_length
+        elif packet.command == Command.read_program_mem:
+            self.read_bytes += packet.arguments[0]
+    
+    def first_byte(self):
+        if self.__pending and self.__pending["first_byte"] is None:
+            self.__pending["first_byte"] = time.monotonic() - self.__sent
+    
+    def finish(self, response_length):
+        self.end = time.monotonic()
+        self.__pending["response"] = self.end - self.__sent
+        self.__pending["response_bytes"] = response_length
+        self.samples.append(self.__pending)
+        self.__pending = None
+    
+    def timed_out(self):
+        self.end = time.monotonic()
+        self.timeouts += 1
+        self.__pending = None
+    
+    def round_trips(self, command=None):
+        return sorted(s["response"] for s in self.samples if command == None or s["command"] == command.name)
+    
+    def timeout_for(self, command, units=1):
+        """Read timeout for a command with units of work (see work_units()),
+        derived from the round trips seen so far, so a large erase or write
+        after small ones gets the time its size needs.
+        """
+        rtts = self.round_trips(command)
+        if len(rtts) < ADAPTIVE_TIMEOUT_SAMPLES:
+            return self.base_timeout
+        per_unit = sorted(s["response"] / s["units"] for s in self.samples if s["command"] == command.name)
+        expected = max(percentile(rtts, 99), percentile(per_unit, 99) * units)
+        return min(self.base_timeout, ADAPTIVE_TIMEOUT_FACTOR * expected + ADAPTIVE_TIMEOUT_MARGIN)
+    
+    def summary(self):
+        elapsed = self.end - self.start
+        rtts = self.round_trips()
+        first_bytes = sorted(s["first_byte"] for s in self.samples if s["first_byte"] is not None)
+        raw_bytes = sum(s["raw_bytes"] for s in self.samples)
+        frame_bytes = sum(s["frame_bytes"] for s in self.samples)
+        
+        return {
+            "elapsed": elapsed,
+            "commands": len(self.samples),
+            "timeouts": self.timeouts,
+            "retries": self.retries,
+            "rtt_p50": percentile(rtts, 50),
+            "rtt_p99": percentile(rtts, 99),
+            "first_byte_p50": percentile(first_bytes, 50),
+            "first_byte_p99": percentile(first_bytes, 99),
+            "program_bytes": self.program_bytes,
+            "bytes_per_second": self.program_bytes / elapsed if elapsed > 0 else 0,
+            "read_bytes": self.read_bytes,
+            "read_bytes_per_second": self.read_bytes / elapsed if elapsed > 0 else 0,
+            "line_rate": self.baudrate / BITS_PER_BYTE,
+            "escape_inflation": frame_bytes / raw_bytes if raw_bytes else 1,
+            "timeout": {command.name: self.timeout_for(command) for command in Command},
+        }
+
+# Statistics for connections that are being tracked with track_stats()
+connection_stats = weakref.WeakKeyDictionary()
+
+def track_stats(serial_conn):
+    stats = UploadStats(serial_conn.baudrate, serial_conn.timeout)
+    connection_stats[serial_conn] = stats
+    return stats
+
+def report_stats(stats, stats_json=None):
+    summary = stats.summary()
+    info("\n%i commands in %.2fs: RTT p50 %.1fms, p99 %.1fms, %i timeouts, %i retries." % 
+         (summary["commands"], summary["elapsed"], summary["rtt_p50"] * 1000, summary["rtt_p99"] * 1000,
+          summary["timeouts"], summary["retries"]))
+    if summary["program_bytes"] or not summary["read_bytes"]:
+        info("Wrote %i bytes at %.0f bytes/s (line rate %.0f bytes/s), escaping added %.1f%%." % 
+             (summary["program_bytes"], summary["bytes_per_second"], summary["line_rate"], (summary["escape_inflation"] - 1) * 100))
+    else:
+        info("Read %i bytes at %.0f bytes/s (line rate %.0f bytes/s)." % 
+             (summary["read_bytes"], summary["read_bytes_per_second"], summary["line_rate"]))
+    debug("First byte latency p50 %.1fms, p99 %.1fms" % (summary["first_byte_p50"] * 1000, summary["first_byte_p99"] * 1000))
+    
+    if stats_json:
+        with Path(stats_json).open("w") as fd:
+            json.dump({"summary": summary, "samples": stats.samples}, fd, indent=4)
+
+def percentile(values, p):
+    """Nearest rank percentile of sorted values."""
+    if not values:
+        return 0
+    rank = max(0, (p * len(values) + 99) // 100 - 1)
+    return values[min(rank, len(values) - 1)]
+
+def upload(hex_file, serial_port=None, probe=False, stats_json=None, resume=True, verify_resume=False):
+    debug("upload(): hex_file=%s, serial_port=%s, probe=%s, stats_json=%s, resume=%s" % (hex_file, serial_port, probe, stats_json, resume))
+    if isinstance(serial_port, (list, tuple)):
+        if not serial_port:
+            raise IOError("No Vex programming modules found")
+        if len(serial_port) > 1:
+            return upload_fleet(hex_file, serial_port, probe, stats_json, resume, verify_resume)
+        serial_port = serial_port[0]
     if serial_port == None:
-        ports = serial.tools.list_ports.grep("2303")
-        try:
-            serial_port = next(ports)[0]
-        except:
-            ports = serial.tools.list_ports.grep("04d8:000a")
-            try:
-                serial_port = next(ports)[0]
-            except:            
-                serial_port = 0
+        serial_port = find_serial_port()
 
     debug("upload(): Using serial port: %s" % serial_port)
-    serial_conn = serial.Serial(serial_port, baudrate=115200, timeout=3)
-    # Loop device for testing
-#     serial_conn = serial.serial_for_url("loop://")
+    serial_conn = open_serial(serial_port)
     serial_conn.flushInput()
      
-    # Load hex file   
-    with Path(hex_file).open("r") as fd:
-        start_address = MAX_PROGRAM_ADDRESS;  # Initialize to highest possible address
-        end_address = 0;  # Initialize to lowest possible address 
+    with load_image(hex_file) as image:
+        journal = open_journal(journal_path(hex_file), image, resume)
+        if journal.erased_rows or journal.written_clusters:
+            info("Resuming interrupted upload (%i rows erased, %i clusters written)." % 
+                 (len(journal.erased_rows), len(journal.written_clusters)))
+
+        set_program_mode()
+        
+        stats = upload_image(serial_conn, image, journal, probe, verify_resume, cache_dir=upload_cache_dir(hex_file))
+        
+        report_stats(stats, stats_json)
+
+def upload_fleet(hex_file, serial_ports, probe=False, stats_json=None, resume=True, verify_resume=False):
+    """Upload the same program to several controllers at once.
+
+    The hex file is parsed once and shared. Each controller gets its own
+    thread, connection, journal and statistics, so a failure on one does not
+    stop the others. Returns the DeviceUpload for each port.
+    """
+    with load_image(hex_file) as image:
+        devices = []
+        for serial_port in serial_ports:
+            device = DeviceUpload(serial_port)
+            device.journal = open_journal(journal_path(hex_file, serial_port), image, resume)
+            devices.append(device)
+        
+        info("Uploading to %i controllers: %s" % (len(devices), ", ".join(str(d.serial_port) for d in devices)))
+        set_program_mode()
+        
+        def worker(device):
+            # Progress is shown by the status line instead of dots
+            progress_state.enabled = False
+            device.start = time.monotonic()
+            serial_conn = None
+            try:
+                serial_conn = open_serial(device.serial_port)
+                serial_conn.flushInput()
+                device.stats = upload_image(serial_conn, image, device.journal, probe, verify_resume, device,
+                                            upload_cache_dir(hex_file))
+                if device.state != "unchanged":
+                    device.state = "done"
+            except Exception as e:
+                # Anything that stops one controller's upload is its failure alone
+                device.error = e
+                device.state = "failed"
+            finally:
+                if serial_conn != None:
+                    serial_conn.close()
+                device.end = time.monotonic()
+        
+        threads = [threading.Thread(target=worker, args=(device,), daemon=True) for device in devices]
+        for thread in threads:
+            thread.start()
+        
+        interactive = sys.stdout.isatty() and debug_level == DebugLevel.none
+        while any(thread.is_alive() for thread in threads):
+            if interactive:
+                print("\r" + "  ".join(device.status() for device in devices), end="", flush=True)
+            for thread in threads:
+                thread.join(0.25)
+        if interactive:
+            print()
+    
+    for device in devices:
+        if device.state == "unchanged":
+            info("%s: already had this program" % device.serial_port)
+        elif device.state == "done":
+            summary = device.stats.summary()
+            info("%s: done in %.1fs, %.0f bytes/s, %i retries" % 
+                 (device.serial_port, device.end - device.start, summary["bytes_per_second"], summary["retries"]))
+        else:
+            info("%s: failed after %.1fs: %s" % (device.serial_port, device.end - device.start, device.error))
+    
+    if probe:
+        max_blocks = [device.max_blocks for device in devices if device.max_blocks]
+        if max_blocks:
+            save_settings({"max_write_blocks": min(max_blocks)})
+    
+    if stats_json:
+        with Path(stats_json).open("w") as fd:
+            json.dump({str(device.serial_port): {"summary": device.stats.summary(), "samples": device.stats.samples}
+                       for device in devices if device.stats}, fd, indent=4)
+    
+    failed = [device for device in devices if device.state not in ("done", "unchanged")]
+    if failed:
+        raise IOError("Upload failed on %i of %i controllers" % (len(failed), len(devices)))
+    
+    return devices
+
+class DeviceUpload(object):
+    """Progress and result of an upload to one controller in a fleet upload."""
+    
+    def __init__(self, serial_port):
+        self.serial_port = serial_port
+        self.state = "waiting"
+        self.done = 0
+        self.total = 0
+        self.max_blocks = None
+        self.journal = None
+        self.stats = None
+        self.error = None
+        self.start = self.end = time.monotonic()
+    
+    def status(self):
+        if self.state in ("erasing", "writing") and self.total:
+            return "%s: %s %3i%%" % (self.serial_port, self.state, 100 * self.done // self.total)
+        return "%s: %s" % (self.serial_port, self.state)
+
+def upload_image(serial_conn, image, journal, probe=False, verify_resume=False, device=None, cache_dir=None):
+    """Erase and write a program to a controller that is in program mode,
+    skipping anything the journal says was already done. Returns the
+    statistics for the connection.
+
+    If the image has a build ID, the ID on the controller is read first. When
+    it matches, nothing is uploaded. When it matches a program in cache_dir,
+    only the rows that differ from that program are erased and written.
+    """
+    # Messages are only printed for single uploads, fleet uploads show the
+    # device's state instead.
+    def message(msg):
+        if device == None:
+            info(msg)
+    def set_state(state, total=0):
+        if device != None:
+            device.state = state
+            device.done = 0
+            device.total = total
+    
+    stats = track_stats(serial_conn)
+    
+    resuming = journal.erased_rows or journal.written_clusters
+    if resuming and not check_journal(serial_conn, journal, image):
+        message("The controller does not hold what the upload journal says was written, starting over.")
+        journal.reset()
+        journal.save()
+        resuming = False
+    if image.build_id and not resuming:
+        flashed_id = read_build_id(serial_conn)
+        debug("upload_image(): build ID on controller: %s, uploading: %s" % (hex_dump(flashed_id), hex_dump(image.build_id)))
+        if flashed_id == image.build_id:
+            message("Controller already has this program (build %s)." % hex_dump(image.build_id))
+            set_state("unchanged")
+            return_to_user_code(serial_conn)
+            return stats
+        if cache_dir and cached_image_path(cache_dir, flashed_id).exists():
+            journal.base_id = hex_dump(flashed_id)
+    
+    base = None
+    if journal.base_id and cache_dir:
+        try:
+            base = load_image(cached_image_path(cache_dir, bytes.fromhex(journal.base_id)))
+        except (OSError, HexException):
+            journal.base_id = None
+    
+    # Rows that were erased before the image was ready need writing even if
+    # they did not change
+    changed_rows = sorted(set(image.changed_rows(base)) | (journal.erased_rows & set(image.rows)))
+    if base:
+        base.close()
+    message("\nProgram size is %i bytes." % (len(image.rows) * ERASE_ROW_SIZE))
+    if base:
+        message("Controller has build %s, %i of %i rows changed." % (journal.base_id, len(changed_rows), len(image.rows)))
+    
+    # The build ID is erased first and written last, so the controller never
+    # claims to have this program until all of it has been written.
+    id_rows = [row for row in changed_rows if image.build_id and row == row_address(BUILD_ID_ADDRESS)]
+    other_rows = [row for row in changed_rows if row not in id_rows]
+
+    rows = [row for row in id_rows + other_rows if row not in journal.erased_rows]
+    message("Erasing %i rows (%i bytes/row, %i bytes total)..." % 
+        (len(rows), ERASE_ROW_SIZE, len(rows) * ERASE_ROW_SIZE))
+    set_state("erasing", len(rows) * ERASE_ROW_SIZE)
+
+    def on_erased(address, length):
+        journal.erased_rows.update(range(address, address + length, ERASE_ROW_SIZE))
+        journal.save()
+        if device != None:
+            device.done += length
+
+    try:
+        for address, length in address_runs(rows[:len(id_rows)], ERASE_ROW_SIZE) + address_runs(rows[len(id_rows):], ERASE_ROW_SIZE):
+            erase_program_mem(serial_conn, address, length, on_erased)
+        message("\n")
+        
+        # Erased flash already holds blank clusters
+        clusters = [cluster for cluster in other_rows + id_rows
+                    if cluster not in journal.written_clusters and not image.is_blank(cluster)]
+        if verify_resume and journal.written_clusters and clusters:
+            if check_resume_boundary(serial_conn, journal, image, clusters[0]):
+                clusters = clusters[1:]
+    
+        if probe:
+            message("Probing the maximum write size...")
+            max_blocks = probe_write_blocks(serial_conn, image.start_address)
+            if device == None:
+                save_settings({"max_write_blocks": max_blocks})
+            else:
+                device.max_blocks = max_blocks
+            message("Controller accepts %i blocks per write." % max_blocks)
+        else:
+            max_blocks = load_settings().get("max_write_blocks", DEFAULT_WRITE_BLOCKS)
+    
+        message("Writing %i clusters (8 bytes/block, up to %i blocks/packet, %i bytes total)..." % 
+            (len(clusters), max_blocks, len(clusters) * WRITE_CLUSTER_SIZE))
+        set_state("writing", len(clusters) * WRITE_CLUSTER_SIZE)
+    
+        id_clusters = [cluster for cluster in clusters if cluster in id_rows]
+        for address, length in address_runs([c for c in clusters if c not in id_clusters], WRITE_CLUSTER_SIZE) + \
+                address_runs(id_clusters, WRITE_CLUSTER_SIZE):
+            run_start = max(address, image.start_address)
+            run_end = min(address + length, image.end_address)
             
-        for line in fd:
-            line = line.strip()
+            def on_written(address, length):
+                # Writes within a run are in order, so every cluster that ends
+                # before the end of this write is complete.
+                written_end = address + length
+                for cluster in range(row_address(run_start), written_end, WRITE_CLUSTER_SIZE):
+                    if min(cluster + WRITE_CLUSTER_SIZE, run_end) <= written_end:
+                        journal.written_clusters.add(cluster)
+                journal.save()
+                if device != None:
+                    device.done += length
             
-            address = int(line[3:7], 16);
-            if address != 0:
-                line_len = int(line[1:3], 16);
-                if address < start_address:
-                    start_address = address
-                if address + line_len > end_address:
-                    end_address = address + line_len
+            write_program_mem(serial_conn, run_start, image.read(run_start, run_end - run_start), max_blocks, on_written)
+    except IOError:
+        message("\nUpload interrupted. Run the upload again to resume where it stopped.")
+        raise
+
+    journal.complete = True
+    journal.save()
+    
+    if cache_dir and image.build_id:
+        save_cached_image(cache_dir, image)
+
+    return_to_user_code(serial_conn)
+    
+    return stats
+
+class PipelinedUpload(object):
+    """An upload that starts while the program is still being built.
+
+    The controller is put in program mode when the upload is created. erase()
+    then erases the rows the build is expected to change on another thread,
+    while the compiler runs, and finish() writes the linked image.
+    """
+    
+    def __init__(self, hex_file, serial_port=None):
+        self.hex_file = Path(hex_file)
+        if serial_port == None:
+            serial_port = find_serial_port()
+        self.serial_conn = open_serial(serial_port)
+        self.serial_conn.flushInput()
+        self.erased_rows = set()
+        self.base_id = None
+        self.error = None
+        self.thread = None
         
-        debug("upload(): Start address: %#06x, End address: %#06x" % (start_address, end_address), DebugLevel.debug);
+        set_program_mode()
+    
+    def erase(self, rows):
+        """Start erasing rows in the background."""
+        self.thread = threading.Thread(target=self.erase_rows, args=(rows,), daemon=True)
+        self.thread.start()
+    
+    def erase_rows(self, rows):
+        # Dots from this thread would end up in the middle of the compiler output
+        progress_state.enabled = False
+        try:
+            cache_dir = upload_cache_dir(self.hex_file)
+            flashed_id = read_build_id(self.serial_conn)
+            if cached_image_path(cache_dir, flashed_id).exists():
+                self.base_id = hex_dump(flashed_id)
+            
+            # The build ID goes first, so the controller never claims to have
+            # a program it only has part of
+            id_row = row_address(BUILD_ID_ADDRESS)
+            rows = [row for row in sorted(rows) if row != id_row]
+            
+            def on_erased(address, length):
+                self.erased_rows.update(range(address, address + length, ERASE_ROW_SIZE))
+            for address, length in address_runs([id_row], ERASE_ROW_SIZE) + address_runs(rows, ERASE_ROW_SIZE):
+                erase_program_mem(self.serial_conn, address, length, on_erased)
+        except IOError as e:
+            self.error = e
+    
+    def finish(self, image, probe=False, stats_json=None):
+        """Wait for the erase to finish, then write image."""
+        if self.thread != None:
+            self.thread.join()
+            info("Erased %i rows while building." % len(self.erased_rows))
         
-        # Make sure hex file addresses are within the correct range
-        check_program_range(hex_file, start_address, end_address)
+        journal = open_journal(journal_path(self.hex_file), image, resume=False)
+        journal.erased_rows = set(self.erased_rows)
+        journal.base_id = self.base_id
+        journal.save()
+        if self.error != None:
+            raise self.error
         
-        program_length = end_address - start_address
+        stats = upload_image(self.serial_conn, image, journal, probe, cache_dir=upload_cache_dir(self.hex_file))
+        report_stats(stats, stats_json)
+        return stats
 
+def dump(out_file, serial_port=None):
+    """Read all of program memory into a hex file."""
+    if serial_port == None:
+        serial_port = find_serial_port()
+    serial_conn = open_serial(serial_port)
+    serial_conn.flushInput()
+    stats = track_stats(serial_conn)
+    
+    set_program_mode()
+    
+    info("Reading %i bytes..." % PROGRAM_SIZE)
+    code = bytearray()
+    for address, data in read_range(serial_conn, MIN_PROGRAM_ADDRESS, PROGRAM_SIZE):
+        code.extend(data)
+    info("")
+    return_to_user_code(serial_conn)
+    
+    # Erased flash is left out
+    lines = [hex_record(HEX_EXTENDED_LINEAR_ADDRESS, 0, (0, 0))]
+    for offset in range(0, len(code), 16):
+        line = code[offset:offset + 16]
+        if any(char != 0xff for char in line):
+            lines.append(hex_record(HEX_DATA, MIN_PROGRAM_ADDRESS + offset, line))
+    lines.append(hex_record(HEX_END_OF_FILE, 0))
+    Path(out_file).write_text("\n".join(lines) + "\n")
+    info("Wrote %s." % out_file)
+    
+    report_stats(stats)
+
+def verify(hex_file, serial_port=None, last_upload=False):
+    """Compare the program on a controller with a hex file, stopping at the
+    first difference. With last_upload set, only the rows written by the last
+    upload of the hex file are compared. Returns the address of the first
+    difference, or None if there is none."""
+    with load_image(hex_file) as image:
+        rows = image.rows
+        if last_upload:
+            journal = UploadJournal(journal_path(hex_file), image.digest())
+            journal.load()
+            if not journal.complete:
+                raise IOError("No finished upload of %s to verify" % hex_file)
+            rows = sorted(journal.written_clusters)
+        
+        if serial_port == None:
+            serial_port = find_serial_port()
+        serial_conn = open_serial(serial_port)
+        serial_conn.flushInput()
+        stats = track_stats(serial_conn)
         
-        code = bytearray((0xff,) * program_length)
+        set_program_mode()
+        
+        info("Verifying %i rows..." % len(rows))
+        mismatch = None
+        for address, length in address_runs(rows, ERASE_ROW_SIZE):
+            expected = image.read(address, length)
+            for chunk_address, data in read_range(serial_conn, address, length, expected):
+                offset = chunk_address - address
+                differences = [i for i, char in enumerate(data) if char != expected[offset + i]]
+                if differences:
+                    mismatch = chunk_address + differences[0]
+                    break
+            if mismatch != None:
+                break
+    info("")
+    return_to_user_code(serial_conn)
+    
+    if mismatch == None:
+        info("Controller matches %s." % hex_file)
+    else:
+        info("Controller differs from %s at %#06x." % (hex_file, mismatch))
+    report_stats(stats)
+    return mismatch
+
+def monitor(format_file=None, serial_port=None, duration=None, output=print, layout_file=None,
+            capture_file=None, plot=False):
+    """Print the lines the program on the controller sends, with the seconds
+    since the monitor started, expanding the records of VexLog() with the
+    format table vexbuild wrote. With the layout of the telemetry channels,
+    telemetry frames are written to a capture file, plotted, or printed when
+    they are neither. Runs for duration seconds, or until stopped."""
+    if serial_port == None:
+        serial_port = find_serial_port()
+    formats = json.loads(Path(format_file).read_text())["formats"] if format_file != None else []
+    telemetry = TelemetryDecoder(json.loads(Path(layout_file).read_text())) if layout_file != None else None
+    decoder = LogDecoder(formats, telemetry)
+    capture = CaptureWriter(capture_file, telemetry.layout) if capture_file != None else None
+    live_plot = LivePlot(telemetry.layout) if plot else None
+    serial_conn = open_serial(serial_port)
+    serial_conn.timeout = MONITOR_TIMEOUT
+    start = time.monotonic()
+    try:
+        while duration == None or time.monotonic() - start < duration:
+            data = serial_conn.read(max(serial_conn.in_waiting, 1))
+            now = time.monotonic() - start
+            for line in decoder.feed(data):
+                output("%9.3f %s" % (now, line))
+            for sample in decoder.take_samples():
+                if capture:
+                    capture.add(sample, now)
+                if live_plot:
+                    live_plot.add(sample)
+                if not capture and not live_plot:
+                    output("%9.3f %s" % (now, " ".join("%s=%s" % item for item in sample.values.items())))
+            if live_plot:
+                live_plot.update()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        serial_conn.close()
+        if capture:
+            capture.close()
+    if decoder.errors:
+        info("%i records could not be decoded." % decoder.errors)
+    if telemetry and telemetry.missed:
+        info("%i telemetry frames were missed." % telemetry.missed)
+
+class LogDecoder:
+    """Splits what a program sends into lines of text, expanding the records
+    of VexLog(), which are framed like packets (see vexlog.h), with the
+    entries of a format table. Text outside the records is passed through.
+    """
+    
+    def __init__(self, formats, telemetry=None):
+        self.formats = {entry["id"]: entry for entry in formats}
+        self.telemetry = telemetry
+        self.samples = []
+        self.text = bytearray()
+        self.record = None
+        self.stx = False
+        self.esc = False
+        self.errors = 0
+        self.lines = []
+    
+    def feed(self, data):
+        """Take received bytes, returning the lines they complete"""
+        for char in data:
+            if self.record != None:
+                self.record_char(char)
+            elif self.stx:
+                self.stx = False
+                if char == CHAR_STX:
+                    self.record = bytearray()
+                else:
+                    self.text_char(CHAR_STX)
+                    self.text_char(char)
+            elif char == CHAR_STX:
+                self.stx = True
+            else:
+                self.text_char(char)
+        lines = self.lines
+        self.lines = []
+        return lines
+    
+    def take_samples(self):
+        """The telemetry samples decoded since the last call"""
+        samples = self.samples
+        self.samples = []
+        return samples
+    
+    def text_char(self, char):
+        if char == ord("\n"):
+            self.lines.append(self.text.decode("latin-1").rstrip("\r"))
+            self.text.clear()
+        else:
+            self.text.append(char)
+    
+    def record_char(self, char):
+        if self.esc:
+            self.esc = False
+            self.record.append(char)
+        elif char == CHAR_ESC:
+            self.esc = True
+        elif char == CHAR_STX:
+            # A record that was cut off, and the start of the next one
+            self.errors += 1
+            self.record = None
+            self.stx = True
+        elif char == CHAR_ETX:
+            record = bytes(self.record)
+            self.record = None
+            if self.telemetry and record[:2] == TELEMETRY_FORMAT and sum(record) & 0xff == 0:
+                sample = self.telemetry.decode(record[2:-1])
+                if sample:
+                    self.samples.append(sample)
+                else:
+                    self.errors += 1
+            else:
+                self.lines.extend(self.expand(record).rstrip("\r\n").split("\n"))
+        else:
+            self.record.append(char)
+    
+    def expand(self, record):
+        """The text of a record, without its framing"""
+        if len(record) < 3 or sum(record) & 0xff != 0:
+            self.errors += 1
+            return "<bad record %s>" % hex_dump(record)
+        format_id = record[0] | record[1] << 8
+        entry = self.formats.get(format_id)
+        if entry == None:
+            self.errors += 1
+            return "<unknown format %i: %s>" % (format_id, hex_dump(record[2:-1]))
+        try:
+            return entry["text"] % struct.unpack("<" + entry["arguments"], record[2:-1])
+        except struct.error:
+            self.errors += 1
+            return "<bad record for %s:%i: %s>" % (entry["file"], entry["line"], hex_dump(record[2:-1]))
+
+# Telemetry (see Toolchain/VexLib/vextelemetry.h)
+
+TelemetrySample = collections.namedtuple("TelemetrySample", "number values")
+
+class TelemetryDecoder:
+    """Decodes telemetry frames with the layout vexbuild writes. A frame's
+    sample number says which channels it has: those whose divider divides
+    it. The numbers are counted on past 16 bits, and the ones that never
+    arrive are counted as missed."""
+    
+    def __init__(self, layout):
+        self.layout = layout
+        channels = layout["channels"]
+        cycle = max(channel["divider"] for channel in channels)
+        # The channels and struct of each sample number, modulo the largest divider
+        self.phases = []
+        for phase in range(cycle):
+            due = [channel for channel in channels if phase % channel["divider"] == 0]
+            self.phases.append(([channel["name"] for channel in due],
+                                struct.Struct("<" + "".join(channel["type"] for channel in due))))
+        self.mask = cycle - 1
+        self.number = None
+        self.missed = 0
+    
+    def decode(self, frame):
+        """The TelemetrySample of a frame, after the format number and
+        before the checksum, or None if it has the wrong length"""
+        if len(frame) < 2:
+            return None
+        number = frame[0] | frame[1] << 8
+        names, samples = self.phases[number & self.mask]
+        if len(frame) - 2 != samples.size:
+            return None
+        if self.number == None:
+            self.number = number
+        else:
+            step = (number - self.number) & 0xffff
+            self.missed += step - 1 if step != 0 else 0
+            self.number += step
+        return TelemetrySample(self.number, collections.OrderedDict(zip(names, samples.unpack_from(frame, 2))))
+
+# Capture files keep the samples in blocks, a column at a time: the sample
+# numbers, the host times, then the values of each channel, only for the
+# samples that have it
+CAPTURE_MAGIC = b"VXTEL1\n"
+CAPTURE_BLOCK_SAMPLES = 256
+
+class CaptureWriter:
+    
+    def __init__(self, path, layout):
+        self.file = open(str(path), "wb")
+        self.layout = layout
+        self.file.write(CAPTURE_MAGIC + json.dumps(layout).encode() + b"\n")
+        self.samples = []
+    
+    def add(self, sample, time):
+        self.samples.append((sample, time))
+        if len(self.samples) == CAPTURE_BLOCK_SAMPLES:
+            self.flush()
+    
+    def flush(self):
+        if not self.samples:
+            return
+        count = len(self.samples)
+        block = [struct.pack("<I", count),
+                 struct.pack("<%iQ" % count, *(sample.number for sample, time in self.samples)),
+                 struct.pack("<%id" % count, *(time for sample, time in self.samples))]
+        for channel in self.layout["channels"]:
+            values = [sample.values[channel["name"]] for sample, time in self.samples if channel["name"] in sample.values]
+            block.append(struct.pack("<%i%s" % (len(values), channel["type"]), *values))
+        self.file.write(b"".join(block))
+        self.file.flush()
+        self.samples = []
+    
+    def close(self):
+        self.flush()
+        self.file.close()
+
+Capture = collections.namedtuple("Capture", "layout numbers times channels")
+
+def read_capture(path):
+    """Read a capture file into a Capture, whose channels map the name of each
+    channel to its sample numbers and values."""
+    with open(str(path), "rb") as capture_file:
+        if capture_file.read(len(CAPTURE_MAGIC)) != CAPTURE_MAGIC:
+            raise IOError("%s is not a telemetry capture" % path)
+        layout = json.loads(capture_file.readline())
+        data = capture_file.read()
+    numbers = []
+    times = []
+    channels = collections.OrderedDict((channel["name"], ([], [])) for channel in layout["channels"])
+    offset = 0
+    while offset < len(data):
+        count, = struct.unpack_from("<I", data, offset)
+        offset += 4
+        block_numbers = struct.unpack_from("<%iQ" % count, data, offset)
+        offset += 8 * count
+        times.extend(struct.unpack_from("<%id" % count, data, offset))
+        offset += 8 * count
+        numbers.extend(block_numbers)
+        for channel in layout["channels"]:
+            due = [number for number in block_numbers if number % channel["divider"] == 0]
+            values = struct.unpack_from("<%i%s" % (len(due), channel["type"]), data, offset)
+            offset += struct.calcsize("<%i%s" % (len(due), channel["type"]))
+            channels[channel["name"]][0].extend(due)
+            channels[channel["name"]][1].extend(values)
+    return Capture(layout, numbers, times, channels)
+
+class LivePlot:
+    """The last LIVE_PLOT_SECONDS of every channel, plotted against the
+    controller's time with matplotlib."""
+    
+    def __init__(self, layout):
+        try:
+            import matplotlib.pyplot
+        except ImportError:
+            raise IOError("Live plots need matplotlib")
+        self.pyplot = matplotlib.pyplot
+        self.period = layout["period"] / 1000
+        self.length = int(LIVE_PLOT_SECONDS / self.period)
+        self.data = collections.OrderedDict((channel["name"], collections.deque(maxlen=self.length))
+                                            for channel in layout["channels"])
+        self.pyplot.ion()
+        self.figure, axes = self.pyplot.subplots(len(self.data), 1, sharex=True, squeeze=False)
+        self.lines = {}
+        for (name, points), (axis,) in zip(self.data.items(), axes):
+            axis.set_ylabel(name)
+            self.lines[name], = axis.plot([], [])
+        self.updated = 0
+    
+    def add(self, sample):
+        for name, value in sample.values.items():
+            self.data[name].append((sample.number * self.period, value))
+    
+    def update(self):
+        if time.monotonic() - self.updated < LIVE_PLOT_INTERVAL:
+            return
+        self.updated = time.monotonic()
+        for name, points in self.data.items():
+            if points:
+                self.lines[name].set_data(*zip(*points))
+                self.lines[name].axes.relim()
+                self.lines[name].axes.autoscale_view()
+        self.pyplot.pause(0.001)
+
+def read_build_id(serial_conn):
+    return bytes(read_program_mem(serial_conn, BUILD_ID_ADDRESS, BUILD_ID_LENGTH))
+
+def upload_cache_dir(hex_file):
+    return Path(hex_file).parent / "upload_cache"
+
+def cached_image_path(cache_dir, build_id):
+    return Path(cache_dir) / (hex_dump(build_id) + ".hex")
+
+def save_cached_image(cache_dir, image):
+    """Keep a copy of an uploaded program, so later uploads only need to send the rows that changed."""
+    cache_dir = Path(cache_dir)
+    cache_dir.mkdir(exist_ok=True)
+    cached_path = cached_image_path(cache_dir, image.build_id)
+    shutil.copyfile(str(image.hex_file), str(cached_path))
+    write_vximg(image, vximg_path(cached_path), cached_path)
+    
+    cached = sorted(cache_dir.glob("*.hex"), key=lambda f: f.stat().st_mtime, reverse=True)
+    for old_file in cached[UPLOAD_CACHE_SIZE:]:
+        old_file.unlink()
+        if vximg_path(old_file).exists():
+            vximg_path(old_file).unlink()
+
+def find_serial_port():
+    ports = find_serial_ports()
+    if ports:
+        return ports[0]
+    return 0
+
+def find_serial_ports():
+    """All ports that look like Vex programming modules: PL2303 USB-serial
+    converters first, then Microchip USB devices."""
+    ports = [port[0] for port in serial.tools.list_ports.grep("2303")]
+    ports.extend(port[0] for port in serial.tools.list_ports.grep("04d8:000a") if port[0] not in ports)
+    return ports
+
+class ProgramImage(object):
+    """The contents of program memory that a hex file defines.
+
+    Attributes:
+        start_address -- address of the first byte of the program
+        code -- contents of program memory from start_address, 0xff where the
+                hex file does not define anything
+        rows -- sorted addresses of the rows that the hex file has data in
+        hex_file -- the file the image was loaded from
+
+    Images can be used in a with statement, which closes them at the end.
+    """
+    
+    def __init__(self, start_address, code, rows=None, hex_file=None):
+        self.start_address = start_address
+        self.code = code
+        if rows == None:
+            rows = row_addresses(start_address, start_address + len(code))
+        self.rows = sorted(rows)
+        self.hex_file = hex_file
+    
+    def __enter__(self):
+        return self
+    
+    def __exit__(self, *exception):
+        self.close()
+    
+    def close(self):
+        pass
+    
+    @property
+    def end_address(self):
+        return self.start_address + len(self.code)
+    
+    def read(self, address, length):
+        """Contents of program memory, with 0xff outside of the program."""
+        data = bytearray((0xff,) * length)
+        start = max(address, self.start_address)
+        end = min(address + length, self.end_address)
+        if start < end:
+            data[start - address:end - address] = self.code[start - self.start_address:end - self.start_address]
+        return data
+    
+    @property
+    def build_id(self):
+        if row_address(BUILD_ID_ADDRESS) not in self.rows:
+            return None
+        return bytes(self.read(BUILD_ID_ADDRESS, BUILD_ID_LENGTH))
+    
+    def write(self, address, data):
+        """Change the contents of program memory, growing the image if needed."""
+        end = address + len(data)
+        if address < self.start_address:
+            self.code[0:0] = bytearray((0xff,) * (self.start_address - address))
+            self.start_address = address
+        if end > self.end_address:
+            self.code.extend((0xff,) * (end - self.end_address))
+        self.code[address - self.start_address:end - self.start_address] = data
+        self.rows = sorted(set(self.rows).union(row_addresses(address, end)))
+    
+    def digest(self):
+        return hashlib.sha1(self.start_address.to_bytes(4, "little") + bytes(self.code)).hexdigest()
+    
+    def row_digest(self, row):
+        return hashlib.sha1(self.read(row, ERASE_ROW_SIZE)).digest()[:ROW_DIGEST_LENGTH]
+    
+    def is_blank(self, cluster):
+        """True if a cluster is the same as erased flash, so it does not need writing."""
+        return all(char == 0xff for char in self.read(cluster, WRITE_CLUSTER_SIZE))
+    
+    def changed_rows(self, base=None):
+        """Rows that have to be erased and written to replace base with this
+        image, including the rows base used that this image doesn't, which
+        only need erasing."""
+        if base == None:
+            return list(self.rows)
+        base_rows = set(base.rows)
+        rows = set(self.rows)
+        return sorted([row for row in self.rows
+                       if row not in base_rows or self.row_digest(row) != base.row_digest(row)] +
+                      [row for row in base.rows if row not in rows])
+
+class MappedImage(ProgramImage):
+    """A ProgramImage read from a memory mapped .vximg file written by
+    write_vximg(), which has everything upload decisions need precomputed.
+
+    A .vximg file is little endian. After a 128 byte header come a table of
+    segments, a digest of each row, a bitmap of the clusters that are blank
+    and the contents of each segment, starting on 64 byte boundaries. Each
+    segment is a run of whole rows.
+    """
+    
+    def __init__(self, path, hex_file=None):
+        with Path(path).open("rb") as fd:
+            self.map = mmap.mmap(fd.fileno(), 0, access=mmap.ACCESS_READ)
+        try:
+            self.__read_header(path, hex_file)
+        except Exception:
+            self.map.close()
+            raise
+    
+    def __read_header(self, path, hex_file):
+        magic, version, flags, build_id, digest, self.start_address, self.__end_address, segment_count, row_count, \
+            hex_size, hex_time, hex_digest = VXIMG_HEADER.unpack_from(self.map)
+        if magic != VXIMG_MAGIC or version != VXIMG_VERSION:
+            raise HexException(path, "Not a version %i vximg file" % VXIMG_VERSION)
+        if hex_file != None and (hex_size, hex_time, hex_digest) != hex_file_stamp(hex_file):
+            raise HexException(path, "Written from another version of %s" % hex_file)
+        self.__build_id = build_id if flags & VXIMG_HAS_BUILD_ID else None
+        self.__digest = digest.hex()
+        self.hex_file = hex_file
         
-        # Return to beginning of file
-        fd.seek(0)
+        offset = VXIMG_HEADER_SIZE
+        self.segments = [VXIMG_SEGMENT.unpack_from(self.map, offset + i * VXIMG_SEGMENT.size) for i in range(segment_count)]
+        self.segment_addresses = [address for address, length, data_offset in self.segments]
+        self.rows = [row for address, length, data_offset in self.segments for row in row_addresses(address, address + length)]
+        self.row_index = {row: i for i, row in enumerate(self.rows)}
         
-        for line in fd:
+        self.digest_offset = offset + segment_count * VXIMG_SEGMENT.size
+        self.blank_offset = self.digest_offset + row_count * ROW_DIGEST_LENGTH
+    
+    def close(self):
+        self.map.close()
+    
+    @property
+    def end_address(self):
+        return self.__end_address
+    
+    @property
+    def code(self):
+        return self.read(self.start_address, self.end_address - self.start_address)
+    
+    @property
+    def build_id(self):
+        return self.__build_id
+    
+    def digest(self):
+        return self.__digest
+    
+    def read(self, address, length):
+        data = bytearray((0xff,) * length)
+        end = address + length
+        i = max(bisect.bisect_right(self.segment_addresses, address) - 1, 0)
+        for segment_address, segment_length, data_offset in self.segments[i:]:
+            if segment_address >= end:
+                break
+            start = max(address, segment_address)
+            stop = min(end, segment_address + segment_length)
+            if start < stop:
+                data_start = data_offset + start - segment_address
+                data[start - address:stop - address] = self.map[data_start:data_start + stop - start]
+        return data
+    
+    def row_digest(self, row):
+        i = self.row_index.get(row)
+        if i == None:
+            return ProgramImage.row_digest(self, row)
+        offset = self.digest_offset + i * ROW_DIGEST_LENGTH
+        return self.map[offset:offset + ROW_DIGEST_LENGTH]
+    
+    def is_blank(self, cluster):
+        i = self.row_index.get(cluster)
+        if i == None:
+            return True
+        return bool(self.map[self.blank_offset + i // 8] & (1 << (i % 8)))
+    
+    def write(self, address, data):
+        raise TypeError("Mapped images are read only")
+
+def hex_file_stamp(hex_file):
+    """The size, modification time and digest of a hex file, which a .vximg
+    file has to have been written with to be used in its place."""
+    hex_file = Path(hex_file)
+    stat = hex_file.stat()
+    return stat.st_size, stat.st_mtime_ns, hashlib.sha1(hex_file.read_bytes()).digest()
+
+def write_vximg(image, path, hex_file=None):
+    """Write an image in the format MappedImage reads, for hex_file, by
+    default the file the image was loaded from."""
+    segments = address_runs(image.rows, ERASE_ROW_SIZE)
+    rows = image.rows
+    
+    table = bytearray()
+    data = bytearray()
+    data_start = round_up(VXIMG_HEADER_SIZE + len(segments) * VXIMG_SEGMENT.size + len(rows) * ROW_DIGEST_LENGTH + 
+                          (len(rows) + 7) // 8, VXIMG_ALIGNMENT)
+    for address, length in segments:
+        table += VXIMG_SEGMENT.pack(address, length, data_start + len(data))
+        data += image.read(address, length)
+        data += bytes(round_up(len(data), VXIMG_ALIGNMENT) - len(data))
+    
+    blank = bytearray((len(rows) + 7) // 8)
+    for i, row in enumerate(rows):
+        if image.is_blank(row):
+            blank[i // 8] |= 1 << (i % 8)
+    
+    build_id = image.build_id
+    hex_file = hex_file or image.hex_file
+    hex_size, hex_time, hex_digest = hex_file_stamp(hex_file) if hex_file != None else (0, 0, bytes(20))
+    header = VXIMG_HEADER.pack(VXIMG_MAGIC, VXIMG_VERSION, VXIMG_HAS_BUILD_ID if build_id else 0,
+                               build_id or bytes(BUILD_ID_LENGTH), bytes.fromhex(image.digest()),
+                               image.start_address, image.end_address, len(segments), len(rows),
+                               hex_size, hex_time, hex_digest)
+    contents = header + bytes(VXIMG_HEADER_SIZE - len(header)) + table + \
+        b"".join(image.row_digest(row) for row in rows) + blank
+    contents += bytes(data_start - len(contents)) + data
+    
+    # Replace the file in one go, in case an upload has the old one mapped
+    path = Path(path)
+    temp_path = path.with_name(path.name + ".tmp")
+    temp_path.write_bytes(contents)
+    os.replace(str(temp_path), str(path))
+
+def vximg_path(hex_file):
+    return Path(hex_file).with_suffix(".vximg")
+
+def load_image(hex_file):
+    """Load the image of a hex file, from the .vximg file next to it if it was
+    written from the same hex file, otherwise from the hex file itself."""
+    image_file = vximg_path(hex_file)
+    try:
+        return MappedImage(image_file, hex_file)
+    except (OSError, ValueError, struct.error, HexException) as e:
+        debug("load_image(): Not using %s: %s" % (image_file, e))
+    return load_hex(hex_file)
+
+def load_hex(hex_file):
+    """Read an Intel hex file into a ProgramImage.
+
+    Data above the low 64 KB (configuration bits, ID locations and EEPROM) is
+    ignored, since the bootloader can only write program memory.
+    """
+    segments = []
+    upper_address = 0
+    
+    with Path(hex_file).open("r") as fd:
+        for line_number, line in enumerate(fd, 1):
             line = line.strip()
+            if not line:
+                continue
+            
+            try:
+                if not line.startswith(":"):
+                    raise ValueError()
+                record = bytes.fromhex(line[1:])
+            except ValueError:
+                raise HexException(hex_file, "Line %i is not an Intel hex record" % line_number)
+            if len(record) < 5 or len(record) != record[0] + 5:
+                raise HexException(hex_file, "Line %i has the wrong length for its record" % line_number)
             
-            address = int(line[3:7], 16);
-            if address != 0:
-                line_len = int(line[1:3], 16);
-                code_offset = address - start_address
-                
-                for c in range(line_len):
-                    pos = 9 + c * 2
-                    val = int(line[pos:pos + 2], 16)
-                    code[code_offset + c] = val
-                # Calculate checksum based on data read from file
-                computed_checksum = -(sum(code[code_offset:code_offset + line_len]) + line_len + (address & 0xff) + ((address >> 8) & 0xff)) & 0xff
-                # Read checksum from line
-                line_checksum = int(line[-2:], 16)
-                if computed_checksum != line_checksum:
-                    raise HexException(hex_file, "Hex file checksum verification failed: computed=%#04x, expected=%#04x" % (computed_checksum, line_checksum))
+            # Calculate checksum based on data read from file
+            computed_checksum = -sum(record[:-1]) & 0xff
+            if computed_checksum != record[-1]:
+                raise HexException(hex_file, "Hex file checksum verification failed on line %i: computed=%#04x, expected=%#04x" % 
+                                   (line_number, computed_checksum, record[-1]))
+            
+            record_type = record[3]
+            address = (record[1] << 8) | record[2]
+            data = record[4:-1]
+            if record_type == HEX_DATA:
+                address |= upper_address
+                if address < 0x10000:
+                    segments.append((address, data))
+            elif record_type == HEX_END_OF_FILE:
+                break
+            elif record_type == HEX_EXTENDED_SEGMENT_ADDRESS:
+                upper_address = int.from_bytes(data, "big") << 4
+            elif record_type == HEX_EXTENDED_LINEAR_ADDRESS:
+                upper_address = int.from_bytes(data, "big") << 16
+    
+    if segments:
+        start_address = min(address for address, data in segments)
+        end_address = max(address + len(data) for address, data in segments)
+    else:
+        start_address = end_address = MIN_PROGRAM_ADDRESS
+    debug("load_hex(): Start address: %#06x, End address: %#06x" % (start_address, end_address), DebugLevel.debug);
+    
+    # Make sure hex file addresses are within the correct range
+    check_program_range(hex_file, start_address, end_address)
+    
+    code = bytearray((0xff,) * (end_address - start_address))
+    rows = set()
+    for address, data in segments:
+        code[address - start_address:address - start_address + len(data)] = data
+        rows.update(row_addresses(address, address + len(data)))
 
-    set_program_mode()
+    return ProgramImage(start_address, code, rows, hex_file)
 
-    erase_rows = program_length // ERASE_ROW_SIZE
-    if program_length % ERASE_ROW_SIZE != 0: erase_rows += 1
-    info("\nProgram size is %i bytes." % program_length)
-    info("Erasing %i rows (%i bytes/row, %i bytes total)..." % 
-        (erase_rows, ERASE_ROW_SIZE, program_length))
+def compute_build_id(image):
+    """Digest of everything in an image except the build ID row."""
+    digest = hashlib.sha1()
+    for row in image.rows:
+        if row != row_address(BUILD_ID_ADDRESS):
+            digest.update(row.to_bytes(4, "little") + bytes(image.read(row, ERASE_ROW_SIZE)))
+    return digest.digest()[:BUILD_ID_LENGTH]
 
-    erase_program_mem(serial_conn, start_address, erase_rows * ERASE_ROW_SIZE)
-    info("\n")
+def stamp_build_id(hex_file):
+    """Add the build ID record to a freshly linked hex file. Returns the
+    stamped image, so it does not need to be read again."""
+    image = load_hex(hex_file)
+    build_id = compute_build_id(image)
+    image.write(BUILD_ID_ADDRESS, build_id)
+    
+    hex_file = Path(hex_file)
+    lines = hex_file.read_text().splitlines()
+    eof = lines.index(hex_record(HEX_END_OF_FILE, 0))
+    lines[eof:eof] = [hex_record(HEX_EXTENDED_LINEAR_ADDRESS, 0, (0, 0)),
+                      hex_record(HEX_DATA, BUILD_ID_ADDRESS, build_id)]
+    hex_file.write_text("\n".join(lines) + "\n")
+    
+    return image
 
-    write_blocks = program_length // WRITE_CLUSTER_SIZE
-    if program_length % WRITE_CLUSTER_SIZE != 0: write_blocks += 1
-    info("Writing %i clusters (8 bytes/block, 8 blocks/cluster, %i bytes total)..." % 
-        (write_blocks, write_blocks * WRITE_CLUSTER_SIZE))
+def hex_record(record_type, address, data=()):
+    """Format an Intel hex record."""
+    record = bytes((len(data), (address >> 8) & 0xff, address & 0xff, record_type)) + bytes(data)
+    return ":%s%02X" % (hex_dump(record).upper(), -sum(record) & 0xff)
 
-    write_program_mem(serial_conn, start_address, code)
+def round_up(value, size):
+    return (value + size - 1) // size * size
+
+def row_address(address):
+    return address - address % ERASE_ROW_SIZE
+
+def row_addresses(start_address, end_address):
+    """Addresses of the rows (and clusters, which are the same size) that hold a range of program memory."""
+    return range(row_address(start_address), end_address, ERASE_ROW_SIZE)
+
+def address_runs(addresses, size):
+    """Group sorted addresses of size byte units into (address, length) runs of adjacent units."""
+    runs = []
+    for address in addresses:
+        if runs and runs[-1][0] + runs[-1][1] == address:
+            runs[-1][1] += size
+        else:
+            runs.append([address, size])
+    return [tuple(run) for run in runs]
+
+def journal_path(hex_file, serial_port=None):
+    """Journals for fleet uploads are kept per port, single uploads share one."""
+    hex_file = Path(hex_file)
+    if serial_port == None:
+        return hex_file.with_suffix(".upload.json")
+    port_name = re.sub(r"[^A-Za-z0-9]+", "_", str(serial_port)).strip("_")
+    return hex_file.with_suffix(".%s.upload.json" % port_name)
+
+def open_journal(path, image, resume=True):
+    journal = UploadJournal(path, image.digest())
+    if resume:
+        journal.load()
+    if journal.complete or not resume:
+        journal.reset()
+    return journal
+
+class UploadJournal(object):
+    """On-disk record of the progress of an upload, so an interrupted upload
+    can carry on where it stopped instead of starting over.
+
+    Attributes:
+        digest -- digest of the image being uploaded, a journal for any other
+                  image is ignored. The controller is checked against the
+                  journal with check_journal() before resuming.
+        erased_rows -- addresses of rows that have been erased
+        written_clusters -- addresses of clusters whose writes were acknowledged
+        base_id -- build ID of the program the upload only sends changes against
+        complete -- True once the whole image has been written
+    """
+    
+    def __init__(self, path, digest):
+        self.path = Path(path)
+        self.digest = digest
+        self.reset()
+    
+    def reset(self):
+        self.erased_rows = set()
+        self.written_clusters = set()
+        self.base_id = None
+        self.complete = False
+    
+    def load(self):
+        try:
+            with self.path.open() as fd:
+                journal = json.load(fd)
+        except (OSError, ValueError):
+            return
+        if journal.get("digest") == self.digest:
+            self.erased_rows = set(journal["erased_rows"])
+            self.written_clusters = set(journal["written_clusters"])
+            self.base_id = journal.get("base_id")
+            self.complete = journal["complete"]
+    
+    def save(self):
+        # Write to a temporary file first, so the journal is never left half written
+        temp_path = self.path.with_name(self.path.name + ".tmp")
+        with temp_path.open("w") as fd:
+            json.dump({"digest": self.digest, "erased_rows": sorted(self.erased_rows),
+                       "written_clusters": sorted(self.written_clusters), "base_id": self.base_id,
+                       "complete": self.complete}, fd)
+        os.replace(str(temp_path), str(self.path))
+
+def check_journal(serial_conn, journal, image):
+    """Read back some of what the journal says was done before trusting it.
+
+    The journal is kept for a hex file and serial port, not a controller, so
+    after a different controller is plugged in, or the controller is
+    reflashed, the rows it says were erased may not be. The first and last
+    clusters it says were written have to hold the image, and the first row
+    it says was erased, but has no written cluster, has to be blank or hold
+    the image. Returns False when they don't.
+    """
+    def holds(cluster, blank_too):
+        start = max(cluster, image.start_address)
+        end = min(cluster + WRITE_CLUSTER_SIZE, image.end_address)
+        if end <= start:
+            return True
+        actual = bytes(read_program_mem(serial_conn, start, end - start))
+        debug("check_journal(): cluster=%#06x, flash=%s" % (cluster, hex_dump(actual)))
+        return actual == bytes(image.read(start, end - start)) or (blank_too and actual == b"\xff" * len(actual))
+    
+    written = sorted(journal.written_clusters)
+    checks = [(cluster, False) for cluster in sorted(set(written[:1] + written[-1:]))]
+    unwritten = [row for row in sorted(journal.erased_rows) if row not in journal.written_clusters]
+    checks += [(row, True) for row in unwritten[:1]]
+    return all(holds(cluster, blank_too) for cluster, blank_too in checks)
+
+def check_resume_boundary(serial_conn, journal, image, cluster):
+    """Read back the first cluster that was not acknowledged before resuming.
+
+    If its write reached the flash before the upload was interrupted, it is
+    marked as written and True is returned. If it holds anything other than
+    the image or erased flash, its row is erased again.
+    """
+    cluster_start = max(cluster, image.start_address)
+    cluster_end = min(cluster + WRITE_CLUSTER_SIZE, image.end_address)
+    
+    expected = image.read(cluster_start, cluster_end - cluster_start)
+    actual = read_program_mem(serial_conn, cluster_start, cluster_end - cluster_start)
+    debug("check_resume_boundary(): cluster=%#06x, flash=%s" % (cluster, hex_dump(actual)))
+    
+    written = bytes(actual) == bytes(expected)
+    if written:
+        journal.written_clusters.add(cluster)
+    elif any(char != 0xff for char in actual):
+        info("Cluster at %#06x was partially written, erasing it again." % cluster)
+        erase_program_mem(serial_conn, row_address(cluster), ERASE_ROW_SIZE)
+    journal.save()
+    return written
+
+def open_serial(serial_port):
+    # Vex uses 115200 bits/sec, no parity, 8 data bits, 1 stop bit.
+    # Names can also be pySerial URLs, such as loop:// or a simulated bootloader.
+    if isinstance(serial_port, str):
+        return serial.serial_for_url(serial_port, baudrate=115200, timeout=DEFAULT_TIMEOUT)
+    return serial.Serial(serial_port, baudrate=115200, timeout=DEFAULT_TIMEOUT)
 
-    return_to_user_code(serial_conn)
-        
 def check_program_range(hex_file, start_address, end_address):
     if end_address < start_address:
         raise HexException(hex_file, "End address (%#06x) is less than start address (%#06x)" % (end_address, start_address))
-    if (start_address < MIN_PROGRAM_ADDRESS) or (end_address > MAX_PROGRAM_ADDRESS):
+    # end_address is just past the last byte
+    if (start_address < MIN_PROGRAM_ADDRESS) or (end_address > MIN_PROGRAM_ADDRESS + PROGRAM_SIZE):
         raise HexException(hex_file, """Valid program addresses are %#08x to %#08x.
 Start and end addresses received are %#08x to %#08x.""" % (MIN_PROGRAM_ADDRESS, MAX_PROGRAM_ADDRESS, start_address, end_address))
 
@@ -238,7 +1521,7 @@ def set_program_mode():
     info("Press the button on the programming module until the PGRM STATUS button flashes.")
     input("Then press return...")
 
-def erase_program_mem(serial_conn, address, length):
+def erase_program_mem(serial_conn, address, length, on_erased=None):
     debug("erase_program_mem(): address=%#08x, length=%i" % (address, length), DebugLevel.debug)
     # Make sure the caller is only trying to erase to the boundary of a block
     if (length % ERASE_ROW_SIZE) != 0:
@@ -266,8 +1549,10 @@ def erase_program_mem(serial_conn, address, length):
                     (curr_addr >> 8) & 0xff,
                     (curr_addr >> 16) & 0xff,
                     0),
-                    None))
+                    None), retries=PACKET_RETRIES)
         
+        if on_erased:
+            on_erased(curr_addr, erase_length)
         curr_addr += erase_length
         progress_dot()
 
@@ -278,13 +1563,49 @@ def read_program_mem(serial_conn, address, length):
     packet = Packet.from_response(send_command(serial_conn, Packet(Command.read_program_mem, (length,
                     address & 0xff,
                     (address >> 8) & 0xff,
-                    (address >> 16) & 0xff,
-                    None))))
+                    (address >> 16) & 0xff),
+                    None), retries=PACKET_RETRIES))
     
     return packet.data
 
-def write_program_mem(serial_conn, address, code):
-    debug("write_program_mem(): address=%#08x, length=%i" % (address, len(code)))
+def read_length(address, expected=None):
+    """Largest read at address whose response is sure to fit in a frame.
+
+    If the expected contents are given, reads are sized for them, so reading
+    program memory that does not need much escaping takes fewer requests.
+    """
+    if expected == None:
+        return MAX_SAFE_READ_LENGTH
+    
+    length = min(len(expected), MAX_READ_LENGTH)
+    arguments = (length, address & 0xff, (address >> 8) & 0xff, (address >> 16) & 0xff)
+    # The checksum of a response that differs might need escaping
+    while length > 1 and 5 + len(arguments) + length + escape_count(arguments) + escape_count(expected[:length]) + 1 > MAX_PACKET_LENGTH:
+        length -= 1
+    return length
+
+def read_range(serial_conn, address, length, expected=None):
+    """Read a range of program memory in as few requests as possible. Yields
+    (address, data) for each request, so a caller can stop early."""
+    start = address
+    end = address + length
+    while address < end:
+        chunk_expected = expected[address - start:] if expected != None else None
+        chunk_length = min(read_length(address, chunk_expected), end - address)
+        try:
+            data = read_program_mem(serial_conn, address, chunk_length)
+        except IOError:
+            if chunk_length <= MAX_SAFE_READ_LENGTH:
+                raise
+            # Something unexpected needed escaping
+            chunk_length = MAX_SAFE_READ_LENGTH
+            data = read_program_mem(serial_conn, address, chunk_length)
+        progress_dot()
+        yield address, data
+        address += chunk_length
+
+def write_program_mem(serial_conn, address, code, max_blocks=DEFAULT_WRITE_BLOCKS, on_written=None):
+    debug("write_program_mem(): address=%#08x, length=%i, max_blocks=%i" % (address, len(code), max_blocks))
     debug("code:\n%s" % textwrap.fill(hex_dump(code), 100), DebugLevel.insane)
     
     # Align the code to the nearest block
@@ -309,46 +1630,158 @@ def write_program_mem(serial_conn, address, code):
     curr_addr = address
 
     while remaining_blocks > 0:
-        write_blocks = min(WRITE_CLUSTER_SIZE // WRITE_BLOCK_SIZE, remaining_blocks)
+        # Pack as many blocks as the controller accepts, dropping blocks until
+        # the escaped frame fits in a packet.
+        write_blocks = min(max_blocks, remaining_blocks)
+        while True:
+            code_offset = curr_addr - address
+            packet = write_packet(curr_addr, code[code_offset:code_offset + (write_blocks * WRITE_BLOCK_SIZE)])
+            if write_blocks == 1 or frame_length(packet) <= MAX_PACKET_LENGTH:
+                break
+            write_blocks -= 1
+
         remaining_blocks -= write_blocks
+        write_length = write_blocks * WRITE_BLOCK_SIZE
         debug("write_program_mem(): Writing %i blocks at %#06x" % (write_blocks, curr_addr))
 
         assert is_valid_address(curr_addr)
-        assert is_valid_address(curr_addr + WRITE_CLUSTER_SIZE)
+        assert is_valid_address(curr_addr + write_length)
 
-        code_offset = curr_addr - address
-
-        send_command(serial_conn, Packet(Command.write_program_mem,
-                    (write_blocks,
-                    curr_addr & 0xff,
-                    (curr_addr >> 8) & 0xff,
-                    (curr_addr >> 16) & 0xff),
-                    code[code_offset:code_offset + (write_blocks * WRITE_BLOCK_SIZE)]))
-        curr_addr += WRITE_CLUSTER_SIZE
+        send_command(serial_conn, packet, retries=PACKET_RETRIES)
+        if on_written:
+            on_written(curr_addr, write_length)
+        curr_addr += write_length
 
         progress_dot()
+
+def write_packet(address, data):
+    return Packet(Command.write_program_mem,
+                  (len(data) // WRITE_BLOCK_SIZE,
+                  address & 0xff,
+                  (address >> 8) & 0xff,
+                  (address >> 16) & 0xff),
+                  data)
+
+def probe_write_blocks(serial_conn, address):
+    """Find the largest number of blocks the bootloader accepts in one write.
+
+    The probes write erased (0xff) blocks, which cannot change the contents of
+    flash, so this is safe to run on any valid address. Sizes are binary
+    searched between DEFAULT_WRITE_BLOCKS, which all controllers accept, and
+    the most that fit in a frame.
+    """
+    debug("probe_write_blocks(): address=%#06x" % address)
+    
+    good = DEFAULT_WRITE_BLOCKS
+    bad = MAX_WRITE_BLOCKS + 1
+    while bad - good > 1:
+        blocks = (good + bad) // 2
+        assert is_valid_address(address + blocks * WRITE_BLOCK_SIZE)
+        try:
+            send_command(serial_conn, write_packet(address, bytes((0xff,) * (blocks * WRITE_BLOCK_SIZE))),
+                         timeout=PROBE_TIMEOUT)
+            good = blocks
+        except IOError as e:
+            debug("probe_write_blocks(): %i blocks rejected: %s" % (blocks, e))
+            bad = blocks
+            # Drop whatever the bootloader sent back for the rejected frame
+            serial_conn.flushInput()
     
+    return good
+
 def return_to_user_code(serial_conn):
     return send_command(serial_conn, Packet(Command.return_to_user_code,
                     (0x40,),
                     None), 0x40)
 
-def send_command(serial_conn, packet, response_etx=CHAR_ETX):
+def send_command(serial_conn, packet, response_etx=CHAR_ETX, timeout=None, retries=0):
     debug("send_command(): command=%s, arguments=%s, data=%s" % (packet.command, hex_dump(packet.arguments), hex_dump(packet.data) if packet.data else None),
           DebugLevel.debug)
     
+    payload = frame_packet(packet)
+    
+    # Packets can have a maximum of 255 bytes
+    if len(payload) > MAX_PACKET_LENGTH:
+        raise IOError("Tried to sent a %i byte packet. The maximum length is %i." % (len(payload), MAX_PACKET_LENGTH))
+    
+    stats = connection_stats.get(serial_conn)
+    attempt = 0
+    while True:
+        try:
+            response = transfer_frame(serial_conn, packet, payload, response_etx, timeout, stats)
+            if response_etx == CHAR_ETX:
+                check_response(response, packet.command)
+            return response
+        except IOError as e:
+            if attempt >= retries:
+                raise
+            attempt += 1
+            debug("send_command(): retry %i after error: %s" % (attempt, e))
+            if stats:
+                stats.retries += 1
+            # Drop any partial response so it is not mistaken for the next one
+            serial_conn.flushInput()
+
+def work_units(packet):
+    """How much work the controller does for a packet: the rows it erases,
+    the blocks it writes or the bytes it reads, or 1 for anything else.
+    """
+    if packet.command == Command.erase_program_mem:
+        return max(1, packet.arguments[0])
+    if packet.command == Command.write_program_mem:
+        return max(1, len(packet.data) // WRITE_BLOCK_SIZE if packet.data else 0)
+    if packet.command == Command.read_program_mem:
+        return max(1, packet.arguments[0])
+    return 1
+
+def transfer_frame(serial_conn, packet, payload, response_etx, timeout, stats):
+    if timeout == None and stats:
+        timeout = stats.timeout_for(packet.command, work_units(packet))
+    previous_timeout = serial_conn.timeout
+    if timeout != None and timeout != previous_timeout:
+        serial_conn.timeout = timeout
+    
+    try:
+        if stats:
+            stats.begin(packet, len(payload))
+        sent = serial_conn.write(payload)
+        serial_conn.flush()
+    
+        if sent != len(payload):
+            raise IOError("Error sending command. %i bytes to write, sent %i." % (len(payload), sent))
+        
+        try:
+            response = read_response(serial_conn, response_etx)
+        except IOError:
+            if stats:
+                stats.timed_out()
+            raise
+        if stats:
+            stats.finish(len(response))
+    finally:
+        if serial_conn.timeout != previous_timeout:
+            serial_conn.timeout = previous_timeout
+    
+    return response
+
+def check_response(response, command):
+    """Make sure a response is a complete frame that replies to command."""
+    if len(response) < 4 or response[0] != CHAR_STX or response[1] != CHAR_STX:
+        raise IOError("Invalid response to %s: %s" % (command.name, hex_dump(response)))
+    if response[2] != command.value:
+        raise IOError("Response is for command %#04x, expected %s" % (response[2], command.name))
+    if command == Command.read_program_mem:
+        # Checks the checksum and length
+        Packet.from_response(response)
+
+def frame_packet(packet):
     payload = bytearray()
-    checksum = 0
     
     # Build payload    
-    checksum -= packet.command.value
     payload.append(packet.command.value)
-    checksum -= sum(packet.arguments)
-        
     payload.extend(packet.arguments)
     
     if packet.data:
-        checksum -= sum(packet.data)
         payload.extend(packet.data)
     payload.append(packet.checksum)
     
@@ -360,17 +1793,17 @@ def send_command(serial_conn, packet, response_etx=CHAR_ETX):
     payload.insert(0, CHAR_STX)
     payload.append(CHAR_ETX)
     
-    # Packets can have a maximum of 255 bytes
-    if len(payload) > MAX_PACKET_LENGTH:
-        raise IOError("Tried to sent a %i byte packet. The maximum length is %i." % (len(payload), MAX_PACKET_LENGTH))
-    
-    sent = serial_conn.write(payload)
-    serial_conn.flush()
+    return payload
 
-    if sent != len(payload):
-        raise IOError("Error sending command. %i bytes to write, sent %i." % (len(payload), sent))
-    
-    return read_response(serial_conn, response_etx)
+def frame_length(packet):
+    """Length of the packet once framed and escaped, without building the frame."""
+    length = 5 + len(packet.arguments)
+    if packet.data:
+        length += len(packet.data)
+    return length + escape_count(packet.arguments) + escape_count(packet.data or ()) + escape_count((packet.checksum,))
+
+def escape_count(data):
+    return sum(1 for char in data if char == CHAR_STX or char == CHAR_ETX or char == CHAR_ESC)
 
 def escape_payload(payload):
     i = 0
@@ -385,9 +1818,12 @@ def read_response(serial_conn, etx=CHAR_ETX):
     debug("read_response(): etx=%#04x" % etx, DebugLevel.debug)
     response = bytearray()
     esc = False
+    stats = connection_stats.get(serial_conn)
     
     while True:
         data = serial_conn.read()
+        if stats and len(data) == 1:
+            stats.first_byte()
         if len(data) == 1:
             data_val = data[0]
             if not esc:
@@ -407,6 +1843,19 @@ def read_response(serial_conn, etx=CHAR_ETX):
     
     return response
    
+def load_settings():
+    try:
+        with settings_file.open() as fd:
+            return json.load(fd)
+    except (OSError, ValueError):
+        return dict()
+
+def save_settings(settings):
+    all_settings = load_settings()
+    all_settings.update(settings)
+    with settings_file.open("w") as fd:
+        json.dump(all_settings, fd, indent=4)
+
 def info(msg):
     print(msg, flush=True)
 
@@ -414,10 +1863,13 @@ def debug(msg, level=DebugLevel.verbose):
     if debug_level.value >= level.value:
         info(msg)
         
+# Progress dots can be turned off per thread, for fleet uploads
+progress_state = threading.local()
+
 def progress_dot():
     # Make sure debug prints are not enabled, and we are running in a real terminal
     # If these conditions are not met, progress bars will not work right.
-    if debug_level == DebugLevel.none:
+    if debug_level == DebugLevel.none and getattr(progress_state, "enabled", True):
         print(".", end="", flush=True)
 
 def hex_dump(data):
@@ -428,8 +1880,23 @@ def parse_args():
     parser = argparse.ArgumentParser()
     
     parser.add_argument("--debug", help="debug level", default="none")
-    parser.add_argument("--dev", help="Use serial port dev instead of the default", default=None)
-    parser.add_argument("hex_file", help="Hex file to upload")
+    parser.add_argument("--dev", help="Use serial port dev instead of the default. Repeat it to upload to several at once.",
+                        action="append", default=None)
+    parser.add_argument("--all", help="upload to every Vex programming module that is plugged in", action="store_true")
+    parser.add_argument("--probe", help="find and remember the largest write the controller accepts", action="store_true")
+    parser.add_argument("--stats-json", help="write per-packet timing statistics to a JSON file", default=None)
+    parser.add_argument("--no-resume", help="start over instead of resuming an interrupted upload", action="store_true")
+    parser.add_argument("--verify-resume", help="read back the first unwritten cluster before resuming", action="store_true")
+    parser.add_argument("--dump", help="read the program on the controller into a hex file", metavar="OUT_HEX", default=None)
+    parser.add_argument("--verify", help="compare the controller with the hex file instead of uploading", action="store_true")
+    parser.add_argument("--verify-last", help="only compare the rows written by the last upload", action="store_true")
+    parser.add_argument("--monitor", help="print what the program sends, expanding VexLog() records with a format table",
+                        metavar="FORMATS_JSON", default=None)
+    parser.add_argument("--telemetry", help="monitor, decoding telemetry frames with a layout", metavar="LAYOUT_JSON",
+                        default=None)
+    parser.add_argument("--capture", help="write the telemetry to a capture file", default=None)
+    parser.add_argument("--plot", help="plot the telemetry as it arrives", action="store_true")
+    parser.add_argument("hex_file", help="Hex file to upload", nargs="?", default=None)
         
     return parser.parse_args()
 
@@ -438,4 +1905,27 @@ if __name__ == "__main__":
     
     debug_level = DebugLevel[args.debug]
     
-    upload(args.hex_file, args.dev)
+    if (args.capture != None or args.plot) and args.telemetry == None:
+        print("Error: --capture and --plot need --telemetry", flush=True, file=sys.stderr)
+        exit(1)
+    
+    serial_ports = args.dev
+    if args.all:
+        serial_ports = find_serial_ports()
+        if not serial_ports:
+            print("Error: No Vex programming modules found", flush=True, file=sys.stderr)
+            exit(1)
+    
+    serial_port = serial_ports[0] if serial_ports else None
+    if args.dump != None:
+        dump(args.dump, serial_port)
+    elif args.monitor != None or args.telemetry != None:
+        monitor(args.monitor, serial_port, layout_file=args.telemetry, capture_file=args.capture, plot=args.plot)
+    elif args.hex_file == None:
+        print("Error: No hex file given", flush=True, file=sys.stderr)
+        exit(1)
+    elif args.verify or args.verify_last:
+        if verify(args.hex_file, serial_port, args.verify_last) != None:
+            exit(1)
+    else:
+        upload(args.hex_file, serial_ports, args.probe, args.stats_json, not args.no_resume, args.verify_resume)
@@ -0,0 +1,680 @@
+#!/usr/bin/env python3
+"""Static worst case execution time analysis of Vex programs.
+
+The instructions of the linked hex file are decoded into a control flow
+graph for each function (the program symbols of the map file), which is
+followed through calls to get the most instruction cycles each entry point
+can take: the interrupt handlers, and main or other functions given on the
+command line. A function that never returns, like the main loop, is measured
+for one pass through its endless loop.
+
+Loops need a bound, the most times the first instruction of the loop runs
+each time the loop is entered. Bounds, and everything else the analysis cannot
+find out from the code, are given in wcet.cfg in the project directory, or in
+comments starting with "wcet:" in the project's source files. Each line is one
+of:
+
+    loop SITE BOUND          bound of the loop starting at SITE, or of every
+                             loop in a function if SITE is a function name
+    cycles FUNCTION CYCLES   take the worst case of a function as given
+    stack FUNCTION BYTES     take the software stack a function uses as
+                             given (see vexstack)
+    targets SITE NAME...     where a computed jump (a write to PCL) or a
+                             call through PUSH at SITE goes
+    entry FUNCTION           analyze a function as an entry point
+    budget ENTRY CYCLES      the most cycles an entry point may take
+
+A SITE is a function name, an address, or a function name with an offset
+like Drive+0x1c, as the report prints them.
+"""
+import collections
+import re
+import sys
+from pathlib import Path
+
+import vexsim
+import vexupload
+from vexsim import INSTRUCTION_RATE, HIGH_PRIORITY_VECTOR, LOW_PRIORITY_VECTOR, is_two_word, signed
+
+
+CONFIG_NAME = "wcet.cfg"
+
+# Names of the interrupt handlers, which start at the vectors
+HIGH_PRIORITY_ENTRY = "high priority interrupt"
+LOW_PRIORITY_ENTRY = "low priority interrupt"
+
+PCL_ACCESS = 0xF9
+
+# Where a path through a function ends: returning, or going around an endless
+# loop (which counts as one pass)
+RETURN = "return"
+PASS = "pass"
+
+Instruction = collections.namedtuple("Instruction", ("address", "size", "kind", "target", "cycles"))
+Config = collections.namedtuple("Config", ("loops", "cycles", "targets", "entries", "budgets", "stack"))
+# A call on a path: the address of the call, the function called, how many
+# times and the cycles each call takes
+Call = collections.namedtuple("Call", ("site", "function", "times", "cycles"))
+
+source_annotation_regex = re.compile(r"(?://|/\*)\s*wcet:\s*(.*?)\s*(?:\*/|$)", re.IGNORECASE)
+
+def writes_pcl(word):
+    """Whether an instruction writes PCL in the access bank, which jumps."""
+    if word & 0x01FF != PCL_ACCESS:
+        return False
+    opcode = word >> 10
+    # Byte operations with the result going back to the register
+    if 1 <= opcode <= 0x17 and opcode not in (2, 3):
+        return bool(word & 0x0200)
+    # SETF, CLRF, NEGF, MOVWF, BTG, BSF and BCF
+    return 0x68 <= word >> 8 <= 0x9F
+
+def decode(word, next_word, address):
+    """Decode the instruction at an address into an Instruction. Its kind is
+    how it affects the flow of the program:
+
+        next      carries on with the next instruction
+        branch    goes to target, or on with the next instruction
+        jump      goes to target
+        skip      skips the next instruction, or carries on with it
+        call      calls target, then carries on
+        return    returns from the function
+        computed  jumps to an address it computes
+        push      pushes the return stack, to call through it
+        reset     resets the processor
+        invalid   is not an instruction
+    """
+    next_address = address + 2
+    top = word >> 12
+    if top == 0xC:
+        destination = next_word & 0x0FFF
+        kind = "computed" if destination == 0xF00 | PCL_ACCESS else "next"
+        return Instruction(address, 4, kind, None, 2)
+    if top == 0xD:
+        target = next_address + 2 * signed(word & 0x7FF, 11)
+        return Instruction(address, 2, "call" if word & 0x0800 else "jump", target, 2)
+    if top == 0xE:
+        operation = word >> 8 & 0x0F
+        if operation <= 7:
+            return Instruction(address, 2, "branch", next_address + 2 * signed(word & 0xFF, 8), 1)
+        if operation in (0xC, 0xD):
+            return Instruction(address, 4, "call", (word & 0xFF | (next_word & 0x0FFF) << 8) << 1, 2)
+        if operation == 0xE and word & 0xC0 == 0:
+            return Instruction(address, 4, "next", None, 2)
+        if operation == 0xF:
+            return Instruction(address, 4, "jump", (word & 0xFF | (next_word & 0x0FFF) << 8) << 1, 2)
+        return Instruction(address, 2, "invalid", None, 1)
+    if top == 0xF:
+        return Instruction(address, 2, "next", None, 1)
+
+    if word & 0xFF00 == 0:
+        if word in (0x0010, 0x0011, 0x0012, 0x0013):
+            return Instruction(address, 2, "return", None, 2)
+        if word == 0x0005:
+            return Instruction(address, 2, "push", None, 1)
+        if word == 0x00FF:
+            return Instruction(address, 2, "reset", None, 1)
+        if 0x0008 <= word <= 0x000F:
+            return Instruction(address, 2, "next", None, 2)
+        if word in (0x0000, 0x0003, 0x0004, 0x0006, 0x0007):
+            return Instruction(address, 2, "next", None, 1)
+        return Instruction(address, 2, "invalid", None, 1)
+    if word >> 8 == 0x0C:
+        return Instruction(address, 2, "return", None, 2)
+    if writes_pcl(word):
+        return Instruction(address, 2, "computed", None, 2)
+    # DECFSZ, INCFSZ, INFSNZ, DCFSNZ, CPFSLT, CPFSEQ, CPFSGT, TSTFSZ, BTFSS and BTFSC
+    if word >> 10 in (0x0B, 0x0F, 0x12, 0x13) or 0x60 <= word >> 8 <= 0x67 or top in (0xA, 0xB):
+        return Instruction(address, 2, "skip", None, 1)
+    return Instruction(address, 2, "next", None, 1)
+
+def read_config(config_file=None, src_dir=None):
+    """Read the analysis settings from a wcet.cfg file and the wcet: comments
+    of the source files in src_dir. Either can be None.
+    """
+    lines = []
+    if config_file != None and Path(config_file).exists():
+        for number, line in enumerate(Path(config_file).read_text().splitlines(), 1):
+            lines.append(("%s:%i" % (config_file, number), line.split("#", 1)[0]))
+    if src_dir != None and Path(src_dir).is_dir():
+        for source in sorted(Path(src_dir).glob("**/*")):
+            if source.suffix not in (".c", ".h"):
+                continue
+            for number, line in enumerate(source.read_text(errors="replace").splitlines(), 1):
+                for match in source_annotation_regex.finditer(line):
+                    lines.append(("%s:%i" % (source, number), match.group(1)))
+
+    config = Config({}, {}, {}, [], {}, {})
+    for where, line in lines:
+        fields = line.split()
+        if not fields:
+            continue
+        try:
+            setting = fields[0].lower()
+            if setting == "loop" and len(fields) == 3:
+                config.loops[fields[1]] = int(fields[2], 0)
+            elif setting == "cycles" and len(fields) == 3:
+                config.cycles[fields[1]] = int(fields[2], 0)
+            elif setting == "targets" and len(fields) >= 3:
+                config.targets[fields[1]] = fields[2:]
+            elif setting == "entry" and len(fields) == 2:
+                config.entries.append(fields[1])
+            elif setting == "budget" and len(fields) == 3:
+                config.budgets[fields[1]] = int(fields[2], 0)
+            elif setting == "stack" and len(fields) == 3:
+                config.stack[fields[1]] = int(fields[2], 0)
+            else:
+                raise ValueError()
+        except ValueError:
+            raise ValueError("%s: cannot understand \"%s\"" % (where, line.strip()))
+    return config
+
+class FunctionTime(object):
+    """The worst case of a function.
+
+    Attributes:
+        name -- the function's name, or its address if it has no symbol
+        address -- where it starts
+        cycles -- most cycles from the call to the return, None if it never returns
+        pass_cycles -- most cycles from the call through one pass of an
+                       endless loop, None if it has none
+        calls -- the Calls on the path of the worst case
+        loops -- the bound used for each loop, by the address it starts at
+        complete -- False if the analysis had problems, the cycles are then
+                    only a lower bound
+    """
+
+    def __init__(self, name, address):
+        self.name = name
+        self.address = address
+        self.cycles = 0
+        self.pass_cycles = None
+        self.calls = ()
+        self.loops = {}
+        self.complete = True
+
+    def worst(self):
+        """The cycles of the worst case, and whether it is a pass of an endless loop."""
+        if self.pass_cycles != None and (self.cycles == None or self.pass_cycles >= self.cycles):
+            return self.pass_cycles, True
+        return self.cycles, False
+
+class Analyzer(object):
+    """Worst case execution time analysis of a program image.
+
+    Attributes:
+        problems -- what stopped the analysis from being complete, as
+                    (site, message) in the order they were found
+    """
+
+    def __init__(self, image, symbols=None, config=None):
+        if not isinstance(image, vexupload.ProgramImage):
+            with vexupload.load_image(image) as loaded:
+                image = vexupload.ProgramImage(loaded.start_address, loaded.code, loaded.rows, loaded.hex_file)
+        self.image = image
+        self.code = image.read(image.start_address, image.end_address - image.start_address)
+        self.symbols = symbols if symbols != None else {}
+        self.config = config if config != None else Config({}, {}, {}, [], {}, {})
+        self.names = {}
+        for symbol in sorted(self.symbols.values(), key=lambda symbol: symbol.name, reverse=True):
+            if symbol.location == "program":
+                self.names[symbol.address] = symbol.name
+        self.names.setdefault(HIGH_PRIORITY_VECTOR, HIGH_PRIORITY_ENTRY)
+        self.names.setdefault(LOW_PRIORITY_VECTOR, LOW_PRIORITY_ENTRY)
+        self.functions = {}
+        self.problems = []
+        self._analyzing = set()
+
+    def word(self, address):
+        offset = address - self.image.start_address
+        if offset < 0 or offset + 1 >= len(self.code):
+            return None
+        return self.code[offset] | self.code[offset + 1] << 8
+
+    def instruction(self, address):
+        word = self.word(address)
+        if word == None:
+            return None
+        next_word = self.word(address + 2) if is_two_word(word) else 0
+        return decode(word, next_word if next_word != None else 0, address)
+
+    def name(self, address):
+        return self.names.get(address, "%#06x" % address)
+
+    def site(self, address, function):
+        """Describe an address as an offset into the function it is in."""
+        if address == function:
+            return self.name(function)
+        if function in self.names:
+            return "%s+%#x" % (self.names[function], address - function)
+        return "%#06x" % address
+
+    def address_of(self, name):
+        """The address of a symbol, entry, function+offset or number."""
+        if name in (HIGH_PRIORITY_ENTRY, HIGH_PRIORITY_ENTRY.replace(" ", "_")):
+            return HIGH_PRIORITY_VECTOR
+        if name in (LOW_PRIORITY_ENTRY, LOW_PRIORITY_ENTRY.replace(" ", "_")):
+            return LOW_PRIORITY_VECTOR
+        base, plus, offset = name.partition("+")
+        if base in self.symbols:
+            return self.symbols[base].address + (int(offset, 0) if plus else 0)
+        try:
+            return int(name, 0)
+        except ValueError:
+            raise KeyError("Unknown symbol: " + name)
+
+    def _setting(self, settings, address, function):
+        """Find the setting for a site, by any of the ways it can be named."""
+        for key, value in settings.items():
+            try:
+                if self.address_of(key) == address:
+                    return value
+            except KeyError:
+                continue
+        if function != None:
+            for key, value in settings.items():
+                if key == self.name(function):
+                    return value
+        return None
+
+    def problem(self, site, message):
+        if (site, message) not in self.problems:
+            self.problems.append((site, message))
+
+    def entries(self):
+        """The entry points to analyze: the interrupt handlers, main, and the
+        ones given in the configuration.
+        """
+        entries = []
+        for vector in (HIGH_PRIORITY_VECTOR, LOW_PRIORITY_VECTOR):
+            instruction = self.instruction(vector)
+            if instruction != None and self.word(vector) != 0xFFFF:
+                entries.append(vector)
+        if "main" in self.symbols:
+            entries.append(self.symbols["main"].address)
+        for name in self.config.entries:
+            address = self.address_of(name)
+            if address not in entries:
+                entries.append(address)
+        return entries
+
+    def function(self, address):
+        """The FunctionTime of the function starting at address."""
+        if address in self.functions:
+            return self.functions[address]
+        result = FunctionTime(self.name(address), address)
+        if address in self._analyzing:
+            self.problem(result.name, "is recursive")
+            result.complete = False
+            return result
+
+        given = self._setting(self.config.cycles, address, None)
+        if given != None:
+            result.cycles = given
+            self.functions[address] = result
+            return result
+
+        self._analyzing.add(address)
+        try:
+            graph = self._graph(address, result)
+            self._collapse_loops(graph, address, result)
+            ends = self._longest_paths(graph, address, result)
+        finally:
+            self._analyzing.discard(address)
+
+        result.cycles, calls = ends.get(RETURN, (None, ()))
+        pass_cycles, pass_calls = ends.get(PASS, (None, ()))
+        result.pass_cycles = pass_cycles
+        result.calls = pass_calls if result.worst()[1] else calls
+        self.functions[address] = result
+        return result
+
+    # Each node of a function's graph is an address, with a list of edges
+    # (target, cycles, calls). RETURN and PASS are the ends.
+    def _graph(self, entry, result):
+        graph = {}
+        work = [entry]
+        while work:
+            address = work.pop()
+            if address in graph:
+                continue
+            instruction = self.instruction(address)
+            if instruction == None:
+                self.problem(self.site(address, entry), "runs outside of the program")
+                result.complete = False
+                graph[address] = [(RETURN, 0, ())]
+                continue
+            edges = self._edges(instruction, entry, result)
+            graph[address] = edges
+            work.extend(target for target, cycles, calls in edges if target not in (RETURN, PASS))
+        return graph
+
+    def _call_edges(self, site, callees, continue_to, cycles, result):
+        """Edges for calling the worst of a set of functions from site."""
+        returning = []
+        passing = []
+        for callee in callees:
+            time = self.function(callee)
+            if not time.complete:
+                result.complete = False
+            if time.cycles != None:
+                returning.append(Call(site, callee, 1, time.cycles))
+            if time.pass_cycles != None:
+                passing.append(Call(site, callee, 1, time.pass_cycles))
+        edges = []
+        if returning:
+            call = max(returning, key=lambda call: call.cycles)
+            edges.append((continue_to, cycles + call.cycles, (call,)))
+        if passing:
+            call = max(passing, key=lambda call: call.cycles)
+            edges.append((PASS, cycles + call.cycles, (call,)))
+        return edges
+
+    def _edges(self, instruction, entry, result):
+        address = instruction.address
+        next_address = address + instruction.size
+        kind = instruction.kind
+        cycles = instruction.cycles
+        if kind == "next":
+            return [(next_address, cycles, ())]
+        if kind == "branch":
+            return [(next_address, cycles, ()), (instruction.target, cycles + 1, ())]
+        if kind == "skip":
+            skipped = self.instruction(next_address)
+            skipped_size = skipped.size if skipped != None else 2
+            return [(next_address, cycles, ()), (next_address + skipped_size, cycles + skipped_size // 2, ())]
+        if kind == "return":
+            return [(RETURN, cycles, ())]
+        if kind == "call":
+            return self._call_edges(address, [instruction.target], next_address, cycles, result)
+        if kind == "jump":
+            # Jumping to the start of another function is a tail call
+            target = instruction.target
+            if target != entry and target in self.names:
+                return self._call_edges(address, [target], RETURN, cycles, result)
+            return [(target, cycles, ())]
+        if kind in ("computed", "push"):
+            targets = self._setting(self.config.targets, address, None)
+            if targets == None:
+                self.problem(self.site(address, entry), "needs targets for its %s" %
+                             ("computed jump" if kind == "computed" else "call through the stack"))
+                result.complete = False
+                return [(RETURN, cycles, ())] if kind == "computed" else [(next_address, cycles, ())]
+            targets = [self.address_of(target) for target in targets]
+            if kind == "push":
+                return self._call_edges(address, targets, next_address, cycles, result)
+            edges = [(target, cycles, ()) for target in targets if target not in self.names]
+            functions = [target for target in targets if target in self.names]
+            return edges + self._call_edges(address, functions, RETURN, cycles, result)
+        if kind == "reset":
+            return [(RETURN, cycles, ())]
+        self.problem(self.site(address, entry), "is not an instruction")
+        result.complete = False
+        return [(RETURN, cycles, ())]
+
+    def _collapse_loops(self, graph, entry, result):
+        """Replace each loop, innermost first, by its first node, with edges
+        for leaving the loop after going around it as many times as it can.
+        """
+        while True:
+            back_edges = retreating_edges(graph, entry)
+            if not back_edges:
+                return
+            loops = {}
+            for source, header in back_edges:
+                loops.setdefault(header, set()).add(source)
+            bodies = {header: loop_body(graph, header, sources) for header, sources in loops.items()}
+            header = min(bodies, key=lambda header: (len(bodies[header]), header))
+            if not self._collapse_loop(graph, entry, header, bodies[header], result):
+                return
+
+    def _collapse_loop(self, graph, entry, header, body, result):
+        site = self.site(header, entry)
+        # Edges into the middle of the loop would make it go around more
+        # than its bound says
+        for node, edges in graph.items():
+            if node not in body and any(target in body and target != header for target, cycles, calls in edges):
+                self.problem(site, "has more than one way in")
+                result.complete = False
+                return False
+
+        inside = {node: [edge for edge in graph[node] if edge[0] in body and edge[0] != header] for node in body}
+        order = topological_order(inside, header)
+        if order == None:
+            self.problem(site, "has a loop that cannot be analyzed")
+            result.complete = False
+            return False
+        paths = longest_paths(inside, order, header)
+
+        back = max(((paths[node][0] + cycles, paths[node][1] + calls)
+                    for node in body if node in paths
+                    for target, cycles, calls in graph[node] if target == header),
+                   key=lambda path: path[0])
+        exits = [(target, paths[node][0] + cycles, paths[node][1] + calls)
+                 for node in body if node in paths
+                 for target, cycles, calls in graph[node] if target not in body]
+
+        if not exits:
+            # An endless loop, counted once around
+            result.loops[header] = None
+            edges = [(PASS, back[0], back[1])]
+        else:
+            bound = self._setting(self.config.loops, header, entry)
+            if bound == None:
+                self.problem(site, "needs a loop bound")
+                result.complete = False
+                bound = 1
+            result.loops[header] = bound
+            repeats = max(bound - 1, 0)
+            repeated_calls = tuple(call._replace(times=call.times * repeats) for call in back[1] if repeats)
+            edges = [(target, repeats * back[0] + cycles, repeated_calls + calls) for target, cycles, calls in exits]
+
+        for node in body:
+            del graph[node]
+        graph[header] = edges
+        return True
+
+    def _longest_paths(self, graph, entry, result):
+        order = topological_order(graph, entry)
+        if order == None:
+            self.problem(self.name(entry), "has a loop that cannot be analyzed")
+            result.complete = False
+            return {}
+        paths = longest_paths(graph, order, entry)
+        ends = {}
+        for node in order:
+            for target, cycles, calls in graph[node]:
+                if target in (RETURN, PASS) and node in paths:
+                    total = paths[node][0] + cycles
+                    if target not in ends or total > ends[target][0]:
+                        ends[target] = (total, paths[node][1] + calls)
+        return ends
+
+    def critical_path(self, address):
+        """The chain of calls that takes most of an entry point's worst case,
+        as (FunctionTime, Call) from the entry down, with None for the call
+        into the entry.
+        """
+        chain = []
+        call = None
+        seen = set()
+        while address not in seen:
+            seen.add(address)
+            time = self.function(address)
+            chain.append((time, call))
+            totals = collections.OrderedDict()
+            for each in time.calls:
+                key = (each.site, each.function)
+                totals[key] = totals.get(key, 0) + each.times * each.cycles
+            if not totals:
+                break
+            (site, address), total = max(totals.items(), key=lambda item: item[1])
+            times = sum(each.times for each in time.calls if (each.site, each.function) == (site, address))
+            call = Call(site, address, times, total)
+        return chain
+
+    def report(self, entries=None):
+        """Analyze the entry points, and describe their worst cases and
+        budgets. Returns the text and the budgets that were not met.
+        """
+        entries = entries if entries != None else self.entries()
+        lines = ["%-40s %12s %12s" % ("Entry", "Cycles", "Time (ms)")]
+        failures = []
+        for entry in entries:
+            time = self.function(entry)
+            cycles, endless = time.worst()
+            name = time.name + (" (per pass)" if endless else "")
+            if cycles == None:
+                cycles = 0
+            bound = "" if time.complete else ">="
+            lines.append("%-40s %12s %12.3f" % (name, bound + str(cycles), cycles * 1000 / INSTRUCTION_RATE))
+
+            budget = self._setting(self.config.budgets, entry, None)
+            if budget == None:
+                continue
+            if not time.complete:
+                failures.append("%s could not be checked against its budget of %i cycles" % (time.name, budget))
+            elif cycles > budget:
+                failures.append("%s takes %i cycles, over its budget of %i" % (time.name, cycles, budget))
+
+        for entry in entries:
+            chain = self.critical_path(entry)
+            if len(chain) < 2:
+                continue
+            lines.append("")
+            lines.append("Critical path of %s:" % chain[0][0].name)
+            for depth, (time, call) in enumerate(chain):
+                if call == None:
+                    lines.append("  %-48s %12i" % (time.name, time.worst()[0] or 0))
+                else:
+                    label = "%s at %s (x%i)" % (time.name, self.site(call.site, chain[depth - 1][0].address), call.times)
+                    lines.append("  %-48s %12i" % ("  " * depth + label, call.cycles))
+
+        if self.problems:
+            lines.append("")
+            lines.append("Problems:")
+            for site, message in self.problems:
+                lines.append("  %s %s" % (site, message))
+        for failure in failures:
+            lines.append("Over budget: " + failure)
+        return "\n".join(lines), failures
+
+def retreating_edges(graph, entry):
+    """The edges of a depth first search that go back to a node on its stack."""
+    edges = []
+    state = {entry: 1}
+    stack = [(entry, iter(graph[entry]))]
+    while stack:
+        node, successors = stack[-1]
+        for target, cycles, calls in successors:
+            if target not in graph:
+                continue
+            if state.get(target) == 1:
+                edges.append((node, target))
+            elif target not in state:
+                state[target] = 1
+                stack.append((target, iter(graph[target])))
+                break
+        else:
+            state[node] = 2
+            stack.pop()
+    return edges
+
+def loop_body(graph, header, sources):
+    """The nodes of the loop through header, that reach one of its back
+    edge sources without going through header.
+    """
+    predecessors = {}
+    for node, edges in graph.items():
+        for target, cycles, calls in edges:
+            predecessors.setdefault(target, set()).add(node)
+    body = {header}
+    work = [source for source in sources if source != header]
+    while work:
+        node = work.pop()
+        if node in body:
+            continue
+        body.add(node)
+        work.extend(predecessors.get(node, ()))
+    return body
+
+def topological_order(graph, entry):
+    """The nodes reachable from entry in topological order, or None if there is a cycle."""
+    order = []
+    state = {entry: 1}
+    stack = [(entry, iter(graph[entry]))]
+    while stack:
+        node, successors = stack[-1]
+        for target, cycles, calls in successors:
+            if target not in graph:
+                continue
+            if state.get(target) == 1:
+                return None
+            if target not in state:
+                state[target] = 1
+                stack.append((target, iter(graph[target])))
+                break
+        else:
+            state[node] = 2
+            order.append(node)
+            stack.pop()
+    order.reverse()
+    return order
+
+def longest_paths(graph, order, entry):
+    """The most cycles to each node from entry, with the calls on the way."""
+    paths = {entry: (0, ())}
+    for node in order:
+        if node not in paths:
+            continue
+        cycles_to, calls_to = paths[node]
+        for target, cycles, calls in graph[node]:
+            if target in graph and (target not in paths or cycles_to + cycles > paths[target][0]):
+                paths[target] = (cycles_to + cycles, calls_to + calls)
+    return paths
+
+def project_dir_of(hex_file):
+    """The project a hex file in its build directory was built from."""
+    return Path(hex_file).resolve().parent.parent
+
+def parse_args():
+    import argparse
+    parser = argparse.ArgumentParser(description="Find the worst case execution time of a Vex program")
+
+    parser.add_argument("hex_file", help="program to analyze")
+    parser.add_argument("--map", help="MPLINK map file with the program's symbols, by default Mapfile.map next to the hex file")
+    parser.add_argument("--config", help="loop bounds and budgets, by default %s in the project directory" % CONFIG_NAME)
+    parser.add_argument("--src", help="source directory to read wcet: comments from, by default the project's src")
+    parser.add_argument("--entry", help="functions to analyze as well as the interrupt handlers and main", nargs="+",
+                        default=[])
+    parser.add_argument("--budget", help="the most cycles any entry point may take", type=int)
+
+    return parser.parse_args()
+
+def main(args):
+    project_dir = project_dir_of(args.hex_file)
+    map_file = Path(args.map) if args.map else Path(args.hex_file).parent / "Mapfile.map"
+    symbols = vexsim.read_symbols(map_file) if map_file.exists() else {}
+    try:
+        config = read_config(args.config if args.config else project_dir / CONFIG_NAME,
+                             args.src if args.src else project_dir / "src")
+    except ValueError as e:
+        print("Error: " + str(e), flush=True, file=sys.stderr)
+        return 1
+    config.entries.extend(args.entry)
+    analyzer = Analyzer(args.hex_file, symbols, config)
+    try:
+        entries = analyzer.entries()
+    except KeyError as e:
+        print("Error: " + str(e.args[0]), flush=True, file=sys.stderr)
+        return 1
+    if args.budget != None:
+        for entry in entries:
+            config.budgets.setdefault(analyzer.name(entry), args.budget)
+
+    text, failures = analyzer.report(entries)
+    print(text)
+    return 1 if failures else 0
+
+if __name__ == "__main__":
+    exit(main(parse_args()))
@@ -0,0 +1,390 @@
+#!/usr/bin/env python3
+"""Software model of the Vex PIC bootloader, for testing and benchmarking VexUpload.
+
+The model implements the AN851 style commands that VexUpload uses (erase,
+write, read and return to user code) against 32 KB of simulated flash, with
+the same rules as the real part: flash can only be erased a row at a time, and
+writes can only clear bits. Timing is modelled from the baud rate and the
+flash erase/write times, either on a virtual clock (fast, deterministic) or in
+real time.
+
+It can be used in three ways:
+ - In process, by passing a SimulatedSerial to the vexupload functions.
+ - Through a pySerial URL, "vexsim://[name][?option=value&...]", after calling
+   register_url_handler(). Connections with the same name share a bootloader.
+ - On a pseudo terminal, by running this script. The terminal path is printed
+   and can be given to vexupload.py with --dev.
+"""
+import collections
+import os
+import sys
+import time
+import types
+import urllib.parse
+
+import serial
+from serial.serialutil import SerialBase, SerialException, PortNotOpenError
+
+import vexupload
+from vexupload import CHAR_ESC, CHAR_ETX, CHAR_STX, Command, ERASE_ROW_SIZE, \
+    WRITE_BLOCK_SIZE, MIN_PROGRAM_ADDRESS, MAX_PACKET_LENGTH
+
+
+FLASH_SIZE = 0x8000
+
+# Typical PIC18F8520 flash timings
+DEFAULT_ERASE_ROW_TIME = 0.002
+DEFAULT_WRITE_BLOCK_TIME = 0.002
+# Time the bootloader takes to parse a command and start replying
+DEFAULT_COMMAND_TIME = 0.0001
+
+# Bits on the wire per byte: 8 data bits, 1 start bit and 1 stop bit
+BITS_PER_BYTE = 10
+
+class Bootloader(object):
+    """Model of the bootloader state machine and the program flash it controls.
+
+    Attributes:
+        flash -- the contents of program memory
+        commands -- number of each Command that has been executed
+        rejected -- number of frames that were dropped without a reply
+        write_violations -- number of writes that tried to set unerased bits
+        user_code -- True once return_to_user_code has been received
+        clock -- modelled time in seconds spent on the link and flash
+    """
+
+    def __init__(self, max_write_blocks=vexupload.DEFAULT_WRITE_BLOCKS, baudrate=115200,
+                 erase_row_time=DEFAULT_ERASE_ROW_TIME, write_block_time=DEFAULT_WRITE_BLOCK_TIME,
+                 command_time=DEFAULT_COMMAND_TIME, fill=0xff):
+        self.max_write_blocks = max_write_blocks
+        self.baudrate = baudrate
+        self.erase_row_time = erase_row_time
+        self.write_block_time = write_block_time
+        self.command_time = command_time
+
+        self.flash = bytearray((fill,) * FLASH_SIZE)
+        self.commands = collections.Counter()
+        self.rejected = 0
+        self.write_violations = 0
+        self.user_code = False
+        self.clock = 0.0
+
+        self.__frame = None
+        self.__frame_length = 0
+        self.__esc = False
+        self.__last = None
+
+    def byte_time(self, count):
+        return count * BITS_PER_BYTE / self.baudrate
+
+    def receive(self, data):
+        """Feed bytes sent by the host to the bootloader.
+
+        Returns the bytes the bootloader sends back and the time in seconds,
+        after the last byte was received, until the reply is complete.
+        """
+        self.clock += self.byte_time(len(data))
+        response = bytearray()
+        busy = 0.0
+
+        for char in data:
+            reply = self.__receive_byte(char)
+            if reply is not None:
+                reply_data, reply_busy = reply
+                busy += reply_busy + self.byte_time(len(reply_data))
+                response.extend(reply_data)
+
+        self.clock += busy
+        return bytes(response), busy
+
+    def __receive_byte(self, char):
+        if self.__frame is None:
+            # Wait for two STX bytes to start a frame
+            if char == CHAR_STX and self.__last == CHAR_STX:
+                self.__frame = bytearray()
+                self.__frame_length = 2
+                self.__esc = False
+                self.__last = None
+            else:
+                self.__last = char
+            return None
+
+        self.__frame_length += 1
+        if self.__esc:
+            self.__esc = False
+            self.__frame.append(char)
+        elif char == CHAR_ESC:
+            self.__esc = True
+        elif char == CHAR_ETX:
+            frame = self.__frame
+            length = self.__frame_length
+            self.__frame = None
+            if length > MAX_PACKET_LENGTH:
+                # The real bootloader overflows its buffer and ignores the frame
+                self.rejected += 1
+                return None
+            return self.__execute(frame)
+        elif char == CHAR_STX and len(self.__frame) == 0:
+            # A third STX just restarts the frame
+            self.__frame_length = 2
+        else:
+            self.__frame.append(char)
+        return None
+
+    def __execute(self, frame):
+        if len(frame) < 2 or sum(frame) & 0xff != 0:
+            self.rejected += 1
+            return None
+
+        try:
+            command = Command(frame[0])
+        except ValueError:
+            self.rejected += 1
+            return None
+        body = frame[1:-1]
+
+        if command == Command.erase_program_mem:
+            return self.__erase(body)
+        elif command == Command.write_program_mem:
+            return self.__write(body)
+        elif command == Command.read_program_mem:
+            return self.__read(body)
+        elif command == Command.return_to_user_code:
+            self.commands[command] += 1
+            self.user_code = True
+            return (bytes((CHAR_STX, CHAR_STX, command.value, 0x40)), self.command_time)
+
+    def __address(self, body):
+        return body[1] | (body[2] << 8) | (body[3] << 16)
+
+    def __check_range(self, address, length):
+        return address >= MIN_PROGRAM_ADDRESS and address + length <= FLASH_SIZE
+
+    def __erase(self, body):
+        if len(body) < 4:
+            self.rejected += 1
+            return None
+        rows = body[0]
+        # Like the flash controller, ignore the address bits within a row
+        address = self.__address(body) & ~(ERASE_ROW_SIZE - 1)
+        length = rows * ERASE_ROW_SIZE
+        # A zero row count drops the controller back to the IFI> prompt
+        if rows == 0 or not self.__check_range(address, length):
+            self.rejected += 1
+            return None
+
+        self.commands[Command.erase_program_mem] += 1
+        self.flash[address:address + length] = (0xff,) * length
+        return (self.__reply(Command.erase_program_mem), self.command_time + rows * self.erase_row_time)
+
+    def __write(self, body):
+        if len(body) < 4:
+            self.rejected += 1
+            return None
+        blocks = body[0]
+        address = self.__address(body)
+        data = body[4:]
+        length = blocks * WRITE_BLOCK_SIZE
+        if blocks == 0 or blocks > self.max_write_blocks or len(data) != length \
+                or address % WRITE_BLOCK_SIZE != 0 or not self.__check_range(address, length):
+            self.rejected += 1
+            return None
+
+        self.commands[Command.write_program_mem] += 1
+        for i, char in enumerate(data):
+            old = self.flash[address + i]
+            # Programming can only clear bits, setting them requires an erase
+            if char & ~old & 0xff:
+                self.write_violations += 1
+            self.flash[address + i] = old & char
+        return (self.__reply(Command.write_program_mem), self.command_time + blocks * self.write_block_time)
+
+    def __read(self, body):
+        if len(body) < 4:
+            self.rejected += 1
+            return None
+        length = body[0]
+        address = self.__address(body)
+        if address + length > FLASH_SIZE:
+            self.rejected += 1
+            return None
+
+        # The reply has to fit in the same buffer as the requests
+        reply = self.__reply(Command.read_program_mem, body[0:4], self.flash[address:address + length])
+        if len(reply) > MAX_PACKET_LENGTH:
+            self.rejected += 1
+            return None
+
+        self.commands[Command.read_program_mem] += 1
+        return (reply, self.command_time)
+
+    def __reply(self, command, arguments=(), data=()):
+        return bytes(vexupload.frame_packet(vexupload.Packet(command, tuple(arguments), bytes(data) or None)))
+
+class SimulatedSerial(SerialBase):
+    """pySerial compatible port connected to a Bootloader.
+
+    With realtime set, replies only become readable after the modelled time
+    has passed on the wall clock. Otherwise they are available immediately and
+    only the bootloader's virtual clock advances.
+    """
+
+    def __init__(self, *args, bootloader=None, realtime=False, **kwargs):
+        self.bootloader = bootloader
+        self.realtime = realtime
+        self.__input = collections.deque()
+        self.__ready_at = 0.0
+        super(SimulatedSerial, self).__init__(*args, **kwargs)
+        if self.bootloader is not None and self.port is None:
+            self.is_open = True
+
+    def open(self):
+        if self.is_open:
+            raise SerialException("Port is already open.")
+        if self._port is None:
+            raise SerialException("Port must be configured before it can be used.")
+        self.from_url(self._port)
+        self.is_open = True
+
+    def from_url(self, url):
+        parts = urllib.parse.urlsplit(url)
+        if parts.scheme != "vexsim":
+            raise SerialException("Expected a URL in the form vexsim://[name][?option=value]: %s" % url)
+        options = dict()
+        for option, values in urllib.parse.parse_qs(parts.query, True).items():
+            if option == "realtime":
+                self.realtime = values[0] not in ("0", "false", "no")
+            elif option in ("max_write_blocks",):
+                options[option] = int(values[0])
+            elif option in ("erase_row_time", "write_block_time", "command_time"):
+                options[option] = float(values[0])
+            else:
+                raise SerialException("Unknown vexsim option: %s" % option)
+        self.bootloader = get_bootloader(parts.netloc, baudrate=self._baudrate, **options)
+
+    def _reconfigure_port(self):
+        pass
+
+    @property
+    def in_waiting(self):
+        if not self.is_open:
+            raise PortNotOpenError()
+        if self.realtime and time.monotonic() < self.__ready_at:
+            return 0
+        return len(self.__input)
+
+    def read(self, size=1):
+        if not self.is_open:
+            raise PortNotOpenError()
+        if self.realtime and self.__input:
+            delay = self.__ready_at - time.monotonic()
+            if delay > 0:
+                if self._timeout is not None and delay > self._timeout:
+                    time.sleep(self._timeout)
+                    return bytes()
+                time.sleep(delay)
+        data = bytearray()
+        while size > 0 and self.__input:
+            data.append(self.__input.popleft())
+            size -= 1
+        return bytes(data)
+
+    def write(self, data):
+        if not self.is_open:
+            raise PortNotOpenError()
+        data = bytes(data)
+        response, busy = self.bootloader.receive(data)
+        if response:
+            if self.realtime:
+                self.__ready_at = max(self.__ready_at, time.monotonic()) + \
+                    self.bootloader.byte_time(len(data)) + busy
+            self.__input.extend(response)
+        return len(data)
+
+    def flush(self):
+        pass
+
+    def reset_input_buffer(self):
+        self.__input.clear()
+
+    def reset_output_buffer(self):
+        pass
+
+    def close(self):
+        self.is_open = False
+
+    def _update_break_state(self):
+        pass
+
+    def _update_rts_state(self):
+        pass
+
+    def _update_dtr_state(self):
+        pass
+
+bootloaders = dict()
+
+def get_bootloader(name, **options):
+    """Returns the named bootloader, creating it on first use. An empty name always creates a new one."""
+    if not name:
+        return Bootloader(**options)
+    if name not in bootloaders:
+        bootloaders[name] = Bootloader(**options)
+    return bootloaders[name]
+
+HANDLER_PACKAGE = "vexbootsim_handlers"
+
+def register_url_handler():
+    """Make "vexsim://" URLs available to serial.serial_for_url()."""
+    if HANDLER_PACKAGE in sys.modules:
+        return
+    package = types.ModuleType(HANDLER_PACKAGE)
+    package.__path__ = []
+    handler = types.ModuleType(HANDLER_PACKAGE + ".protocol_vexsim")
+    handler.Serial = SimulatedSerial
+    sys.modules[HANDLER_PACKAGE] = package
+    sys.modules[handler.__name__] = handler
+    serial.protocol_handler_packages.append(HANDLER_PACKAGE)
+
+def serve_pty(bootloader, realtime=True):
+    """Run the bootloader on a pseudo terminal until interrupted."""
+    import tty
+
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    print(os.ttyname(slave), flush=True)
+
+    while True:
+        data = os.read(master, 1024)
+        start = time.monotonic()
+        response, busy = bootloader.receive(data)
+        if response:
+            if realtime:
+                delay = bootloader.byte_time(len(data)) + busy - (time.monotonic() - start)
+                if delay > 0:
+                    time.sleep(delay)
+            os.write(master, response)
+        if bootloader.user_code:
+            print("Returned to user code after %i commands" % sum(bootloader.commands.values()), flush=True)
+            bootloader.user_code = False
+
+def parse_args():
+    import argparse
+    parser = argparse.ArgumentParser(description="Run a simulated Vex bootloader on a pseudo terminal")
+
+    parser.add_argument("--max-write-blocks", type=int, default=vexupload.DEFAULT_WRITE_BLOCKS,
+                        help="largest write the bootloader accepts, in 8 byte blocks")
+    parser.add_argument("--erase-row-time", type=float, default=DEFAULT_ERASE_ROW_TIME, help="seconds to erase a row")
+    parser.add_argument("--write-block-time", type=float, default=DEFAULT_WRITE_BLOCK_TIME, help="seconds to write a block")
+    parser.add_argument("--fast", help="reply immediately instead of modelling link and flash time", action="store_true")
+
+    return parser.parse_args()
+
+if __name__ == "__main__":
+    args = parse_args()
+
+    try:
+        serve_pty(Bootloader(args.max_write_blocks, erase_row_time=args.erase_row_time,
+                             write_block_time=args.write_block_time), not args.fast)
+    except KeyboardInterrupt:
+        pass
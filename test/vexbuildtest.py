@@ -0,0 +1,784 @@
+import json
+import re
+import shutil
+import tempfile
+import unittest
+import warnings
+from pathlib import Path
+
+import vexbuild
+import vexupload
+
+
+MAP_FILE = """MPLINK 4.15, Linker
+Linker Map File - Created Sat Oct 17 12:00:00 2026
+
+                                 Section Info
+                  Section       Type    Address   Location Size(Bytes)
+                ---------  ---------  ---------  ---------  ---------
+               _entry_scn       code   0x000000    program   0x000006
+             .code_main.o       code   0x000800    program   0x0000a4
+            .code_drive.o       code   0x0008a4    program   0x000130
+                   .cinit    romdata   0x0009d4    program   0x000002
+            .udata_main.o      udata   0x000100       data   0x000004
+           .udata_drive.o      udata   0x000104       data   0x000010
+                  .stack       udata   0x000600       data   0x000100
+"""
+
+LINKER_SCRIPT = (Path(__file__).parent.parent / "Toolchain" / "WPILib" / "Vex" / "18f8520.lkr").read_text()
+
+def memory_regions(script):
+    return {match.group(2): (int(match.group(3), 0), int(match.group(4), 0))
+            for match in map(vexbuild.memory_regex.match, script.splitlines()) if match}
+
+class StableLayoutTest(unittest.TestCase):
+    
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.map_file = Path(self.temp_dir.name) / "Mapfile.map"
+        self.map_file.write_text(MAP_FILE)
+        self.sections = vexbuild.read_map_sections(self.map_file)
+        self.script = vexbuild.reserve_build_id(LINKER_SCRIPT)
+    
+    def tearDown(self):
+        self.temp_dir.cleanup()
+    
+    def test_read_map_sections(self):
+        assert len(self.sections) == 7
+        assert self.sections[1] == vexbuild.MapSection(".code_main.o", "code", 0x800, "program", 0xa4)
+        assert vexbuild.section_object(".code_main.o") == "main"
+        assert vexbuild.section_object(".udata_drive.o") == "drive"
+        assert vexbuild.section_object(".cinit") == None
+    
+    def test_reserve_build_id(self):
+        regions = memory_regions(self.script)
+        
+        assert regions["page"] == (0x800, 0x7f7f)
+        assert regions["buildid"] == (vexupload.BUILD_ID_ADDRESS, 0x7fbf)
+    
+    def test_pin_sections(self):
+        script = vexbuild.stable_linker_script(self.script, self.sections)
+        regions = memory_regions(script)
+        assignments = dict(re.findall(r"SECTION\s+NAME=(\S+) (?:ROM|RAM)=(\S+)", script))
+        
+        # The entry point is in the protected vectors page and the stack in a
+        # bank the script already uses for it, so neither is pinned
+        assert "_entry_scn" not in assignments
+        assert ".stack" not in assignments
+        assert regions[assignments[".code_main.o"]] == (0x800, 0x8a3)
+        assert regions[assignments[".code_drive.o"]] == (0x8a4, 0x9d3)
+        assert regions[assignments[".cinit"]] == (0x9d4, 0x9ff)
+        assert regions[assignments[".udata_drive.o"]] == (0x104, 0x113)
+        assert regions["page"] == (0xa00, 0x7f7f)
+        assert regions["gpr1"] == (0x114, 0x1ff)
+    
+    def test_pad_sections(self):
+        script = vexbuild.stable_linker_script(self.script, self.sections, pad=True)
+        regions = memory_regions(script)
+        assignments = dict(re.findall(r"SECTION\s+NAME=(\S+) (?:ROM|RAM)=(\S+)", script))
+        
+        assert regions[assignments[".code_main.o"]] == (0x800, 0x8bf)
+        assert regions[assignments[".code_drive.o"]] == (0x8c0, 0x9ff)
+        assert regions[assignments[".cinit"]] == (0xa00, 0xa3f)
+        assert regions["page"] == (0xa40, 0x7f7f)
+    
+    def test_unpinned_sections(self):
+        script = vexbuild.stable_linker_script(self.script, self.sections, [".code_main.o"])
+        regions = memory_regions(script)
+        
+        # The space main used is free for it, or anything else, to use
+        assert ".code_main.o" not in script
+        assert regions["page"] == (0x800, 0x8a3)
+        assert regions["page_1"] == (0xa00, 0x7f7f)
+
+if __name__ == "__main__":
+    unittest.main()
+
+DRIVE_SOURCE = """#include <p18cxxx.h>
+#include "drive.h"
+
+unsigned char Drive_Scale(unsigned char input) {
+    PORTB = input;
+    return input > 200 ? 255 : input;
+}
+"""
+
+DRIVE_TEST = """#include <p18cxxx.h>
+#include "vexhost.h"
+#include "drive.h"
+
+int main(void) {
+    if (Drive_Scale(250) != 255 || Drive_Scale(3) != 3) {
+        return 1;
+    }
+    /* Registers share storage with their bits */
+    return PORTBbits.RB0 && PORTBbits.RB1 && !PORTBbits.RB2 ? 0 : 2;
+}
+"""
+
+@unittest.skipUnless(shutil.which("gcc"), "no host compiler")
+class HostBuildTest(unittest.TestCase):
+    
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        vexbuild.project_dir = Path(self.temp_dir.name) / "robot"
+        vexbuild.toolchain_dir = Path(__file__).parent.parent / "Toolchain"
+        vexbuild.debug_enabled = False
+        vexbuild.enable_copy_launcher = False
+        vexbuild.host_build = True
+        vexbuild.specialize_printf_enabled = False
+        vexbuild.host_coverage = False
+        vexbuild.host_cc = "gcc"
+        
+        src_dir = vexbuild.project_dir / "src"
+        src_dir.mkdir(parents=True)
+        (src_dir / "drive.h").write_text("unsigned char Drive_Scale(unsigned char input);\n")
+        (src_dir / "drive.c").write_text(DRIVE_SOURCE)
+        (src_dir / "main.c").write_text("#include \"Api.h\"\n\nvoid Initialize(void) {\n}\n")
+        self.test_dir = vexbuild.project_dir / "test"
+        self.test_dir.mkdir()
+        (self.test_dir / "drive_test.c").write_text(DRIVE_TEST)
+    
+    def tearDown(self):
+        vexbuild.host_build = False
+        self.temp_dir.cleanup()
+    
+    # Builds the project with a test of the library, which fails the build
+    # if it returns anything but 0
+    def run_host_test(self, name, source):
+        (self.test_dir / name).write_text(source)
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+    
+    def test_host_build(self):
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        self.assertTrue((vexbuild.host_dir / "robot").exists())
+        self.assertTrue((vexbuild.host_dir / "test" / "drive_test").exists())
+    
+    def test_failing_test(self):
+        (self.test_dir / "fail_test.c").write_text("int main(void) {\n    return 1;\n}\n")
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            self.assertRaises(ChildProcessError, vexbuild.build)
+    
+    def test_fixed_math(self):
+        self.run_host_test("fixmath_test.c", FIXMATH_TEST)
+        self.assertTrue((vexbuild.host_dir / "vexlib" / "fixmath.o").exists())
+    
+    def test_specialized_printf(self):
+        src_dir = vexbuild.project_dir / "src"
+        (src_dir / "report.h").write_text("#define REPORT_FORMAT \"%d\\n\"\n"
+                                          "int Report_Format(char *buffer, int value, long big, const char *name);\n")
+        (src_dir / "report.c").write_text(REPORT_SOURCE)
+        (self.test_dir / "report_test.c").write_text(REPORT_TEST)
+        vexbuild.specialize_printf_enabled = True
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        formatters = (vexbuild.host_dir / "printf" / "report_printf.c").read_text()
+        self.assertIn("VexSprintf_report_0", formatters)
+        self.assertNotIn("VexPrintf", formatters)
+        
+        # Turning it off rebuilds without the formatters. The host's printf
+        # has 32 bit ints, so the test only holds for the formatters.
+        (self.test_dir / "report_test.c").unlink()
+        vexbuild.specialize_printf_enabled = False
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        self.assertFalse((vexbuild.host_dir / "printf").exists())
+    
+    def test_buffered_serial(self):
+        self.run_host_test("bufserial_test.c", BUFSERIAL_TEST)
+    
+    def test_whole_port_io(self):
+        self.run_host_test("vexio_test.c", VEXIO_TEST)
+    
+    def test_analog_sampler(self):
+        self.run_host_test("vexadc_test.c", VEXADC_TEST)
+    
+    def test_quadrature_decoder(self):
+        self.run_host_test("vexquad_test.c", VEXQUAD_TEST)
+    
+    def test_timer_wheel(self):
+        self.run_host_test("timerwheel_test.c", TIMERWHEEL_TEST)
+    
+    def test_tasks(self):
+        (vexbuild.project_dir / "tasks.cfg").write_text("task Drive_Task 0 10 2000\n"
+                                                        "task Arm_Task 1    # every pass\n"
+                                                        "task Log_Task 2 20 500\n")
+        (vexbuild.project_dir / "src" / "tasks.c").write_text(TASKS_SOURCE)
+        (self.test_dir / "vextask_test.c").write_text(VEXTASK_TEST)
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        self.assertIn("    {Log_Task, 2, 20, 500},\n", (vexbuild.host_dir / "tasks" / "vextask_table.c").read_text())
+        
+        (vexbuild.project_dir / "tasks.cfg").unlink()
+        (vexbuild.project_dir / "src" / "tasks.c").unlink()
+        (self.test_dir / "vextask_test.c").unlink()
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        self.assertFalse((vexbuild.host_dir / "tasks").exists())
+    
+    def test_telemetry(self):
+        (vexbuild.project_dir / "telemetry.cfg").write_text("period 10\nchannel ticks armTicks long\n"
+                                                            "channel speed armSpeed int 2\n")
+        (vexbuild.project_dir / "src" / "arm.c").write_text("long armTicks = 0x01020304;\nint armSpeed = -2;\n")
+        (self.test_dir / "telemetry_test.c").write_text(TELEMETRY_TEST)
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        layout = json.loads((vexbuild.host_dir / "telemetry" / "layout.json").read_text())
+        self.assertEqual(layout, {"period": 10, "channels": [{"name": "ticks", "type": "l", "divider": 1},
+                                                             {"name": "speed", "type": "h", "divider": 2}]})
+        
+        # Taking the channels out takes the generated code out too
+        (vexbuild.project_dir / "telemetry.cfg").unlink()
+        (self.test_dir / "telemetry_test.c").unlink()
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        self.assertFalse((vexbuild.host_dir / "telemetry").exists())
+    
+    def test_tokenized_logging(self):
+        (vexbuild.project_dir / "src" / "arm.c").write_text(ARM_SOURCE)
+        (self.test_dir / "vexlog_test.c").write_text(VEXLOG_TEST)
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        formats = json.loads((vexbuild.host_dir / "vexlog" / "formats.json").read_text())["formats"]
+        self.assertEqual([(entry["id"], entry["file"], entry["line"], entry["text"]) for entry in formats],
+                         [(0, "arm.c", 5, "Arm %d at %lu\r\n")])
+        
+        # Without VexLog() calls, the source is compiled as it is
+        (vexbuild.project_dir / "src" / "arm.c").write_text("void Arm_Report(int position, unsigned long ticks) {\n}\n")
+        (self.test_dir / "vexlog_test.c").unlink()
+        with warnings.catch_warnings():
+            warnings.simplefilter("ignore")
+            vexbuild.build()
+        self.assertEqual(list((vexbuild.host_dir / "vexlog").iterdir()), [vexbuild.host_dir / "vexlog" / "formats.json"])
+
+# Checks the accuracy fixmath.h documents. The math.h functions in brackets
+# are not replaced.
+FIXMATH_TEST = """#include <math.h>
+#define FIXMATH_REPLACES_FLOAT
+#include "fixmath.h"
+
+#define PI 3.14159265358979
+
+static double angleError(binary_angle angle, double radians) {
+    double error = fabs(angle - radians * 32768 / PI);
+    return error > 32768 ? 65536 - error : error;
+}
+
+int main(void) {
+    long i;
+    short x, y;
+    unsigned long value;
+
+    for (i = 0; i < 65536; i++) {
+        if (fabs(Fix_Sin(i) - (sin)(i * PI / 32768) * 32768) > 5.5 ||
+            fabs(Fix_Cos(i) - (cos)(i * PI / 32768) * 32768) > 5.5) {
+            return 1;
+        }
+    }
+    for (x = -32000; x < 32000; x += 97) {
+        for (y = -32000; y < 32000; y += 89) {
+            if (angleError(Fix_Atan2(y, x), (atan2)(y, x)) > 6.5) {
+                return 2;
+            }
+        }
+    }
+    for (x = -40; x <= 40; x++) {
+        for (y = -40; y <= 40; y++) {
+            if ((x || y) && angleError(Fix_Atan2(y, x), (atan2)(y, x)) > 6.5) {
+                return 3;
+            }
+        }
+    }
+    for (value = 0; value < 0xFFFF0000UL; value += 65521) {
+        unsigned long root = Fix_Sqrt(value);
+        if (root * root > value || (root + 1) * (root + 1) <= value) {
+            return 4;
+        }
+    }
+    if (Fix_Sqrt(0xFFFFFFFFUL) != 0xFFFF || Fix_SqrtQ8_8(2 * FIX_Q8_8_ONE) != 362 ||
+        Fix_MulQ15(16384, -16384) != -8192 || Fix_PowQ8_8(384, 3) != 864) {
+        return 5;
+    }
+    /* The replacements */
+    if (fabs(sin(1.0f) - (sin)(1.0)) > 0.0002 || fabs(cos(-2.0f) - (cos)(-2.0)) > 0.0002 ||
+        fabs(atan2(-1.0f, -3.0f) - (atan2)(-1.0, -3.0)) > 0.001 || fabs(sqrt(1e6f) - 1000) > 0.05) {
+        return 6;
+    }
+    return 0;
+}
+"""
+
+BUFSERIAL_TEST = """#include <string.h>
+#include "vexhost.h"
+#include "bufserial.h"
+
+int main(void) {
+    unsigned char input[40];
+    unsigned char output[8];
+    unsigned i;
+
+    BufSerial_Open(1, BAUD_115200);
+    if (BufSerial_WriteText(1, "hello") != 5 || VexHost_SerialOutput(1, output, 8) != 5 ||
+        memcmp(output, "hello", 5) != 0 || BufSerial_Free(1) != BUFSERIAL_TX_SIZE) {
+        return 1;
+    }
+
+    /* Received bytes wait for the interrupt, and the ones that do not fit are counted */
+    for (i = 0; i < sizeof(input); i++) {
+        input[i] = 'A' + i;
+    }
+    VexHost_SerialInput(1, input, sizeof(input));
+    if (BufSerial_ReadByte(1) != -1) {
+        return 2;
+    }
+    VexHost_Advance(1000);
+    if (BufSerial_Available(1) != BUFSERIAL_RX_SIZE ||
+        BufSerial_GetRxOverflows(1) != sizeof(input) - BUFSERIAL_RX_SIZE) {
+        return 3;
+    }
+    if (BufSerial_Read(1, output, 4) != 4 || memcmp(output, "ABCD", 4) != 0 || BufSerial_ReadByte(1) != 'E') {
+        return 4;
+    }
+
+    /* Frames are queued whole or not at all */
+    if (BufSerial_WriteFrame(1, input, BUFSERIAL_TX_SIZE + 1) != 0 ||
+        BufSerial_GetTxOverflows(1) != BUFSERIAL_TX_SIZE + 1 || VexHost_SerialOutput(1, output, 8) != 0 ||
+        BufSerial_WriteFrame(1, input, 3) != 1 || VexHost_SerialOutput(1, output, 8) != 3) {
+        return 5;
+    }
+    return BufSerial_Write(3, input, 1) == 0 && BufSerial_Available(2) == 0 ? 0 : 6;
+}
+"""
+
+VEXIO_TEST = """#include "vexhost.h"
+#include "vexio.h"
+
+int main(void) {
+    unsigned char values[VEXIO_PWM_PORTS] = {0, 10, 20, 30, 40, 50, 60, 255};
+    unsigned char port;
+
+    VexHost_Reset();
+    VexHost_SetDigitalInput(1, 0);
+    VexHost_SetDigitalInput(5, 0);
+    VexHost_SetDigitalInput(16, 0);
+    if (VexIO_GetDigitalInputs() != 0x7FEE) {
+        return 1;
+    }
+
+    /* Ports 1 and 8 are left alone */
+    VexIO_SetPWMs(values, 0x7E);
+    for (port = 1; port <= VEXIO_PWM_PORTS; port++) {
+        if (VexHost_GetPWM(port) != (port == 1 || port == 8 ? 127 : values[port - 1])) {
+            return 2;
+        }
+    }
+    /* Unchanged values are skipped, so a port set another way keeps its value until they are forgotten */
+    SetPWM(2, 127);
+    VexIO_SetPWMs(values, 0x02);
+    if (VexHost_GetPWM(2) != 127) {
+        return 3;
+    }
+    VexIO_ForgetPWMs();
+    VexIO_SetPWMs(values, 0x02);
+    return VexHost_GetPWM(2) == 10 ? 0 : 4;
+}
+"""
+
+VEXADC_TEST = """#include "vexhost.h"
+#include "vexadc.h"
+
+int main(void) {
+    const volatile unsigned short *results;
+
+    VexHost_Reset();
+    VexHost_SetAnalogInput(1, 100);
+    VexHost_SetAnalogInput(2, 200);
+    VexHost_SetAnalogInput(3, 300);
+    VexAdc_SetOversampling(3, 2);
+    VexAdc_Start(3);
+
+    /* A pass takes 2 ms for each port, and 3 more for the 4 conversions of port 3 */
+    VexHost_Advance(8000);
+    if (VexAdc_Get(1) != 0 || VexAdc_GetPasses() != 0) {
+        return 1;
+    }
+    VexHost_Advance(1000);
+    if (VexAdc_Get(1) != 100 || VEXADC_GET(2) != 200 || VexAdc_Get(3) != 300 || VexAdc_Get(4) != 0) {
+        return 2;
+    }
+
+    /* The results only change at the end of a pass, and port 3 averages its conversions */
+    VexHost_Advance(7000);
+    VexHost_SetAnalogInput(1, 50);
+    VexHost_SetAnalogInput(3, 400);
+    if (VexAdc_Get(3) != 300) {
+        return 3;
+    }
+    VexHost_Advance(2000);
+    results = VexAdc_Results();
+    if (VexAdc_Get(1) != 100 || VexAdc_Get(3) != 350 || VexAdc_GetPasses() != 2 ||
+        results[0] != 100 || results[1] != 200 || results[2] != 350) {
+        return 4;
+    }
+
+    VexAdc_Stop();
+    VexHost_Advance(20000);
+    return VexAdc_GetPasses() == 2 ? 0 : 5;
+}
+"""
+
+VEXQUAD_TEST = """#include "vexhost.h"
+#include "vexquad.h"
+
+/* Levels of A and B through a line forward */
+static const unsigned char forward[4][2] = {{1, 0}, {1, 1}, {0, 1}, {0, 0}};
+
+static void turn(unsigned char portA, unsigned char portB, long edges) {
+    static unsigned char phase[VEXHOST_INTERRUPT_PORTS + 1];
+    unsigned char step;
+
+    for (; edges > 0; edges--) {
+        step = phase[portA]++ & 3;
+        VexHost_SetInterruptInput(portA, forward[step][0]);
+        VexHost_SetInterruptInput(portB, forward[step][1]);
+    }
+    for (; edges < 0; edges++) {
+        step = --phase[portA] & 3;
+        VexHost_SetInterruptInput(portA, forward[(step + 3) & 3][0]);
+        VexHost_SetInterruptInput(portB, forward[(step + 3) & 3][1]);
+    }
+}
+
+int main(void) {
+    long i;
+
+    VexHost_Reset();
+    VexQuad_Start(0, 1, 2, 0);
+    VexQuad_Start(1, 3, 4, 1);
+
+    /* Every edge of both channels counts */
+    turn(1, 2, 12);
+    turn(1, 2, -4);
+    turn(3, 4, 4);
+    if (VexQuad_Get(0) != 8 || VexQuad_Get(1) != -4 || VexQuad_GetErrors(0) != 0) {
+        return 1;
+    }
+
+    /* A port another encoder is decoding is refused */
+    VexQuad_Start(2, 4, 5, 0);
+    turn(3, 4, 4);
+    if (VexQuad_Get(2) != 0 || VexQuad_Get(1) != -8) {
+        return 2;
+    }
+
+    /* The 16 bit count is widened as long as it is read often enough */
+    for (i = 0; i < 4; i++) {
+        turn(1, 2, 20000);
+        VexQuad_Get(0);
+    }
+    if (VexQuad_Get(0) != 80008L) {
+        return 3;
+    }
+    VexQuad_Set(0, -1000000L);
+    turn(1, 2, -3);
+    if (VexQuad_Get(0) != -1000003L) {
+        return 4;
+    }
+
+    VexQuad_Stop(0);
+    turn(1, 2, 8);
+    return VexQuad_Get(0) == 0 && VexQuad_Get(1) == -8 ? 0 : 5;
+}
+"""
+
+TIMERWHEEL_TEST = """#include "vexhost.h"
+#include "timerwheel.h"
+
+#define MANY 50
+
+static TimerWheel_Timer fast, once, slow, first, second, many[MANY];
+static unsigned fastCount, onceCount, slowCount, secondCount, manyCount;
+
+static void countFast(void) {
+    fastCount++;
+}
+
+static void countOnce(void) {
+    onceCount++;
+}
+
+static void countSlow(void) {
+    slowCount++;
+}
+
+static void cancelSecond(void) {
+    TimerWheel_Cancel(&second);
+}
+
+static void countSecond(void) {
+    secondCount++;
+}
+
+static void countMany(void) {
+    manyCount++;
+}
+
+int main(void) {
+    unsigned i;
+
+    TimerWheel_Start(TIMERWHEEL_IN_INTERRUPT);
+    TimerWheel_Repeating(&fast, 3, countFast);
+    TimerWheel_Single(&once, 20, countOnce);
+    TimerWheel_Repeating(&slow, 40, countSlow);
+    for (i = 0; i < MANY; i++) {
+        TimerWheel_Repeating(&many[i], 7, countMany);
+    }
+    /* A handler can cancel a timer due on the same tick */
+    TimerWheel_Repeating(&first, 10, cancelSecond);
+    TimerWheel_Repeating(&second, 10, countSecond);
+    VexHost_Advance(100000);
+    if (TimerWheel_GetTicks() != 100 || fastCount != 33 || onceCount != 1 || slowCount != 2 ||
+        manyCount != 14 * MANY || secondCount != 0) {
+        return 1;
+    }
+    if (TimerWheel_IsActive(&once) || !TimerWheel_IsActive(&fast) || TimerWheel_IsActive(&second)) {
+        return 2;
+    }
+    TimerWheel_Cancel(&fast);
+    VexHost_Advance(10000);
+    if (fastCount != 33 || TimerWheel_IsActive(&fast)) {
+        return 3;
+    }
+
+    /* Cooperative handlers wait for TimerWheel_Dispatch(), and a late repeating timer skips what it missed */
+    TimerWheel_Cancel(&slow);
+    TimerWheel_Cancel(&first);
+    for (i = 0; i < MANY; i++) {
+        TimerWheel_Cancel(&many[i]);
+    }
+    TimerWheel_Start(TIMERWHEEL_COOPERATIVE);
+    fastCount = onceCount = 0;
+    TimerWheel_Repeating(&fast, 5, countFast);
+    VexHost_Advance(20000);
+    if (fastCount != 0) {
+        return 4;
+    }
+    TimerWheel_Dispatch();
+    if (fastCount != 1) {
+        return 5;
+    }
+    /* Due on the third turn of the wheel */
+    TimerWheel_Single(&once, 40, countOnce);
+    for (i = 0; i < 100; i++) {
+        VexHost_Advance(1000);
+        TimerWheel_Dispatch();
+        if (i == 38 && onceCount != 0) {
+            return 6;
+        }
+    }
+    return fastCount == 21 && onceCount == 1 ? 0 : 7;
+}
+"""
+
+TASKS_SOURCE = """#include "Api.h"
+#include "vextask.h"
+
+unsigned char order[16];
+unsigned char orderLength;
+unsigned char armLimit;
+unsigned armSteps;
+
+static void note(unsigned char id) {
+    if (orderLength < sizeof(order)) {
+        order[orderLength++] = id;
+    }
+}
+
+char Drive_Task(VexTask *task) {
+    note(0);
+    return VEXTASK_ENDED;
+}
+
+char Arm_Task(VexTask *task) {
+    VexTask_Begin(task);
+    for (;;) {
+        note(1);
+        VexTask_WaitUntil(task, armLimit);
+        armSteps++;
+        VexTask_Sleep(task, 5);
+        armSteps++;
+    }
+    VexTask_End(task);
+}
+
+/* Takes a millisecond, over its budget */
+char Log_Task(VexTask *task) {
+    note(2);
+    Wait(1);
+    return VEXTASK_ENDED;
+}
+"""
+
+VEXTASK_TEST = """#include <string.h>
+#include "vexhost.h"
+#include "vextask.h"
+
+extern unsigned char order[16];
+extern unsigned char orderLength;
+extern unsigned char armLimit;
+extern unsigned armSteps;
+
+int main(void) {
+    static const unsigned char expected[] = {0, 1, 2, 0, 1};
+
+    /* All of the tasks start out ready, and run by priority */
+    VexTask_Start();
+    if (VexTask_Step() != 3) {
+        return 1;
+    }
+    /* The arm task waits on every pass, the others are waiting for their periods */
+    if (VexTask_Step() != 1 || armSteps != 0) {
+        return 2;
+    }
+    armLimit = 1;
+    if (VexTask_Step() != 1 || armSteps != 1 || VexTask_Step() != 0) {
+        return 3;
+    }
+    /* 10 ms in, the drive task is released and the arm task has slept 5 ms */
+    VexHost_Advance(9000);
+    if (VexTask_Step() != 2 || armSteps != 3) {
+        return 4;
+    }
+    if (orderLength != sizeof(expected) || memcmp(order, expected, sizeof(expected)) != 0) {
+        return 5;
+    }
+
+    /* Ending after the next release misses a deadline */
+    VexHost_Advance(25000);
+    VexTask_Step();
+    if (VexTask_Get(0)->misses != 1 || VexTask_Get(0)->calls != 3 || VexTask_Get(2)->misses != 0) {
+        return 6;
+    }
+    if (VexTask_Get(2)->overruns != 2 || VexTask_Get(2)->runUs < 2000 || VexTask_Get(2)->worstUs < 1000 ||
+        VexTask_Get(1)->overruns != 0) {
+        return 7;
+    }
+    return VexTask_Get(3) == 0 ? 0 : 8;
+}
+"""
+
+ARM_SOURCE = """#include "vexlog.h"
+
+void Arm_Report(int position, unsigned long ticks) {
+    /* Sent as a record */
+    VexLog("Arm %d at %lu\\r\\n", position, ticks);
+}
+"""
+
+VEXLOG_TEST = """#include <string.h>
+#include "vexhost.h"
+#include "vexlog.h"
+
+void Arm_Report(int position, unsigned long ticks);
+
+int main(void) {
+    /* Format 0 with -1 and 0x050F, the STX and ESC bytes escaped */
+    static const unsigned char expected[] = {
+        0x0F, 0x0F, 0x00, 0x00, 0xFF, 0xFF, 0x05, 0x0F, 0x05, 0x05, 0x00, 0x00, 0xEE, 0x04
+    };
+    unsigned char output[32];
+
+    /* Records are dropped until the port is open */
+    Arm_Report(1, 2);
+    if (VexLog_GetDropped() != 1) {
+        return 1;
+    }
+    VexLog_Open(1, BAUD_115200);
+    Arm_Report(-1, 0x050F);
+    VexHost_Advance(1000);
+    if (VexHost_SerialOutput(1, output, sizeof(output)) != sizeof(expected) ||
+        memcmp(output, expected, sizeof(expected)) != 0) {
+        return 2;
+    }
+    return VexLog_GetDropped() == 0 ? 0 : 3;
+}
+"""
+
+TELEMETRY_TEST = """#include <string.h>
+#include "vexhost.h"
+#include "vextelemetry.h"
+
+int main(void) {
+    /* Samples 0 and 1, with the ETX bytes escaped */
+    static const unsigned char expected[] = {
+        0x0F, 0x0F, 0xFF, 0xFF, 0x00, 0x00, 0x05, 0x04, 0x03, 0x02, 0x01, 0xFE, 0xFF, 0xFB, 0x04,
+        0x0F, 0x0F, 0xFF, 0xFF, 0x01, 0x00, 0x05, 0x04, 0x03, 0x02, 0x01, 0xF7, 0x04
+    };
+    unsigned char output[64];
+
+    VexTelemetry_Start(1, BAUD_115200);
+    VexHost_Advance(25000);
+    if (VexHost_SerialOutput(1, output, sizeof(output)) != sizeof(expected) ||
+        memcmp(output, expected, sizeof(expected)) != 0) {
+        return 1;
+    }
+    VexTelemetry_Stop();
+    VexHost_Advance(25000);
+    return VexHost_SerialOutput(1, output, sizeof(output)) == 0 && VexTelemetry_GetDropped() == 0 ? 0 : 2;
+}
+"""
+
+REPORT_SOURCE = """#include <stdio.h>
+#include "report.h"
+
+int Report_Format(char *buffer, int value, long big, const char *name) {
+    return sprintf(buffer, "%d|%5u|%-4x|%04X|%+d|%lu|%08lx|%ld|%c|%s|%6s|100%%", value, value, value, value,
+                   value, big, big, -big, 'k', name, name);
+}
+
+int Report_Print(int value) {
+    /* Not a literal format, so left to printf */
+    return printf(REPORT_FORMAT, value);
+}
+"""
+
+REPORT_TEST = """#include <stdio.h>
+#include <string.h>
+#include "report.h"
+
+int main(void) {
+    static const int values[] = {0, 1, -1, 9, 10, 99, 100, 12345, -32768, 32767};
+    static const long bigs[] = {0, 7, 65536, 99999, 1000000000, 2147483647};
+    char expected[128];
+    char buffer[128];
+    unsigned i;
+    unsigned j;
+
+    for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        for (j = 0; j < sizeof(bigs) / sizeof(bigs[0]); j++) {
+            int value = values[i];
+            long big = bigs[j];
+            int length = snprintf(expected, sizeof(expected), "%d|%5u|%-4x|%04X|%+d|%lu|%08lx|%ld|%c|%s|%6s|100%%",
+                                  value, (unsigned short) value, (unsigned short) value, (unsigned short) value,
+                                  value, big, big, -big, 'k', "arm", "arm");
+            if (Report_Format(buffer, value, big, "arm") != length || strcmp(buffer, expected) != 0) {
+                printf("%s\\n%s\\n", buffer, expected);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+"""
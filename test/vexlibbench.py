@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+"""Cycle counts of the VexLib functions, measured in the simulator.
+
+The program is any build that uses the functions, since the linker only takes
+those from VexLib.lib, with its map file. It is run from reset to main(), or
+the function given with --start, so the startup code sets up the software
+stack, then each function in the map is called with a spread of arguments,
+pushed the way MPLAB C18 passes them. The library functions VexLib replaces
+are measured the same way, when the program uses them too.
+
+The serial writes send a 16 byte message a byte at a time. Start after the
+program opens port 1, and the spread between the fastest and slowest call is
+how long a print can hold up the control loop.
+
+TimerWheel_Tick() is measured with 1 to 64 timers on the wheel, in both of
+its modes, with the timers' periods spread so they fall in every slot. In
+interrupt mode a tick walks its slot and runs the handlers that are due, so
+it grows with the timers; only in cooperative mode does a tick take the
+same time however many timers there are, leaving the walk to
+TimerWheel_Dispatch(), which is measured after each tick.
+
+VexIO_SetPWMs() is measured setting all 8 motors, with values that change
+on every call and with values that don't, against 8 calls of SetPWM(), and
+VexIO_GetDigitalInputs() against 16 calls of GetDigitalInput().
+
+VexAdc_Get() is measured against GetAnalogInput() with 8 channels sampled,
+and so is the sampler's tick, VexAdc_Service(), which is what the sampling
+costs each millisecond.
+
+VexTask_Step() is measured with 1 to 10 tasks that return straight away,
+in a table written after the end of the program, and the cycles are given
+for each task it switches to.
+
+The quadrature decoders are measured by the edge rate they keep up with:
+256 edges of an encoder turning forward are put on the pins at 1000 to
+100000 edges a second, with the program waiting in a loop, and the highest
+rate the count is still right at is given for VexQuad_Get(), which should
+count 256, and GetQuadEncoder(), which counts once for every 4 edges, 64.
+"""
+import math
+import struct
+from pathlib import Path
+
+import vexsim
+
+
+# Startup clears and initializes the data, which takes a while
+STARTUP_CYCLES = 10 * vexsim.INSTRUCTION_RATE
+MAX_CALL_CYCLES = vexsim.INSTRUCTION_RATE
+
+ANGLES = [(angle,) for angle in range(0, 0x10000, 0x0FFF)]
+VECTORS = [(y, x) for y in (-30000, -517, 0, 2, 9000) for x in (-32768, -40, 1, 700, 32767)]
+RADIANS = [(angle * math.pi / 0x8000 - math.pi,) for angle, in ANGLES]
+FLOAT_VECTORS = [(y / 100, x / 100) for y, x in VECTORS if x != 0 or y != 0]
+ROOTS = [(value,) for value in (0, 1, 2, 1000, 65535, 123456, 0x7FFFFFFF, 0xFFFFFFFF)]
+FLOAT_ROOTS = [(value / 7,) for value, in ROOTS]
+MESSAGE = b"Arm at 1234 ok\r\n"
+
+# Function, the struct formats of its arguments, the arguments to call it with
+BENCHMARKS = (
+    ("Fix_Sin", "H", ANGLES),
+    ("Fix_Cos", "H", ANGLES),
+    ("Fix_Atan2", "hh", VECTORS),
+    ("Fix_Sqrt", "L", ROOTS),
+    ("Fix_SqrtQ8_8", "h", [(value & 0x7FFF,) for value, in ROOTS]),
+    ("Fix_MulQ15", "hh", VECTORS),
+    ("Fix_PowQ8_8", "hB", [(384, exponent) for exponent in range(8)]),
+    ("Fix_SinF", "f", RADIANS),
+    ("sin", "f", RADIANS),
+    ("Fix_CosF", "f", RADIANS),
+    ("cos", "f", RADIANS),
+    ("Fix_Atan2F", "ff", FLOAT_VECTORS),
+    ("atan2", "ff", FLOAT_VECTORS),
+    ("Fix_SqrtF", "f", FLOAT_ROOTS),
+    ("sqrt", "f", FLOAT_ROOTS),
+    ("WriteSerialPortOne", "B", [(byte,) for byte in MESSAGE]),
+    ("BufSerial_WriteByte", "BB", [(1, byte) for byte in MESSAGE]),
+    ("GetDigitalInput", "B", [(port,) for port in range(1, 17)]),
+    ("VexIO_GetDigitalInputs", "", [()]),
+    ("SetPWM", "Bh", [(port, 200) for port in range(1, 9)]),
+    ("GetAnalogInput", "B", [(port,) for port in range(1, 9)]),
+    ("Get_Analog_Value", "B", [(channel,) for channel in range(8)]),
+)
+
+# Calls of VexIO_SetPWMs() to measure
+PWM_CALLS = 8
+
+# Channels to sample, ticks of 2 passes over them, and cycles between ticks
+ADC_CHANNELS = 8
+ADC_TICKS = 4 * ADC_CHANNELS
+ADC_TICK_CYCLES = 1000
+
+# Timers to put on the wheel, and ticks to measure with each
+WHEEL_COUNTS = (1, 4, 16, 64)
+WHEEL_TICKS = 64
+# sizeof(TimerWheel_Timer) with C18's 16 bit pointers
+WHEEL_TIMER_SIZE = 10
+WHEEL_MODES = (("interrupt", 0x00), ("cooperative", 0x01))
+WHEEL_OWN_TICK = 0x02
+
+# Tasks to measure the scheduler with, and passes with each
+TASK_COUNTS = (1, 4, 10)
+TASK_PASSES = 16
+# sizeof(VexTask) and sizeof(VexTask_Entry) with C18's 16 bit pointers
+TASK_SIZE = 25
+TASK_ENTRY = "<HBHH"
+VEXTASK_YIELDED = 1
+
+# Edge rates to try the quadrature decoders at, edges to put on the pins at
+# each, and cycles to let the interrupts finish after
+QUAD_RATES = (1000, 2000, 5000, 10000, 20000, 50000, 100000)
+QUAD_EDGES = 256
+QUAD_SETTLE_CYCLES = 10000
+# Levels of channels A and B going forward, from 00
+QUADRATURE = ((1, 0), (1, 1), (0, 1), (0, 0))
+# The calls that start, read and stop each decoder, the pins of its
+# channels (interrupt ports 1 and 2 are RB2 and RB3, digital port 1 is RA0)
+# and the edges it takes to count once
+QUAD_DECODERS = (
+    ((("VexQuad_Start", "BBBB", (0, 1, 2, 0)), ("VexQuad_Get", "B", (0,)), ("VexQuad_Stop", "B", (0,))),
+     ("B", 2), ("B", 3), 1),
+    ((("StartQuadEncoder", "BBB", (1, 1, 0)), ("GetQuadEncoder", "BB", (1, 1)), ("StopQuadEncoder", "BB", (1, 1))),
+     ("B", 2), ("A", 0), 4),
+)
+
+def push_arguments(simulator, formats, values):
+    """Push the arguments on the software stack, last first, and return
+    where the stack was."""
+    stack = simulator.read_variable(vexsim.FSR1L, 2)
+    data = b"".join(struct.pack("<" + f, value) for f, value in reversed(list(zip(formats, values))))
+    simulator.data[stack:stack + len(data)] = data
+    simulator.write_variable(vexsim.FSR1L, stack + len(data), 2)
+    return stack
+
+def call(simulator, function, formats, values):
+    stack = push_arguments(simulator, formats, values)
+    cycles = simulator.call(function, MAX_CALL_CYCLES)
+    simulator.write_variable(vexsim.FSR1L, stack, 2)
+    return cycles
+
+def measure(simulator, function, formats, arguments):
+    cycles = []
+    for values in arguments:
+        cycles.append(call(simulator, function, formats, values))
+    return cycles
+
+def measure_pwms(simulator):
+    """Cycles of VexIO_SetPWMs() setting every motor, with the values on the
+    software stack."""
+    stack = simulator.read_variable(vexsim.FSR1L, 2)
+    simulator.write_variable(vexsim.FSR1L, stack + 8, 2)
+    call(simulator, "VexIO_ForgetPWMs", "", ())
+    results = []
+    for name, speeds in (("changed", [(100 + 50 * (i & 1) + port) for i in range(PWM_CALLS) for port in range(8)]),
+                         ("same", [(100 + port) for i in range(PWM_CALLS) for port in range(8)])):
+        cycles = []
+        for i in range(PWM_CALLS):
+            simulator.data[stack:stack + 8] = bytes(speeds[8 * i:8 * i + 8])
+            cycles.append(call(simulator, "VexIO_SetPWMs", "HB", (stack, 0xFF)))
+        results.append(("VexIO_SetPWMs/" + name, len(cycles), min(cycles), sum(cycles) / len(cycles), max(cycles)))
+    simulator.write_variable(vexsim.FSR1L, stack, 2)
+    return results
+
+def measure_adc(simulator):
+    """Cycles of VexAdc_Get() and VexAdc_Service() sampling 8 channels, with
+    2 passes done first. The timer is taken back out after."""
+    call(simulator, "VexAdc_Start", "B", (ADC_CHANNELS,))
+    service = []
+    for i in range(ADC_TICKS):
+        service.append(call(simulator, "VexAdc_Service", "", ()))
+        # Let the conversion finish before the next tick
+        elapsed = 0
+        while elapsed < ADC_TICK_CYCLES:
+            elapsed += call(simulator, "VexAdc_GetPasses", "", ())
+    gets = measure(simulator, "VexAdc_Get", "B", [(port,) for port in range(1, ADC_CHANNELS + 1)])
+    call(simulator, "VexAdc_Stop", "", ())
+    return [("VexAdc_Get", len(gets), min(gets), sum(gets) / len(gets), max(gets)),
+            ("VexAdc_Service", len(service), min(service), sum(service) / len(service), max(service))]
+
+def measure_wheel(simulator):
+    """Cycles of TimerWheel_Tick() for each mode and count of timers, and of
+    TimerWheel_Dispatch() in cooperative mode. The
+    timers go on the software stack, which is moved up past them, and their
+    handler is TimerWheel_GetTicks(), which only returns a value."""
+    results = []
+    handler = simulator.address_of("TimerWheel_GetTicks")
+    for mode_name, mode in WHEEL_MODES:
+        call(simulator, "TimerWheel_Start", "B", (mode | WHEEL_OWN_TICK,))
+        for count in WHEEL_COUNTS:
+            stack = simulator.read_variable(vexsim.FSR1L, 2)
+            timers = [stack + i * WHEEL_TIMER_SIZE for i in range(count)]
+            simulator.data[stack:stack + count * WHEEL_TIMER_SIZE] = bytes(count * WHEEL_TIMER_SIZE)
+            simulator.write_variable(vexsim.FSR1L, stack + count * WHEEL_TIMER_SIZE, 2)
+            for i, timer in enumerate(timers):
+                call(simulator, "TimerWheel_Repeating", "HHH", (timer, 20 + 3 * i, handler))
+            cycles = []
+            dispatches = []
+            for tick in range(WHEEL_TICKS):
+                cycles.append(call(simulator, "TimerWheel_Tick", "", ()))
+                if mode & 0x01:
+                    dispatches.append(call(simulator, "TimerWheel_Dispatch", "", ()))
+            for timer in timers:
+                call(simulator, "TimerWheel_Cancel", "H", (timer,))
+            simulator.write_variable(vexsim.FSR1L, stack, 2)
+            results.append(("TimerWheel_Tick/%s/%i" % (mode_name, count), len(cycles), min(cycles),
+                            sum(cycles) / len(cycles), max(cycles)))
+            if dispatches:
+                results.append(("TimerWheel_Dispatch/%i" % count, len(dispatches), min(dispatches),
+                                sum(dispatches) / len(dispatches), max(dispatches)))
+    return results
+
+def measure_tasks(simulator):
+    """Cycles of VexTask_Step() for each task it runs. Every task is one
+    RETLW VEXTASK_YIELDED, at priority 0 with no period, and their state goes
+    on the software stack, which is moved up past it."""
+    free = len(simulator.program.rstrip(b"\xff")) + 1 & ~1
+    function = free
+    simulator.program[function:function + 2] = (0x0C00 | VEXTASK_YIELDED).to_bytes(2, "little")
+    results = []
+    for count in TASK_COUNTS:
+        table = function + 2
+        entries = struct.pack(TASK_ENTRY, function, 0, 0, 0) * count
+        if table + len(entries) > vexsim.PROGRAM_MEMORY_SIZE:
+            break
+        simulator.program[table:table + len(entries)] = entries
+        simulator.invalidate()
+        stack = simulator.read_variable(vexsim.FSR1L, 2)
+        simulator.write_variable(vexsim.FSR1L, stack + count * TASK_SIZE, 2)
+        call(simulator, "VexTask_Init", "HHB", (table, stack, count))
+        cycles = [call(simulator, "VexTask_Step", "", ()) / count for i in range(TASK_PASSES)]
+        simulator.write_variable(vexsim.FSR1L, stack, 2)
+        results.append(("VexTask_Step/%i" % count, len(cycles), min(cycles), sum(cycles) / len(cycles),
+                        max(cycles)))
+    return results
+
+def read_long(simulator):
+    """A long a function returned, in PRODL:PRODH and AARGB2:AARGB3"""
+    return struct.unpack("<l", bytes([simulator.read_variable(vexsim.PRODL), simulator.read_variable(vexsim.PRODH),
+                                      simulator.read_variable("__AARGB2"), simulator.read_variable("__AARGB3")]))[0]
+
+def turn(simulator, pin_a, pin_b, rate, levels):
+    """Put QUAD_EDGES edges on the pins, starting from the levels, while the
+    program waits in a loop at the end of program memory. Returns the levels
+    it ended with."""
+    loop = len(simulator.program.rstrip(b"\xff")) + 1 & ~1
+    simulator.program[loop:loop + 2] = (0xD7FF).to_bytes(2, "little")
+    simulator.invalidate()
+    return_pc = simulator.pc
+    simulator.pc = loop
+    phase = QUADRATURE.index(levels) + 1
+    for edge in range(QUAD_EDGES):
+        levels = QUADRATURE[(phase + edge) % len(QUADRATURE)]
+        simulator.ports.set_input(pin_a[0], pin_a[1], levels[0])
+        simulator.ports.set_input(pin_b[0], pin_b[1], levels[1])
+        simulator.run(vexsim.INSTRUCTION_RATE // rate)
+    simulator.run(QUAD_SETTLE_CYCLES)
+    simulator.pc = return_pc
+    return levels
+
+def edge_rates(hex_file, map_file, start="main"):
+    """The highest edge rate each decoder in the program counts right at, as
+    (function, edges a second), 0 when it doesn't keep up at all. Each
+    decoder gets a simulator of its own, so the other doesn't take its
+    interrupts."""
+    symbols = vexsim.read_symbols(map_file)
+    results = []
+    for (starting, getting, stopping), pin_a, pin_b, edges_per_count in QUAD_DECODERS:
+        if getting[0] not in symbols:
+            continue
+        simulator = vexsim.Simulator(hex_file, symbols)
+        if simulator.run(STARTUP_CYCLES, start) != "until":
+            raise vexsim.SimulatorError(simulator.pc, "The program did not get to " + start)
+        levels = QUADRATURE[-1]
+        simulator.ports.set_input(*pin_a, levels[0])
+        simulator.ports.set_input(*pin_b, levels[1])
+        call(simulator, *starting)
+        best = 0
+        for rate in QUAD_RATES:
+            call(simulator, *getting)
+            before = read_long(simulator)
+            levels = turn(simulator, pin_a, pin_b, rate, levels)
+            call(simulator, *getting)
+            counts = read_long(simulator) - before
+            if counts != QUAD_EDGES // edges_per_count:
+                break
+            best = rate
+        call(simulator, *stopping)
+        results.append((getting[0], best))
+    return results
+
+def run(hex_file, map_file, start="main", benchmarks=BENCHMARKS):
+    symbols = vexsim.read_symbols(map_file)
+    simulator = vexsim.Simulator(hex_file, symbols)
+    if simulator.run(STARTUP_CYCLES, start) != "until":
+        raise vexsim.SimulatorError(simulator.pc, "The program did not get to " + start)
+
+    results = []
+    for function, formats, arguments in benchmarks:
+        if function in symbols:
+            cycles = measure(simulator, function, formats, arguments)
+            results.append((function, len(cycles), min(cycles), sum(cycles) / len(cycles), max(cycles)))
+    if "VexIO_SetPWMs" in symbols:
+        results.extend(measure_pwms(simulator))
+    if "VexAdc_Service" in symbols:
+        results.extend(measure_adc(simulator))
+    if "TimerWheel_Tick" in symbols:
+        results.extend(measure_wheel(simulator))
+    if "VexTask_Step" in symbols:
+        results.extend(measure_tasks(simulator))
+    return results
+
+def parse_args():
+    import argparse
+    parser = argparse.ArgumentParser(description="Measure the cycles VexLib functions take in the simulator")
+
+    parser.add_argument("hex_file", help="program built with the functions")
+    parser.add_argument("--map", help="MPLINK map file of the program, by default Mapfile.map next to the hex file")
+    parser.add_argument("--start", help="function to run the program to before measuring", default="main")
+
+    return parser.parse_args()
+
+if __name__ == "__main__":
+    args = parse_args()
+    map_file = Path(args.map) if args.map else Path(args.hex_file).parent / "Mapfile.map"
+
+    print("%-28s %6s %8s %8s %8s %8s" % ("function", "calls", "min", "mean", "max", "max/us"))
+    for function, calls, least, mean, most in run(args.hex_file, map_file, args.start):
+        print("%-28s %6i %8i %8.0f %8i %8.1f" % (function, calls, least, mean, most,
+                                                 most * 1e6 / vexsim.INSTRUCTION_RATE))
+    for function, rate in edge_rates(args.hex_file, map_file, args.start):
+        print("%-28s %i edges/s" % (function, rate))
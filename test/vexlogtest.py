@@ -0,0 +1,66 @@
+import tempfile
+import unittest
+from pathlib import Path
+
+import vexlog
+
+SOURCE = """#include "vexlog.h"
+/* VexLog("Commented out %d", x); */
+void Report(int arm, long ticks) {
+    VexLog("Arm %d at %08lx\\r\\n", arm, ticks);
+    VexLog ( "Ready\\n" );
+    VexLog("Key %c",
+           'x');
+    VexLog("Ready\\n");
+}
+"""
+
+class LogTest(unittest.TestCase):
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.table_path = Path(self.temp_dir.name) / "formats.json"
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def test_rewrite(self):
+        table = vexlog.FormatTable(self.table_path)
+        source, sites = vexlog.rewrite(SOURCE, "report", "report.c", table)
+        self.assertEqual([(site.name, site.id, site.line) for site in sites],
+                         [("VexLog_report_0", 0, 4), ("VexLog_report_1", 1, 5), ("VexLog_report_2", 2, 6),
+                          ("VexLog_report_3", 3, 8)])
+        self.assertEqual(source, SOURCE.replace('VexLog("Arm %d at %08lx\\r\\n", ', "VexLog_report_0(")
+                                       .replace('VexLog ( "Ready\\n" )', "VexLog_report_1()")
+                                       .replace('VexLog("Key %c",\n           ', "VexLog_report_2(\n")
+                                       .replace('VexLog("Ready\\n")', "VexLog_report_3()"))
+        self.assertEqual([vexlog.prototype(site) for site in sites[:3]],
+                         ["void VexLog_report_0(int a1, unsigned long a2)", "void VexLog_report_1(void)",
+                          "void VexLog_report_2(char a1)"])
+        self.assertIn("    VexLog_Begin(0);\n    VexLog_Put16(a1);\n    VexLog_Put32(a2);\n    VexLog_End();\n",
+                      vexlog.records(sites, "report.c"))
+
+    def test_table(self):
+        table = vexlog.FormatTable(self.table_path)
+        table.replace("report.c", vexlog.rewrite(SOURCE, "report", "report.c", table)[1])
+        table.write()
+        [entry] = [entry for entry in table.formats if entry["id"] == 0]
+        self.assertEqual((entry["text"], entry["arguments"], entry["line"]), ("Arm %d at %08lx\r\n", "hL", 4))
+        self.assertEqual((vexlog.record_size(entry), vexlog.text_size(entry)), (12, 19))
+
+        # Calls keep their numbers when they move, and new ones get new numbers
+        table = vexlog.FormatTable(self.table_path)
+        source = 'VexLog("New");\n' + SOURCE.replace('    VexLog ( "Ready\\n" );\n', "")
+        sites = vexlog.rewrite(source, "report", "report.c", table)[1]
+        self.assertEqual([(site.id, site.line) for site in sites], [(4, 1), (0, 5), (2, 6), (1, 8)])
+        table.replace("report.c", sites)
+        table.keep_files({"main.c"})
+        self.assertEqual(table.formats, [])
+
+    def test_errors(self):
+        table = vexlog.FormatTable(self.table_path)
+        for call in ('VexLog("%s", name);', 'VexLog("%f", 1.5);', 'VexLog("%ld%ld%ld%ld%d", 1, 2, 3, 4, 5);'):
+            self.assertRaises(vexlog.LogFormatError, vexlog.rewrite, call, "main", "main.c", table)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,63 @@
+import unittest
+
+import vexprintf
+import vexsim
+from vexprintf import Conversion
+from vexsimtest import assemble, word_address, bra, nop, ret
+from vexwcettest import symbols
+
+SOURCE = """#include <stdio.h>
+/* printf("Commented out %d\\n", x); */
+void Report(int arm, long ticks) {
+    char line[20];
+    printf("Arm %d at %08lx\\r\\n", arm, ticks);
+    PrintToScreen ( "Ready\\n" );
+    sprintf(line, "%5.2f", 1.5); // printf("%d", 1)
+    sprintf(line, "%u%%", arm);
+}
+"""
+
+class PrintfTest(unittest.TestCase):
+
+    def test_parse_format(self):
+        self.assertEqual(vexprintf.parse_format("Arm %d at %08lx\\r\\n"),
+                         ["Arm ", Conversion("d", 2, 0, ""), " at ", Conversion("x", 4, 8, "0"), "\\r\\n"])
+        self.assertEqual(vexprintf.parse_format("%-+5u%%%c"),
+                         [Conversion("u", 2, 5, "+-"), "%", Conversion("c", 2, 0, "")])
+        # Floats, precision, * and escaped % signs are left to printf
+        for text in ("%f", "%.2d", "%*d", "%lc", "\\x25 d", "\\045d", "100%"):
+            self.assertIsNone(vexprintf.parse_format(text), text)
+
+    def test_rewrite(self):
+        specialization = vexprintf.specialize(SOURCE, "report", "report.c")
+        self.assertEqual([(site.name, site.function, site.line) for site in specialization.sites],
+                         [("VexPrintf_report_0", "printf", 5), ("VexPrintf_report_1", "PrintToScreen", 6),
+                          ("VexSprintf_report_2", "sprintf", 8)])
+        lines = specialization.source.splitlines()
+        self.assertEqual(lines[0], "int VexPrintf_report_0(int a1, unsigned long a2); int VexPrintf_report_1(void); "
+                         "int VexSprintf_report_2(char *buffer, unsigned a1);")
+        self.assertEqual(lines[1], "#line 1 \"report.c\"")
+        self.assertEqual(lines[2:], SOURCE.replace('printf("Arm %d at %08lx\\r\\n", ', "VexPrintf_report_0(")
+                                          .replace('PrintToScreen ( "Ready\\n" )', "VexPrintf_report_1()")
+                                          .replace('sprintf(line, "%u%%", ', "VexSprintf_report_2(line, ")
+                                          .splitlines())
+        self.assertIn("    VexFmt_Hex32(a2, 8, VEXFMT_ZERO);\n    VexFmt_Text(\"\\r\\n\");\n",
+                      specialization.formatters)
+        self.assertIn("    VexFmt_Unsigned16(a1, 0, 0);\n    VexFmt_Text(\"%\");\n", specialization.formatters)
+
+        self.assertEqual(vexprintf.specialize("printf(format, 1);\n", "main"), ("printf(format, 1);\n", None, []))
+
+        # A call over several lines keeps the lines after it where they were
+        lines = vexprintf.specialize('printf("%d\\n",\n       1);\nx = 2;\n', "main").source.splitlines()
+        self.assertEqual(lines[2:], ["VexPrintf_main_0(", "1);", "x = 2;"])
+
+    def test_measure(self):
+        # A formatter of 1 cycle and a printf of 3
+        image = assemble(bra(-1), nop(), ret(), nop(), nop(), nop(), ret())
+        sites = vexprintf.specialize('printf("%d\\n", 1);', "main").sites
+        program_symbols = symbols(main=word_address(0), VexPrintf_main_0=word_address(1), printf=word_address(3))
+        [(site, cycles, original)] = vexprintf.measure(image, program_symbols, sites)
+        self.assertEqual((cycles, original), (1 + 2, 3 + 2))
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,308 @@
+import tempfile
+import unittest
+from pathlib import Path
+
+import vexsim
+import vexupload
+from vexsim import STATUS, STATUS_C, STATUS_DC, STATUS_N, STATUS_OV, STATUS_Z, WREG, FSR1L, PCLATH
+from vexupload import MIN_PROGRAM_ADDRESS
+
+
+# Encoders for the instructions the tests use. Branch offsets are in words,
+# relative to the instruction after the branch.
+def movlw(k): return [0x0E00 | k]
+def addlw(k): return [0x0F00 | k]
+def sublw(k): return [0x0800 | k]
+def retlw(k): return [0x0C00 | k]
+def movlb(k): return [0x0100 | k]
+def movwf(f, a=0): return [0x6E00 | a << 8 | f]
+def movf(f, d, a=0): return [0x5000 | d << 9 | a << 8 | f]
+def subwf(f, d, a=0): return [0x5C00 | d << 9 | a << 8 | f]
+def rlcf(f, d, a=0): return [0x3400 | d << 9 | a << 8 | f]
+def decfsz(f, d, a=0): return [0x2C00 | d << 9 | a << 8 | f]
+def btfss(f, b, a=0): return [0xA000 | b << 9 | a << 8 | f]
+def bra(n): return [0xD000 | n & 0x7FF]
+def rcall(n): return [0xD800 | n & 0x7FF]
+def call(address): return [0xEC00 | address >> 1 & 0xFF, 0xF000 | address >> 9]
+def goto(address): return [0xEF00 | address >> 1 & 0xFF, 0xF000 | address >> 9]
+def lfsr(n, k): return [0xEE00 | n << 4 | k >> 8, 0xF000 | k & 0xFF]
+def movff(source, destination): return [0xC000 | source, 0xF000 | destination]
+def btfsc(f, b, a=0): return [0xB000 | b << 9 | a << 8 | f]
+def bsf(f, b, a=0): return [0x8000 | b << 9 | a << 8 | f]
+def bcf(f, b, a=0): return [0x9000 | b << 9 | a << 8 | f]
+def incf(f, d, a=0): return [0x2800 | d << 9 | a << 8 | f]
+def nop(): return [0x0000]
+def ret(): return [0x0012]
+def retfie(s=0): return [0x0010 | s]
+def sleep(): return [0x0003]
+def tblrd_postinc(): return [0x0009]
+
+POSTINC1 = 0xE6
+POSTDEC1 = 0xE5
+PLUSW1 = 0xE3
+PCL = 0xF9
+TBLPTRL = 0xF6
+TBLPTRH = 0xF7
+
+def assemble(*instructions):
+    words = [word for instruction in instructions for word in instruction]
+    code = bytearray()
+    for word in words:
+        code += word.to_bytes(2, "little")
+    return vexupload.ProgramImage(MIN_PROGRAM_ADDRESS, code)
+
+def word_address(index):
+    return MIN_PROGRAM_ADDRESS + 2 * index
+
+# Access bank addresses of the special function registers the tests use
+INTCON = 0xF2
+T0CON = 0xD5
+TXSTA1 = 0xAC
+RCSTA1 = 0xAB
+TXREG1 = 0xAD
+RCREG1 = 0xAE
+SPBRG1 = 0xAF
+ADCON0 = 0xC2
+ADCON2 = 0xC0
+ADRESH = 0xC4
+TRISB = 0x93
+SSPCON1 = 0xC6
+SSPBUF = 0xC9
+
+def with_interrupt_handler(handler, *main):
+    """A program that starts at main, with handler at the high priority vector."""
+    handler_index = (vexsim.HIGH_PRIORITY_VECTOR - MIN_PROGRAM_ADDRESS) // 2
+    handler_words = [word for instruction in handler for word in instruction]
+    main_index = handler_index + len(handler_words)
+    return (goto(word_address(main_index)),) + (nop(),) * (handler_index - 2) + tuple(handler) + main
+
+class CoreTest(unittest.TestCase):
+
+    def run_program(self, *instructions, cycles=1000):
+        self.simulator = vexsim.Simulator(assemble(*instructions))
+        self.assertEqual(self.simulator.run(cycles), "sleep")
+        return self.simulator
+
+    def test_add_flags(self):
+        simulator = self.run_program(movlw(0x7f), addlw(0x01), sleep())
+        self.assertEqual(simulator.w, 0x80)
+        self.assertEqual(simulator.data[STATUS], STATUS_OV | STATUS_N | STATUS_DC)
+
+        simulator = self.run_program(movlw(0xff), addlw(0x01), sleep())
+        self.assertEqual(simulator.w, 0x00)
+        self.assertEqual(simulator.data[STATUS], STATUS_C | STATUS_DC | STATUS_Z)
+
+    def test_subtract_flags(self):
+        # 5 - 6 borrows, so C is clear
+        simulator = self.run_program(movlw(5), movwf(0x20), movlw(6), subwf(0x20, 0), sleep())
+        self.assertEqual(simulator.w, 0xff)
+        self.assertEqual(simulator.data[STATUS] & (STATUS_C | STATUS_N | STATUS_Z), STATUS_N)
+
+        # 6 - 6 does not
+        simulator = self.run_program(movlw(6), sublw(6), sleep())
+        self.assertEqual(simulator.w, 0)
+        self.assertEqual(simulator.data[STATUS] & (STATUS_C | STATUS_Z), STATUS_C | STATUS_Z)
+
+    def test_rotate_through_carry(self):
+        simulator = self.run_program(movlw(0x81), movwf(0x20), rlcf(0x20, 1), rlcf(0x20, 1), sleep())
+        self.assertEqual(simulator.data[0x20], 0x05)
+        self.assertEqual(simulator.data[STATUS] & STATUS_C, 0)
+
+    def test_loop_cycles(self):
+        simulator = self.run_program(
+            movlw(10), movwf(0x20),
+            decfsz(0x20, 1), bra(-2),
+            sleep())
+        # 2 setup cycles, 9 passes of DECFSZ and a taken BRA, the final
+        # skipping DECFSZ and SLEEP
+        self.assertEqual(simulator.cycles, 2 + 9 * 3 + 2 + 1)
+        self.assertEqual(simulator.instructions, 2 + 9 * 2 + 1 + 1)
+        self.assertEqual(simulator.pc, word_address(5))
+
+    def test_skip_two_word_instruction(self):
+        simulator = self.run_program(
+            movlw(1), movwf(0x20),
+            btfss(0x20, 0), goto(word_address(7)),
+            movlw(0x42), sleep(),
+            movlw(0), sleep())
+        self.assertEqual(simulator.w, 0x42)
+        # The skip over GOTO takes 3 cycles
+        self.assertEqual(simulator.cycles, 2 + 3 + 1 + 1)
+
+    def test_call_and_return(self):
+        function = word_address(3)
+        simulator = self.run_program(call(function), sleep(), movlw(42), ret())
+        self.assertEqual(simulator.w, 42)
+        self.assertEqual(simulator.cycles, 2 + 1 + 2 + 1)
+        self.assertEqual(simulator.data[vexsim.STKPTR], 0)
+
+        simulator.write_variable(WREG, 0)
+        self.assertEqual(simulator.call(function), 3)
+        self.assertEqual(simulator.w, 42)
+
+    def test_retlw_table(self):
+        simulator = self.run_program(rcall(2), movwf(0x20), sleep(), retlw(0x33))
+        self.assertEqual(simulator.data[0x20], 0x33)
+
+    def test_indirect_registers(self):
+        simulator = self.run_program(
+            lfsr(1, 0x100),
+            movlw(7), movwf(POSTINC1),
+            movlw(9), movwf(POSTINC1),
+            movlw(0xfe), movf(PLUSW1, 0),
+            movwf(0x20),
+            movf(POSTDEC1, 0),
+            sleep())
+        self.assertEqual(simulator.data[0x100:0x102], bytes((7, 9)))
+        self.assertEqual(simulator.data[0x20], 7)
+        self.assertEqual(simulator.read_variable(FSR1L, 2), 0x101)
+
+    def test_banked_and_movff(self):
+        simulator = self.run_program(
+            movlb(3), movlw(0x55), movwf(0x10, 1),
+            movff(0x310, 0x020),
+            sleep())
+        self.assertEqual(simulator.data[0x310], 0x55)
+        self.assertEqual(simulator.data[0x020], 0x55)
+        self.assertEqual(simulator.cycles, 3 + 2 + 1)
+
+    def test_table_read(self):
+        table = word_address(9)
+        simulator = self.run_program(
+            movlw(table & 0xff), movwf(TBLPTRL), movlw(table >> 8), movwf(TBLPTRH),
+            tblrd_postinc(), movff(0xFF5, 0x020),
+            tblrd_postinc(),
+            sleep(),
+            [0x2211])
+        self.assertEqual(simulator.data[0x20], 0x11)
+        self.assertEqual(simulator.data[0xFF5], 0x22)
+        self.assertEqual(simulator.read_variable(0xFF6, 2), table + 2)
+
+    def test_read_pcl_latches(self):
+        simulator = self.run_program(movf(PCL, 0), sleep())
+        self.assertEqual(simulator.w, word_address(1) & 0xff)
+        self.assertEqual(simulator.data[PCLATH], word_address(1) >> 8)
+
+    def test_stack_overflow(self):
+        simulator = vexsim.Simulator(assemble(rcall(-1)))
+        with self.assertRaises(vexsim.SimulatorError) as context:
+            simulator.run(1000)
+        self.assertEqual(context.exception.address, MIN_PROGRAM_ADDRESS)
+        self.assertEqual(simulator.data[vexsim.STKPTR] & vexsim.STKPTR_SP, vexsim.STACK_DEPTH)
+
+    def test_run_until(self):
+        simulator = vexsim.Simulator(assemble(movlw(1), movlw(2), movlw(3), sleep()),
+                                     {"third": vexsim.Symbol("third", word_address(2), "program")})
+        self.assertEqual(simulator.run(until="third"), "until")
+        self.assertEqual(simulator.w, 2)
+        self.assertEqual(simulator.run(), "sleep")
+        self.assertEqual(simulator.w, 3)
+
+    def test_read_symbols(self):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            map_file = Path(temp_dir) / "Mapfile.map"
+            map_file.write_text("""
+                                 Section Info
+                  Section       Type    Address   Location Size(Bytes)
+             .code_main.o       code   0x000800    program   0x0000a4
+
+                              Symbols - Sorted by Name
+                     Name    Address   Location    Storage File
+                ---------  ---------  ---------  --------- ---------
+                     main   0x000800    program     extern C:\\robot\\src\\main.c
+                    count   0x000100       data     static C:\\robot\\src\\main.c
+""")
+            symbols = vexsim.read_symbols(map_file)
+        self.assertEqual(symbols["main"], vexsim.Symbol("main", 0x800, "program"))
+        self.assertEqual(symbols["count"], vexsim.Symbol("count", 0x100, "data"))
+        self.assertNotIn(".code_main.o", symbols)
+
+class PeripheralTest(unittest.TestCase):
+
+    def test_timer0_interrupt(self):
+        simulator = vexsim.Simulator(assemble(*with_interrupt_handler(
+            (incf(0x20, 1), bcf(INTCON, 2), retfie(1)),
+            # 8 bit, no prescaler
+            movlw(0xC8), movwf(T0CON),
+            bsf(INTCON, 5), bsf(INTCON, 7),
+            bra(-1))))
+        self.assertEqual(simulator.run(2000), "cycles")
+        # The timer starts at cycle 4 and overflows every 256 cycles
+        self.assertEqual(simulator.data[0x20], (2000 - 4) // 256)
+        self.assertEqual(simulator.data[vexsim.STKPTR], 0)
+
+    def test_usart(self):
+        simulator = vexsim.Simulator(assemble(
+            # 40 cycles a bit, so 400 a byte
+            movlw(9), movwf(SPBRG1), movlw(0x24), movwf(TXSTA1), movlw(0x90), movwf(RCSTA1),
+            movlw(0x41), movwf(TXREG1), movlw(0x42), movwf(TXREG1),
+            btfss(vexsim.PIR1 & 0xFF, 5), bra(-2),
+            movf(RCREG1, 0), movwf(0x20),
+            sleep()))
+        simulator.run(6)
+        simulator.usarts[0].receive(b"x")
+        self.assertEqual(simulator.run(1000), "sleep")
+        self.assertEqual(simulator.data[0x20], ord("x"))
+        self.assertEqual(bytes(simulator.usarts[0].output), b"A")
+        simulator.run(400)
+        self.assertEqual(bytes(simulator.usarts[0].output), b"AB")
+
+    def test_usart_movff(self):
+        simulator = vexsim.Simulator(assemble(
+            movlw(9), movwf(SPBRG1), movlw(0x24), movwf(TXSTA1), movlw(0x90), movwf(RCSTA1),
+            btfss(vexsim.PIR1 & 0xFF, 5), bra(-2),
+            # Wait for the second byte, 256 * 3 cycles
+            movlw(0), movwf(0x21), decfsz(0x21, 1), bra(-2),
+            # Writing TXREG needs the time, so the MOVFF runs again
+            movff(0xF00 | RCREG1, 0xF00 | TXREG1), movff(0xF00 | RCREG1, 0xF00 | TXREG1),
+            sleep()))
+        simulator.run(6)
+        simulator.usarts[0].receive(b"xy")
+        self.assertEqual(simulator.run(2000), "sleep")
+        simulator.run(1000)
+        self.assertEqual(bytes(simulator.usarts[0].output), b"xy")
+
+    def test_adc(self):
+        simulator = vexsim.Simulator(assemble(
+            movlw(0x01), movwf(ADCON2),
+            # Channel 3
+            movlw(0x0F), movwf(ADCON0),
+            btfsc(ADCON0, 1), bra(-2),
+            movf(ADRESH, 0),
+            sleep()))
+        simulator.adc.set_input(3, 0x2AA)
+        self.assertEqual(simulator.run(1000), "sleep")
+        self.assertEqual(simulator.w, 0xAA)
+        self.assertTrue(simulator.data[vexsim.PIR1] & vexsim.PIR1_ADIF)
+        # 12 TAD of 2 cycles
+        self.assertGreaterEqual(simulator.cycles, 4 + 24)
+
+    def test_external_interrupt(self):
+        simulator = vexsim.Simulator(assemble(*with_interrupt_handler(
+            (incf(0x20, 1), bcf(vexsim.INTCON3 & 0xFF, 1), retfie(1)),
+            # INT2 on a falling edge
+            bcf(vexsim.INTCON2 & 0xFF, 4), bsf(vexsim.INTCON3 & 0xFF, 4), bsf(INTCON, 7),
+            bra(-1))))
+        simulator.run(100)
+        simulator.ports.set_input("B", 2, 1)
+        simulator.run(100)
+        self.assertEqual(simulator.data[0x20], 0)
+        simulator.ports.set_input("B", 2, 0)
+        simulator.run(100)
+        self.assertEqual(simulator.data[0x20], 1)
+
+    def test_master_link(self):
+        simulator = vexsim.Simulator(assemble(
+            # SPI slave, no slave select
+            movlw(0x25), movwf(SSPCON1),
+            btfss(vexsim.PIR1 & 0xFF, 3), bra(-2),
+            bcf(vexsim.PIR1 & 0xFF, 3),
+            movf(SSPBUF, 0), addlw(1), movwf(SSPBUF),
+            bra(-7)))
+        simulator.master.set_packet(b"\x10\x20\x30")
+        simulator.run(vexsim.MASTER_PACKET_CYCLES * 2 + 1000)
+        # Each byte sent back is the one before plus 1
+        self.assertEqual(list(simulator.master.replies), [b"\x00\x11\x21", b"\x31\x11\x21"])
+
+if __name__ == "__main__":
+    unittest.main()
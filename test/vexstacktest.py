@@ -0,0 +1,102 @@
+import tempfile
+import unittest
+from pathlib import Path
+
+import vexsim
+import vexstack
+from vexsimtest import assemble, word_address, movlw, movwf, movf, subwf, bra, rcall, call, goto, lfsr, movff, ret, nop
+from vexwcettest import addwf, symbols, config
+
+FSR1L = 0xE1
+POSTINC1 = 0xE6
+POSTDEC1 = 0xE5
+
+def push(): return [0x0005]
+
+# What C18 puts around a function with a frame of locals
+def prologue(locals):
+    return [movff(vexsim.FSR2L, vexstack.POSTINC1), movff(vexsim.FSR1L, vexsim.FSR2L),
+            movlw(locals), addwf(FSR1L, 1)]
+
+def epilogue(locals):
+    return [movlw(locals), subwf(FSR1L, 1), movf(POSTDEC1, 1), movff(vexsim.FSR1L + vexsim.INDF, vexsim.FSR2L), ret()]
+
+class StackTest(unittest.TestCase):
+
+    def test_frames(self):
+        leaf = word_address(0)
+        caller = word_address(12)
+        image = assemble(*(prologue(3) + epilogue(3) +
+                           # Push a 2 byte argument and pop it after the call
+                           prologue(2) + [movwf(POSTINC1), movwf(POSTINC1), call(leaf),
+                                          movf(POSTDEC1, 1), movf(POSTDEC1, 1)] + epilogue(2)))
+        analyzer = vexstack.StackAnalyzer(image, symbols(leaf=leaf, caller=caller))
+        self.assertEqual(analyzer.function(leaf).depth, 4)
+        stack = analyzer.function(caller)
+        self.assertTrue(stack.complete)
+        self.assertEqual(stack.depth, 3 + 2 + 4)
+        self.assertEqual(stack.levels, 1)
+        self.assertEqual(stack.deepest, (word_address(20), leaf))
+        self.assertEqual(analyzer.problems, [])
+
+    def test_unbalanced(self):
+        image = assemble(movwf(POSTINC1), ret())
+        analyzer = vexstack.StackAnalyzer(image, symbols(leaky=word_address(0)))
+        self.assertFalse(analyzer.function(word_address(0)).complete)
+        self.assertEqual(analyzer.problems, [("leaky+0x2", "returns with 1 bytes left on the stack")])
+
+    def test_unknown_stack_pointer(self):
+        image = assemble(lfsr(1, 0x600), ret())
+        analyzer = vexstack.StackAnalyzer(image, symbols(start=word_address(0)))
+        self.assertFalse(analyzer.function(word_address(0)).complete)
+
+    def test_loop_keeps_height(self):
+        image = assemble(movwf(POSTINC1), movf(POSTDEC1, 1), bra(-3), ret())
+        analyzer = vexstack.StackAnalyzer(image, symbols(loop=word_address(0)))
+        stack = analyzer.function(word_address(0))
+        self.assertTrue(stack.complete)
+        self.assertEqual(stack.depth, 1)
+
+    def test_registered_handlers(self):
+        dispatch = word_address(0)
+        handler = word_address(2)
+        image = assemble(addwf(0xF9, 1), ret(), *prologue(6) + epilogue(6))
+        with tempfile.TemporaryDirectory() as temp_dir:
+            (Path(temp_dir) / "main.c").write_text("void Initialize(void) {\n"
+                                                   "    RegisterRepeatingTimer(20, Poll);\n"
+                                                   "    RegisterInterruptHandler(1, RISING_EDGE, &Count);\n"
+                                                   "    TimerWheel_Repeating(&blink, 500, Blink);\n}\n")
+            handlers = vexstack.registered_handlers(temp_dir)
+            (Path(temp_dir) / "tasks.cfg").write_text("task Drive_Task 0 10\ntask Poll 1\n")
+            with_tasks = vexstack.registered_handlers(temp_dir, temp_dir)
+        self.assertEqual(handlers, ["Poll", "Count", "Blink"])
+        self.assertEqual(with_tasks, ["Poll", "Count", "Blink", "Drive_Task"])
+
+        analyzer = vexstack.StackAnalyzer(image, symbols(InterruptHandlerLow=dispatch, Poll=handler))
+        self.assertFalse(analyzer.function(dispatch).complete)
+        analyzer = vexstack.StackAnalyzer(image, symbols(InterruptHandlerLow=dispatch, Poll=handler), handlers=handlers)
+        self.assertEqual(analyzer.function(dispatch).depth, 7)
+        self.assertTrue(analyzer.function(dispatch).complete)
+        analyzer = vexstack.StackAnalyzer(image, symbols(InterruptHandlerLow=dispatch, Poll=handler),
+                                          config("targets InterruptHandlerLow InterruptHandlerLow+2"), handlers)
+        self.assertEqual(analyzer.function(dispatch).depth, 0)
+        # Only the library's dispatchers are taken to call the handlers
+        analyzer = vexstack.StackAnalyzer(image, symbols(dispatch=dispatch, Poll=handler), handlers=handlers)
+        self.assertFalse(analyzer.function(dispatch).complete)
+        self.assertEqual(analyzer.problems, [("dispatch", "needs targets for its computed jump")])
+
+    def test_usage_adds_interrupts(self):
+        main = word_address(16)
+        high = word_address(18)
+        # The high priority vector jumps to its handler, the low one is erased
+        image = assemble(nop(), nop(), nop(), nop(), goto(high), *[nop()] * 6 + [[0xFFFF]] * 4 +
+                         [movwf(POSTINC1), bra(-1)] +
+                         prologue(4) + epilogue(4))
+        analyzer = vexstack.StackAnalyzer(image, symbols(main=main, high_isr=high))
+        usage = analyzer.usage()
+        self.assertEqual(usage, vexstack.Usage(1 + 5, 1, True))
+        self.assertTrue(vexstack.fits(usage))
+        self.assertFalse(vexstack.fits(usage, 6))
+
+if __name__ == "__main__":
+    unittest.main()
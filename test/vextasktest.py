@@ -0,0 +1,46 @@
+import tempfile
+import unittest
+from pathlib import Path
+
+import vextask
+from vextask import Task
+
+CONFIG = """task Drive_Task 0 10 2000    # function, priority, period, budget
+task Arm_Task 1
+task Log_Task 3 0x14
+"""
+
+class TaskTest(unittest.TestCase):
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.config_file = Path(self.temp_dir.name) / vextask.CONFIG_NAME
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def test_read_config(self):
+        self.config_file.write_text(CONFIG)
+        self.assertEqual(vextask.read_config(self.config_file),
+                         [Task("Drive_Task", 0, 10, 2000), Task("Arm_Task", 1, 0, 0), Task("Log_Task", 3, 20, 0)])
+        for line in ("task Arm_Task 2", "task Spin 4", "task Spin", "task Spin 0 70000", "task Spin.x 0",
+                     "task Spin 0 1 2 3", "thread Spin 0"):
+            self.config_file.write_text(CONFIG + line + "\n")
+            self.assertRaises(ValueError, vextask.read_config, self.config_file)
+        # The state of more tasks would not fit in a data bank
+        self.config_file.write_text("".join("task t%i 0\n" % i for i in range(10)))
+        self.assertEqual(len(vextask.read_config(self.config_file)), 10)
+        self.config_file.write_text("".join("task t%i 0\n" % i for i in range(11)))
+        self.assertRaises(ValueError, vextask.read_config, self.config_file)
+
+    def test_source(self):
+        self.config_file.write_text(CONFIG)
+        source = vextask.source(vextask.read_config(self.config_file))
+        self.assertIn("char Drive_Task(VexTask *task);\nchar Arm_Task(VexTask *task);\n", source)
+        self.assertIn("    {Drive_Task, 0, 10, 2000},\n    {Arm_Task, 1, 0, 0},\n    {Log_Task, 3, 20, 0},\n};\n",
+                      source)
+        self.assertIn("#pragma udata vextask\nstatic VexTask tasks[3];\n#pragma udata\n", source)
+        self.assertIn("VexTask_Init(table, tasks, 3);", source)
+
+if __name__ == "__main__":
+    unittest.main()
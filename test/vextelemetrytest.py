@@ -0,0 +1,54 @@
+import tempfile
+import unittest
+from pathlib import Path
+
+import vextelemetry
+from vextelemetry import Channel
+
+CONFIG = """period 10                            # ms between samples
+channel left_ticks leftTicks long    # every sample
+channel gyro gyroAngle int 2
+channel left_pwm leftPwm uchar 4
+"""
+
+class TelemetryTest(unittest.TestCase):
+
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.config_file = Path(self.temp_dir.name) / vextelemetry.CONFIG_NAME
+
+    def tearDown(self):
+        self.temp_dir.cleanup()
+
+    def test_read_config(self):
+        self.config_file.write_text(CONFIG)
+        self.assertEqual(vextelemetry.read_config(self.config_file),
+                         (10, [Channel("left_ticks", "leftTicks", "long", 1), Channel("gyro", "gyroAngle", "int", 2),
+                               Channel("left_pwm", "leftPwm", "uchar", 4)]))
+        for line in ("channel gyro gyroAngle int 3", "channel gyro gyroAngle float", "channel left_ticks x long",
+                     "period 0", "channel gyro gyro.angle int", "budget 10"):
+            self.config_file.write_text(CONFIG + line + "\n")
+            self.assertRaises(ValueError, vextelemetry.read_config, self.config_file)
+        # The worst case frame of the most channels fits in the transmit ring
+        self.config_file.write_text("".join("channel c%i v%i long\n" % (i, i) for i in range(6)) +
+                                    "channel c6 v6 int\n")
+        layout = vextelemetry.read_config(self.config_file)
+        self.assertLessEqual(vextelemetry.worst_frame_size(sum(map(vextelemetry.size, layout.channels))),
+                             vextelemetry.TX_RING_BYTES)
+        self.config_file.write_text("".join("channel c%i v%i long\n" % (i, i) for i in range(6)) +
+                                    "channel c6 v6 int\nchannel c7 v7 char\n")
+        self.assertRaises(ValueError, vextelemetry.read_config, self.config_file)
+
+    def test_source(self):
+        self.config_file.write_text(CONFIG)
+        layout = vextelemetry.read_config(self.config_file)
+        source = vextelemetry.source(layout)
+        self.assertIn("extern long leftTicks;\nextern int gyroAngle;\nextern unsigned char leftPwm;\n", source)
+        self.assertIn("    VexTelemetry_Put32(leftTicks);\n    if ((number & 1) == 0) {\n"
+                      "        VexTelemetry_Put16(gyroAngle);\n    }\n    if ((number & 3) == 0) {\n", source)
+        self.assertIn("RegisterRepeatingTimer(10, sample);", source)
+        # 4 frames of 8 bytes of framing, 4 longs, 2 ints and a char every 40 ms
+        self.assertEqual(vextelemetry.bytes_per_second(layout), (4 * 8 + 16 + 4 + 1) * 1000 / 40)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Upload throughput benchmarks, run against the simulated bootloader.
+
+For each image size and write packing limit, the image is erased and written
+through the vexupload functions. The results report modelled link throughput
+in bytes/s, the number of command round trips, and the host wall time spent in
+the uploader.
+"""
+import contextlib
+import io
+import random
+import time
+
+import vexbootsim
+import vexupload
+from vexupload import MIN_PROGRAM_ADDRESS, ERASE_ROW_SIZE
+
+
+# Up to nearly the whole of program memory
+IMAGE_SIZES = (4096, 16384, 30656)
+
+def make_image(size, seed=0):
+    """Random bytes, which need escaping about as often as compiled code does."""
+    rng = random.Random(seed)
+    return bytearray(rng.randrange(256) for _ in range(size))
+
+def run(size, max_write_blocks, realtime=False):
+    bootloader = vexbootsim.Bootloader(max_write_blocks=max_write_blocks)
+    serial_conn = vexbootsim.SimulatedSerial(bootloader=bootloader, realtime=realtime, timeout=3)
+    code = make_image(size)
+
+    rows = (size + ERASE_ROW_SIZE - 1) // ERASE_ROW_SIZE
+
+    # Keep the progress dots out of the results
+    with contextlib.redirect_stdout(io.StringIO()):
+        start = time.perf_counter()
+        vexupload.erase_program_mem(serial_conn, MIN_PROGRAM_ADDRESS, rows * ERASE_ROW_SIZE)
+        vexupload.write_program_mem(serial_conn, MIN_PROGRAM_ADDRESS, bytearray(code), max_write_blocks)
+        wall = time.perf_counter() - start
+
+    assert bootloader.flash[MIN_PROGRAM_ADDRESS:MIN_PROGRAM_ADDRESS + size] == code, "Image was not written correctly"
+
+    return {
+        "size": size,
+        "max_write_blocks": max_write_blocks,
+        "round_trips": sum(bootloader.commands.values()),
+        "link_time": bootloader.clock,
+        "bytes_per_second": size / bootloader.clock,
+        "wall_time": wall,
+    }
+
+def parse_args():
+    import argparse
+    parser = argparse.ArgumentParser(description="Benchmark uploads against the simulated bootloader")
+
+    parser.add_argument("--realtime", help="wait for the modelled link and flash time", action="store_true")
+    parser.add_argument("--blocks", help="write packing limits to compare", type=int, nargs="+",
+                        default=[vexupload.DEFAULT_WRITE_BLOCKS, vexupload.MAX_WRITE_BLOCKS])
+
+    return parser.parse_args()
+
+if __name__ == "__main__":
+    args = parse_args()
+
+    print("%8s %7s %12s %12s %10s %10s" % ("bytes", "blocks", "round trips", "link time/s", "bytes/s", "wall/s"))
+    for size in IMAGE_SIZES:
+        for blocks in args.blocks:
+            result = run(size, blocks, args.realtime)
+            print("%8i %7i %12i %12.3f %10.0f %10.3f" % (result["size"], result["max_write_blocks"],
+                  result["round_trips"], result["link_time"], result["bytes_per_second"], result["wall_time"]))
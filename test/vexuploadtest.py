@@ -1,10 +1,26 @@
+import os
+from pathlib import Path
+import struct
+import tempfile
+import time
 import unittest
+import vexbootsim
 import vexupload
 import serial
 from vexupload import CHAR_ESC, CHAR_ETX, CHAR_STX, Command
 
 packet_header = (CHAR_STX, CHAR_STX)
 
+def write_test_hex(path, address, code, *regions):
+    """Write code at address, and any more (address, code) regions, to a hex file."""
+    with open(path, "w") as fd:
+        for address, code in ((address, code),) + regions:
+            for offset in range(0, len(code), 16):
+                line = bytes((min(16, len(code) - offset), ((address + offset) >> 8) & 0xff, (address + offset) & 0xff, 0)) + \
+                    bytes(code[offset:offset + 16])
+                fd.write(":%s%02X\n" % (line.hex().upper(), -sum(line) & 0xff))
+        fd.write(":00000001FF\n")
+
 class PacketTest(unittest.TestCase):
 
     def setUp(self):
@@ -22,6 +38,12 @@ class PacketTest(unittest.TestCase):
         assert packet.arguments == arguments
         assert packet.data == data
 
+    def test_frame_length(self):
+        data = (0x12, CHAR_STX, 0x34, CHAR_ESC, CHAR_ETX, 0x56, 0x78, 0x9a)
+        packet = vexupload.write_packet(0x0800, data)
+        
+        assert vexupload.frame_length(packet) == len(vexupload.frame_packet(packet))
+
 class SerialTest(unittest.TestCase):
     
     def setUp(self):
@@ -45,6 +67,544 @@ class SerialTest(unittest.TestCase):
     def test_erase_program_mem(self):
         vexupload.erase_program_mem(self.serial_conn, 0x800, 256)
         
+class BootloaderTest(unittest.TestCase):
+    
+    def setUp(self):
+        # Start with a controller that has an old program in it
+        self.bootloader = vexbootsim.Bootloader(max_write_blocks=vexupload.MAX_WRITE_BLOCKS, fill=0x00)
+        self.serial_conn = vexbootsim.SimulatedSerial(bootloader=self.bootloader, timeout=0.1)
+        
+    def test_erase_program_mem(self):
+        vexupload.erase_program_mem(self.serial_conn, 0x800, 256)
+        
+        assert self.bootloader.flash[0x800:0x900] == bytes((0xff,) * 256)
+        assert self.bootloader.flash[0x7ff] == 0 and self.bootloader.flash[0x900] == 0
+        assert self.bootloader.commands[Command.erase_program_mem] == 1  # @UndefinedVariable
+        
+    def test_write_read_program_mem(self):
+        code = bytearray((CHAR_STX, CHAR_ETX, CHAR_ESC) * 100 + tuple(range(256)))
+        vexupload.erase_program_mem(self.serial_conn, 0x800, 576)
+        vexupload.write_program_mem(self.serial_conn, 0x800, bytearray(code), vexupload.MAX_WRITE_BLOCKS)
+        
+        assert self.bootloader.write_violations == 0
+        assert self.bootloader.rejected == 0
+        assert self.bootloader.flash[0x800:0x800 + len(code)] == code
+        assert bytes(vexupload.read_program_mem(self.serial_conn, 0x810, 64)) == code[0x10:0x50]
+        
+    def test_write_without_erase(self):
+        vexupload.write_program_mem(self.serial_conn, 0x800, bytearray((0x55,) * 64))
+        
+        assert self.bootloader.write_violations == 64
+        assert self.bootloader.flash[0x800:0x840] == bytes(64)
+        
+    def test_probe_write_blocks(self):
+        self.bootloader.max_write_blocks = 20
+        
+        assert vexupload.probe_write_blocks(self.serial_conn, 0x800) == 20
+        assert self.bootloader.flash[0x800:0x800 + 30 * 8] == bytes(30 * 8), "Probe changed flash"
+        
+    def test_upload_stats(self):
+        stats = vexupload.track_stats(self.serial_conn)
+        vexupload.erase_program_mem(self.serial_conn, 0x800, 1024)
+        vexupload.write_program_mem(self.serial_conn, 0x800, bytearray((CHAR_STX,) * 64 + (0x55,) * 960))
+        
+        summary = stats.summary()
+        assert summary["commands"] == len(stats.samples) == 1 + 16
+        assert summary["timeouts"] == 0
+        assert summary["program_bytes"] == 1024
+        assert summary["escape_inflation"] > 1
+        assert all(s["first_byte"] <= s["response"] for s in stats.samples)
+        # Enough writes have been timed for their timeout to adapt, but not erases
+        assert summary["timeout"]["write_program_mem"] < 0.1
+        assert summary["timeout"]["erase_program_mem"] == 0.1
+        
+    def test_url_handler(self):
+        vexbootsim.register_url_handler()
+        serial_conn = vexupload.open_serial("vexsim://test?max_write_blocks=16")
+        vexupload.erase_program_mem(serial_conn, 0x800, 64)
+        
+        assert vexbootsim.bootloaders["test"].max_write_blocks == 16
+        assert vexbootsim.bootloaders["test"].commands[Command.erase_program_mem] == 1  # @UndefinedVariable
+        
+    def test_write_program_mem_packing(self):
+        # The simulated bootloader acknowledges each write, and drops frames over its limit without a reply
+        writes = []
+        send_command = vexupload.send_command
+        def record_command(serial_conn, packet, *args, **kwargs):
+            writes.append(packet)
+            return send_command(serial_conn, packet, *args, **kwargs)
+        vexupload.send_command = record_command
+        try:
+            vexupload.write_program_mem(self.serial_conn, 0x800, bytearray(range(200)) * 2, vexupload.MAX_WRITE_BLOCKS)
+        finally:
+            vexupload.send_command = send_command
+        
+        assert sum(len(p.data) for p in writes) == 400
+        assert all(vexupload.frame_length(p) <= vexupload.MAX_PACKET_LENGTH for p in writes)
+        assert len(writes) == 2, "Expected 2 packets, sent %i" % len(writes)
+        
+
+class UploadTestCase(unittest.TestCase):
+    """Uploads a hex file to a simulated bootloader through the vexsim:// URL handler."""
+    
+    def setUp(self):
+        vexbootsim.register_url_handler()
+        self.bootloader = vexbootsim.get_bootloader("upload%i" % id(self), fill=0x00,
+                                                    max_write_blocks=vexupload.MAX_WRITE_BLOCKS)
+        self.port = "vexsim://upload%i" % id(self)
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.hex_file = os.path.join(self.temp_dir.name, "test.hex")
+        self.code = bytes(range(256)) * 8
+        write_test_hex(self.hex_file, 0x800, self.code)
+        
+        self.set_program_mode = vexupload.set_program_mode
+        vexupload.set_program_mode = lambda: None
+        self.settings_file = vexupload.settings_file
+        vexupload.settings_file = Path(self.temp_dir.name) / "settings.json"
+        
+    def tearDown(self):
+        vexupload.set_program_mode = self.set_program_mode
+        vexupload.settings_file = self.settings_file
+        self.temp_dir.cleanup()
+        
+class ResumeTest(UploadTestCase):
+    
+    def test_resume_upload(self):
+        # Stop responding part way through writing
+        receive = self.bootloader.receive
+        def unplugged(data):
+            if self.bootloader.commands[Command.write_program_mem] >= 16:  # @UndefinedVariable
+                return bytes(), 0
+            return receive(data)
+        self.bootloader.receive = unplugged
+        
+        with self.assertRaises(IOError):
+            vexupload.upload(self.hex_file, self.port)
+        
+        journal = vexupload.UploadJournal(vexupload.journal_path(self.hex_file), vexupload.load_hex(self.hex_file).digest())
+        journal.load()
+        assert len(journal.erased_rows) == 32
+        assert 0 < len(journal.written_clusters) < 32
+        
+        self.bootloader.receive = receive
+        self.bootloader.commands.clear()
+        vexupload.upload(self.hex_file, self.port, verify_resume=True)
+        
+        assert self.bootloader.flash[0x800:0x800 + len(self.code)] == self.code
+        assert self.bootloader.commands[Command.erase_program_mem] == 0  # @UndefinedVariable
+        assert self.bootloader.commands[Command.write_program_mem] == 32 - len(journal.written_clusters)  # @UndefinedVariable
+        assert self.bootloader.write_violations == 0
+        
+    def test_resume_other_controller(self):
+        receive = self.bootloader.receive
+        def unplugged(data):
+            if self.bootloader.commands[Command.write_program_mem] >= 16:  # @UndefinedVariable
+                return bytes(), 0
+            return receive(data)
+        self.bootloader.receive = unplugged
+        
+        with self.assertRaises(IOError):
+            vexupload.upload(self.hex_file, self.port)
+        
+        # A controller with an old program in it goes on the port instead
+        self.bootloader.receive = receive
+        self.bootloader.flash[:] = bytes(len(self.bootloader.flash))
+        self.bootloader.commands.clear()
+        vexupload.upload(self.hex_file, self.port)
+        
+        self.assertEqual(self.bootloader.flash[0x800:0x800 + len(self.code)], self.code)
+        self.assertGreater(self.bootloader.commands[Command.erase_program_mem], 0)  # @UndefinedVariable
+        self.assertEqual(self.bootloader.write_violations, 0)
+        
+    def test_packet_retry(self):
+        # Lose the response to every other write
+        receive = self.bootloader.receive
+        lost = []
+        writes = []
+        def flaky(data):
+            response, busy = receive(data)
+            if data[2] == Command.write_program_mem:  # @UndefinedVariable
+                writes.append(data)
+                if len(writes) % 2 == 0:
+                    lost.append(data)
+                    return bytes(), 0
+            return response, busy
+        self.bootloader.receive = flaky
+        
+        vexupload.upload(self.hex_file, self.port, resume=False)
+        
+        assert len(lost) == 31
+        assert self.bootloader.flash[0x800:0x800 + len(self.code)] == self.code
+
+class TimeoutTest(UploadTestCase):
+    
+    def test_mixed_sizes(self):
+        # Small erases and writes are timed first, and a large erase after them
+        # must not time out
+        port = "vexsim://mixed%i?realtime=1" % id(self)
+        bootloader = vexbootsim.get_bootloader("mixed%i" % id(self), fill=0x00)
+        # 9 rows apart from each other, then a run of 64 rows
+        row = bytes(range(vexupload.ERASE_ROW_SIZE))
+        large = bytes(range(256)) * 16
+        write_test_hex(self.hex_file, 0x2000, large,
+                       *[(0x800 + i * 2 * vexupload.ERASE_ROW_SIZE, row) for i in range(9)])
+        
+        vexupload.upload(self.hex_file, port, resume=False)
+        
+        self.assertEqual(bootloader.flash[0x2000:0x2000 + len(large)], large)
+        self.assertEqual(bootloader.flash[0x800:0x800 + len(row)], row)
+
+class BuildIdTest(UploadTestCase):
+    
+    def setUp(self):
+        super().setUp()
+        self.build_id = vexupload.stamp_build_id(self.hex_file).build_id
+    
+    def test_stamp_build_id(self):
+        image = vexupload.load_hex(self.hex_file)
+        
+        assert image.build_id == self.build_id
+        assert image.rows[-1] == 0x7f80
+        assert vexupload.compute_build_id(image) == self.build_id
+        assert image.read(0x800, len(self.code)) == self.code
+    
+    def test_already_uploaded(self):
+        vexupload.upload(self.hex_file, self.port)
+        assert self.bootloader.flash[0x7f80:0x7f88] == self.build_id
+        
+        self.bootloader.commands.clear()
+        self.bootloader.user_code = False
+        vexupload.upload(self.hex_file, self.port)
+        
+        assert self.bootloader.commands[Command.read_program_mem] == 1  # @UndefinedVariable
+        assert self.bootloader.commands[Command.erase_program_mem] == 0  # @UndefinedVariable
+        assert self.bootloader.commands[Command.write_program_mem] == 0  # @UndefinedVariable
+        assert self.bootloader.user_code
+    
+    def test_changed_rows_only(self):
+        vexupload.upload(self.hex_file, self.port)
+        
+        code = bytearray(self.code)
+        code[0x123] ^= 0xff
+        write_test_hex(self.hex_file, 0x800, code)
+        build_id = vexupload.stamp_build_id(self.hex_file).build_id
+        
+        self.bootloader.commands.clear()
+        vexupload.upload(self.hex_file, self.port)
+        
+        # The changed row and the build ID row
+        assert self.bootloader.commands[Command.erase_program_mem] == 2  # @UndefinedVariable
+        assert self.bootloader.commands[Command.write_program_mem] == 2  # @UndefinedVariable
+        assert self.bootloader.flash[0x800:0x800 + len(code)] == code
+        assert self.bootloader.flash[0x7f80:0x7f88] == build_id
+        assert self.bootloader.write_violations == 0
+
+    def test_removed_rows(self):
+        vexupload.upload(self.hex_file, self.port)
+        
+        # The new build leaves out the last 4 rows of the old one
+        code = self.code[:-4 * vexupload.ERASE_ROW_SIZE]
+        write_test_hex(self.hex_file, 0x800, code)
+        vexupload.stamp_build_id(self.hex_file)
+        
+        vexupload.upload(self.hex_file, self.port)
+        
+        self.assertEqual(self.bootloader.flash[0x800:0x800 + len(code)], code)
+        self.assertEqual(self.bootloader.flash[0x800 + len(code):0x800 + len(self.code)],
+                         bytes([0xff]) * (len(self.code) - len(code)))
+        self.assertEqual(self.bootloader.write_violations, 0)
+
+    def test_pipelined_upload(self):
+        vexupload.upload(self.hex_file, self.port)
+        
+        code = bytearray(self.code)
+        code[0x123] ^= 0xff
+        write_test_hex(self.hex_file, 0x800, code)
+        
+        # Erase a row that turns out not to change as well as the one that does
+        self.bootloader.commands.clear()
+        pipeline = vexupload.PipelinedUpload(self.hex_file, self.port)
+        pipeline.erase([0x900, 0x800])
+        image = vexupload.stamp_build_id(self.hex_file)
+        pipeline.finish(image)
+        
+        # Nothing is left to erase after the build
+        assert pipeline.base_id == vexupload.hex_dump(self.build_id)
+        assert self.bootloader.commands[Command.erase_program_mem] == 3  # @UndefinedVariable
+        assert self.bootloader.flash[0x800:0x800 + len(code)] == code
+        assert self.bootloader.flash[0x7f80:0x7f88] == image.build_id
+        assert self.bootloader.write_violations == 0
+        assert self.bootloader.user_code
+
+class MappedImageTest(UploadTestCase):
+    
+    def setUp(self):
+        super().setUp()
+        # Leave a blank cluster and a gap between segments
+        self.code = bytearray(self.code)
+        self.code[0x40:0x80] = bytes((0xff,)) * 0x40
+        write_test_hex(self.hex_file, 0x800, self.code)
+        tail_file = self.hex_file + ".tail"
+        write_test_hex(tail_file, 0x2000, bytes(range(100)))
+        with open(self.hex_file) as head, open(tail_file) as tail:
+            lines = head.read().splitlines()[:-1] + tail.read().splitlines()
+        with open(self.hex_file, "w") as fd:
+            fd.write("\n".join(lines) + "\n")
+        
+        self.image = vexupload.stamp_build_id(self.hex_file)
+        vexupload.write_vximg(self.image, vexupload.vximg_path(self.hex_file))
+    
+    def test_round_trip(self):
+        mapped = vexupload.load_image(self.hex_file)
+        
+        assert isinstance(mapped, vexupload.MappedImage)
+        assert mapped.rows == self.image.rows
+        assert mapped.start_address == self.image.start_address
+        assert mapped.end_address == self.image.end_address
+        assert mapped.build_id == self.image.build_id
+        assert mapped.digest() == self.image.digest()
+        assert mapped.code == self.image.code
+        assert mapped.read(0x7f00, 0x100) == self.image.read(0x7f00, 0x100)
+        assert mapped.is_blank(0x840) and self.image.is_blank(0x840)
+        assert not mapped.is_blank(0x800)
+        assert mapped.changed_rows(self.image) == []
+        assert self.image.changed_rows(mapped) == []
+    
+    def test_stale_image(self):
+        # A hex file rewritten with the same size and modification time is
+        # read instead of its image
+        hex_time = os.stat(self.hex_file).st_mtime_ns
+        text = Path(self.hex_file).read_text()
+        lines = text.splitlines()
+        i = next(i for i, line in enumerate(lines) if line.startswith(":10"))
+        # Swapping two data bytes keeps the checksum
+        lines[i] = lines[i][:9] + lines[i][11:13] + lines[i][9:11] + lines[i][13:]
+        Path(self.hex_file).write_text("\n".join(lines) + "\n")
+        os.utime(self.hex_file, ns=(hex_time, hex_time))
+        
+        with vexupload.load_image(self.hex_file) as image:
+            self.assertNotIsInstance(image, vexupload.MappedImage)
+        
+        # So is one copied back with an older modification time
+        Path(self.hex_file).write_text(text)
+        os.utime(self.hex_file, ns=(hex_time - 10 ** 10, hex_time - 10 ** 10))
+        with vexupload.load_image(self.hex_file) as image:
+            self.assertNotIsInstance(image, vexupload.MappedImage)
+    
+    def test_close(self):
+        with vexupload.load_image(self.hex_file) as image:
+            self.assertIsInstance(image, vexupload.MappedImage)
+        self.assertTrue(image.map.closed)
+        # The image can be replaced once it is closed, on Windows too
+        vexupload.write_vximg(self.image, vexupload.vximg_path(self.hex_file))
+    
+    def test_upload(self):
+        vexupload.upload(self.hex_file, self.port)
+        
+        assert self.bootloader.flash[0x800:0x800 + len(self.code)] == self.code
+        assert self.bootloader.flash[0x2000:0x2064] == bytes(range(100))
+        # One write per cluster, except the blank one
+        assert self.bootloader.commands[Command.write_program_mem] == 31 + 2 + 1  # @UndefinedVariable
+        assert self.bootloader.write_violations == 0
+
+class VerifyTest(UploadTestCase):
+    
+    def setUp(self):
+        super().setUp()
+        vexupload.upload(self.hex_file, self.port)
+        self.bootloader.commands.clear()
+    
+    def test_read_length(self):
+        assert vexupload.read_length(0x800) == vexupload.MAX_SAFE_READ_LENGTH
+        assert vexupload.read_length(0x800, bytes(300)) == vexupload.MAX_READ_LENGTH
+        
+        escaped = bytes((vexupload.CHAR_ESC,)) * 300
+        length = vexupload.read_length(0x800, escaped)
+        packet = vexupload.Packet(Command.read_program_mem, (length, 0x00, 0x08, 0x00), escaped[:length])  # @UndefinedVariable
+        assert vexupload.frame_length(packet) + 1 <= vexupload.MAX_PACKET_LENGTH
+        assert length >= vexupload.MAX_SAFE_READ_LENGTH
+    
+    def test_dump(self):
+        # The last byte of program memory is dumped too
+        self.bootloader.flash[vexupload.MAX_PROGRAM_ADDRESS] = 0x5a
+        dump_file = os.path.join(self.temp_dir.name, "dump.hex")
+        vexupload.dump(dump_file, self.port)
+        
+        image = vexupload.load_hex(dump_file)
+        assert image.read(0x800, len(self.code)) == self.code
+        self.assertEqual(image.read(vexupload.MAX_PROGRAM_ADDRESS, 1), b"\x5a")
+        assert self.bootloader.commands[Command.read_program_mem] < 0x7800 / 100  # @UndefinedVariable
+        assert self.bootloader.user_code
+    
+    def test_verify(self):
+        assert vexupload.verify(self.hex_file, self.port) == None
+        reads = self.bootloader.commands[Command.read_program_mem]  # @UndefinedVariable
+        
+        self.bootloader.flash[0x900] ^= 0x01
+        self.bootloader.commands.clear()
+        assert vexupload.verify(self.hex_file, self.port) == 0x900
+        assert self.bootloader.commands[Command.read_program_mem] < reads  # @UndefinedVariable
+    
+    def test_verify_last(self):
+        vexupload.stamp_build_id(self.hex_file)
+        vexupload.upload(self.hex_file, self.port)
+        code = bytearray(self.code)
+        code[0x123] ^= 0xff
+        write_test_hex(self.hex_file, 0x800, code)
+        vexupload.stamp_build_id(self.hex_file)
+        vexupload.upload(self.hex_file, self.port)
+        
+        # Rows the last upload did not write are not compared
+        self.bootloader.flash[0xa00] ^= 0x01
+        self.bootloader.commands.clear()
+        assert vexupload.verify(self.hex_file, self.port, last_upload=True) == None
+        assert self.bootloader.commands[Command.read_program_mem] == 2  # @UndefinedVariable
+        assert vexupload.verify(self.hex_file, self.port) == 0xa00
+
+class FleetTest(UploadTestCase):
+    
+    def test_upload_fleet(self):
+        ports = ["vexsim://fleet%i-%i?realtime=1" % (id(self), i) for i in range(4)]
+        
+        # When each controller got its first and last command
+        commands = []
+        for i in range(4):
+            bootloader = vexbootsim.get_bootloader("fleet%i-%i" % (id(self), i))
+            times = []
+            def timed(data, receive=bootloader.receive, times=times):
+                times.append(time.monotonic())
+                return receive(data)
+            bootloader.receive = timed
+            commands.append(times)
+        
+        devices = vexupload.upload(self.hex_file, ports)
+        
+        self.assertEqual([device.state for device in devices], ["done"] * 4)
+        for i in range(4):
+            bootloader = vexbootsim.bootloaders["fleet%i-%i" % (id(self), i)]
+            self.assertEqual(bootloader.flash[0x800:0x800 + len(self.code)], self.code)
+            self.assertTrue(bootloader.user_code)
+            self.assertTrue(vexupload.journal_path(self.hex_file, ports[i]).exists())
+        
+        # The uploads overlap: every controller got its first command before
+        # any of them got its last
+        self.assertLess(max(times[0] for times in commands), min(times[-1] for times in commands))
+    
+    def test_unexpected_error(self):
+        ports = ["vexsim://broken%i-%i" % (id(self), i) for i in range(2)]
+        bootloader = vexbootsim.get_bootloader("broken%i-1" % id(self))
+        def broken(data):
+            raise ValueError("broken bootloader")
+        bootloader.receive = broken
+        
+        # Every connection is closed, whatever stopped its upload
+        opened = []
+        open_serial = vexupload.open_serial
+        def tracked(port):
+            opened.append(open_serial(port))
+            return opened[-1]
+        vexupload.open_serial = tracked
+        try:
+            with self.assertRaises(IOError):
+                vexupload.upload(self.hex_file, ports)
+        finally:
+            vexupload.open_serial = open_serial
+        
+        self.assertEqual(len(opened), 2)
+        self.assertFalse(any(serial_conn.is_open for serial_conn in opened))
+    
+    def test_no_devices(self):
+        # --all with no programming modules plugged in
+        with self.assertRaises(IOError):
+            vexupload.upload(self.hex_file, [])
+
+class LogDecoderTest(unittest.TestCase):
+    
+    formats = [{"id": 0x0F04, "file": "main.c", "line": 3, "text": "Arm %d at %lu\r\n", "arguments": "hL"},
+               {"id": 1, "file": "main.c", "line": 5, "text": "Key %c", "arguments": "B"}]
+    
+    def test_decode(self):
+        decoder = vexupload.LogDecoder(self.formats)
+        # Format 0x0F04 with -1 and 0x050F, escaped
+        record = (CHAR_STX, CHAR_STX, CHAR_ESC, CHAR_ETX, CHAR_ESC, CHAR_STX, 0xFF, 0xFF, CHAR_ESC, CHAR_STX,
+                  CHAR_ESC, CHAR_ESC, 0, 0, -(CHAR_ETX + CHAR_STX + 0xFF + 0xFF + CHAR_STX + CHAR_ESC) & 0xff, CHAR_ETX)
+        self.assertEqual(decoder.feed(b"Hello\r\nha" + bytes(record[:7])), ["Hello"])
+        self.assertEqual(decoder.feed(bytes(record[7:])), ["Arm -1 at 1295"])
+        self.assertEqual(decoder.feed(bytes((CHAR_STX, CHAR_STX, 1, 0, ord("x"), -(1 + ord("x")) & 0xff, CHAR_ETX))
+                                      + b"lf\n"), ["Key x", "half"])
+        self.assertEqual(decoder.errors, 0)
+    
+    def test_bad_records(self):
+        decoder = vexupload.LogDecoder(self.formats)
+        self.assertEqual(decoder.feed(bytes((CHAR_STX, CHAR_STX, 1, 0, 0x40, 0, CHAR_ETX))), ["<bad record 01004000>"])
+        self.assertEqual(decoder.feed(bytes((CHAR_STX, CHAR_STX, 2, 0, 9, 0xF5, CHAR_ETX))),
+                         ["<unknown format 2: 09>"])
+        self.assertEqual(decoder.feed(bytes((CHAR_STX, CHAR_STX, 1, 0, 0xFF, CHAR_STX, CHAR_STX, 1, 0, 0x41,
+                                             0xBE, CHAR_ETX))), ["Key A"])
+        self.assertEqual(decoder.errors, 3)
+
+class TelemetryTest(unittest.TestCase):
+    
+    layout = {"period": 10, "channels": [{"name": "ticks", "type": "l", "divider": 1},
+                                         {"name": "gyro", "type": "h", "divider": 2},
+                                         {"name": "pwm", "type": "B", "divider": 4}]}
+    
+    @staticmethod
+    def frame(number, samples):
+        payload = bytearray(vexupload.TELEMETRY_FORMAT + struct.pack("<H", number) + samples)
+        payload.append(-sum(payload) & 0xff)
+        vexupload.escape_payload(payload)
+        return bytes(packet_header) + bytes(payload) + bytes((CHAR_ETX,))
+    
+    def frames(self, start, count):
+        return b"".join(self.frame(number & 0xffff, struct.pack("<l", -number) +
+                                   (struct.pack("<H", number & 0xffff) if number % 2 == 0 else b"") +
+                                   (bytes((number & 0xff,)) if number % 4 == 0 else b""))
+                        for number in range(start, start + count))
+    
+    def test_decode(self):
+        decoder = vexupload.LogDecoder([], vexupload.TelemetryDecoder(self.layout))
+        # Frames around the 16 bit wrap, with one lost
+        stream = self.frames(65534, 2) + self.frames(65537, 2)
+        self.assertEqual(decoder.feed(b"up\n" + stream), ["up"])
+        samples = decoder.take_samples()
+        self.assertEqual([sample.number for sample in samples], [65534, 65535, 65537, 65538])
+        self.assertEqual(dict(samples[0].values), {"ticks": -65534, "gyro": 65534 - 65536})
+        self.assertEqual(dict(samples[3].values), {"ticks": -65538, "gyro": 2})
+        self.assertEqual(dict(samples[2].values), {"ticks": -65537})
+        self.assertEqual((decoder.telemetry.missed, decoder.errors), (1, 0))
+        # A frame without the channels its number says it has
+        decoder.feed(self.frame(4, b"\x01\x02\x03\x04"))
+        self.assertEqual((decoder.take_samples(), decoder.errors), ([], 1))
+    
+    def test_capture(self):
+        decoder = vexupload.LogDecoder([], vexupload.TelemetryDecoder(self.layout))
+        decoder.feed(self.frames(0, 600))
+        with tempfile.TemporaryDirectory() as temp_dir:
+            path = Path(temp_dir) / "run.vxtel"
+            capture = vexupload.CaptureWriter(path, self.layout)
+            for sample in decoder.take_samples():
+                capture.add(sample, sample.number / 100)
+            capture.close()
+            result = vexupload.read_capture(path)
+        self.assertEqual(result.layout, self.layout)
+        self.assertEqual(result.numbers, list(range(600)))
+        self.assertEqual(result.times[599], 5.99)
+        self.assertEqual(result.channels["pwm"], (list(range(0, 600, 4)), [n & 0xff for n in range(0, 600, 4)]))
+        self.assertEqual(result.channels["ticks"][1], [-n for n in range(600)])
+    
+    def test_line_rate(self):
+        # Ten seconds of a port running at 115200 baud, read as it arrives,
+        # decodes every whole frame in it
+        decoder = vexupload.LogDecoder([], vexupload.TelemetryDecoder(self.layout))
+        stream = self.frames(0, 10000)[:115200]
+        for offset in range(0, len(stream), 64):
+            decoder.feed(stream[offset:offset + 64])
+        numbers = [sample.number for sample in decoder.take_samples()]
+        self.assertEqual(numbers, list(range(len(numbers))))
+        self.assertLessEqual(len(self.frames(0, len(numbers))), len(stream))
+        self.assertGreater(len(self.frames(0, len(numbers) + 1)), len(stream))
+        self.assertEqual(decoder.errors, 0)
 
 if __name__ == "__main__":
     unittest.main()
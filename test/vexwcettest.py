@@ -0,0 +1,119 @@
+import tempfile
+import unittest
+from pathlib import Path
+
+import vexsim
+import vexwcet
+from vexsimtest import assemble, word_address, movlw, movwf, decfsz, btfss, bra, rcall, call, goto, ret, nop
+
+PCL = 0xF9
+
+def addwf(f, d, a=0): return [0x2400 | d << 9 | a << 8 | f]
+
+def symbols(**addresses):
+    return {name: vexsim.Symbol(name, address, "program") for name, address in addresses.items()}
+
+def config(text):
+    with tempfile.TemporaryDirectory() as temp_dir:
+        config_file = Path(temp_dir) / vexwcet.CONFIG_NAME
+        config_file.write_text(text)
+        return vexwcet.read_config(config_file)
+
+class WcetTest(unittest.TestCase):
+
+    def test_decode(self):
+        self.assertEqual(vexwcet.decode(0xD7FF, 0, 0x1000), vexwcet.Instruction(0x1000, 2, "jump", 0x1000, 2))
+        self.assertEqual(vexwcet.decode(0xE0FE, 0, 0x1000).target, 0x0FFE)
+        self.assertEqual(vexwcet.decode(0xEC12, 0xF004, 0x1000), vexwcet.Instruction(0x1000, 4, "call", 0x0824, 2))
+        self.assertEqual(vexwcet.decode(0x0C05, 0, 0x1000).kind, "return")
+        self.assertEqual(vexwcet.decode(btfss(0x20, 3)[0], 0, 0x1000).kind, "skip")
+        self.assertEqual(vexwcet.decode(addwf(PCL, 1)[0], 0, 0x1000).kind, "computed")
+        # Reading PCL does not jump
+        self.assertEqual(vexwcet.decode(addwf(PCL, 0)[0], 0, 0x1000).kind, "next")
+
+    def test_loop_matches_simulator(self):
+        image = assemble(movlw(10), movwf(0x20), decfsz(0x20, 1), bra(-2), ret())
+        analyzer = vexwcet.Analyzer(image, symbols(count=word_address(0)), config("loop count+0x4 10"))
+        time = analyzer.function(word_address(0))
+        self.assertTrue(time.complete)
+        self.assertEqual(time.loops, {word_address(2): 10})
+
+        simulator = vexsim.Simulator(image)
+        self.assertEqual(time.cycles, simulator.call(word_address(0)))
+
+    def test_worst_branch(self):
+        # The skipped GOTO makes the short way 3 cycles, the long way round is 2 + 2 + 1
+        image = assemble(btfss(0x20, 0), goto(word_address(4)), ret(), nop(), nop(), ret())
+        time = vexwcet.Analyzer(image).function(word_address(0))
+        self.assertEqual(time.cycles, 1 + 2 + 1 + 1 + 2)
+
+    def test_calls_and_critical_path(self):
+        main = word_address(0)
+        small = word_address(4)
+        big = word_address(6)
+        image = assemble(call(big), rcall(1), ret(),
+                         # small
+                         movlw(1), ret(),
+                         # big, which loops 4 times and calls small each time
+                         movlw(4), movwf(0x20), rcall(-5), decfsz(0x20, 1), bra(-3), ret())
+        analyzer = vexwcet.Analyzer(image, symbols(main=main, small=small, big=big), config("loop big 4"))
+        small_time = analyzer.function(small)
+        self.assertEqual(small_time.cycles, 3)
+        big_time = analyzer.function(big)
+        self.assertEqual(big_time.cycles, 2 + 3 * (2 + 3 + 1 + 2) + 2 + 3 + 2 + 2)
+        main_time = analyzer.function(main)
+        self.assertEqual(main_time.cycles, 2 + big_time.cycles + 2 + small_time.cycles + 2)
+
+        chain = analyzer.critical_path(main)
+        self.assertEqual([time.name for time, call in chain], ["main", "big", "small"])
+        self.assertEqual(chain[2][1].times, 4)
+        self.assertEqual(chain[2][1].cycles, 4 * small_time.cycles)
+
+    def test_missing_bound(self):
+        image = assemble(movlw(10), movwf(0x20), decfsz(0x20, 1), bra(-2), ret())
+        analyzer = vexwcet.Analyzer(image, symbols(count=word_address(0)))
+        time = analyzer.function(word_address(0))
+        self.assertFalse(time.complete)
+        self.assertEqual(analyzer.problems, [("count+0x4", "needs a loop bound")])
+
+    def test_endless_loop(self):
+        image = assemble(rcall(1), bra(-1), movlw(1), ret())
+        analyzer = vexwcet.Analyzer(image, symbols(main=word_address(0)))
+        time = analyzer.function(word_address(0))
+        self.assertEqual(time.cycles, None)
+        self.assertEqual(time.worst(), (2 + 1 + 2 + 2, True))
+
+    def test_computed_jump(self):
+        # Jump into a table of two RETLWs
+        image = assemble(addwf(PCL, 1), [0x0C01], [0x0C02], movlw(1), ret())
+        analyzer = vexwcet.Analyzer(image, symbols(table=word_address(0), other=word_address(3)))
+        self.assertFalse(analyzer.function(word_address(0)).complete)
+        self.assertEqual(analyzer.problems, [("table", "needs targets for its computed jump")])
+
+        analyzer = vexwcet.Analyzer(image, symbols(table=word_address(0), other=word_address(3)),
+                                    config("targets table table+2 table+4 other"))
+        time = analyzer.function(word_address(0))
+        self.assertTrue(time.complete)
+        self.assertEqual(time.cycles, 2 + 1 + 2)
+
+    def test_budget(self):
+        image = assemble(movlw(10), movwf(0x20), decfsz(0x20, 1), bra(-2), ret())
+        analyzer = vexwcet.Analyzer(image, symbols(count=word_address(0)),
+                                    config("loop count+0x4 10\nbudget count 30\n"))
+        text, failures = analyzer.report([word_address(0)])
+        self.assertEqual(failures, ["count takes 33 cycles, over its budget of 30"])
+
+    def test_source_annotations(self):
+        with tempfile.TemporaryDirectory() as temp_dir:
+            source = Path(temp_dir) / "main.c"
+            source.write_text("while (i < 8) { /* wcet: loop Drive 9 */\n"
+                              "// WCET: budget main 1000\n")
+            settings = vexwcet.read_config(None, temp_dir)
+        self.assertEqual(settings.loops, {"Drive": 9})
+        self.assertEqual(settings.budgets, {"main": 1000})
+
+        with self.assertRaises(ValueError):
+            config("loop Drive")
+
+if __name__ == "__main__":
+    unittest.main()